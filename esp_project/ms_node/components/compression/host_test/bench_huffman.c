@@ -0,0 +1,117 @@
+// Huffman round trips on awkward inputs, then encoder throughput on
+// log-shaped data (the same lines as the on-device BENCH placement run).
+// Exits non-zero if any round trip fails.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compression.h"
+#include "esp_timer.h"
+
+#define BENCH_LEN (16 * 1024)
+#define BENCH_ROUNDS 2000
+
+static uint32_t s_rng = 1;
+
+static uint32_t rnd(void)
+{
+    s_rng = s_rng * 1103515245u + 12345u;
+    return s_rng >> 8;
+}
+
+static void fill_log_lines(uint8_t *buf, size_t len)
+{
+    size_t pos = 0;
+    for (uint32_t i = 0; pos < len; i++) {
+        char line[96];
+        int n = snprintf(line, sizeof(line),
+                         "{\"ts_ms\":%lu,\"env\":{\"t\":%u.%u,\"h\":%u.%u},\"gas\":{\"tvoc\":%u}}\n",
+                         (unsigned long)(i * 1000), (unsigned)(20 + i % 7), (unsigned)(i % 10),
+                         (unsigned)(60 + i % 13), (unsigned)(i * 7 % 10), (unsigned)(200 + i % 31));
+        size_t take = (pos + (size_t)n > len) ? len - pos : (size_t)n;
+        memcpy(buf + pos, line, take);
+        pos += take;
+    }
+}
+
+// Compress into a buffer of exactly the stream size (no slack), then into
+// one a byte short, and decode the first
+static bool round_trip(const char *name, const uint8_t *in, size_t len)
+{
+    const size_t bound = huffman_bound(len);
+    uint8_t *out = malloc(bound);
+    uint8_t *back = malloc(len + 1);
+    size_t out_len = 0, back_len = 0;
+    bool ok = out && back && huffman_compress(in, len, out, bound, &out_len, NULL) == ESP_OK;
+
+    if (ok) {
+        uint8_t *exact = malloc(out_len);
+        size_t exact_len = 0;
+        ok = exact && huffman_compress(in, len, exact, out_len, &exact_len, NULL) == ESP_OK &&
+             exact_len == out_len && memcmp(exact, out, out_len) == 0 &&
+             huffman_compress(in, len, exact, out_len - 1, &exact_len, NULL) == ESP_ERR_NO_MEM;
+        free(exact);
+    }
+    ok = ok && huffman_decompress(out, out_len, back, len, &back_len, NULL) == ESP_OK &&
+         back_len == len && memcmp(back, in, len) == 0;
+
+    printf("%-10s %7zu -> %7zu %s\n", name, len, out_len, ok ? "ok" : "FAIL");
+    free(out);
+    free(back);
+    return ok;
+}
+
+int main(void)
+{
+    static uint8_t buf[1 << 20];
+    bool ok = true;
+
+    fill_log_lines(buf, BENCH_LEN);
+    ok &= round_trip("log", buf, BENCH_LEN);
+
+    // Short inputs end inside the word loops' first group
+    for (size_t n = 1; n < 40; n++) {
+        for (size_t i = 0; i < n; i++) buf[i] = (uint8_t)rnd();
+        char name[16];
+        snprintf(name, sizeof(name), "rand%zu", n);
+        ok &= round_trip(name, buf, n);
+    }
+
+    for (size_t i = 0; i < 65536; i++) buf[i] = (uint8_t)rnd();
+    ok &= round_trip("rand64k", buf, 65536);
+
+    memset(buf, 'A', 1000);
+    ok &= round_trip("single", buf, 1000);
+
+    // Fibonacci frequencies give codes up to ~28 bits, one symbol per drain
+    size_t n = 0;
+    uint32_t f1 = 1, f2 = 1;
+    for (int s = 0; s < 30 && n < sizeof(buf); s++) {
+        uint32_t f = s < 2 ? 1 : f1 + f2;
+        if (s >= 2) {
+            f1 = f2;
+            f2 = f;
+        }
+        for (uint32_t j = 0; j < f && n < sizeof(buf); j++) buf[n++] = (uint8_t)s;
+    }
+    ok &= round_trip("fib", buf, n);
+
+    // Bytes per microsecond is MB/s
+    fill_log_lines(buf, BENCH_LEN);
+    const size_t bound = huffman_bound(BENCH_LEN);
+    uint8_t *out = malloc(bound);
+    size_t out_len = 0;
+    const int64_t t0 = esp_timer_get_time();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        if (huffman_compress(buf, BENCH_LEN, out, bound, &out_len, NULL) != ESP_OK) ok = false;
+    }
+    const int64_t dt = esp_timer_get_time() - t0;
+    printf("compress %d x %d B: %.1f MB/s\n", BENCH_ROUNDS, BENCH_LEN,
+           dt > 0 ? (double)BENCH_LEN * BENCH_ROUNDS / (double)dt : 0.0);
+    free(out);
+
+    printf(ok ? "all ok\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
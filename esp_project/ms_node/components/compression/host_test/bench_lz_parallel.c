@@ -0,0 +1,118 @@
+// The BENCH PAR run on the host: 256 KB of log lines deflated serially, then
+// through lz_compress_parallel() at a few block sizes, where a pthread stands
+// in for the second core. Every container is checked whole and by its last
+// block alone; small and empty inputs round-trip too. Exits non-zero if any
+// check fails. The speedup needs at least two CPUs; on one it shows the
+// container overhead instead.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "compression.h"
+
+#define PAR_BENCH_LEN (256 * 1024)
+#define PAR_BENCH_LEVEL 1
+#define PAR_BENCH_ROUNDS 5
+
+static void fill_log_lines(uint8_t *buf, size_t len)
+{
+    size_t pos = 0;
+    for (uint32_t i = 0; pos < len; i++) {
+        char line[96];
+        int n = snprintf(line, sizeof(line),
+                         "{\"ts_ms\":%lu,\"env\":{\"t\":%u.%u,\"h\":%u.%u},\"gas\":{\"tvoc\":%u}}\n",
+                         (unsigned long)(i * 1000), (unsigned)(20 + i % 7), (unsigned)(i % 10),
+                         (unsigned)(60 + i % 13), (unsigned)(i * 7 % 10), (unsigned)(200 + i % 31));
+        size_t take = (pos + (size_t)n > len) ? len - pos : (size_t)n;
+        memcpy(buf + pos, line, take);
+        pos += take;
+    }
+}
+
+// Whole-container and last-block decode of one compressed buffer
+static bool verify(const uint8_t *in, size_t len, const uint8_t *out, size_t out_len, uint8_t *back)
+{
+    size_t back_len = 0;
+    if (lz_decompress_parallel(out, out_len, back, len, &back_len, NULL) != ESP_OK || back_len != len ||
+        memcmp(back, in, len) != 0) {
+        return false;
+    }
+    if (len == 0) return true;
+
+    lz_par_info_t info;
+    const uint8_t *block;
+    size_t block_len, raw_len, got = 0;
+    if (lz_parallel_info(out, out_len, &info) != ESP_OK) return false;
+    const uint32_t last = info.block_count - 1;
+    return lz_parallel_block(out, out_len, last, &block, &block_len, &raw_len) == ESP_OK &&
+           lz_decompress_miniz(block, block_len, back, raw_len, &got, NULL) == ESP_OK && got == raw_len &&
+           memcmp(back, in + (size_t)last * info.block_size, raw_len) == 0;
+}
+
+// Best of a few rounds, in MB/s (bytes per microsecond)
+static double best_mbps(int64_t best_us)
+{
+    return best_us > 0 ? (double)PAR_BENCH_LEN / (double)best_us : 0.0;
+}
+
+int main(void)
+{
+    static const size_t block_sizes[] = {16 * 1024, 32 * 1024, 64 * 1024};
+    const size_t par_max = lz_parallel_bound(PAR_BENCH_LEN, 16 * 1024); // Smallest block, largest bound
+    uint8_t *in = malloc(PAR_BENCH_LEN);
+    uint8_t *out = malloc(par_max);
+    uint8_t *back = malloc(PAR_BENCH_LEN);
+    bool ok = in && out && back && lz_parallel_init() == ESP_OK;
+    if (!ok) {
+        fprintf(stderr, "no memory for buffers\n");
+        return 1;
+    }
+    fill_log_lines(in, PAR_BENCH_LEN);
+    printf("%ld CPU(s) online\n", sysconf(_SC_NPROCESSORS_ONLN));
+
+    comp_stats_t cs;
+    size_t n = 0;
+    int64_t serial_us = 0;
+    for (int r = 0; r < PAR_BENCH_ROUNDS; r++) {
+        n = lz_miniz_bound(PAR_BENCH_LEN);
+        ok &= lz_compress_miniz(in, PAR_BENCH_LEN, out, n, &n, PAR_BENCH_LEVEL, &cs) == ESP_OK;
+        if (r == 0 || cs.time_us < serial_us) serial_us = cs.time_us;
+    }
+    printf("serial      %u -> %u bytes, %.1f MB/s\n", (unsigned)PAR_BENCH_LEN, (unsigned)n,
+           best_mbps(serial_us));
+
+    for (size_t b = 0; b < sizeof(block_sizes) / sizeof(block_sizes[0]); b++) {
+        int64_t par_us = 0;
+        bool block_ok = true;
+        for (int r = 0; r < PAR_BENCH_ROUNDS; r++) {
+            block_ok &= lz_compress_parallel(in, PAR_BENCH_LEN, out, par_max, &n, PAR_BENCH_LEVEL,
+                                             block_sizes[b], &cs) == ESP_OK;
+            if (r == 0 || cs.time_us < par_us) par_us = cs.time_us;
+        }
+        block_ok = block_ok && verify(in, PAR_BENCH_LEN, out, n, back);
+        printf("%2uK blocks  %u -> %u bytes, %.1f MB/s, x%.2f %s\n", (unsigned)(block_sizes[b] / 1024),
+               (unsigned)PAR_BENCH_LEN, (unsigned)n, best_mbps(par_us),
+               par_us > 0 ? (double)serial_us / (double)par_us : 0.0, block_ok ? "ok" : "FAIL");
+        ok &= block_ok;
+    }
+
+    // Empty, one byte, one block exactly, one byte into the second block
+    static const size_t small[] = {0, 1, 16 * 1024, 16 * 1024 + 1};
+    for (size_t i = 0; i < sizeof(small) / sizeof(small[0]); i++) {
+        const size_t cap = lz_parallel_bound(small[i], 16 * 1024);
+        const bool small_ok =
+            lz_compress_parallel(in, small[i], out, cap, &n, PAR_BENCH_LEVEL, 16 * 1024, NULL) == ESP_OK &&
+            verify(in, small[i], out, n, back);
+        printf("small %5u -> %u bytes %s\n", (unsigned)small[i], (unsigned)n, small_ok ? "ok" : "FAIL");
+        ok &= small_ok;
+    }
+
+    free(in);
+    free(out);
+    free(back);
+    printf(ok ? "all ok\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
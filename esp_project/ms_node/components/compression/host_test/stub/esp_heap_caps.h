@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+
+static inline void heap_caps_free(void *p) { free(p); }
+static inline size_t heap_caps_get_free_size(unsigned caps) { (void)caps; return 0; }
+static inline size_t heap_caps_get_largest_free_block(unsigned caps) { (void)caps; return 0; }
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+// Checked like the others, never printed
+#define ESP_LOGI(tag, fmt, ...)                                   \
+    do {                                                          \
+        if (0) fprintf(stderr, "%s: " fmt, tag, ##__VA_ARGS__);   \
+    } while (0)
+#define ESP_LOGD ESP_LOGI
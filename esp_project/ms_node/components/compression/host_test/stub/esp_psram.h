@@ -0,0 +1,5 @@
+#pragma once
+
+#include <stdbool.h>
+
+static inline bool esp_psram_is_initialized(void) { return false; }
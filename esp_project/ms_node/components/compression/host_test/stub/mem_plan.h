@@ -0,0 +1,64 @@
+// Arena API of components/mem_plan on malloc, serialised with a pthread
+// mutex like the real one is with its FreeRTOS mutex
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+
+#define MEM_HOT_FN
+#define MEM_HOT_DATA
+#define MEM_CAPS_BULK (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#define MEM_CAPS_HOT (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+
+typedef struct {
+    uint8_t *base;
+    size_t cap;
+    size_t used;
+    pthread_mutex_t lock;
+} mem_arena_t;
+
+static inline void *mem_plan_alloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    return malloc(size);
+}
+
+static inline esp_err_t mem_arena_init(mem_arena_t *a, const char *name, size_t cap, uint32_t caps)
+{
+    (void)name;
+    a->base = mem_plan_alloc(cap, caps);
+    if (!a->base) return ESP_ERR_NO_MEM;
+    a->cap = cap;
+    a->used = 0;
+    pthread_mutex_init(&a->lock, NULL);
+    return ESP_OK;
+}
+
+static inline bool mem_arena_ready(const mem_arena_t *a) { return a->base != NULL; }
+
+static inline void mem_arena_begin(mem_arena_t *a)
+{
+    pthread_mutex_lock(&a->lock);
+    a->used = 0;
+}
+
+static inline void *mem_arena_alloc(mem_arena_t *a, size_t size)
+{
+    const size_t n = (size + 7) & ~(size_t)7;
+    if (n > a->cap - a->used) return NULL;
+    void *p = a->base + a->used;
+    a->used += n;
+    return p;
+}
+
+static inline void mem_arena_end(mem_arena_t *a)
+{
+    a->used = 0;
+    pthread_mutex_unlock(&a->lock);
+}
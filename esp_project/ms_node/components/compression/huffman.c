@@ -18,29 +18,26 @@
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "esp_heap_caps.h"
+#include "mem_plan.h"
 
 static const char *TAG = "huffman";
 
 // Huffman previously used several large stack allocations (multiple KB).
 // On ESP-IDF the main task stack can be small, which can silently corrupt
 // memory and cause crashes later in unrelated code (often inside ESP_LOG).
-// To avoid that, allocate the big temporary tables on the heap.
+// The big temporary tables now come from an arena reserved once at boot
+// (internal RAM for speed), so a codec call never touches the heap.
+static mem_arena_t s_arena;
+
 static void *huf_alloc(size_t size)
 {
-    // Prefer internal RAM for speed; fall back to any 8-bit capable region
-    // (can include PSRAM) if internal is tight.
-    void *p = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-    if (!p) {
-        p = heap_caps_malloc(size, MALLOC_CAP_8BIT);
-    }
-    return p;
+    return mem_arena_alloc(&s_arena, size);
 }
 
 static void huf_free(void *p)
 {
-    if (p) {
-        heap_caps_free(p);
-    }
+    // Released together with the rest of the scope by mem_arena_end()
+    (void)p;
 }
 
 #define HUF_MAGIC 0x48554631u // 'H' 'U' 'F' '1'
@@ -52,12 +49,14 @@ typedef struct {
     int16_t sym; // 0..255 for leaf, -1 for internal
 } huf_node_t;
 
+typedef struct { int16_t idx; uint8_t depth; } stack_item_t;
+
 typedef struct {
     uint8_t *dst;
     size_t cap;
     size_t pos;
     uint64_t bitbuf;
-    uint8_t bitcount; // number of bits currently stored in bitbuf
+    uint32_t bitcount; // number of bits currently stored in bitbuf
 } bitw_t;
 
 typedef struct {
@@ -89,40 +88,46 @@ static inline void bitw_init(bitw_t *w, uint8_t *dst, size_t cap, size_t start_p
     w->pos = start_pos;
 }
 
-static esp_err_t bitw_put_bits(bitw_t *w, uint32_t code, uint8_t nbits) {
-    if (nbits == 0) return ESP_OK;
-    if (nbits > 32) return ESP_ERR_INVALID_SIZE;
-
-    // Ensure we never overflow bitbuf (64 bits).
-    if (w->bitcount + nbits > 64) {
-        return ESP_ERR_INVALID_SIZE;
-    }
-
-    // Append MSB-first code bits into the stream.
-    w->bitbuf = (w->bitbuf << nbits) | ((uint64_t)code & ((nbits == 32) ? 0xFFFFFFFFull : ((1ull << nbits) - 1ull)));
+// Append codes from the combined table (length in bits 32..37, code below)
+// to a 64-bit accumulator that holds under 32 pending bits between drains.
+// A drain stores one big-endian word unconditionally and only advances pos
+// when 32 bits were pending, so there is no branch per output byte. The
+// store needs 4 bytes of room at pos; near the end of the buffer
+// bitw_drain8() takes over.
+static inline void bitw_append(bitw_t *w, uint64_t entry) {
+    const uint32_t nbits = (uint32_t)(entry >> 32);
+    w->bitbuf = (w->bitbuf << nbits) | (uint32_t)entry;
     w->bitcount += nbits;
+}
 
+static inline void bitw_drain32(bitw_t *w) {
+    const uint32_t full = w->bitcount >> 5; // 1 once 32 bits are pending
+    w->bitcount -= full << 5;
+    const uint32_t be = __builtin_bswap32((uint32_t)(w->bitbuf >> w->bitcount));
+    memcpy(w->dst + w->pos, &be, sizeof(be));
+    w->pos += full << 2;
+}
+
+// Byte-at-a-time drain for the last few output bytes. Capacity was checked
+// against the exact stream size up front.
+static inline void bitw_drain8(bitw_t *w) {
     while (w->bitcount >= 8) {
-        if (w->pos >= w->cap) return ESP_ERR_NO_MEM;
-        uint8_t outb = (uint8_t)((w->bitbuf >> (w->bitcount - 8)) & 0xFF);
-        w->dst[w->pos++] = outb;
         w->bitcount -= 8;
-        // Keep only remaining bits (lower bitcount bits)
-        if (w->bitcount == 0) {
-            w->bitbuf = 0;
-        } else {
-            w->bitbuf &= (1ull << w->bitcount) - 1ull;
-        }
+        w->dst[w->pos++] = (uint8_t)(w->bitbuf >> w->bitcount);
     }
-    return ESP_OK;
 }
 
-static esp_err_t bitw_flush(bitw_t *w) {
-    if (w->bitcount == 0) return ESP_OK;
-    if (w->pos >= w->cap) return ESP_ERR_NO_MEM;
-    // Pad remaining bits with zeros to a full byte.
-    uint8_t outb = (uint8_t)((w->bitbuf << (8 - w->bitcount)) & 0xFF);
-    w->dst[w->pos++] = outb;
+static inline esp_err_t bitw_flush(bitw_t *w) {
+    // Whole bytes first, then the last partial byte padded with zeros.
+    while (w->bitcount >= 8) {
+        if (w->pos >= w->cap) return ESP_ERR_NO_MEM;
+        w->bitcount -= 8;
+        w->dst[w->pos++] = (uint8_t)(w->bitbuf >> w->bitcount);
+    }
+    if (w->bitcount > 0) {
+        if (w->pos >= w->cap) return ESP_ERR_NO_MEM;
+        w->dst[w->pos++] = (uint8_t)(w->bitbuf << (8 - w->bitcount));
+    }
     w->bitbuf = 0;
     w->bitcount = 0;
     return ESP_OK;
@@ -135,7 +140,7 @@ static inline void bitr_init(bitr_t *r, const uint8_t *src, size_t len, size_t s
     r->pos = start_pos;
 }
 
-static esp_err_t bitr_get_bit(bitr_t *r, uint8_t *bit_out) {
+static inline esp_err_t bitr_get_bit(bitr_t *r, uint8_t *bit_out) {
     if (r->bitcount == 0) {
         if (r->pos >= r->len) return ESP_ERR_INVALID_SIZE;
         r->bitbuf = r->src[r->pos++];
@@ -147,79 +152,140 @@ static esp_err_t bitr_get_bit(bitr_t *r, uint8_t *bit_out) {
     return ESP_OK;
 }
 
-static int16_t pick_min_node(const huf_node_t *nodes, const uint8_t *alive, int n_nodes) {
-    int16_t best = -1;
-    uint32_t bestf = 0;
-    for (int i = 0; i < n_nodes; i++) {
-        if (!alive[i]) continue;
-        if (best < 0 || nodes[i].freq < bestf) {
-            best = (int16_t)i;
-            bestf = nodes[i].freq;
+// The per-byte loops run from IRAM (MEM_HOT_FN); the bit reader and writer
+// above are inlined into them.
+
+// Four sub-histograms, one per byte lane: a run of equal bytes otherwise
+// makes every increment wait for the previous store to the same counter.
+static MEM_HOT_FN void histogram4(const uint8_t *in, size_t len, uint32_t (*lanes)[256],
+                                  uint32_t freq[256]) {
+    memset(lanes, 0, sizeof(uint32_t) * 4 * 256);
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        uint32_t v;
+        memcpy(&v, in + i, sizeof(v));
+        lanes[0][v & 0xFF]++;
+        lanes[1][(v >> 8) & 0xFF]++;
+        lanes[2][(v >> 16) & 0xFF]++;
+        lanes[3][v >> 24]++;
+    }
+    for (; i < len; i++) {
+        lanes[0][in[i]]++;
+    }
+    for (int s = 0; s < 256; s++) {
+        freq[s] = lanes[0][s] + lanes[1][s] + lanes[2][s] + lanes[3][s];
+    }
+}
+
+// Short codes let several symbols share one drain: with under 32 bits
+// pending, four codes of up to 8 bits, three of up to 10 or two of up to 16
+// still fit the accumulator. Text-like logs usually land in the first case.
+// The word loops stop once a store could run past the end of the buffer.
+static MEM_HOT_FN void encode_symbols(bitw_t *w, const uint8_t *in, size_t in_len,
+                                      const uint64_t table[256], uint8_t max_len) {
+    const size_t word_end = w->cap >= 4 ? w->cap - 4 : 0;
+    size_t i = 0;
+    if (max_len <= 8) {
+        for (; i + 4 <= in_len && w->pos <= word_end; i += 4) {
+            bitw_append(w, table[in[i]]);
+            bitw_append(w, table[in[i + 1]]);
+            bitw_append(w, table[in[i + 2]]);
+            bitw_append(w, table[in[i + 3]]);
+            bitw_drain32(w);
+        }
+    } else if (max_len <= 10) {
+        for (; i + 3 <= in_len && w->pos <= word_end; i += 3) {
+            bitw_append(w, table[in[i]]);
+            bitw_append(w, table[in[i + 1]]);
+            bitw_append(w, table[in[i + 2]]);
+            bitw_drain32(w);
         }
+    } else if (max_len <= 16) {
+        for (; i + 2 <= in_len && w->pos <= word_end; i += 2) {
+            bitw_append(w, table[in[i]]);
+            bitw_append(w, table[in[i + 1]]);
+            bitw_drain32(w);
+        }
+    }
+    for (; i < in_len && w->pos <= word_end; i++) {
+        bitw_append(w, table[in[i]]);
+        bitw_drain32(w);
+    }
+    for (; i < in_len; i++) {
+        bitw_append(w, table[in[i]]);
+        bitw_drain8(w);
     }
-    return best;
+}
+
+static int cmp_leaf(const void *a, const void *b) {
+    const huf_node_t *x = (const huf_node_t *)a;
+    const huf_node_t *y = (const huf_node_t *)b;
+    if (x->freq != y->freq) return (x->freq < y->freq) ? -1 : 1;
+    return (int)x->sym - (int)y->sym;
+}
+
+// Two-queue merge: leaves sorted by (freq, sym) form one queue, internal
+// nodes are appended behind them in the order they are made and form the
+// other. Merged weights never decrease, so the smaller head of the two
+// queues is always the global minimum and the tree costs O(n log n) (the
+// sort) instead of a full rescan per merge. Taking the leaf on ties picks
+// the same nodes as the old lowest-index scan, so code lengths are unchanged.
+static int16_t pop_min_node(const huf_node_t *nodes, int *leaf_head, int n_leaves,
+                            int *inner_head, int n_nodes)
+{
+    if (*leaf_head < n_leaves &&
+        (*inner_head >= n_nodes || nodes[*leaf_head].freq <= nodes[*inner_head].freq)) {
+        return (int16_t)(*leaf_head)++;
+    }
+    return (int16_t)(*inner_head)++;
 }
 
 static esp_err_t build_code_lengths(const uint32_t freq[256], uint8_t lens_out[256], uint8_t *max_len_out)
 {
-    // Allocate the working set on the heap to avoid blowing the main task stack.
+    // Working set comes from the arena to avoid blowing the main task stack.
     huf_node_t *nodes = (huf_node_t *)huf_alloc(sizeof(huf_node_t) * 512);
-    uint8_t *alive = (uint8_t *)huf_alloc(512);
-    typedef struct { int16_t idx; uint8_t depth; } stack_item_t;
     stack_item_t *stack = (stack_item_t *)huf_alloc(sizeof(stack_item_t) * 512);
 
-    if (!nodes || !alive || !stack) {
+    if (!nodes || !stack) {
         huf_free(stack);
-        huf_free(alive);
         huf_free(nodes);
         return ESP_ERR_NO_MEM;
     }
 
     memset(lens_out, 0, 256);
     *max_len_out = 0;
-    memset(alive, 0, 512);
 
     // Create initial leaf nodes.
-    int n_nodes = 0;
-    int n_alive = 0;
+    int n_leaves = 0;
     for (int s = 0; s < 256; s++) {
         if (freq[s] == 0) continue;
-        nodes[n_nodes] = (huf_node_t){ .freq = freq[s], .left = -1, .right = -1, .sym = (int16_t)s };
-        alive[n_nodes] = 1;
-        n_nodes++;
-        n_alive++;
+        nodes[n_leaves++] = (huf_node_t){ .freq = freq[s], .left = -1, .right = -1, .sym = (int16_t)s };
     }
 
-    if (n_alive == 0) {
+    if (n_leaves == 0) {
         huf_free(stack);
-        huf_free(alive);
         huf_free(nodes);
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (n_alive == 1) {
+    if (n_leaves == 1) {
         // Special case: only one symbol. Give it length 1.
-        for (int i = 0; i < n_nodes; i++) {
-            if (alive[i]) {
-                lens_out[(uint8_t)nodes[i].sym] = 1;
-                *max_len_out = 1;
-                huf_free(stack);
-                huf_free(alive);
-                huf_free(nodes);
-                return ESP_OK;
-            }
-        }
+        lens_out[(uint8_t)nodes[0].sym] = 1;
+        *max_len_out = 1;
+        huf_free(stack);
+        huf_free(nodes);
+        return ESP_OK;
     }
 
-    // Build tree by repeatedly combining two smallest-frequency nodes.
-    while (n_alive > 1) {
-        int16_t a = pick_min_node(nodes, alive, n_nodes);
-        alive[a] = 0;
-        n_alive--;
+    qsort(nodes, (size_t)n_leaves, sizeof(huf_node_t), cmp_leaf);
 
-        int16_t b = pick_min_node(nodes, alive, n_nodes);
-        alive[b] = 0;
-        n_alive--;
+    // Build tree by repeatedly combining two smallest-frequency nodes.
+    int n_nodes = n_leaves;
+    int leaf_head = 0;
+    int inner_head = n_leaves;
+    while (n_nodes < 2 * n_leaves - 1) {
+        int16_t a = pop_min_node(nodes, &leaf_head, n_leaves, &inner_head, n_nodes);
+        int16_t b = pop_min_node(nodes, &leaf_head, n_leaves, &inner_head, n_nodes);
 
         nodes[n_nodes] = (huf_node_t){
             .freq = nodes[a].freq + nodes[b].freq,
@@ -227,22 +293,11 @@ static esp_err_t build_code_lengths(const uint32_t freq[256], uint8_t lens_out[2
             .right = b,
             .sym = -1,
         };
-        alive[n_nodes] = 1;
         n_nodes++;
-        n_alive++;
     }
 
-    // Find root.
-    int16_t root = -1;
-    for (int i = 0; i < n_nodes; i++) {
-        if (alive[i]) { root = (int16_t)i; break; }
-    }
-    if (root < 0) {
-        huf_free(stack);
-        huf_free(alive);
-        huf_free(nodes);
-        return ESP_FAIL;
-    }
+    // The last node made is the root.
+    int16_t root = (int16_t)(n_nodes - 1);
 
     // DFS to compute lengths.
     int sp = 0;
@@ -256,7 +311,6 @@ static esp_err_t build_code_lengths(const uint32_t freq[256], uint8_t lens_out[2
             if (d > 32) {
                 ESP_LOGE(TAG, "Huffman code length too large (%u). Rejecting.", d);
                 huf_free(stack);
-                huf_free(alive);
                 huf_free(nodes);
                 return ESP_ERR_INVALID_SIZE;
             }
@@ -270,7 +324,6 @@ static esp_err_t build_code_lengths(const uint32_t freq[256], uint8_t lens_out[2
     }
 
     huf_free(stack);
-    huf_free(alive);
     huf_free(nodes);
     return ESP_OK;
 }
@@ -359,6 +412,36 @@ static esp_err_t build_decode_tree(const uint8_t lens[256], const uint32_t codes
     return ESP_OK;
 }
 
+static MEM_HOT_FN esp_err_t decode_symbols(bitr_t *r, const dec_node_t *tree, int root,
+                                          uint8_t *out, size_t out_len) {
+    size_t produced = 0;
+    int cur = root;
+    while (produced < out_len) {
+        uint8_t bit;
+        esp_err_t err = bitr_get_bit(r, &bit);
+        if (err != ESP_OK) return err;
+
+        cur = bit ? tree[cur].right : tree[cur].left;
+        if (cur < 0) return ESP_FAIL;
+        if (tree[cur].sym >= 0) {
+            out[produced++] = (uint8_t)tree[cur].sym;
+            cur = root;
+        }
+    }
+    return ESP_OK;
+}
+
+// Compression needs the lane histograms, the combined code table and the
+// code-length working set, decompression the decode tree; never both at once.
+#define HUF_BUILD_BYTES (sizeof(uint32_t) * 4 * 256 + sizeof(uint64_t) * 256 + \
+                         sizeof(huf_node_t) * 512 + 512 + sizeof(stack_item_t) * 512 + 5 * 8)
+#define HUF_DECODE_BYTES (sizeof(dec_node_t) * 2048 + 8)
+
+esp_err_t huffman_init(void) {
+    const size_t cap = HUF_BUILD_BYTES > HUF_DECODE_BYTES ? HUF_BUILD_BYTES : HUF_DECODE_BYTES;
+    return mem_arena_init(&s_arena, "huffman", cap, MEM_CAPS_HOT);
+}
+
 size_t huffman_bound(size_t in_len) {
     // Header (magic + original_len + lengths) + worst-case bitstream (~32 bits per byte)
     // This is intentionally conservative.
@@ -368,19 +451,18 @@ size_t huffman_bound(size_t in_len) {
     return header + bytes;
 }
 
-esp_err_t huffman_compress(const uint8_t *in, size_t in_len,
-                           uint8_t *out, size_t out_max,
-                           size_t *out_len,
-                           comp_stats_t *stats) {
-    if (!in || !out || !out_len) return ESP_ERR_INVALID_ARG;
-    if (in_len > 0xFFFFFFFFu) return ESP_ERR_INVALID_SIZE;
-
+static esp_err_t encode_in_arena(const uint8_t *in, size_t in_len,
+                                 uint8_t *out, size_t out_max,
+                                 size_t *out_len,
+                                 comp_stats_t *stats) {
     int64_t t0 = esp_timer_get_time();
 
-    uint32_t freq[256] = {0};
-    for (size_t i = 0; i < in_len; i++) {
-        freq[in[i]]++;
-    }
+    uint32_t (*lanes)[256] = (uint32_t (*)[256])huf_alloc(sizeof(uint32_t) * 4 * 256);
+    uint64_t *table = (uint64_t *)huf_alloc(sizeof(uint64_t) * 256);
+    if (!lanes || !table) return ESP_ERR_NO_MEM;
+
+    uint32_t freq[256];
+    histogram4(in, in_len, lanes, freq);
 
     uint8_t lens[256];
     uint8_t max_len = 0;
@@ -391,9 +473,17 @@ esp_err_t huffman_compress(const uint8_t *in, size_t in_len,
     err = build_canonical_codes(lens, codes, &max_len);
     if (err != ESP_OK) return err;
 
-    // Write header.
+    // The exact stream size is known from the histogram, so capacity is
+    // checked once here rather than per output byte.
+    uint64_t total_bits = 0;
+    for (int s = 0; s < 256; s++) {
+        table[s] = ((uint64_t)lens[s] << 32) | codes[s];
+        total_bits += (uint64_t)freq[s] * lens[s];
+    }
+
     const size_t header_sz = 4 + 4 + 256;
-    if (out_max < header_sz) return ESP_ERR_NO_MEM;
+    const uint64_t need = header_sz + (total_bits + 7) / 8;
+    if (need > out_max) return ESP_ERR_NO_MEM;
 
     wr_u32_le(out + 0, HUF_MAGIC);
     wr_u32_le(out + 4, (uint32_t)in_len);
@@ -403,13 +493,7 @@ esp_err_t huffman_compress(const uint8_t *in, size_t in_len,
     bitw_t w;
     bitw_init(&w, out, out_max, header_sz);
 
-    for (size_t i = 0; i < in_len; i++) {
-        uint8_t s = in[i];
-        uint8_t l = lens[s];
-        if (l == 0) return ESP_FAIL;
-        err = bitw_put_bits(&w, codes[s], l);
-        if (err != ESP_OK) return err;
-    }
+    encode_symbols(&w, in, in_len, table, max_len);
     err = bitw_flush(&w);
     if (err != ESP_OK) return err;
 
@@ -424,12 +508,24 @@ esp_err_t huffman_compress(const uint8_t *in, size_t in_len,
     return ESP_OK;
 }
 
-esp_err_t huffman_decompress(const uint8_t *in, size_t in_len,
-                             uint8_t *out, size_t out_max,
-                             size_t *out_len,
-                             comp_stats_t *stats) {
+esp_err_t huffman_compress(const uint8_t *in, size_t in_len,
+                           uint8_t *out, size_t out_max,
+                           size_t *out_len,
+                           comp_stats_t *stats) {
     if (!in || !out || !out_len) return ESP_ERR_INVALID_ARG;
+    if (in_len > 0xFFFFFFFFu) return ESP_ERR_INVALID_SIZE;
+    if (!mem_arena_ready(&s_arena) && huffman_init() != ESP_OK) return ESP_ERR_NO_MEM;
 
+    mem_arena_begin(&s_arena);
+    esp_err_t err = encode_in_arena(in, in_len, out, out_max, out_len, stats);
+    mem_arena_end(&s_arena);
+    return err;
+}
+
+static esp_err_t decode_in_arena(const uint8_t *in, size_t in_len,
+                                 uint8_t *out, size_t out_max,
+                                 size_t *out_len,
+                                 comp_stats_t *stats) {
     int64_t t0 = esp_timer_get_time();
 
     const size_t header_sz = 4 + 4 + 256;
@@ -454,7 +550,7 @@ esp_err_t huffman_decompress(const uint8_t *in, size_t in_len,
 
     // Build decode tree.
     // NOTE: This used to be on the stack, but can be large enough to blow the
-    // default main task stack. Keep it on the heap to avoid silent corruption.
+    // default main task stack. Keep it in the arena to avoid silent corruption.
     dec_node_t *tree = (dec_node_t *)huf_alloc(sizeof(dec_node_t) * 2048);
     if (!tree) return ESP_ERR_NO_MEM;
     int root = 0;
@@ -482,34 +578,29 @@ esp_err_t huffman_decompress(const uint8_t *in, size_t in_len,
     bitr_t r;
     bitr_init(&r, in, in_len, header_sz);
 
-    size_t produced = 0;
-    int cur = root;
-    while (produced < orig_len) {
-        uint8_t bit;
-        err = bitr_get_bit(&r, &bit);
-        if (err != ESP_OK) {
-            huf_free(tree);
-            return err;
-        }
-
-        cur = bit ? tree[cur].right : tree[cur].left;
-        if (cur < 0) {
-            huf_free(tree);
-            return ESP_FAIL;
-        }
-        if (tree[cur].sym >= 0) {
-            out[produced++] = (uint8_t)tree[cur].sym;
-            cur = root;
-        }
-    }
+    err = decode_symbols(&r, tree, root, out, orig_len);
+    huf_free(tree);
+    if (err != ESP_OK) return err;
 
-    *out_len = produced;
+    *out_len = orig_len;
 
     if (stats) {
         stats->input_len = in_len;
         stats->output_len = *out_len;
         stats->time_us = esp_timer_get_time() - t0;
     }
-    huf_free(tree);
     return ESP_OK;
 }
+
+esp_err_t huffman_decompress(const uint8_t *in, size_t in_len,
+                             uint8_t *out, size_t out_max,
+                             size_t *out_len,
+                             comp_stats_t *stats) {
+    if (!in || !out || !out_len) return ESP_ERR_INVALID_ARG;
+    if (!mem_arena_ready(&s_arena) && huffman_init() != ESP_OK) return ESP_ERR_NO_MEM;
+
+    mem_arena_begin(&s_arena);
+    esp_err_t err = decode_in_arena(in, in_len, out, out_max, out_len, stats);
+    mem_arena_end(&s_arena);
+    return err;
+}
@@ -14,6 +14,10 @@ typedef struct {
     int64_t time_us; // compression/decompression time in microseconds
 } comp_stats_t;
 
+// Reserve the codec scratch arena (see mem_plan.h). Call once during boot;
+// the first compress/decompress otherwise reserves it on demand.
+esp_err_t lz_miniz_init(void);
+
 // Maximum possible compressed size for the given input length.
 size_t lz_miniz_bound(size_t in_len);
 
@@ -31,6 +35,53 @@ esp_err_t lz_decompress_miniz(const uint8_t *in, size_t in_len,
                               size_t *out_len,
                               comp_stats_t *stats);
 
+// -----------------------------
+// Parallel block container (miniz)
+// -----------------------------
+// Format (little-endian): 4B magic 'MSPB' | 1B version | 1B level | 2B 0 |
+// 4B block_size | 4B original_len | 4B block_count |
+// block_count x 4B compressed length | blocks back to back
+// - every block is an independent zlib stream of block_size input bytes
+//   (the last one may be shorter), readable with lz_decompress_miniz()
+
+#ifndef LZ_PAR_DEFAULT_BLOCK
+#define LZ_PAR_DEFAULT_BLOCK (32 * 1024)
+#endif
+
+typedef struct {
+    uint32_t block_size;
+    uint32_t orig_len;
+    uint32_t block_count;
+} lz_par_info_t;
+
+// Reserve the second deflate arena and start the per-core helper tasks.
+// Call once during boot; the first parallel compress otherwise does it.
+esp_err_t lz_parallel_init(void);
+
+// Output size lz_compress_parallel() requires; block_size 0 = default.
+size_t lz_parallel_bound(size_t in_len, size_t block_size);
+
+// Compress on both cores into an 'MSPB' container. The caller's task does
+// half the blocks, so call it from a task that may block for the duration.
+esp_err_t lz_compress_parallel(const uint8_t *in, size_t in_len,
+                               uint8_t *out, size_t out_max,
+                               size_t *out_len,
+                               int level,
+                               size_t block_size,
+                               comp_stats_t *stats);
+
+esp_err_t lz_parallel_info(const uint8_t *in, size_t in_len, lz_par_info_t *info);
+
+// Locate one block for streaming reads; raw_len is its decompressed size.
+esp_err_t lz_parallel_block(const uint8_t *in, size_t in_len, uint32_t index,
+                            const uint8_t **block, size_t *block_len, size_t *raw_len);
+
+// Decompress a whole container, block by block.
+esp_err_t lz_decompress_parallel(const uint8_t *in, size_t in_len,
+                                 uint8_t *out, size_t out_max,
+                                 size_t *out_len,
+                                 comp_stats_t *stats);
+
 // -----------------------------
 // Huffman (byte-wise) codec
 // -----------------------------
@@ -38,6 +89,11 @@ esp_err_t lz_decompress_miniz(const uint8_t *in, size_t in_len,
 // - code_lengths[i] is the bit-length (0..32) for symbol byte value i
 // - bitstream is MSB-first per byte
 
+// Reserve the Huffman table arena; same contract as lz_miniz_init().
+esp_err_t huffman_init(void);
+
+// Worst-case compressed size (header plus 32 bits per input byte). Any
+// out_max covering the actual stream is enough; no slack is needed past it.
 size_t huffman_bound(size_t in_len);
 
 esp_err_t huffman_compress(const uint8_t *in, size_t in_len,
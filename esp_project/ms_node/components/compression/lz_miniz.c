@@ -6,7 +6,9 @@
 #include "esp_log.h"
 #include "esp_psram.h"
 #include "esp_timer.h"
+#include "mem_plan.h"
 
+#include "lz_miniz_internal.h"
 #include "miniz.h"
 
 static const char *TAG = "lz_miniz";
@@ -41,49 +43,28 @@ static inline void log_heap_snapshot(void)
              (int)esp_psram_is_initialized());
 }
 
-// PSRAM-first allocator for miniz internal state.
-static void *idf_alloc(size_t n)
-{
-    void *p = NULL;
-
-    if (esp_psram_is_initialized())
-    {
-        p = heap_caps_malloc(n, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    }
-
-    if (!p)
-    {
-        p = heap_caps_malloc(n, MALLOC_CAP_8BIT);
-    }
+// Boot-time scratch for miniz; sized in lz_miniz_internal.h. One stream
+// runs at a time, so deflate and inflate share the same arena.
+static mem_arena_t s_arena;
 
-    return p;
-}
-
-static void idf_free(void *p)
+// opaque is the arena the stream was opened in
+static voidpf mz_idf_zalloc(voidpf opaque, size_t items, size_t size)
 {
-    if (p)
-    {
-        heap_caps_free(p);
-    }
-}
-
-static voidpf mz_idf_zalloc(voidpf opaque, unsigned items, unsigned size)
-{
-    (void)opaque;
-    const size_t n = (size_t)items * (size_t)size;
-    return (voidpf)idf_alloc(n);
+    const size_t n = items * size;
+    return (voidpf)mem_arena_alloc((mem_arena_t *)opaque, n);
 }
 
 static void mz_idf_zfree(voidpf opaque, voidpf address)
 {
+    // Released together with the rest of the scope by mem_arena_end()
     (void)opaque;
-    idf_free(address);
+    (void)address;
 }
 
 esp_err_t lz_miniz_init(void)
 {
-    // Nothing to init for miniz.
-    return ESP_OK;
+    // The deflate state is too large to pin in internal RAM
+    return mem_arena_init(&s_arena, "miniz", LZ_MINIZ_ARENA_BYTES, MEM_CAPS_BULK);
 }
 
 size_t lz_miniz_bound(size_t in_len)
@@ -93,19 +74,24 @@ size_t lz_miniz_bound(size_t in_len)
     return (size_t)mz_compressBound((mz_ulong)in_len);
 }
 
-esp_err_t lz_compress_miniz(const uint8_t *in,
-                            size_t in_len,
-                            uint8_t *out,
-                            size_t out_max,
-                            size_t *out_len,
-                            int level,
-                            comp_stats_t *stats)
+mem_arena_t *lz_miniz_arena(void)
 {
-    if (!in || !out || !out_len || (out_max == 0))
+    if (!mem_arena_ready(&s_arena) && lz_miniz_init() != ESP_OK)
     {
-        return ESP_ERR_INVALID_ARG;
+        return NULL;
     }
+    return &s_arena;
+}
 
+esp_err_t lz_miniz_deflate_in(mem_arena_t *arena,
+                              const uint8_t *in,
+                              size_t in_len,
+                              uint8_t *out,
+                              size_t out_max,
+                              size_t *out_len,
+                              int level,
+                              comp_stats_t *stats)
+{
     // Clamp level (miniz follows zlib levels 0..9; 1 or 3 recommended for ESP32).
     if (level < 0)
         level = 1;
@@ -120,7 +106,7 @@ esp_err_t lz_compress_miniz(const uint8_t *in,
     memset(&s, 0, sizeof(s));
     s.zalloc = mz_idf_zalloc;
     s.zfree = mz_idf_zfree;
-    s.opaque = NULL;
+    s.opaque = arena;
 
     s.next_in = (unsigned char *)in;
     s.avail_in = (mz_uint)in_len;
@@ -171,23 +157,18 @@ esp_err_t lz_compress_miniz(const uint8_t *in,
     return ESP_OK;
 }
 
-esp_err_t lz_decompress_miniz(const uint8_t *in,
-                              size_t in_len,
-                              uint8_t *out,
-                              size_t out_max,
-                              size_t *out_len,
-                              comp_stats_t *stats)
+static esp_err_t inflate_in_arena(const uint8_t *in,
+                                  size_t in_len,
+                                  uint8_t *out,
+                                  size_t out_max,
+                                  size_t *out_len,
+                                  comp_stats_t *stats)
 {
-    if (!in || !out || !out_len || (out_max == 0))
-    {
-        return ESP_ERR_INVALID_ARG;
-    }
-
     mz_stream s;
     memset(&s, 0, sizeof(s));
     s.zalloc = mz_idf_zalloc;
     s.zfree = mz_idf_zfree;
-    s.opaque = NULL;
+    s.opaque = &s_arena;
 
     s.next_in = (unsigned char *)in;
     s.avail_in = (mz_uint)in_len;
@@ -234,3 +215,48 @@ esp_err_t lz_decompress_miniz(const uint8_t *in,
 
     return ESP_OK;
 }
+
+esp_err_t lz_compress_miniz(const uint8_t *in,
+                            size_t in_len,
+                            uint8_t *out,
+                            size_t out_max,
+                            size_t *out_len,
+                            int level,
+                            comp_stats_t *stats)
+{
+    if (!in || !out || !out_len || (out_max == 0))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!mem_arena_ready(&s_arena) && lz_miniz_init() != ESP_OK)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    mem_arena_begin(&s_arena);
+    esp_err_t err = lz_miniz_deflate_in(&s_arena, in, in_len, out, out_max, out_len, level, stats);
+    mem_arena_end(&s_arena);
+    return err;
+}
+
+esp_err_t lz_decompress_miniz(const uint8_t *in,
+                              size_t in_len,
+                              uint8_t *out,
+                              size_t out_max,
+                              size_t *out_len,
+                              comp_stats_t *stats)
+{
+    if (!in || !out || !out_len || (out_max == 0))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!mem_arena_ready(&s_arena) && lz_miniz_init() != ESP_OK)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    mem_arena_begin(&s_arena);
+    esp_err_t err = inflate_in_arena(in, in_len, out, out_max, out_len, stats);
+    mem_arena_end(&s_arena);
+    return err;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// Shared between lz_miniz.c and lz_parallel.c; not part of the public API.
+
+#include "compression.h"
+#include "mem_plan.h"
+#include "miniz.h"
+
+// mz_deflateInit2() takes one tdefl_compressor (~300 KB with the default
+// dictionary and hash sizes); inflate_state is private to miniz.c
+// (tinfl_decompressor + 32 KB dictionary) and is covered by
+// LZ_MINIZ_INFLATE_BYTES.
+#ifndef LZ_MINIZ_INFLATE_BYTES
+#define LZ_MINIZ_INFLATE_BYTES (48 * 1024)
+#endif
+
+#define LZ_MINIZ_DEFLATE_BYTES (sizeof(tdefl_compressor) + 64)
+
+#define LZ_MINIZ_ARENA_BYTES                                                  \
+    ((sizeof(tdefl_compressor) > LZ_MINIZ_INFLATE_BYTES                       \
+          ? sizeof(tdefl_compressor)                                          \
+          : LZ_MINIZ_INFLATE_BYTES) + 64)
+
+// The codec arena, reserved on first use; NULL if that fails.
+mem_arena_t *lz_miniz_arena(void);
+
+// One zlib stream, allocating from an arena the caller already holds
+// (between mem_arena_begin() and mem_arena_end()).
+esp_err_t lz_miniz_deflate_in(mem_arena_t *arena,
+                              const uint8_t *in, size_t in_len,
+                              uint8_t *out, size_t out_max,
+                              size_t *out_len,
+                              int level,
+                              comp_stats_t *stats);
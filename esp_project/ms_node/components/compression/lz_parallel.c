@@ -0,0 +1,335 @@
+#include "compression.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mem_plan.h"
+
+#include "lz_miniz_internal.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#else
+#include <pthread.h>
+#endif
+
+static const char *TAG = "lz_par";
+
+// -----------------------------------------------------------------------------
+// Dual-core block compression
+//
+// The input is cut into fixed-size blocks that are deflated independently,
+// so any block decodes on its own with lz_decompress_miniz(). A shared
+// dictionary tail (pigz) would gain a little ratio on small blocks but ties
+// every block to its predecessor, which defeats block-by-block reads.
+//
+// The calling task compresses in the miniz arena; a helper on the other core
+// compresses in its own arena. Both pull block indices from one counter, so a
+// slow block on one side does not stall the other. Blocks are deflated into
+// bound-sized slots of the output and packed down in order at the end.
+// -----------------------------------------------------------------------------
+
+#define LZ_PAR_MAGIC 0x4250534DU // 'MSPB' little-endian
+#define LZ_PAR_VERSION 1
+#define LZ_PAR_HDR_BYTES 20
+
+#ifndef LZ_PAR_HELPER_STACK
+#define LZ_PAR_HELPER_STACK 4096
+#endif
+
+typedef struct {
+    const uint8_t *in;
+    size_t in_len;
+    uint8_t *slots; // Block i is deflated at slots + i * slot_size
+    size_t slot_size;
+    uint8_t *table; // Compressed length of each block, u32 LE
+    uint32_t block_size;
+    uint32_t block_count;
+    int level;
+    volatile uint32_t next;
+    volatile esp_err_t err;
+} par_job_t;
+
+static mem_arena_t s_helper_arena;
+static par_job_t s_job;
+
+static inline void wr_u32_le(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v);
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t rd_u32_le(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Compress blocks until the counter runs past the end. The arena is held per
+// block, so a logger flush sharing the miniz arena waits at most one block.
+static void run_blocks(par_job_t *job, mem_arena_t *arena)
+{
+    for (;;) {
+        const uint32_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->block_count || job->err != ESP_OK) return;
+
+        const size_t off = (size_t)i * job->block_size;
+        const size_t len = (job->in_len - off < job->block_size) ? job->in_len - off : job->block_size;
+        size_t out_len = 0;
+
+        mem_arena_begin(arena);
+        esp_err_t err = lz_miniz_deflate_in(arena, job->in + off, len, job->slots + (size_t)i * job->slot_size,
+                                            job->slot_size, &out_len, job->level, NULL);
+        mem_arena_end(arena);
+
+        if (err != ESP_OK) {
+            job->err = err;
+            return;
+        }
+        wr_u32_le(job->table + 4 * (size_t)i, (uint32_t)out_len);
+    }
+}
+
+#ifdef ESP_PLATFORM
+// One helper per core; a job wakes the one that is not running the caller.
+static StackType_t s_helper_stack[portNUM_PROCESSORS][LZ_PAR_HELPER_STACK];
+static StaticTask_t s_helper_tcb[portNUM_PROCESSORS];
+static TaskHandle_t s_helper[portNUM_PROCESSORS];
+static StaticSemaphore_t s_done_buf;
+static SemaphoreHandle_t s_done;
+static StaticSemaphore_t s_lock_buf;
+static SemaphoreHandle_t s_lock;
+
+static void helper_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        run_blocks(&s_job, &s_helper_arena);
+        xSemaphoreGive(s_done);
+    }
+}
+
+static esp_err_t start_helpers(void)
+{
+    s_done = xSemaphoreCreateBinaryStatic(&s_done_buf);
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        s_helper[core] = xTaskCreateStaticPinnedToCore(helper_task, "lz_par", LZ_PAR_HELPER_STACK, NULL,
+                                                       tskIDLE_PRIORITY + 1, s_helper_stack[core],
+                                                       &s_helper_tcb[core], core);
+        mem_plan_watch_task(s_helper[core]);
+    }
+    return ESP_OK;
+}
+
+static void job_lock(void) { xSemaphoreTake(s_lock, portMAX_DELAY); }
+static void job_unlock(void) { xSemaphoreGive(s_lock); }
+
+static void run_job(void)
+{
+    TaskHandle_t h = s_helper[(xPortGetCoreID() + 1) % portNUM_PROCESSORS];
+    // Match the caller so neither half of the job is starved by the other
+    vTaskPrioritySet(h, uxTaskPriorityGet(NULL));
+    xTaskNotifyGive(h);
+    run_blocks(&s_job, lz_miniz_arena());
+    xSemaphoreTake(s_done, portMAX_DELAY);
+}
+#else
+// Host benchmark build: a plain thread stands in for the second core.
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *helper_thread(void *arg)
+{
+    (void)arg;
+    run_blocks(&s_job, &s_helper_arena);
+    return NULL;
+}
+
+static esp_err_t start_helpers(void)
+{
+    return ESP_OK;
+}
+
+static void job_lock(void) { pthread_mutex_lock(&s_lock); }
+static void job_unlock(void) { pthread_mutex_unlock(&s_lock); }
+
+static void run_job(void)
+{
+    pthread_t t;
+    const bool spawned = pthread_create(&t, NULL, helper_thread, NULL) == 0;
+    run_blocks(&s_job, lz_miniz_arena());
+    if (spawned) pthread_join(t, NULL);
+}
+#endif
+
+esp_err_t lz_parallel_init(void)
+{
+    if (mem_arena_ready(&s_helper_arena)) return ESP_OK;
+    if (!lz_miniz_arena()) return ESP_ERR_NO_MEM;
+    esp_err_t err = mem_arena_init(&s_helper_arena, "miniz-par", LZ_MINIZ_DEFLATE_BYTES, MEM_CAPS_BULK);
+    if (err != ESP_OK) return err;
+    return start_helpers();
+}
+
+static uint32_t block_count(size_t in_len, size_t block_size)
+{
+    return in_len ? (uint32_t)((in_len + block_size - 1) / block_size) : 0;
+}
+
+size_t lz_parallel_bound(size_t in_len, size_t block_size)
+{
+    if (block_size == 0) block_size = LZ_PAR_DEFAULT_BLOCK;
+    const uint32_t n = block_count(in_len, block_size);
+    return LZ_PAR_HDR_BYTES + 4 * (size_t)n + (size_t)n * lz_miniz_bound(block_size);
+}
+
+esp_err_t lz_compress_parallel(const uint8_t *in, size_t in_len,
+                               uint8_t *out, size_t out_max,
+                               size_t *out_len,
+                               int level,
+                               size_t block_size,
+                               comp_stats_t *stats)
+{
+    if (!in || !out || !out_len) return ESP_ERR_INVALID_ARG;
+    if (block_size == 0) block_size = LZ_PAR_DEFAULT_BLOCK;
+    if (in_len > 0xFFFFFFFFu || block_size > 0xFFFFFFFFu) return ESP_ERR_INVALID_SIZE;
+    if (out_max < lz_parallel_bound(in_len, block_size)) return ESP_ERR_NO_MEM;
+    if (!mem_arena_ready(&s_helper_arena) && lz_parallel_init() != ESP_OK) return ESP_ERR_NO_MEM;
+
+    const int64_t t0 = esp_timer_get_time();
+    const uint32_t n = block_count(in_len, block_size);
+    const size_t data_off = LZ_PAR_HDR_BYTES + 4 * (size_t)n;
+
+    wr_u32_le(out + 0, LZ_PAR_MAGIC);
+    out[4] = LZ_PAR_VERSION;
+    out[5] = (uint8_t)level;
+    out[6] = 0;
+    out[7] = 0;
+    wr_u32_le(out + 8, (uint32_t)block_size);
+    wr_u32_le(out + 12, (uint32_t)in_len);
+    wr_u32_le(out + 16, n);
+
+    // s_job is shared with the helpers; one container at a time
+    job_lock();
+    memset(&s_job, 0, sizeof(s_job));
+    s_job.in = in;
+    s_job.in_len = in_len;
+    s_job.slots = out + data_off;
+    s_job.slot_size = lz_miniz_bound(block_size);
+    s_job.table = out + LZ_PAR_HDR_BYTES;
+    s_job.block_size = (uint32_t)block_size;
+    s_job.block_count = n;
+    s_job.level = level;
+    s_job.err = ESP_OK;
+
+    if (n > 1) {
+        run_job();
+    } else if (n == 1) {
+        run_blocks(&s_job, lz_miniz_arena());
+    }
+    const esp_err_t err = s_job.err;
+    const size_t slot_size = s_job.slot_size;
+    job_unlock();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "block compress failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // Pack the slots; every block only ever moves towards the front
+    size_t pos = data_off;
+    for (uint32_t i = 0; i < n; i++) {
+        const size_t len = rd_u32_le(out + LZ_PAR_HDR_BYTES + 4 * (size_t)i);
+        memmove(out + pos, out + data_off + (size_t)i * slot_size, len);
+        pos += len;
+    }
+    *out_len = pos;
+
+    if (stats) {
+        stats->time_us = esp_timer_get_time() - t0;
+        stats->input_len = in_len;
+        stats->output_len = pos;
+    }
+    return ESP_OK;
+}
+
+esp_err_t lz_parallel_info(const uint8_t *in, size_t in_len, lz_par_info_t *info)
+{
+    if (!in || !info) return ESP_ERR_INVALID_ARG;
+    if (in_len < LZ_PAR_HDR_BYTES) return ESP_ERR_INVALID_SIZE;
+    if (rd_u32_le(in) != LZ_PAR_MAGIC || in[4] != LZ_PAR_VERSION) return ESP_ERR_INVALID_ARG;
+
+    info->block_size = rd_u32_le(in + 8);
+    info->orig_len = rd_u32_le(in + 12);
+    info->block_count = rd_u32_le(in + 16);
+    if (info->block_size == 0 || info->block_count != block_count(info->orig_len, info->block_size) ||
+        in_len < LZ_PAR_HDR_BYTES + 4 * (size_t)info->block_count) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t lz_parallel_block(const uint8_t *in, size_t in_len, uint32_t index,
+                            const uint8_t **block, size_t *block_len, size_t *raw_len)
+{
+    if (!block || !block_len || !raw_len) return ESP_ERR_INVALID_ARG;
+    lz_par_info_t info;
+    esp_err_t err = lz_parallel_info(in, in_len, &info);
+    if (err != ESP_OK) return err;
+    if (index >= info.block_count) return ESP_ERR_NOT_FOUND;
+
+    const uint8_t *table = in + LZ_PAR_HDR_BYTES;
+    size_t off = LZ_PAR_HDR_BYTES + 4 * (size_t)info.block_count;
+    for (uint32_t i = 0; i < index; i++) {
+        off += rd_u32_le(table + 4 * (size_t)i);
+    }
+    const size_t len = rd_u32_le(table + 4 * (size_t)index);
+    if (off > in_len || len > in_len - off) return ESP_ERR_INVALID_SIZE;
+
+    const size_t start = (size_t)index * info.block_size;
+    *block = in + off;
+    *block_len = len;
+    *raw_len = (info.orig_len - start < info.block_size) ? info.orig_len - start : info.block_size;
+    return ESP_OK;
+}
+
+esp_err_t lz_decompress_parallel(const uint8_t *in, size_t in_len,
+                                 uint8_t *out, size_t out_max,
+                                 size_t *out_len,
+                                 comp_stats_t *stats)
+{
+    if (!in || !out || !out_len) return ESP_ERR_INVALID_ARG;
+    lz_par_info_t info;
+    esp_err_t err = lz_parallel_info(in, in_len, &info);
+    if (err != ESP_OK) return err;
+    if (out_max < info.orig_len) return ESP_ERR_NO_MEM;
+
+    // Same walk as lz_parallel_block(), without rescanning the table per block
+    const int64_t t0 = esp_timer_get_time();
+    const uint8_t *table = in + LZ_PAR_HDR_BYTES;
+    size_t off = LZ_PAR_HDR_BYTES + 4 * (size_t)info.block_count;
+    size_t pos = 0;
+    for (uint32_t i = 0; i < info.block_count; i++) {
+        const size_t blk_len = rd_u32_le(table + 4 * (size_t)i);
+        const size_t raw_len = (info.orig_len - pos < info.block_size) ? info.orig_len - pos : info.block_size;
+        size_t got = 0;
+        if (off > in_len || blk_len > in_len - off) return ESP_ERR_INVALID_SIZE;
+        err = lz_decompress_miniz(in + off, blk_len, out + pos, raw_len, &got, NULL);
+        if (err != ESP_OK) return err;
+        if (got != raw_len) return ESP_ERR_INVALID_SIZE;
+        off += blk_len;
+        pos += got;
+    }
+    *out_len = pos;
+
+    if (stats) {
+        stats->time_us = esp_timer_get_time() - t0;
+        stats->input_len = in_len;
+        stats->output_len = pos;
+    }
+    return ESP_OK;
+}
@@ -1,6 +1,7 @@
 #include "blockbuf.h"
 
 #include "esp_heap_caps.h"
+#include "mem_plan.h"
 
 #include <string.h>
 
@@ -10,12 +11,7 @@ int blockbuf_init(blockbuf_t *b, size_t cap_bytes, int prefer_psram)
     memset(b, 0, sizeof(*b));
     b->cap = cap_bytes;
 
-    if (prefer_psram) {
-        b->buf = heap_caps_malloc(cap_bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    }
-    if (!b->buf) {
-        b->buf = heap_caps_malloc(cap_bytes, MALLOC_CAP_8BIT);
-    }
+    b->buf = mem_plan_alloc(cap_bytes, prefer_psram ? MEM_CAPS_BULK : MALLOC_CAP_8BIT);
     if (!b->buf) {
         b->cap = 0;
         return -2;
@@ -4,12 +4,14 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "storage_layout.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 // Default log file path (binary chunks, some may be compressed)
-#define LOGGER_DEFAULT_PATH "/spiffs/samples.lz"
+#define LOGGER_DEFAULT_PATH STORAGE_LOGS_PATH "/samples.lz"
 
 // Mount SPIFFS and prepare logger
 esp_err_t logger_init(void);
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Filesystem-less MSLG store on a dedicated data partition. The partition
+// is a ring of erase-aligned segments, each opened with a sequence-numbered
+// header and filled append-only with MSLG chunks. The oldest segment is
+// erased when the ring wraps.
+#define RAWLOG_PARTITION_LABEL "rawlog"
+#define RAWLOG_PARTITION_SUBTYPE 0x40
+#define RAWLOG_SEGMENT_SIZE (64 * 1024)
+
+// Find the partition and recover the write position (ESP_ERR_NOT_FOUND if
+// the partition table has no rawlog partition)
+esp_err_t rawlog_init(void);
+bool rawlog_ready(void);
+
+// Append one chunk (header + payload); never spans segments
+esp_err_t rawlog_append(const void *hdr, size_t hdr_len, const void *data,
+                        size_t data_len);
+
+// Erase everything and start a fresh segment
+esp_err_t rawlog_erase_all(void);
+
+// Erase the oldest segments that only hold chunks stamped before cutoff
+// (Unix time). Returns the number of segments erased.
+uint32_t rawlog_expire(uint32_t cutoff);
+
+// Bytes held in written segments / partition size
+esp_err_t rawlog_get_usage(size_t *used_bytes, size_t *total_bytes);
+
+// Zero-copy reader, oldest chunk first. Each segment is memory-mapped while
+// it is being walked, so chunks can be handed to BLE/HTTP straight from
+// flash. A chunk pointer stays valid until the next call to
+// rawlog_reader_next() or rawlog_reader_close().
+typedef struct {
+  uint32_t seg;     // Segment being walked
+  uint32_t seq;     // Its sequence number
+  uint32_t visited; // Segments visited so far
+  size_t off;       // Next chunk offset in the segment
+  const uint8_t *base;
+  esp_partition_mmap_handle_t map;
+  bool mapped;
+} rawlog_reader_t;
+
+esp_err_t rawlog_reader_open(rawlog_reader_t *r);
+
+// ESP_ERR_NOT_FOUND once past the newest chunk. ESP_ERR_INVALID_STATE if
+// the ring wrapped over the segment being read.
+esp_err_t rawlog_reader_next(rawlog_reader_t *r, const uint8_t **chunk,
+                             size_t *len);
+
+void rawlog_reader_close(rawlog_reader_t *r);
+
+#ifdef __cplusplus
+}
+#endif
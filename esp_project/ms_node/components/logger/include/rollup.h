@@ -0,0 +1,64 @@
+#pragma once
+
+#include "esp_err.h"
+#include "storage_layout.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Aggregation tier files (fixed-size ring files, never deleted by cleanup)
+#define ROLLUP_5M_PATH STORAGE_LOGS_PATH "/rollup_5m.bin"
+#define ROLLUP_1H_PATH STORAGE_LOGS_PATH "/rollup_1h.bin"
+
+// Channels tracked by the rollup tiers (one record per channel per window)
+typedef enum {
+  ROLLUP_CH_TEMP = 0,
+  ROLLUP_CH_HUM,
+  ROLLUP_CH_PRESS,
+  ROLLUP_CH_AQI,
+  ROLLUP_CH_TVOC,
+  ROLLUP_CH_ECO2,
+  ROLLUP_CH_MAG_X,
+  ROLLUP_CH_MAG_Y,
+  ROLLUP_CH_MAG_Z,
+  ROLLUP_CH_BUS_V,
+  ROLLUP_CH_CURRENT,
+  ROLLUP_CH_AUDIO_RMS,
+  ROLLUP_CH_COUNT
+} rollup_channel_t;
+
+typedef enum {
+  ROLLUP_TIER_5M = 0,
+  ROLLUP_TIER_1H,
+  ROLLUP_TIER_COUNT
+} rollup_tier_t;
+
+// One closed window for one channel, as stored in the tier file
+typedef struct __attribute__((packed)) {
+  uint32_t window_start; // logger_get_time() at window start (seconds)
+  uint8_t channel;       // rollup_channel_t
+  uint8_t tier;          // rollup_tier_t
+  uint16_t count;        // samples folded into this window
+  float min;
+  float max;
+  float mean;
+} rollup_record_t; // 20 bytes
+
+// Open (or create) the tier files. Called from logger_init() after mount.
+esp_err_t rollup_init(void);
+
+// Fold one sample into the open 5-minute and hourly windows. Windows that
+// have ended are written to their tier file first.
+void rollup_add(rollup_channel_t ch, float value);
+
+// Read up to max_records of the newest records of a tier, oldest first.
+// Returns the number of records copied.
+size_t rollup_read_latest(rollup_tier_t tier, rollup_record_t *out,
+                          size_t max_records);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+// On-flash MSLG chunk header, shared by the SPIFFS and raw partition backends
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;     // 'MSLG'
+  uint16_t version;   // 2 (bumped for crc32 + node_id)
+  uint8_t algo;       // 0 = raw, 1 = miniz(deflate)
+  uint8_t level;      // deflate level when algo=1
+  uint32_t raw_len;   // bytes before compression
+  uint32_t data_len;  // bytes stored after header
+  uint32_t crc32;     // CRC32 of payload data
+  uint64_t node_id;   // Unique node ID from MAC
+  uint32_t timestamp; // Unix timestamp (if available)
+  uint32_t reserved;  // Future use
+} log_chunk_hdr_t;
+
+#define LOG_CHUNK_MAGIC 0x4D534C47U // MSLG
+#define LOG_CHUNK_VERSION 2
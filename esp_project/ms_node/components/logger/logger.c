@@ -1,5 +1,9 @@
 #include "logger.h"
 #include "blockbuf.h"
+#include "log_chunk.h"
+#include "rawlog.h"
+#include "rollup.h"
+#include "storage_layout.h"
 
 #include "compression.h"
 
@@ -7,9 +11,9 @@
 #include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "esp_mac.h"
-#include "esp_spiffs.h"
 #include "esp_task_wdt.h"
 #include "esp_timer.h"
+#include "mem_plan.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "rom/crc.h"
@@ -48,25 +52,24 @@
 #define LOGGER_MAX_FILE_SIZE (1024 * 1024) // 1MB
 #endif
 
+// Raw tier retention: rotated raw files older than this are dropped (only
+// enforced once time is synced; uptime stamps are not comparable across boots)
+#ifndef LOGGER_RAW_RETENTION_H
+#define LOGGER_RAW_RETENTION_H 48
+#endif
+
 // File paths for rotation
-#define LOGGER_OLD_PATH "/spiffs/samples_old.lz"
-#define LOGGER_BACKUP_PATH "/spiffs/samples_backup.lz"
-
-typedef struct __attribute__((packed)) {
-  uint32_t magic;     // 'MSLG'
-  uint16_t version;   // 2 (bumped for crc32 + node_id)
-  uint8_t algo;       // 0 = raw, 1 = miniz(deflate)
-  uint8_t level;      // deflate level when algo=1
-  uint32_t raw_len;   // bytes before compression
-  uint32_t data_len;  // bytes stored after header
-  uint32_t crc32;     // CRC32 of payload data
-  uint64_t node_id;   // Unique node ID from MAC
-  uint32_t timestamp; // Unix timestamp (if available)
-  uint32_t reserved;  // Future use
-} log_chunk_hdr_t;
-
-static const uint32_t LOG_MAGIC = 0x4D534C47U; // MSLG
-static const uint16_t LOG_VER = 2;
+#define LOGGER_OLD_PATH STORAGE_LOGS_PATH "/samples_old.lz"
+#define LOGGER_BACKUP_PATH STORAGE_LOGS_PATH "/samples_backup.lz"
+
+// Write chunks to the "rawlog" partition when the partition table has one,
+// bypassing SPIFFS. Set to 0 to keep samples in SPIFFS files regardless.
+#ifndef LOGGER_USE_RAWLOG
+#define LOGGER_USE_RAWLOG 1
+#endif
+
+static const uint32_t LOG_MAGIC = LOG_CHUNK_MAGIC;
+static const uint16_t LOG_VER = LOG_CHUNK_VERSION;
 
 // Storage management thresholds
 #ifndef LOGGER_STORAGE_WARNING_PCT
@@ -81,9 +84,16 @@ static const uint16_t LOG_VER = 2;
 static uint32_t s_boot_timestamp = 0; // Unix time at boot (if synced)
 
 static bool s_inited = false;
+static bool s_rawlog = false; // Chunks go to the raw partition
 static blockbuf_t s_bb;
+// Compressed-chunk staging, reserved at init; only touched under the flush
+// mutex
+static uint8_t *s_comp_out = NULL;
+static size_t s_comp_out_cap = 0;
 static uint64_t s_node_id = 0;
 static SemaphoreHandle_t s_flush_mutex = NULL;
+// Serializes appends: the main loop and the CH aggregator both log lines
+static SemaphoreHandle_t s_append_mutex = NULL;
 
 // Calculate CRC32 of data
 static uint32_t calc_crc32(const uint8_t *data, size_t len) {
@@ -132,10 +142,53 @@ static esp_err_t rotate_log_file(size_t incoming_bytes) {
   return ESP_OK;
 }
 
-// Check storage and cleanup if needed
+// Timestamp of the first chunk in a log file, 0 if missing/unreadable
+static uint32_t first_chunk_timestamp(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return 0;
+  log_chunk_hdr_t hdr;
+  size_t n = fread(&hdr, 1, sizeof(hdr), f);
+  fclose(f);
+  if (n != sizeof(hdr) || hdr.magic != LOG_MAGIC)
+    return 0;
+  return hdr.timestamp;
+}
+
+// A rotated file only holds samples older than the first chunk of the next
+// newer file, so it can go once that chunk is past the raw retention.
+static void enforce_raw_retention(void) {
+  if (s_boot_timestamp == 0)
+    return;
+
+  const uint32_t now = get_timestamp();
+  const uint32_t keep_s = LOGGER_RAW_RETENTION_H * 3600U;
+
+  if (s_rawlog) {
+    uint32_t n = (now > keep_s) ? rawlog_expire(now - keep_s) : 0;
+    if (n)
+      ESP_LOGI(TAG, "Raw retention: %" PRIu32 " segment(s) expired", n);
+    return;
+  }
+
+  uint32_t ts = first_chunk_timestamp(LOGGER_OLD_PATH);
+  if (ts && now > ts && now - ts > keep_s && remove(LOGGER_BACKUP_PATH) == 0) {
+    ESP_LOGI(TAG, "Raw retention: backup file expired");
+  }
+
+  ts = first_chunk_timestamp(LOGGER_DEFAULT_PATH);
+  if (ts && now > ts && now - ts > keep_s && remove(LOGGER_OLD_PATH) == 0) {
+    ESP_LOGI(TAG, "Raw retention: old file expired");
+  }
+}
+
+// Check storage and cleanup if needed. Only raw files are ever deleted here;
+// the rollup tier files are fixed-size rings and keep the coarse history.
 static esp_err_t check_storage_and_cleanup(void) {
+  enforce_raw_retention();
+
   size_t total = 0, used = 0;
-  if (esp_spiffs_info(NULL, &total, &used) != ESP_OK) {
+  if (storage_layout_info(STORAGE_CLASS_LOGS, &total, &used) != ESP_OK) {
     return ESP_FAIL;
   }
 
@@ -151,7 +204,7 @@ static esp_err_t check_storage_and_cleanup(void) {
     remove(LOGGER_BACKUP_PATH);
 
     // Re-check after deletion
-    if (esp_spiffs_info(NULL, &total, &used) == ESP_OK) {
+    if (storage_layout_info(STORAGE_CLASS_LOGS, &total, &used) == ESP_OK) {
       used_pct = (used * 100) / total;
 
       // Still critical? Delete old file too
@@ -171,18 +224,45 @@ static esp_err_t check_storage_and_cleanup(void) {
   return ESP_OK;
 }
 
-static esp_err_t write_chunk_raw(const uint8_t *raw, size_t raw_len) {
+// Append one chunk (header + data_len payload bytes) to the active backend
+static esp_err_t store_chunk(const log_chunk_hdr_t *hdr, const uint8_t *data) {
+  if (s_rawlog) {
+    enforce_raw_retention();
+    return rawlog_append(hdr, sizeof(*hdr), data, hdr->data_len);
+  }
+
   // Check storage and cleanup if needed
   check_storage_and_cleanup();
 
   // Rotate file if needed
-  rotate_log_file(sizeof(log_chunk_hdr_t) + raw_len);
+  rotate_log_file(sizeof(*hdr) + hdr->data_len);
 
+  const int64_t t0 = esp_timer_get_time();
   FILE *f = fopen(LOGGER_DEFAULT_PATH, "ab");
   if (!f) {
     return ESP_FAIL;
   }
 
+  bool write_ok = true;
+  if (fwrite(hdr, 1, sizeof(*hdr), f) != sizeof(*hdr)) {
+    write_ok = false;
+  } else if (hdr->data_len &&
+             fwrite(data, 1, hdr->data_len, f) != hdr->data_len) {
+    write_ok = false;
+  }
+  fclose(f);
+  storage_layout_note_write(STORAGE_CLASS_LOGS, t0);
+
+  // Log current file size to confirm growth/rotation timing
+  struct stat st;
+  if (stat(LOGGER_DEFAULT_PATH, &st) == 0) {
+    ESP_LOGI(TAG, "Log file size: %zu bytes", (size_t)st.st_size);
+  }
+
+  return write_ok ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t write_chunk_raw(const uint8_t *raw, size_t raw_len) {
   log_chunk_hdr_t hdr = {
       .magic = LOG_MAGIC,
       .version = LOG_VER,
@@ -196,21 +276,7 @@ static esp_err_t write_chunk_raw(const uint8_t *raw, size_t raw_len) {
       .reserved = 0,
   };
 
-  bool write_ok = true;
-  if (fwrite(&hdr, 1, sizeof(hdr), f) != sizeof(hdr)) {
-    write_ok = false;
-  } else if (raw_len && fwrite(raw, 1, raw_len, f) != raw_len) {
-    write_ok = false;
-  }
-  fclose(f);
-
-  // Log current file size to confirm growth/rotation timing
-  struct stat st;
-  if (stat(LOGGER_DEFAULT_PATH, &st) == 0) {
-    ESP_LOGI(TAG, "Log file size: %zu bytes", (size_t)st.st_size);
-  }
-
-  if (!write_ok) {
+  if (store_chunk(&hdr, raw) != ESP_OK) {
     return ESP_FAIL;
   }
 
@@ -226,12 +292,9 @@ static esp_err_t write_chunk_miniz(const uint8_t *raw, size_t raw_len) {
   }
 
   size_t out_max = lz_miniz_bound(raw_len);
-  uint8_t *out = heap_caps_malloc(out_max, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-  if (!out)
-    out = heap_caps_malloc(out_max, MALLOC_CAP_8BIT);
-  if (!out) {
-    ESP_LOGW(TAG, "OOM allocating %u bytes for compress output, storing raw",
-             (unsigned)out_max);
+  uint8_t *out = s_comp_out;
+  if (!out || out_max > s_comp_out_cap) {
+    ESP_LOGW(TAG, "No %u byte compress buffer, storing raw", (unsigned)out_max);
     return write_chunk_raw(raw, raw_len);
   }
 
@@ -242,29 +305,15 @@ static esp_err_t write_chunk_miniz(const uint8_t *raw, size_t raw_len) {
   if (rc != ESP_OK) {
     ESP_LOGW(TAG, "miniz compress failed (%s), storing raw",
              esp_err_to_name(rc));
-    heap_caps_free(out);
     return write_chunk_raw(raw, raw_len);
   }
 
   // If we don't save at least ~5%, keep it raw.
   if (out_len + sizeof(log_chunk_hdr_t) >=
       raw_len - (raw_len / LOGGER_MIN_SAVINGS_DIV)) {
-    heap_caps_free(out);
     return write_chunk_raw(raw, raw_len);
   }
 
-  // Check storage and cleanup if needed
-  check_storage_and_cleanup();
-
-  // Rotate file if needed (projected compressed size)
-  rotate_log_file(sizeof(log_chunk_hdr_t) + out_len);
-
-  FILE *f = fopen(LOGGER_DEFAULT_PATH, "ab");
-  if (!f) {
-    heap_caps_free(out);
-    return ESP_FAIL;
-  }
-
   log_chunk_hdr_t hdr = {
       .magic = LOG_MAGIC,
       .version = LOG_VER,
@@ -278,16 +327,7 @@ static esp_err_t write_chunk_miniz(const uint8_t *raw, size_t raw_len) {
       .reserved = 0,
   };
 
-  bool write_ok = true;
-  if (fwrite(&hdr, 1, sizeof(hdr), f) != sizeof(hdr)) {
-    write_ok = false;
-  } else if (fwrite(out, 1, out_len, f) != out_len) {
-    write_ok = false;
-  }
-  fclose(f);
-  heap_caps_free(out);
-
-  if (!write_ok) {
+  if (store_chunk(&hdr, out) != ESP_OK) {
     return ESP_FAIL;
   }
 
@@ -319,43 +359,33 @@ esp_err_t logger_init(void) {
     s_node_id = 0xFFFFFFFFFFFFULL;
   }
 
-  esp_vfs_spiffs_conf_t conf = {
-      .base_path = "/spiffs",
-      .partition_label = NULL,
-      .max_files = 5,
-      .format_if_mount_failed = true,
-  };
-
-  ret = esp_vfs_spiffs_register(&conf);
+  // High-churn partition of its own: GC here never stalls state writes
+  ret = storage_layout_mount(STORAGE_CLASS_LOGS);
   if (ret != ESP_OK) {
-    if (ret == ESP_ERR_INVALID_STATE) {
-      // SPIFFS corrupted - format and retry
-      ESP_LOGW(TAG, "SPIFFS corrupted, formatting...");
-      esp_vfs_spiffs_unregister(NULL);
-
-      esp_vfs_spiffs_conf_t format_conf = {
-          .base_path = "/spiffs",
-          .partition_label = NULL,
-          .max_files = 5,
-          .format_if_mount_failed = true,
-      };
-
-      ret = esp_vfs_spiffs_register(&format_conf);
-      if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "SPIFFS format failed: %s", esp_err_to_name(ret));
-        return ret;
-      }
-      ESP_LOGI(TAG, "SPIFFS formatted successfully");
-    } else {
-      ESP_LOGE(TAG, "SPIFFS mount failed: %s", esp_err_to_name(ret));
-      return ret;
-    }
+    return ret;
   }
 
   size_t total = 0, used = 0;
-  ret = esp_spiffs_info(NULL, &total, &used);
+  ret = storage_layout_info(STORAGE_CLASS_LOGS, &total, &used);
   if (ret == ESP_OK) {
-    ESP_LOGI(TAG, "SPIFFS total=%u used=%u", (unsigned)total, (unsigned)used);
+    ESP_LOGI(TAG, "Log storage total=%u used=%u", (unsigned)total,
+             (unsigned)used);
+  }
+
+#if LOGGER_USE_RAWLOG
+  ret = rawlog_init();
+  if (ret == ESP_OK) {
+    s_rawlog = true;
+    ESP_LOGI(TAG, "Samples go to raw partition \"%s\"",
+             RAWLOG_PARTITION_LABEL);
+  } else if (ret != ESP_ERR_NOT_FOUND) {
+    ESP_LOGW(TAG, "Raw log unavailable (%s), using SPIFFS",
+             esp_err_to_name(ret));
+  }
+#endif
+
+  if (rollup_init() != ESP_OK) {
+    ESP_LOGW(TAG, "Rollup tiers unavailable, raw log only");
   }
 
   (void)blockbuf_init(&s_bb, LOGGER_BLOCK_CAP, 1);
@@ -363,10 +393,21 @@ esp_err_t logger_init(void) {
     ESP_LOGW(TAG, "No RAM for log buffer, writing chunks directly");
   }
 
+  // Compression scratch is reserved now so a flush never allocates
+  if (lz_miniz_init() == ESP_OK) {
+    s_comp_out_cap = lz_miniz_bound(LOGGER_BLOCK_CAP);
+    s_comp_out = mem_plan_alloc(s_comp_out_cap, MEM_CAPS_BULK);
+  }
+  if (!s_comp_out) {
+    s_comp_out_cap = 0;
+    ESP_LOGW(TAG, "No RAM for compression, chunks will be stored raw");
+  }
+
   // Create mutex for thread-safe flush operations
   s_flush_mutex = xSemaphoreCreateMutex();
-  if (!s_flush_mutex) {
-    ESP_LOGE(TAG, "Failed to create flush mutex");
+  s_append_mutex = xSemaphoreCreateMutex();
+  if (!s_flush_mutex || !s_append_mutex) {
+    ESP_LOGE(TAG, "Failed to create logger mutexes");
     return ESP_ERR_NO_MEM;
   }
 
@@ -412,19 +453,17 @@ esp_err_t logger_clear(void) {
     return ESP_ERR_INVALID_STATE;
 
   (void)logger_flush();
+  if (s_rawlog)
+    return rawlog_erase_all();
   remove(LOGGER_DEFAULT_PATH);
   return ESP_OK;
 }
 
-esp_err_t logger_append_line(const char *line) {
-  if (!s_inited)
-    return ESP_ERR_INVALID_STATE;
-  if (!line)
-    return ESP_ERR_INVALID_ARG;
+static esp_err_t append_line_locked(const char *line) {
 
   // Check if storage is critically full; if so, clear old data (circular buffer
-  // behavior)
-  if (logger_storage_critical()) {
+  // behavior). The raw partition is a ring of its own and never fills.
+  if (!s_rawlog && logger_storage_critical()) {
     ESP_LOGW(TAG, "Storage critically full (>%d%%), clearing old data",
              LOGGER_STORAGE_CRITICAL_PCT);
     (void)logger_clear();
@@ -468,15 +507,33 @@ esp_err_t logger_append_line(const char *line) {
   return ESP_OK;
 }
 
+esp_err_t logger_append_line(const char *line) {
+  if (!s_inited)
+    return ESP_ERR_INVALID_STATE;
+  if (!line)
+    return ESP_ERR_INVALID_ARG;
+
+  xSemaphoreTake(s_append_mutex, portMAX_DELAY);
+  esp_err_t ret = append_line_locked(line);
+  xSemaphoreGive(s_append_mutex);
+  return ret;
+}
+
 esp_err_t logger_get_storage_usage(size_t *used_bytes, size_t *total_bytes) {
   if (!used_bytes || !total_bytes)
     return ESP_ERR_INVALID_ARG;
   if (!s_inited)
     return ESP_ERR_INVALID_STATE;
-  return esp_spiffs_info(NULL, total_bytes, used_bytes);
+  if (s_rawlog)
+    return rawlog_get_usage(used_bytes, total_bytes);
+  return storage_layout_info(STORAGE_CLASS_LOGS, total_bytes, used_bytes);
 }
 
 size_t logger_get_file_size(void) {
+  if (s_rawlog) {
+    size_t used = 0, total = 0;
+    return rawlog_get_usage(&used, &total) == ESP_OK ? used : 0;
+  }
   struct stat st;
   if (stat(LOGGER_DEFAULT_PATH, &st) != 0)
     return 0;
@@ -504,7 +561,7 @@ esp_err_t logger_get_node_id(char *buf, size_t buf_len) {
 
 bool logger_storage_warning(void) {
   size_t total = 0, used = 0;
-  if (esp_spiffs_info(NULL, &total, &used) != ESP_OK)
+  if (storage_layout_info(STORAGE_CLASS_LOGS, &total, &used) != ESP_OK)
     return false;
   if (total == 0)
     return false;
@@ -513,7 +570,7 @@ bool logger_storage_warning(void) {
 
 bool logger_storage_critical(void) {
   size_t total = 0, used = 0;
-  if (esp_spiffs_info(NULL, &total, &used) != ESP_OK)
+  if (storage_layout_info(STORAGE_CLASS_LOGS, &total, &used) != ESP_OK)
     return false;
   if (total == 0)
     return false;
@@ -541,7 +598,7 @@ esp_err_t logger_cleanup_old_data(void) {
     return ESP_ERR_INVALID_STATE;
 
   size_t total = 0, used = 0;
-  if (esp_spiffs_info(NULL, &total, &used) != ESP_OK) {
+  if (storage_layout_info(STORAGE_CLASS_LOGS, &total, &used) != ESP_OK) {
     return ESP_FAIL;
   }
 
@@ -559,7 +616,7 @@ esp_err_t logger_cleanup_old_data(void) {
   }
 
   // If still critical, delete old file
-  if (esp_spiffs_info(NULL, &total, &used) == ESP_OK) {
+  if (storage_layout_info(STORAGE_CLASS_LOGS, &total, &used) == ESP_OK) {
     used_pct = (used * 100) / total;
     if (used_pct >= LOGGER_STORAGE_WARNING_PCT) {
       if (stat(LOGGER_OLD_PATH, &st) == 0) {
@@ -572,12 +629,47 @@ esp_err_t logger_cleanup_old_data(void) {
   return ESP_OK;
 }
 
+// Chunks are printed straight from the memory-mapped partition
+static void dump_rawlog_to_uart(void) {
+  rawlog_reader_t r;
+  if (rawlog_reader_open(&r) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to open raw log for dumping");
+    return;
+  }
+
+  ESP_LOGI(TAG, "=== BEGIN LOG DUMP ===");
+
+  const uint8_t *chunk = NULL;
+  size_t len = 0;
+  size_t total = 0;
+  size_t chunk_count = 0;
+  while (rawlog_reader_next(&r, &chunk, &len) == ESP_OK) {
+    for (size_t i = 0; i < len; i++) {
+      printf("%02X", chunk[i]);
+    }
+    total += len;
+
+    if (++chunk_count % 10 == 0) {
+      esp_task_wdt_reset();
+    }
+  }
+  printf("\n");
+
+  rawlog_reader_close(&r);
+  ESP_LOGI(TAG, "=== END LOG DUMP === (%u bytes)", (unsigned)total);
+}
+
 void logger_dump_to_uart(void) {
   if (!s_inited) {
     ESP_LOGE(TAG, "Logger not initialized");
     return;
   }
 
+  if (s_rawlog) {
+    dump_rawlog_to_uart();
+    return;
+  }
+
   FILE *f = fopen(LOGGER_DEFAULT_PATH, "rb");
   if (!f) {
     ESP_LOGE(TAG, "Failed to open log file for dumping");
@@ -0,0 +1,343 @@
+#include "rawlog.h"
+#include "log_chunk.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#define TAG "rawlog"
+
+#define RAWLOG_SEG_MAGIC 0x4D535253U // MSRS
+#define RAWLOG_SEG_VERSION 1
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;   // 'MSRS'
+  uint16_t version; // 1
+  uint16_t hdr_len; // Offset of the first chunk
+  uint32_t seq;     // +1 for every segment opened
+  uint32_t seq_inv; // ~seq, so a torn header write never validates
+} seg_hdr_t;
+
+static const esp_partition_t *s_part = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+static uint32_t s_seg_count = 0;
+static uint32_t s_head = 0;     // Segment being appended to
+static uint32_t s_head_seq = 0; // Its sequence number
+static size_t s_head_off = 0;   // Write offset inside the head segment
+static uint32_t s_used_segs = 0;
+
+static inline size_t seg_base(uint32_t seg) {
+  return (size_t)seg * RAWLOG_SEGMENT_SIZE;
+}
+
+static bool read_seg_hdr(uint32_t seg, seg_hdr_t *h) {
+  if (esp_partition_read(s_part, seg_base(seg), h, sizeof(*h)) != ESP_OK)
+    return false;
+  return h->magic == RAWLOG_SEG_MAGIC && h->version == RAWLOG_SEG_VERSION &&
+         h->seq_inv == ~h->seq;
+}
+
+// Offset just past the last chunk of a segment. A chunk header that does
+// not parse (power lost mid-write) seals the segment: nothing is appended
+// after it, the next append opens a new segment.
+static size_t find_end(uint32_t seg) {
+  size_t off = sizeof(seg_hdr_t);
+  while (off + sizeof(log_chunk_hdr_t) <= RAWLOG_SEGMENT_SIZE) {
+    log_chunk_hdr_t h;
+    if (esp_partition_read(s_part, seg_base(seg) + off, &h, sizeof(h)) !=
+        ESP_OK)
+      return RAWLOG_SEGMENT_SIZE;
+    if (h.magic == 0xFFFFFFFFU)
+      return off; // Erased: end of data
+    if (h.magic != LOG_CHUNK_MAGIC ||
+        h.data_len > RAWLOG_SEGMENT_SIZE - off - sizeof(h)) {
+      ESP_LOGW(TAG, "Segment %" PRIu32 ": bad chunk at 0x%x, sealing", seg,
+               (unsigned)off);
+      return RAWLOG_SEGMENT_SIZE;
+    }
+    off += sizeof(h) + h.data_len;
+  }
+  return off;
+}
+
+// Caller holds s_lock
+static esp_err_t open_segment(uint32_t seg, uint32_t seq) {
+  seg_hdr_t old;
+  bool reused = read_seg_hdr(seg, &old);
+
+  esp_err_t ret =
+      esp_partition_erase_range(s_part, seg_base(seg), RAWLOG_SEGMENT_SIZE);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Erase segment %" PRIu32 " failed: %s", seg,
+             esp_err_to_name(ret));
+    return ret;
+  }
+
+  seg_hdr_t h = {
+      .magic = RAWLOG_SEG_MAGIC,
+      .version = RAWLOG_SEG_VERSION,
+      .hdr_len = sizeof(seg_hdr_t),
+      .seq = seq,
+      .seq_inv = ~seq,
+  };
+  ret = esp_partition_write(s_part, seg_base(seg), &h, sizeof(h));
+  if (ret != ESP_OK)
+    return ret;
+
+  if (!reused && s_used_segs < s_seg_count)
+    s_used_segs++;
+  s_head = seg;
+  s_head_seq = seq;
+  s_head_off = sizeof(seg_hdr_t);
+  return ESP_OK;
+}
+
+esp_err_t rawlog_init(void) {
+  if (s_part)
+    return ESP_OK;
+
+  const esp_partition_t *p = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, RAWLOG_PARTITION_SUBTYPE, RAWLOG_PARTITION_LABEL);
+  if (!p)
+    return ESP_ERR_NOT_FOUND;
+  if (p->size < 2 * RAWLOG_SEGMENT_SIZE) {
+    ESP_LOGE(TAG, "Partition too small (%" PRIu32 " bytes)", p->size);
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  s_lock = xSemaphoreCreateMutex();
+  if (!s_lock)
+    return ESP_ERR_NO_MEM;
+
+  s_part = p;
+  s_seg_count = p->size / RAWLOG_SEGMENT_SIZE;
+
+  // Only segment headers are read, so mount cost is one small read per
+  // segment plus a walk of the head segment's chunk headers
+  const int64_t t0 = esp_timer_get_time();
+  bool found = false;
+  s_used_segs = 0;
+  for (uint32_t seg = 0; seg < s_seg_count; seg++) {
+    seg_hdr_t h;
+    if (!read_seg_hdr(seg, &h))
+      continue;
+    s_used_segs++;
+    if (!found || (int32_t)(h.seq - s_head_seq) > 0) {
+      s_head = seg;
+      s_head_seq = h.seq;
+      found = true;
+    }
+  }
+
+  esp_err_t ret = ESP_OK;
+  if (found) {
+    s_head_off = find_end(s_head);
+  } else {
+    ret = open_segment(0, 1);
+  }
+
+  ESP_LOGI(TAG,
+           "%" PRIu32 " x %u KB segments, head=%" PRIu32 " seq=%" PRIu32
+           " off=0x%x (scan %lld us)",
+           s_seg_count, RAWLOG_SEGMENT_SIZE / 1024, s_head, s_head_seq,
+           (unsigned)s_head_off, (long long)(esp_timer_get_time() - t0));
+  return ret;
+}
+
+bool rawlog_ready(void) { return s_part != NULL; }
+
+esp_err_t rawlog_append(const void *hdr, size_t hdr_len, const void *data,
+                        size_t data_len) {
+  if (!s_part)
+    return ESP_ERR_INVALID_STATE;
+  const size_t need = hdr_len + data_len;
+  if (need > RAWLOG_SEGMENT_SIZE - sizeof(seg_hdr_t))
+    return ESP_ERR_INVALID_SIZE;
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  esp_err_t ret = ESP_OK;
+  if (s_head_off + need > RAWLOG_SEGMENT_SIZE) {
+    ret = open_segment((s_head + 1) % s_seg_count, s_head_seq + 1);
+  }
+
+  const size_t at = seg_base(s_head) + s_head_off;
+  if (ret == ESP_OK)
+    ret = esp_partition_write(s_part, at, hdr, hdr_len);
+  if (ret == ESP_OK && data_len)
+    ret = esp_partition_write(s_part, at + hdr_len, data, data_len);
+
+  if (ret == ESP_OK) {
+    s_head_off += need;
+  } else {
+    // Never append behind a half-written chunk
+    s_head_off = RAWLOG_SEGMENT_SIZE;
+    ESP_LOGE(TAG, "Write failed: %s", esp_err_to_name(ret));
+  }
+  xSemaphoreGive(s_lock);
+  return ret;
+}
+
+esp_err_t rawlog_erase_all(void) {
+  if (!s_part)
+    return ESP_ERR_INVALID_STATE;
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  esp_err_t ret = esp_partition_erase_range(
+      s_part, 0, (size_t)s_seg_count * RAWLOG_SEGMENT_SIZE);
+  if (ret == ESP_OK) {
+    s_used_segs = 0;
+    ret = open_segment(0, s_head_seq + 1);
+  }
+  xSemaphoreGive(s_lock);
+  return ret;
+}
+
+// Timestamp of a segment's first chunk, 0 if it has none
+static uint32_t first_chunk_ts(uint32_t seg) {
+  log_chunk_hdr_t h;
+  if (esp_partition_read(s_part, seg_base(seg) + sizeof(seg_hdr_t), &h,
+                         sizeof(h)) != ESP_OK ||
+      h.magic != LOG_CHUNK_MAGIC)
+    return 0;
+  return h.timestamp;
+}
+
+// Segments are written in ring order, so a segment only holds chunks older
+// than the first chunk of the one after it
+uint32_t rawlog_expire(uint32_t cutoff) {
+  if (!s_part)
+    return 0;
+
+  uint32_t erased = 0;
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  uint32_t seg = (s_head + 1) % s_seg_count;
+  for (; seg != s_head; seg = (seg + 1) % s_seg_count) {
+    seg_hdr_t h;
+    if (!read_seg_hdr(seg, &h))
+      continue; // Erased (never written, or already expired)
+    uint32_t ts = first_chunk_ts((seg + 1) % s_seg_count);
+    if (ts == 0 || ts >= cutoff)
+      break;
+    if (esp_partition_erase_range(s_part, seg_base(seg),
+                                  RAWLOG_SEGMENT_SIZE) != ESP_OK)
+      break;
+    if (s_used_segs > 0)
+      s_used_segs--;
+    erased++;
+  }
+  xSemaphoreGive(s_lock);
+  return erased;
+}
+
+esp_err_t rawlog_get_usage(size_t *used_bytes, size_t *total_bytes) {
+  if (!used_bytes || !total_bytes)
+    return ESP_ERR_INVALID_ARG;
+  if (!s_part)
+    return ESP_ERR_INVALID_STATE;
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  *total_bytes = (size_t)s_seg_count * RAWLOG_SEGMENT_SIZE;
+  *used_bytes = s_used_segs
+                    ? (size_t)(s_used_segs - 1) * RAWLOG_SEGMENT_SIZE +
+                          s_head_off
+                    : 0;
+  xSemaphoreGive(s_lock);
+  return ESP_OK;
+}
+
+esp_err_t rawlog_reader_open(rawlog_reader_t *r) {
+  if (!r)
+    return ESP_ERR_INVALID_ARG;
+  if (!s_part)
+    return ESP_ERR_INVALID_STATE;
+
+  memset(r, 0, sizeof(*r));
+  // The segment after the head is the oldest once the ring has wrapped;
+  // before that it is erased and simply skipped
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  r->seg = (s_head + 1) % s_seg_count;
+  xSemaphoreGive(s_lock);
+  return ESP_OK;
+}
+
+static void reader_unmap(rawlog_reader_t *r) {
+  if (r->mapped) {
+    esp_partition_munmap(r->map);
+    r->mapped = false;
+    r->base = NULL;
+  }
+}
+
+esp_err_t rawlog_reader_next(rawlog_reader_t *r, const uint8_t **chunk,
+                             size_t *len) {
+  if (!r || !chunk || !len)
+    return ESP_ERR_INVALID_ARG;
+  if (!s_part)
+    return ESP_ERR_INVALID_STATE;
+
+  for (;;) {
+    if (!r->mapped) {
+      if (r->visited >= s_seg_count)
+        return ESP_ERR_NOT_FOUND;
+
+      seg_hdr_t h;
+      if (!read_seg_hdr(r->seg, &h)) {
+        r->seg = (r->seg + 1) % s_seg_count;
+        r->visited++;
+        continue;
+      }
+
+      const void *ptr = NULL;
+      esp_err_t ret =
+          esp_partition_mmap(s_part, seg_base(r->seg), RAWLOG_SEGMENT_SIZE,
+                             ESP_PARTITION_MMAP_DATA, &ptr, &r->map);
+      if (ret != ESP_OK)
+        return ret;
+      r->base = ptr;
+      r->mapped = true;
+      r->seq = h.seq;
+      r->off = h.hdr_len;
+    }
+
+    // The writer erases a segment when the ring wraps onto it
+    const seg_hdr_t *mh = (const seg_hdr_t *)r->base;
+    if (mh->seq != r->seq) {
+      reader_unmap(r);
+      return ESP_ERR_INVALID_STATE;
+    }
+
+    // Only whole chunks are visible in the head segment
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const bool is_head = (r->seg == s_head && r->seq == s_head_seq);
+    const size_t end = is_head ? s_head_off : RAWLOG_SEGMENT_SIZE;
+    xSemaphoreGive(s_lock);
+
+    if (r->off + sizeof(log_chunk_hdr_t) <= end) {
+      const log_chunk_hdr_t *c = (const log_chunk_hdr_t *)(r->base + r->off);
+      if (c->magic == LOG_CHUNK_MAGIC &&
+          c->data_len <= end - r->off - sizeof(*c)) {
+        *chunk = r->base + r->off;
+        *len = sizeof(*c) + c->data_len;
+        r->off += *len;
+        return ESP_OK;
+      }
+    }
+
+    reader_unmap(r);
+    if (is_head) {
+      r->visited = s_seg_count;
+      return ESP_ERR_NOT_FOUND;
+    }
+    r->seg = (r->seg + 1) % s_seg_count;
+    r->visited++;
+  }
+}
+
+void rawlog_reader_close(rawlog_reader_t *r) {
+  if (r)
+    reader_unmap(r);
+}
@@ -0,0 +1,262 @@
+#include "rollup.h"
+#include "logger.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TAG "rollup"
+
+// Retention per tier, in hours. Each tier file is a ring sized for one
+// record per channel per window over this span; the oldest windows are
+// overwritten in place, so tier files never grow past their budget.
+#ifndef LOGGER_ROLLUP_5M_RETENTION_H
+#define LOGGER_ROLLUP_5M_RETENTION_H (14 * 24) // 2 weeks (~0.97MB)
+#endif
+
+#ifndef LOGGER_ROLLUP_1H_RETENTION_H
+#define LOGGER_ROLLUP_1H_RETENTION_H (365 * 24) // 1 year (~2.1MB)
+#endif
+
+#define ROLLUP_5M_PERIOD_S 300
+#define ROLLUP_1H_PERIOD_S 3600
+
+// stdio buffer per tier file. The files stay open with these, since opening
+// one (or letting stdio pick a buffer) allocates, and rollup_add runs on the
+// main loop after mem_plan_seal().
+#define ROLLUP_IO_BUF 256
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;       // 'MSRU'
+  uint16_t version;     // 1
+  uint16_t record_size; // sizeof(rollup_record_t)
+  uint32_t capacity;    // ring size in records
+  uint32_t head;        // next slot to write
+  uint32_t count;       // valid records (<= capacity)
+} rollup_file_hdr_t;
+
+static const uint32_t ROLLUP_MAGIC = 0x4D535255U; // MSRU
+static const uint16_t ROLLUP_VER = 1;
+
+// Open window for one tier
+typedef struct {
+  uint32_t window_start;
+  uint32_t samples; // total across channels, 0 = window empty
+  uint16_t count[ROLLUP_CH_COUNT];
+  float min[ROLLUP_CH_COUNT];
+  float max[ROLLUP_CH_COUNT];
+  double sum[ROLLUP_CH_COUNT];
+} rollup_acc_t;
+
+typedef struct {
+  const char *path;
+  uint32_t period_s;
+  uint32_t capacity;
+  rollup_file_hdr_t hdr;
+  bool ready;
+  FILE *f;
+  char buf[ROLLUP_IO_BUF];
+} rollup_tier_file_t;
+
+// Open windows live in RTC slow memory so a CRITICAL-mode deep sleep does not
+// drop a partially filled window.
+RTC_DATA_ATTR static rollup_acc_t s_acc[ROLLUP_TIER_COUNT];
+
+static rollup_tier_file_t s_tiers[ROLLUP_TIER_COUNT] = {
+    [ROLLUP_TIER_5M] = {.path = ROLLUP_5M_PATH,
+                        .period_s = ROLLUP_5M_PERIOD_S,
+                        .capacity = LOGGER_ROLLUP_5M_RETENTION_H *
+                                    (3600 / ROLLUP_5M_PERIOD_S) *
+                                    ROLLUP_CH_COUNT},
+    [ROLLUP_TIER_1H] = {.path = ROLLUP_1H_PATH,
+                        .period_s = ROLLUP_1H_PERIOD_S,
+                        .capacity =
+                            LOGGER_ROLLUP_1H_RETENTION_H * ROLLUP_CH_COUNT},
+};
+
+static SemaphoreHandle_t s_mutex = NULL;
+
+static long slot_offset(uint32_t slot) {
+  return (long)(sizeof(rollup_file_hdr_t) + slot * sizeof(rollup_record_t));
+}
+
+static esp_err_t tier_open(rollup_tier_file_t *t) {
+  FILE *f = fopen(t->path, "r+b");
+  if (f) {
+    setvbuf(f, t->buf, _IOFBF, sizeof(t->buf));
+    size_t n = fread(&t->hdr, 1, sizeof(t->hdr), f);
+    if (n == sizeof(t->hdr) && t->hdr.magic == ROLLUP_MAGIC &&
+        t->hdr.version == ROLLUP_VER &&
+        t->hdr.record_size == sizeof(rollup_record_t) &&
+        t->hdr.capacity == t->capacity && t->hdr.head < t->capacity &&
+        t->hdr.count <= t->capacity) {
+      ESP_LOGI(TAG, "%s: %u/%u records", t->path, (unsigned)t->hdr.count,
+               (unsigned)t->capacity);
+      t->f = f;
+      t->ready = true;
+      return ESP_OK;
+    }
+    // Slot positions depend on capacity, so a changed retention starts over.
+    ESP_LOGW(TAG, "%s: incompatible header, recreating", t->path);
+    fclose(f);
+  }
+
+  t->hdr = (rollup_file_hdr_t){
+      .magic = ROLLUP_MAGIC,
+      .version = ROLLUP_VER,
+      .record_size = sizeof(rollup_record_t),
+      .capacity = t->capacity,
+      .head = 0,
+      .count = 0,
+  };
+
+  f = fopen(t->path, "w+b");
+  if (!f) {
+    ESP_LOGE(TAG, "%s: create failed", t->path);
+    return ESP_FAIL;
+  }
+  setvbuf(f, t->buf, _IOFBF, sizeof(t->buf));
+  if (fwrite(&t->hdr, 1, sizeof(t->hdr), f) != sizeof(t->hdr) ||
+      fflush(f) != 0) {
+    fclose(f);
+    return ESP_FAIL;
+  }
+
+  t->f = f;
+  t->ready = true;
+  return ESP_OK;
+}
+
+static esp_err_t tier_write(rollup_tier_file_t *t, const rollup_record_t *recs,
+                            size_t n) {
+  if (!t->ready)
+    return ESP_ERR_INVALID_STATE;
+
+  const int64_t t0 = esp_timer_get_time();
+  FILE *f = t->f;
+
+  // Slots are filled in order, so before the first wrap the head slot is
+  // always the current end of file.
+  bool ok = true;
+  for (size_t i = 0; i < n && ok; i++) {
+    ok = fseek(f, slot_offset(t->hdr.head), SEEK_SET) == 0 &&
+         fwrite(&recs[i], 1, sizeof(recs[i]), f) == sizeof(recs[i]);
+    if (ok) {
+      t->hdr.head = (t->hdr.head + 1) % t->hdr.capacity;
+      if (t->hdr.count < t->hdr.capacity)
+        t->hdr.count++;
+    }
+  }
+
+  if (fseek(f, 0, SEEK_SET) != 0 ||
+      fwrite(&t->hdr, 1, sizeof(t->hdr), f) != sizeof(t->hdr) ||
+      fflush(f) != 0) {
+    ok = false;
+  }
+  storage_layout_note_write(STORAGE_CLASS_LOGS, t0);
+  return ok ? ESP_OK : ESP_FAIL;
+}
+
+static void tier_close_window(rollup_tier_t tier) {
+  rollup_acc_t *a = &s_acc[tier];
+  rollup_record_t recs[ROLLUP_CH_COUNT];
+  size_t n = 0;
+
+  for (int ch = 0; ch < ROLLUP_CH_COUNT; ch++) {
+    if (a->count[ch] == 0)
+      continue;
+    recs[n++] = (rollup_record_t){
+        .window_start = a->window_start,
+        .channel = (uint8_t)ch,
+        .tier = (uint8_t)tier,
+        .count = a->count[ch],
+        .min = a->min[ch],
+        .max = a->max[ch],
+        .mean = (float)(a->sum[ch] / a->count[ch]),
+    };
+  }
+
+  if (n > 0 && tier_write(&s_tiers[tier], recs, n) != ESP_OK) {
+    ESP_LOGW(TAG, "%s: window %u not written", s_tiers[tier].path,
+             (unsigned)a->window_start);
+  }
+  memset(a, 0, sizeof(*a));
+}
+
+esp_err_t rollup_init(void) {
+  if (!s_mutex) {
+    s_mutex = xSemaphoreCreateMutex();
+    if (!s_mutex)
+      return ESP_ERR_NO_MEM;
+  }
+
+  esp_err_t ret = ESP_OK;
+  for (int tier = 0; tier < ROLLUP_TIER_COUNT; tier++) {
+    if (tier_open(&s_tiers[tier]) != ESP_OK)
+      ret = ESP_FAIL;
+  }
+  return ret;
+}
+
+void rollup_add(rollup_channel_t ch, float value) {
+  if (ch >= ROLLUP_CH_COUNT || !s_mutex)
+    return;
+
+  const uint32_t now = logger_get_time();
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+  for (int tier = 0; tier < ROLLUP_TIER_COUNT; tier++) {
+    rollup_acc_t *a = &s_acc[tier];
+    const uint32_t start = now - (now % s_tiers[tier].period_s);
+
+    // Also closes on a backwards jump (time sync, uptime reset after sleep).
+    if (a->samples > 0 && a->window_start != start)
+      tier_close_window((rollup_tier_t)tier);
+
+    if (a->samples == 0)
+      a->window_start = start;
+
+    if (a->count[ch] == 0 || value < a->min[ch])
+      a->min[ch] = value;
+    if (a->count[ch] == 0 || value > a->max[ch])
+      a->max[ch] = value;
+    a->sum[ch] += value;
+    if (a->count[ch] < UINT16_MAX)
+      a->count[ch]++;
+    a->samples++;
+  }
+
+  xSemaphoreGive(s_mutex);
+}
+
+size_t rollup_read_latest(rollup_tier_t tier, rollup_record_t *out,
+                          size_t max_records) {
+  if (tier >= ROLLUP_TIER_COUNT || !out || max_records == 0 || !s_mutex)
+    return 0;
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+  rollup_tier_file_t *t = &s_tiers[tier];
+  size_t n = 0;
+
+  FILE *f = t->ready ? t->f : NULL;
+  if (f) {
+    size_t want = t->hdr.count < max_records ? t->hdr.count : max_records;
+    uint32_t slot = (t->hdr.head + t->hdr.capacity - want) % t->hdr.capacity;
+    for (; n < want; n++) {
+      if (fseek(f, slot_offset(slot), SEEK_SET) != 0 ||
+          fread(&out[n], 1, sizeof(out[n]), f) != sizeof(out[n])) {
+        break;
+      }
+      slot = (slot + 1) % t->hdr.capacity;
+    }
+  }
+
+  xSemaphoreGive(s_mutex);
+  return n;
+}
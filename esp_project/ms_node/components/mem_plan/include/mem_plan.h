@@ -0,0 +1,96 @@
+#pragma once
+
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Boot-time memory plan. Subsystems that need scratch memory on a hot path
+// reserve it once during init as an arena, long-lived tasks get static
+// stacks, and after mem_plan_seal() the steady state runs without touching
+// the heap, so PSRAM cannot fragment under it.
+// Placement profile. Hot code runs from IRAM and small hot tables sit in
+// internal DRAM, so neither competes for the shared flash cache with
+// whatever else runs (SPIFFS GC, NimBLE, Wi-Fi). MEM_PLACE_HOT=0 builds
+// the flash-resident baseline for the placement bench
+// (idf.py -DMEM_PLACE_HOT=0 build).
+#ifndef MEM_PLACE_HOT
+#define MEM_PLACE_HOT 1
+#endif
+
+// Kept out of line so the compiler cannot fold a hot function back into a
+// flash-resident caller
+#if MEM_PLACE_HOT
+#define MEM_HOT_FN IRAM_ATTR __attribute__((noinline))
+#define MEM_HOT_DATA DRAM_ATTR
+#else
+#define MEM_HOT_FN
+#define MEM_HOT_DATA
+#endif
+
+// Bulk buffers (log blocks, deflate state, audio) belong in PSRAM; small
+// per-byte working sets in internal RAM
+#define MEM_CAPS_BULK (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#define MEM_CAPS_HOT (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+
+// Allocate with explicit caps. MEM_CAPS_BULK only falls back to internal
+// RAM on a board without PSRAM, so a full PSRAM is reported instead of
+// quietly eating the internal heap; MEM_CAPS_HOT falls back to any 8-bit
+// RAM (slower, still correct).
+void *mem_plan_alloc(size_t size, uint32_t caps);
+
+#define MEM_PLAN_MAX_ARENAS 8
+#define MEM_PLAN_MAX_TASKS 12
+
+// Bump allocator over one block reserved at boot. Memory handed out between
+// mem_arena_begin() and mem_arena_end() is released all at once by end;
+// scopes are serialised by the arena's own mutex, so an arena can be shared
+// by every caller of a codec.
+typedef struct {
+  const char *name;
+  uint8_t *base;
+  size_t cap;
+  size_t used;
+  size_t high_water; // Largest scope seen so far
+  uint32_t scopes;
+  uint32_t fails; // Allocations that did not fit
+  SemaphoreHandle_t lock;
+  StaticSemaphore_t lock_buf;
+} mem_arena_t;
+
+// Reserve cap bytes with mem_plan_alloc()
+esp_err_t mem_arena_init(mem_arena_t *a, const char *name, size_t cap,
+                         uint32_t caps);
+bool mem_arena_ready(const mem_arena_t *a);
+
+void mem_arena_begin(mem_arena_t *a);
+// 8-byte aligned; NULL when the scope would overflow the arena
+void *mem_arena_alloc(mem_arena_t *a, size_t size);
+void mem_arena_end(mem_arena_t *a);
+
+// Track a task created with xTaskCreateStatic: its stack headroom shows up
+// in the report, and its heap use after seal is flagged
+void mem_plan_watch_task(TaskHandle_t task);
+
+// Boot is over. With CONFIG_HEAP_USE_HOOKS every later heap allocation is
+// counted; with MEM_PLAN_STRICT as well, one made by a watched task (or the
+// caller of this function) aborts with the task name and size.
+void mem_plan_seal(void);
+bool mem_plan_sealed(void);
+
+// Heap fragmentation, arena high-water marks, static stack headroom and
+// post-seal allocations; meant to be polled during long soak runs
+void mem_plan_log_report(void);
+
+#ifdef __cplusplus
+}
+#endif
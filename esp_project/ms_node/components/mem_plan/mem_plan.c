@@ -0,0 +1,210 @@
+#include "mem_plan.h"
+
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_memory_utils.h"
+#include "sdkconfig.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "mem_plan"
+
+// Abort on heap use by a watched task after seal (needs CONFIG_HEAP_USE_HOOKS)
+#ifndef MEM_PLAN_STRICT
+#define MEM_PLAN_STRICT 0
+#endif
+
+#define ARENA_ALIGN 8
+
+static mem_arena_t *s_arenas[MEM_PLAN_MAX_ARENAS];
+static int s_arena_count = 0;
+static TaskHandle_t s_tasks[MEM_PLAN_MAX_TASKS];
+static int s_task_count = 0;
+static volatile bool s_sealed = false;
+
+// Written from the heap hook, possibly on both cores at once; these are
+// soak statistics, an occasional lost increment does not matter
+static volatile uint32_t s_late_allocs = 0;
+static volatile uint32_t s_late_bytes = 0;
+static volatile uint32_t s_late_watched = 0;
+static volatile TaskHandle_t s_late_last_task = NULL;
+static volatile uint32_t s_late_last_size = 0;
+
+void *mem_plan_alloc(size_t size, uint32_t caps) {
+  void *p = heap_caps_malloc(size, caps);
+  if (p)
+    return p;
+  if ((caps & MALLOC_CAP_SPIRAM) &&
+      heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0)
+    return NULL;
+  return heap_caps_malloc(size, MALLOC_CAP_8BIT);
+}
+
+esp_err_t mem_arena_init(mem_arena_t *a, const char *name, size_t cap,
+                         uint32_t caps) {
+  if (!a || cap == 0)
+    return ESP_ERR_INVALID_ARG;
+  if (a->base)
+    return ESP_OK;
+  if (s_sealed)
+    ESP_LOGW(TAG, "Arena %s reserved after seal", name);
+
+  uint8_t *p = mem_plan_alloc(cap, caps);
+  if (!p) {
+    ESP_LOGE(TAG, "Arena %s: cannot reserve %u bytes", name, (unsigned)cap);
+    return ESP_ERR_NO_MEM;
+  }
+
+  memset(a, 0, sizeof(*a));
+  a->lock = xSemaphoreCreateMutexStatic(&a->lock_buf);
+  a->name = name;
+  a->base = p;
+  a->cap = cap;
+
+  if (s_arena_count < MEM_PLAN_MAX_ARENAS)
+    s_arenas[s_arena_count++] = a;
+  ESP_LOGI(TAG, "Arena %s: %u bytes in %s", name, (unsigned)cap,
+           esp_ptr_external_ram(p) ? "PSRAM" : "internal RAM");
+  return ESP_OK;
+}
+
+bool mem_arena_ready(const mem_arena_t *a) { return a && a->base; }
+
+void mem_arena_begin(mem_arena_t *a) {
+  xSemaphoreTake(a->lock, portMAX_DELAY);
+  a->used = 0;
+  a->scopes++;
+}
+
+void *mem_arena_alloc(mem_arena_t *a, size_t size) {
+  const size_t need = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  if (need > a->cap - a->used) {
+    a->fails++;
+    return NULL;
+  }
+  void *p = a->base + a->used;
+  a->used += need;
+  if (a->used > a->high_water)
+    a->high_water = a->used;
+  return p;
+}
+
+void mem_arena_end(mem_arena_t *a) {
+  a->used = 0;
+  xSemaphoreGive(a->lock);
+}
+
+void mem_plan_watch_task(TaskHandle_t task) {
+  if (!task)
+    return;
+  for (int i = 0; i < s_task_count; i++) {
+    if (s_tasks[i] == task)
+      return;
+  }
+  if (s_task_count < MEM_PLAN_MAX_TASKS)
+    s_tasks[s_task_count++] = task;
+}
+
+void mem_plan_seal(void) {
+  // The caller is normally app_main, whose loop is itself a hot path
+  mem_plan_watch_task(xTaskGetCurrentTaskHandle());
+  s_sealed = true;
+#if !CONFIG_HEAP_USE_HOOKS
+  ESP_LOGI(TAG, "Sealed (CONFIG_HEAP_USE_HOOKS off: later allocations are "
+                "not tracked)");
+#else
+  ESP_LOGI(TAG, "Sealed: heap allocations from now on are counted%s",
+           MEM_PLAN_STRICT ? ", watched tasks abort" : "");
+#endif
+}
+
+bool mem_plan_sealed(void) { return s_sealed; }
+
+#if CONFIG_HEAP_USE_HOOKS
+static IRAM_ATTR bool is_watched(TaskHandle_t t) {
+  for (int i = 0; i < s_task_count; i++) {
+    if (s_tasks[i] == t)
+      return true;
+  }
+  return false;
+}
+
+// Called by heap_caps for every successful allocation, from any context
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size,
+                                         uint32_t caps) {
+  (void)caps;
+  if (!s_sealed || !ptr)
+    return;
+  s_late_allocs++;
+  s_late_bytes += size;
+  if (xPortInIsrContext())
+    return;
+
+  TaskHandle_t t = xTaskGetCurrentTaskHandle();
+  if (!is_watched(t))
+    return;
+  s_late_watched++;
+  s_late_last_task = t;
+  s_late_last_size = size;
+#if MEM_PLAN_STRICT
+  ESP_DRAM_LOGE(DRAM_STR("mem_plan"), "heap alloc of %u bytes after seal in %s",
+                (unsigned)size, pcTaskGetName(t));
+  abort();
+#endif
+}
+#endif
+
+static void report_heap(const char *label, uint32_t caps) {
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, caps);
+  if (info.total_free_bytes == 0 && info.total_allocated_bytes == 0)
+    return;
+
+  // Share of free memory that is not usable as one block
+  const unsigned frag =
+      info.total_free_bytes
+          ? (unsigned)(100 - (uint64_t)info.largest_free_block * 100 /
+                                 info.total_free_bytes)
+          : 0;
+  ESP_LOGI(TAG,
+           "%-8s free=%u largest=%u min_free=%u frag=%u%% blocks=%u/%u "
+           "(used/free)",
+           label, (unsigned)info.total_free_bytes,
+           (unsigned)info.largest_free_block,
+           (unsigned)info.minimum_free_bytes, frag,
+           (unsigned)info.allocated_blocks, (unsigned)info.free_blocks);
+}
+
+void mem_plan_log_report(void) {
+  report_heap("internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  report_heap("psram", MALLOC_CAP_SPIRAM);
+
+  for (int i = 0; i < s_arena_count; i++) {
+    const mem_arena_t *a = s_arenas[i];
+    ESP_LOGI(TAG,
+             "arena %-8s cap=%u high_water=%u (%u%%) scopes=%" PRIu32
+             " fails=%" PRIu32,
+             a->name, (unsigned)a->cap, (unsigned)a->high_water,
+             (unsigned)(a->high_water * 100 / a->cap), a->scopes, a->fails);
+  }
+
+  for (int i = 0; i < s_task_count; i++) {
+    ESP_LOGI(TAG, "task  %-14s stack headroom=%u bytes",
+             pcTaskGetName(s_tasks[i]),
+             (unsigned)uxTaskGetStackHighWaterMark(s_tasks[i]));
+  }
+
+#if CONFIG_HEAP_USE_HOOKS
+  const TaskHandle_t last = s_late_last_task;
+  ESP_LOGI(TAG,
+           "after seal: allocs=%" PRIu32 " bytes=%" PRIu32
+           " watched=%" PRIu32 " last=%s/%" PRIu32,
+           s_late_allocs, s_late_bytes, s_late_watched,
+           last ? pcTaskGetName(last) : "-", s_late_last_size);
+#else
+  ESP_LOGI(TAG, "after seal: not tracked (CONFIG_HEAP_USE_HOOKS off)");
+#endif
+}
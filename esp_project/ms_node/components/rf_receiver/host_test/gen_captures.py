@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""
+Regenerate the decoder test captures in captures/.
+
+Each capture is the level durations (us) the RMT would hand the decoder for
+one burst, high level first, as a remote keeps the button pressed: receiver
+noise before the burst, then the frame repeated with the sync after each
+copy, as RCSwitch transmits it. Every level gets the transmitter's clock
+error and edge jitter, and highs come out of the receiver stretched at the
+expense of the following low, so the decoder sees neither exact multiples
+of the base pulse nor exact sync gaps.
+
+Usage:
+  python gen_captures.py
+"""
+
+import os
+import random
+
+# RCSwitch table: pulse_us, sync, zero, one, inverted
+PROTOCOLS = {
+    1: (350, (1, 31), (1, 3), (3, 1), False),
+    2: (650, (1, 10), (1, 2), (2, 1), False),
+    3: (100, (30, 71), (4, 11), (9, 6), False),
+    4: (380, (1, 6), (1, 3), (3, 1), False),
+    5: (500, (6, 14), (1, 2), (2, 1), False),
+    6: (450, (23, 1), (1, 2), (2, 1), True),
+}
+
+REPEATS = 6
+
+# name: protocol, code, bits, clock factor, edge jitter (us, uniform +-),
+# how much longer highs come out (us)
+CAPTURES = {
+    "p1_24bit": (1, 22, 24, 1.00, 30, 20),
+    "p1_slow_clock": (1, 0x5A5A5A, 24, 1.12, 30, 20),
+    "p2_24bit": (2, 0x0F0F0F, 24, 0.97, 30, 20),
+    "p3_24bit": (3, 0x123456, 24, 1.03, 30, 20),
+    "p4_24bit": (4, 0xABCDEF, 24, 0.98, 30, 20),
+    "p5_24bit": (5, 0x00FF00, 24, 0.98, 30, 20),
+    # Strong, nearby transmitter: clean edges, also within protocol 2's
+    # tolerance
+    "p5_clean": (5, 0x3C3C3C, 24, 1.00, 10, 0),
+    "p6_28bit": (6, 0x0A5A5A5, 28, 0.99, 30, 20),
+    "noise_only": (None, 0, 0, 1.00, 0, 0),
+}
+
+
+def noise(rng, n):
+    # What the receiver outputs with no carrier: AGC at full gain
+    return [rng.randint(40, 2500) for _ in range(n)]
+
+
+def frame_levels(proto, code, bits):
+    pulse, sync, zero, one, inverted = PROTOCOLS[proto]
+    levels = []
+    for i in reversed(range(bits)):
+        hi, lo = one if (code >> i) & 1 else zero
+        levels += [hi * pulse, lo * pulse]
+    levels += [sync[0] * pulse, sync[1] * pulse]
+    # Inverted protocols send each pair low first; the receiver output still
+    # alternates, so only the phase of the first level changes
+    return levels, inverted
+
+
+def capture(rng, proto, code, bits, clock, jitter, stretch):
+    out = noise(rng, 40)
+    if proto is not None:
+        levels, inverted = frame_levels(proto, code, bits)
+        if inverted:
+            # Noise ended on a low level; the first frame level is low too,
+            # so the two merge into one longer low
+            out[-1] += int(levels[0] * clock)
+            levels_seq = levels[1:] + levels * (REPEATS - 1)
+        else:
+            levels_seq = levels * REPEATS
+        for lv in levels_seq:
+            # Noise ends on a low, so even positions are highs
+            high = len(out) % 2 == 0
+            lv *= clock
+            lv += stretch if high else -stretch
+            lv += rng.uniform(-jitter, jitter)
+            out.append(max(1, int(lv)))
+    out += noise(rng, 20)
+    return out
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    outdir = os.path.join(here, "captures")
+    os.makedirs(outdir, exist_ok=True)
+    rng = random.Random(433)
+    for name, (proto, code, bits, clock, jitter, stretch) in CAPTURES.items():
+        levels = capture(rng, proto, code, bits, clock, jitter, stretch)
+        with open(os.path.join(outdir, name + ".txt"), "w") as f:
+            if proto is None:
+                f.write("# expect none\n")
+            else:
+                f.write("# expect %d %d %d\n" % (proto, bits, code))
+            for i in range(0, len(levels), 16):
+                f.write(" ".join(str(v) for v in levels[i:i + 16]) + "\n")
+        print("%s: %d levels" % (name, len(levels)))
+
+
+if __name__ == "__main__":
+    main()
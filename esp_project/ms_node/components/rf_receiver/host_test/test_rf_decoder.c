@@ -0,0 +1,69 @@
+// Feed one capture through the decoder and check every decoded frame.
+// A capture starts with "# expect <protocol> <bits> <code>" (or
+// "# expect none"), followed by level durations in microseconds.
+
+#include "rf_decoder.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+// A burst must decode at least this often; the receiver confirms a code
+// after two identical frames
+#define MIN_FRAMES 2
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s capture.txt\n", argv[0]);
+    return 2;
+  }
+  FILE *f = fopen(argv[1], "r");
+  if (!f) {
+    perror(argv[1]);
+    return 2;
+  }
+
+  char head[64];
+  unsigned protocol = 0, bits = 0;
+  uint32_t code = 0;
+  bool expect_none = false;
+  if (!fgets(head, sizeof(head), f)) {
+    fprintf(stderr, "%s: empty\n", argv[1]);
+    return 2;
+  }
+  if (strncmp(head, "# expect none", 13) == 0) {
+    expect_none = true;
+  } else if (sscanf(head, "# expect %u %u %" SCNu32, &protocol, &bits,
+                    &code) != 3) {
+    fprintf(stderr, "%s: bad header\n", argv[1]);
+    return 2;
+  }
+
+  rf_decoder_t dec;
+  rf_decoder_reset(&dec);
+  unsigned frames = 0, wrong = 0;
+  uint32_t us;
+  while (fscanf(f, "%" SCNu32, &us) == 1) {
+    rf_frame_t fr;
+    if (!rf_decoder_feed(&dec, us, &fr))
+      continue;
+    frames++;
+    printf("decoded protocol %u, %u bits, code 0x%" PRIx32 ", pulse %u us\n",
+           fr.protocol, fr.bits, fr.code, fr.pulse_us);
+    if (expect_none || fr.protocol != protocol || fr.bits != bits ||
+        fr.code != code)
+      wrong++;
+  }
+  fclose(f);
+
+  if (wrong > 0) {
+    printf("FAIL: %u of %u frames wrong\n", wrong, frames);
+    return 1;
+  }
+  if (!expect_none && frames < MIN_FRAMES) {
+    printf("FAIL: %u frames decoded, expected at least %d\n", frames,
+           MIN_FRAMES);
+    return 1;
+  }
+  printf("OK: %u frames\n", frames);
+  return 0;
+}
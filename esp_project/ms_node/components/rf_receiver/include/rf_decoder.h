@@ -0,0 +1,40 @@
+#pragma once
+
+// RCSwitch-compatible pulse-width decoder (protocols 1-6).
+// Plain C with no ESP-IDF dependencies: feed it the alternating high/low
+// durations of the receiver output, in microseconds. host_test/ runs it
+// against captures on the build machine.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Edge buffer size, as in RCSwitch (32 bits * 2 + sync + slack)
+#define RF_DECODER_MAX_CHANGES 67
+
+typedef struct {
+  uint32_t code;
+  uint8_t bits;
+  uint8_t protocol;  // 1..6
+  uint16_t pulse_us; // Base pulse length measured from the sync gap
+} rf_frame_t;
+
+typedef struct {
+  uint32_t timings[RF_DECODER_MAX_CHANGES];
+  unsigned change_count;
+  unsigned repeat_count;
+  uint32_t pending_us; // Long level not yet known to be the sync
+} rf_decoder_t;
+
+/**
+ * @brief Clear all decoder state (e.g. after a capture ends)
+ */
+void rf_decoder_reset(rf_decoder_t *dec);
+
+/**
+ * @brief Feed the duration of one level
+ * @param dec Decoder state
+ * @param duration_us Length of the level that just ended
+ * @param out Filled when a frame has been decoded
+ * @return true if @p out holds a newly decoded frame
+ */
+bool rf_decoder_feed(rf_decoder_t *dec, uint32_t duration_us, rf_frame_t *out);
@@ -7,14 +7,71 @@
 // Configuration
 #define RF_RECEIVER_GPIO 21
 #define RF_EXPECTED_CODE 22
+#define RF_EXPECTED_BITS 24 // RCSwitch default frame length
+
+// A code is reported after this many identical frames within the window
+#define RF_CONFIRM_FRAMES 2
+#define RF_CONFIRM_WINDOW_MS 1000
+
+typedef struct {
+  uint32_t code;
+  uint8_t bits;
+  uint8_t protocol;      // RCSwitch protocol number (1..6)
+  uint16_t pulse_us;     // Measured base pulse length
+  int64_t timestamp_us;  // When confirmation completed
+} rf_event_t;
+
+/**
+ * @brief Called from the decoder task for every confirmed code
+ */
+typedef void (*rf_receiver_cb_t)(const rf_event_t *event, void *ctx);
 
 /**
- * @brief Initialize the RF receiver (RMT)
+ * @brief Initialize the RF receiver (RMT) and start the decoder task
  */
 esp_err_t rf_receiver_init(void);
 
+/**
+ * @brief Register a callback for confirmed codes (NULL to remove)
+ */
+void rf_receiver_set_callback(rf_receiver_cb_t cb, void *ctx);
+
+/**
+ * @brief Take the next confirmed code from the event queue
+ * @param out Event
+ * @param timeout_ms How long to wait
+ * @return true if an event was returned
+ */
+bool rf_receiver_get_event(rf_event_t *out, uint32_t timeout_ms);
+
 /**
  * @brief Check if the specific UAV trigger code has been received
+ * Consumes the trigger: true only once per confirmed RF_EXPECTED_CODE /
+ * RF_EXPECTED_BITS transmission.
  * @return true if trigger received, false otherwise
  */
 bool rf_receiver_check_trigger(void);
+
+/**
+ * @brief Listen without holding the chip awake
+ * When enabled the RMT is stopped while the line is idle and an edge on
+ * RF_RECEIVER_GPIO wakes the chip from light sleep; the RMT then decodes
+ * for RF_LISTEN_WINDOW_MS. Wakes that decode nothing back off the edge
+ * wake exponentially. When disabled the RMT listens continuously.
+ */
+void rf_receiver_set_low_power(bool enable);
+
+/**
+ * @brief After an EXT1 (RF) deep-sleep wake, wait for the trigger code
+ * @param timeout_ms How long to decode before giving up
+ * @return true if RF_EXPECTED_CODE was confirmed (the trigger stays pending
+ * for rf_receiver_check_trigger)
+ */
+bool rf_receiver_confirm_wake(uint32_t timeout_ms);
+
+/**
+ * @brief Arm EXT1 wake on RF_RECEIVER_GPIO for the coming deep sleep
+ * Skipped for one sleep after RF_DEEP_SPURIOUS_LIMIT unconfirmed wakes.
+ * @return true if the RF wake source was armed
+ */
+bool rf_receiver_prepare_deep_sleep(void);
@@ -0,0 +1,206 @@
+#include "rf_decoder.h"
+#include <stddef.h>
+#include <string.h>
+
+// The decoder also builds on the host, where there is no placement profile
+#ifdef ESP_PLATFORM
+#include "mem_plan.h"
+#define RF_HOT_DATA MEM_HOT_DATA
+#else
+#define RF_HOT_DATA
+#endif
+
+// A level longer than this percentage of the shortest sync gap in the table
+// is a sync candidate. RCSwitch's fixed 4300 us is above protocol 4's sync
+// (6 x 380 us), so it could never frame that protocol.
+#ifndef RF_DECODER_SEPARATION_PCT
+#define RF_DECODER_SEPARATION_PCT 75
+#endif
+
+// Two syncs are the same frame boundary if within this much of each other
+#ifndef RF_DECODER_SYNC_MATCH_US
+#define RF_DECODER_SYNC_MATCH_US 200
+#endif
+
+// Per-pulse tolerance, percent of the measured base pulse
+#ifndef RF_DECODER_TOLERANCE_PCT
+#define RF_DECODER_TOLERANCE_PCT 60
+#endif
+
+// Shortest frame worth reporting; anything below is usually noise
+#ifndef RF_DECODER_MIN_BITS
+#define RF_DECODER_MIN_BITS 4
+#endif
+
+typedef struct {
+  uint8_t high;
+  uint8_t low;
+} pulses_t;
+
+typedef struct {
+  uint16_t pulse_us;
+  pulses_t sync;
+  pulses_t zero;
+  pulses_t one;
+  bool inverted;
+} protocol_t;
+
+// Same table as RCSwitch, in pulse-length units
+static const protocol_t s_protocols[] RF_HOT_DATA = {
+    {350, {1, 31}, {1, 3}, {3, 1}, false},  // 1
+    {650, {1, 10}, {1, 2}, {2, 1}, false},  // 2
+    {100, {30, 71}, {4, 11}, {9, 6}, false}, // 3
+    {380, {1, 6}, {1, 3}, {3, 1}, false},   // 4
+    {500, {6, 14}, {1, 2}, {2, 1}, false},  // 5
+    {450, {23, 1}, {1, 2}, {2, 1}, true},   // 6 (HT6P20B)
+};
+
+#define PROTOCOL_COUNT (sizeof(s_protocols) / sizeof(s_protocols[0]))
+
+static inline uint32_t diff_u32(uint32_t a, uint32_t b) {
+  return a > b ? a - b : b - a;
+}
+
+// Deviation of one bit's levels from the expected pair, in 1/256 of each
+// expected level so that long and short units weigh the same
+static uint32_t bit_error(uint32_t da, uint32_t db, uint32_t delay,
+                         const pulses_t *bit) {
+  return da * 256 / (delay * bit->high) + db * 256 / (delay * bit->low);
+}
+
+static uint32_t separation_us(void) {
+  static uint32_t sep = 0;
+  if (sep == 0) {
+    uint32_t min_sync = UINT32_MAX;
+    for (size_t i = 0; i < PROTOCOL_COUNT; i++) {
+      const protocol_t *p = &s_protocols[i];
+      uint32_t gap =
+          (uint32_t)p->pulse_us * (p->inverted ? p->sync.high : p->sync.low);
+      if (gap < min_sync)
+        min_sync = gap;
+    }
+    sep = min_sync * RF_DECODER_SEPARATION_PCT / 100;
+  }
+  return sep;
+}
+
+// timings[0] is the sync gap that opened the frame; data pairs follow.
+// The sync's short half trails the data and is not part of any bit.
+// Returns the mean bit_error, UINT32_MAX if the frame does not decode with
+// this protocol.
+static uint32_t try_protocol(const rf_decoder_t *dec, unsigned changes,
+                             size_t idx, rf_frame_t *out) {
+  const protocol_t *p = &s_protocols[idx];
+  const uint32_t sync_units = p->inverted ? p->sync.high : p->sync.low;
+  const uint32_t delay = dec->timings[0] / sync_units;
+  if (delay == 0)
+    return UINT32_MAX;
+  const uint32_t tol = delay * RF_DECODER_TOLERANCE_PCT / 100;
+
+  // Inverted protocols start with the low half of the first bit
+  const unsigned first = p->inverted ? 2 : 1;
+  uint32_t code = 0;
+  unsigned bits = 0;
+  uint64_t err = 0;
+
+  for (unsigned i = first; i + 1 < changes; i += 2) {
+    const uint32_t a = dec->timings[i];
+    const uint32_t b = dec->timings[i + 1];
+    const uint32_t za = diff_u32(a, delay * p->zero.high);
+    const uint32_t zb = diff_u32(b, delay * p->zero.low);
+    const uint32_t oa = diff_u32(a, delay * p->one.high);
+    const uint32_t ob = diff_u32(b, delay * p->one.low);
+    const bool zero = za < tol && zb < tol;
+    const bool one = oa < tol && ob < tol;
+    code <<= 1;
+    if (zero && (!one || za + zb <= oa + ob)) {
+      err += bit_error(za, zb, delay, &p->zero);
+    } else if (one) {
+      code |= 1;
+      err += bit_error(oa, ob, delay, &p->one);
+    } else {
+      return UINT32_MAX;
+    }
+    bits++;
+  }
+
+  if (bits < RF_DECODER_MIN_BITS || bits > 32)
+    return UINT32_MAX;
+
+  out->code = code;
+  out->bits = (uint8_t)bits;
+  out->protocol = (uint8_t)(idx + 1);
+  out->pulse_us = (uint16_t)(delay > UINT16_MAX ? UINT16_MAX : delay);
+  return (uint32_t)(err / bits);
+}
+
+void rf_decoder_reset(rf_decoder_t *dec) {
+  memset(dec, 0, sizeof(*dec));
+}
+
+static void push(rf_decoder_t *dec, uint32_t duration_us) {
+  if (dec->change_count >= RF_DECODER_MAX_CHANGES) {
+    dec->change_count = 0;
+    dec->repeat_count = 0;
+  }
+  dec->timings[dec->change_count++] = duration_us;
+}
+
+// Several protocols can fit the same timings (a protocol 5 frame is also
+// within tolerance of protocol 2), so the closest fit wins.
+static bool decode(const rf_decoder_t *dec, rf_frame_t *out) {
+  uint32_t best = UINT32_MAX;
+  for (size_t i = 0; i < PROTOCOL_COUNT; i++) {
+    rf_frame_t f;
+    uint32_t err = try_protocol(dec, dec->change_count, i, &f);
+    if (err < best) {
+      best = err;
+      *out = f;
+    }
+  }
+  return best != UINT32_MAX;
+}
+
+// A sync gap closes the frame in the buffer and opens the next one
+static bool sync_seen(rf_decoder_t *dec, uint32_t sync_us, rf_frame_t *out) {
+  bool decoded = false;
+
+  // A frame is only trusted once it is bracketed by two matching syncs. The
+  // closing sync also opens the next copy, so every repeat can decode.
+  if (dec->repeat_count > 0 &&
+      diff_u32(sync_us, dec->timings[0]) < RF_DECODER_SYNC_MATCH_US) {
+    dec->repeat_count++;
+    decoded = decode(dec, out);
+  } else {
+    dec->repeat_count = 1;
+  }
+  dec->change_count = 0;
+  push(dec, sync_us);
+  return decoded;
+}
+
+bool rf_decoder_feed(rf_decoder_t *dec, uint32_t duration_us,
+                     rf_frame_t *out) {
+  const bool long_level = duration_us > separation_us();
+
+  bool decoded = false;
+
+  // A long level is only taken as the sync once the next level is known:
+  // protocols 3 and 5 have a long high before the (longer) sync gap, which
+  // belongs to the frame that just ended.
+  if (dec->pending_us != 0) {
+    if (long_level && duration_us > dec->pending_us) {
+      push(dec, dec->pending_us);
+      dec->pending_us = duration_us;
+      return false;
+    }
+    decoded = sync_seen(dec, dec->pending_us, out);
+    dec->pending_us = 0;
+  }
+
+  if (long_level)
+    dec->pending_us = duration_us;
+  else
+    push(dec, duration_us);
+  return decoded;
+}
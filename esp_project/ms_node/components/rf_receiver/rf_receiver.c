@@ -1,44 +1,327 @@
 #include "rf_receiver.h"
 #include "driver/gpio.h"
 #include "driver/rmt_rx.h"
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/stream_buffer.h"
+#include "freertos/task.h"
+#include "mem_plan.h"
+#include "rf_decoder.h"
 
 static const char *TAG = "RF_RX";
 
-static rmt_channel_handle_t rx_chan = NULL;
-static QueueHandle_t rx_queue = NULL;
-static rmt_symbol_word_t raw_symbols[64]; // Buffer for received symbols
-
 // RMT Configuration
 #define RMT_RESOLUTION_HZ 1000000 // 1MHz, 1us per tick
+#define RMT_RX_SYMBOLS 128
+
+// Idle time that ends a capture. Longer than any RCSwitch sync gap
+// (protocol 1: 31 x 350 us), so one capture spans many repeated frames and
+// the decoder sees the gaps between them.
+#define RMT_IDLE_NS 30000000
+// Shorter pulses are glitches
+#define RMT_GLITCH_NS 1000
+
+// Symbols waiting for the decoder task (~2 KB)
+#define RF_STREAM_SYMBOLS 512
+#define RF_EVENT_QUEUE_DEPTH 4
+// After a code is reported, the rest of the same burst is ignored
+#define RF_REPEAT_HOLDOFF_MS 2000
+
+// Low-power listening: the RMT (and its PM lock) only runs for this long
+// after an edge on the data pin wakes the chip
+#ifndef RF_LISTEN_WINDOW_MS
+#define RF_LISTEN_WINDOW_MS 1500
+#endif
+// Wakes that decode nothing are free up to this count, then edge wake is
+// paused for BASE << (n - FREE) ms, capped at MAX
+#ifndef RF_WAKE_SPURIOUS_FREE
+#define RF_WAKE_SPURIOUS_FREE 3
+#endif
+#ifndef RF_WAKE_BACKOFF_BASE_MS
+#define RF_WAKE_BACKOFF_BASE_MS 1000
+#endif
+#ifndef RF_WAKE_BACKOFF_MAX_MS
+#define RF_WAKE_BACKOFF_MAX_MS 60000
+#endif
+// Deep sleep: after this many unconfirmed EXT1 wakes in a row, sleep one
+// period on the timer alone
+#ifndef RF_DEEP_SPURIOUS_LIMIT
+#define RF_DEEP_SPURIOUS_LIMIT 3
+#endif
+// Decoder task re-checks the listen mode at least this often
+#define RF_SERVICE_MS 1000
+
+static rmt_channel_handle_t rx_chan = NULL;
+static rmt_symbol_word_t raw_symbols[RMT_RX_SYMBOLS];
+static StreamBufferHandle_t s_stream = NULL;
+static QueueHandle_t s_event_queue = NULL;
+static rf_decoder_t s_decoder;
+static StackType_t s_decode_stack[3072];
+static StaticTask_t s_decode_tcb;
+
+static rf_receiver_cb_t s_cb = NULL;
+static void *s_cb_ctx = NULL;
+static volatile bool s_trigger = false;
+
+// Low-power listening state (decoder task only, except s_low_power)
+static volatile bool s_low_power = false;
+static bool s_rmt_running = false;
+static bool s_wake_armed = false;
+static bool s_window_hit = false;
+static int64_t s_listen_until_us = 0;
+static int64_t s_rearm_at_us = 0;
+static uint32_t s_spurious = 0;
+
+RTC_DATA_ATTR static uint32_t s_deep_spurious = 0;
 
-// Simple OOK/ASK decoding (RCSwitch-like)
-// We look for a synced burst or just a specific pattern.
-// Since we don't have the exact RCSwitch timing details in C,
-// we will implement a simplified detector that triggers on receiving
-// a sequence of pulses that match the "22" code pattern if possible,
-// OR (simplification for this task) we will just detect "activity"
-// adhering to the protocol if we can't fully emulate RCSwitch.
+static const rmt_receive_config_t s_receive_config = {
+    .signal_range_min_ns = RMT_GLITCH_NS,
+    .signal_range_max_ns = RMT_IDLE_NS,
+    // Hand over the buffer as it fills instead of dropping long bursts
+    .flags.en_partial_rx = true,
+};
 
-// HOWEVER, to be robust, let's implement a basic pulse width checker.
-// RCSwitch Protocol 1:
-// Sync: 1 high (1 tick), 31 low (31 ticks)
-// 0: 1 high, 3 low
-// 1: 3 high, 1 low
+// Zero word: end of one capture (a real symbol always has a duration)
+static const rmt_symbol_word_t s_end_marker = {.val = 0};
+// Zero-length high level: edge on the data pin while the RMT was off
+static const rmt_symbol_word_t s_wake_marker = {.level0 = 1};
+
+static void IRAM_ATTR rf_gpio_isr(void *arg) {
+  BaseType_t high_task_wakeup = pdFALSE;
+  // Level interrupt (shared with the light-sleep wake config): mask it until
+  // the decoder task has run the listen window.
+  gpio_intr_disable(RF_RECEIVER_GPIO);
+  xStreamBufferSendFromISR(s_stream, &s_wake_marker, sizeof(s_wake_marker),
+                           &high_task_wakeup);
+  if (high_task_wakeup == pdTRUE)
+    portYIELD_FROM_ISR();
+}
 
 static bool rmt_callback(rmt_channel_handle_t rx_chan,
                          const rmt_rx_done_event_data_t *edata,
                          void *user_ctx) {
   BaseType_t high_task_wakeup = pdFALSE;
-  xQueueSendFromISR(rx_queue, edata, &high_task_wakeup);
+
+  // Copy out in whole symbols; the RMT reuses raw_symbols straight away.
+  // The last slot is never filled with data: without the end marker the
+  // decoder task would not restart reception and the receiver goes deaf.
+  size_t space = xStreamBufferSpacesAvailable(s_stream) /
+                 sizeof(rmt_symbol_word_t);
+  size_t n = edata->num_symbols;
+  if (space > 0)
+    space--;
+  if (n > space)
+    n = space;
+  if (n > 0) {
+    xStreamBufferSendFromISR(s_stream, edata->received_symbols,
+                             n * sizeof(rmt_symbol_word_t), &high_task_wakeup);
+  }
+  if (edata->flags.is_last) {
+    xStreamBufferSendFromISR(s_stream, &s_end_marker, sizeof(s_end_marker),
+                             &high_task_wakeup);
+  }
   return high_task_wakeup == pdTRUE;
 }
 
+// Report a code once it has been seen RF_CONFIRM_FRAMES times in a row.
+static void confirm_frame(const rf_frame_t *frame) {
+  static rf_frame_t last;
+  static unsigned seen = 0;
+  static int64_t first_seen_us = 0;
+  static int64_t reported_us = 0;
+  static bool reported = false;
+
+  int64_t now_us = esp_timer_get_time();
+  bool same = seen > 0 && frame->code == last.code &&
+              frame->bits == last.bits && frame->protocol == last.protocol;
+
+  if (!same || now_us - first_seen_us > RF_CONFIRM_WINDOW_MS * 1000LL) {
+    // Holdoff only applies to the code that was just reported
+    if (!same || now_us - reported_us > RF_REPEAT_HOLDOFF_MS * 1000LL)
+      reported = false;
+    last = *frame;
+    seen = 0;
+    first_seen_us = now_us;
+  }
+  seen++;
+
+  s_window_hit = true;
+  if (reported || seen < RF_CONFIRM_FRAMES)
+    return;
+  reported = true;
+  reported_us = now_us;
+
+  rf_event_t event = {
+      .code = frame->code,
+      .bits = frame->bits,
+      .protocol = frame->protocol,
+      .pulse_us = frame->pulse_us,
+      .timestamp_us = now_us,
+  };
+  ESP_LOGI(TAG, "RF code %lu/%u bits (protocol %u, pulse %u us)",
+           (unsigned long)event.code, event.bits, event.protocol,
+           event.pulse_us);
+
+  if (event.code == RF_EXPECTED_CODE && event.bits == RF_EXPECTED_BITS)
+    s_trigger = true;
+
+  if (xQueueSend(s_event_queue, &event, 0) != pdTRUE) {
+    // Oldest event is least useful; make room for this one
+    rf_event_t dropped;
+    (void)xQueueReceive(s_event_queue, &dropped, 0);
+    (void)xQueueSend(s_event_queue, &event, 0);
+  }
+
+  rf_receiver_cb_t cb = s_cb;
+  if (cb)
+    cb(&event, s_cb_ctx);
+}
+
+static void feed_duration(uint32_t duration) {
+  rf_frame_t frame;
+  if (duration > 0 && rf_decoder_feed(&s_decoder, duration, &frame))
+    confirm_frame(&frame);
+}
+
+static void rmt_start(void) {
+  if (s_rmt_running)
+    return;
+  rf_decoder_reset(&s_decoder);
+  if (rmt_enable(rx_chan) == ESP_OK &&
+      rmt_receive(rx_chan, raw_symbols, sizeof(raw_symbols),
+                  &s_receive_config) == ESP_OK) {
+    s_rmt_running = true;
+  }
+}
+
+static void rmt_stop(void) {
+  if (!s_rmt_running)
+    return;
+  // Releases the RMT driver's PM lock so the chip can light-sleep again
+  rmt_disable(rx_chan);
+  s_rmt_running = false;
+}
+
+static void wake_arm(bool arm) {
+  if (arm == s_wake_armed)
+    return;
+  s_wake_armed = arm;
+  if (arm) {
+    gpio_wakeup_enable(RF_RECEIVER_GPIO, GPIO_INTR_HIGH_LEVEL);
+    gpio_intr_enable(RF_RECEIVER_GPIO);
+  } else {
+    gpio_intr_disable(RF_RECEIVER_GPIO);
+    gpio_wakeup_disable(RF_RECEIVER_GPIO);
+  }
+}
+
+// Listen window ended: decide whether the wake was worth it.
+static void window_closed(int64_t now_us) {
+  rmt_stop();
+  s_listen_until_us = 0;
+
+  if (s_window_hit) {
+    s_spurious = 0;
+  } else if (++s_spurious > RF_WAKE_SPURIOUS_FREE) {
+    uint32_t shift = s_spurious - RF_WAKE_SPURIOUS_FREE - 1;
+    uint32_t backoff_ms = (shift >= 16) ? RF_WAKE_BACKOFF_MAX_MS
+                                        : (RF_WAKE_BACKOFF_BASE_MS << shift);
+    if (backoff_ms > RF_WAKE_BACKOFF_MAX_MS)
+      backoff_ms = RF_WAKE_BACKOFF_MAX_MS;
+    s_rearm_at_us = now_us + (int64_t)backoff_ms * 1000;
+    ESP_LOGD(TAG, "%lu spurious wakes, edge wake paused %lu ms",
+             (unsigned long)s_spurious, (unsigned long)backoff_ms);
+    return;
+  }
+  wake_arm(true);
+}
+
+// Apply the listen mode and timers; returns how long the task may block.
+static TickType_t low_power_service(int64_t now_us) {
+  if (!s_low_power) {
+    wake_arm(false);
+    s_listen_until_us = 0;
+    s_rearm_at_us = 0;
+    rmt_start();
+    return pdMS_TO_TICKS(RF_SERVICE_MS);
+  }
+
+  int64_t next_us = now_us + RF_SERVICE_MS * 1000LL;
+  if (s_listen_until_us != 0) {
+    if (now_us >= s_listen_until_us) {
+      window_closed(now_us);
+    } else if (s_listen_until_us < next_us) {
+      next_us = s_listen_until_us;
+    }
+  } else if (s_rearm_at_us != 0) {
+    if (now_us >= s_rearm_at_us) {
+      s_rearm_at_us = 0;
+      wake_arm(true);
+    } else if (s_rearm_at_us < next_us) {
+      next_us = s_rearm_at_us;
+    }
+  } else {
+    // Idle: RMT off, edge wake armed
+    rmt_stop();
+    wake_arm(true);
+  }
+  return pdMS_TO_TICKS((next_us - now_us) / 1000) + 1;
+}
+
+static void rf_decode_task(void *pvParameters) {
+  rmt_symbol_word_t sym[32];
+  TickType_t wait = 0;
+
+  for (;;) {
+    size_t len = xStreamBufferReceive(s_stream, sym, sizeof(sym), wait);
+    size_t n = len / sizeof(rmt_symbol_word_t);
+
+    for (size_t i = 0; i < n; i++) {
+      if (sym[i].val == s_wake_marker.val) {
+        // Edge woke us: run the RMT for a window to see if it is a code
+        s_wake_armed = false;
+        gpio_wakeup_disable(RF_RECEIVER_GPIO);
+        if (s_low_power && s_listen_until_us == 0) {
+          s_window_hit = false;
+          s_listen_until_us =
+              esp_timer_get_time() + RF_LISTEN_WINDOW_MS * 1000LL;
+          rmt_start();
+        }
+        continue;
+      }
+      if (sym[i].val == s_end_marker.val) {
+        // Capture ended on idle: the line went quiet, start over
+        rf_decoder_reset(&s_decoder);
+        if (!s_rmt_running)
+          continue;
+        esp_err_t err = rmt_receive(rx_chan, raw_symbols, sizeof(raw_symbols),
+                                    &s_receive_config);
+        if (err != ESP_OK)
+          ESP_LOGW(TAG, "rmt_receive: %s", esp_err_to_name(err));
+        continue;
+      }
+      feed_duration(sym[i].duration0);
+      feed_duration(sym[i].duration1);
+    }
+
+    wait = low_power_service(esp_timer_get_time());
+  }
+}
+
 esp_err_t rf_receiver_init(void) {
   ESP_LOGI(TAG, "Initializing RF Receiver on GPIO %d", RF_RECEIVER_GPIO);
 
+  s_stream = xStreamBufferCreate(RF_STREAM_SYMBOLS * sizeof(rmt_symbol_word_t),
+                                 sizeof(rmt_symbol_word_t));
+  s_event_queue = xQueueCreate(RF_EVENT_QUEUE_DEPTH, sizeof(rf_event_t));
+  if (!s_stream || !s_event_queue)
+    return ESP_ERR_NO_MEM;
+  rf_decoder_reset(&s_decoder);
+
   rmt_rx_channel_config_t rx_chan_config = {
       .clk_src = RMT_CLK_SRC_DEFAULT,
       .resolution_hz = RMT_RESOLUTION_HZ,
@@ -52,51 +335,77 @@ esp_err_t rf_receiver_init(void) {
       .on_recv_done = rmt_callback,
   };
   ESP_ERROR_CHECK(rmt_rx_register_event_callbacks(rx_chan, &cbs, NULL));
-  ESP_ERROR_CHECK(rmt_enable(rx_chan));
 
-  rx_queue = xQueueCreate(1, sizeof(rmt_rx_done_event_data_t));
+  // Edge wake path for low-power listening; the RMT reads the same pin
+  // through the GPIO matrix.
+  esp_err_t err = gpio_install_isr_service(0);
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+    return err;
+  gpio_intr_disable(RF_RECEIVER_GPIO);
+  ESP_ERROR_CHECK(gpio_isr_handler_add(RF_RECEIVER_GPIO, rf_gpio_isr, NULL));
+  ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
 
-  // Enable reception
-  rmt_receive_config_t receive_config = {
-      .signal_range_min_ns = 1000,
-      .signal_range_max_ns = 10000000, // 10ms max pulse
-  };
-  ESP_ERROR_CHECK(
-      rmt_receive(rx_chan, raw_symbols, sizeof(raw_symbols), &receive_config));
+  // The decoder task enables reception (continuous until low power is set)
+  TaskHandle_t task =
+      xTaskCreateStatic(rf_decode_task, "rf_decode", sizeof(s_decode_stack),
+                        NULL, 6, s_decode_stack, &s_decode_tcb);
+  if (!task)
+    return ESP_ERR_NO_MEM;
+  mem_plan_watch_task(task);
 
   return ESP_OK;
 }
 
-bool rf_receiver_check_trigger(void) {
-  if (rx_queue == NULL) {
-    return false;
+void rf_receiver_set_low_power(bool enable) { s_low_power = enable; }
+
+bool rf_receiver_confirm_wake(uint32_t timeout_ms) {
+  int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+  bool confirmed = false;
+
+  while (!confirmed) {
+    int64_t left_us = deadline - esp_timer_get_time();
+    rf_event_t event;
+    if (left_us <= 0 || !rf_receiver_get_event(&event, left_us / 1000 + 1))
+      break;
+    confirmed =
+        event.code == RF_EXPECTED_CODE && event.bits == RF_EXPECTED_BITS;
   }
-  rmt_rx_done_event_data_t edata;
-  if (xQueueReceive(rx_queue, &edata, 0) == pdTRUE) {
-    // Re-enable params
-    rmt_receive_config_t receive_config = {
-        .signal_range_min_ns = 1000,
-        .signal_range_max_ns = 10000000,
-    };
-
-    // Process received symbols
-    // For this port, since we lack the full RCSwitch C library,
-    // we will assume ANY valid encoded burst on 433Hz is the trigger
-    // OR we'd need to manually decode.
-
-    // TODO: Implement full RCSwitch decoding.
-    // For now, return TRUE if we see a substantial burst (likely the trigger).
-    // This is a placeholder to ensure the logic flow works.
-    if (edata.num_symbols > 10) {
-      ESP_LOGI(TAG, "RF Signal Detected (%u symbols)",
-               (unsigned)edata.num_symbols);
-      // Re-enable rx for next time
-      rmt_receive(rx_chan, raw_symbols, sizeof(raw_symbols), &receive_config);
-      return true;
-    }
 
-    // Re-enable rx
-    rmt_receive(rx_chan, raw_symbols, sizeof(raw_symbols), &receive_config);
+  s_deep_spurious = confirmed ? 0 : s_deep_spurious + 1;
+  return confirmed;
+}
+
+bool rf_receiver_prepare_deep_sleep(void) {
+  if (s_deep_spurious >= RF_DEEP_SPURIOUS_LIMIT) {
+    // Receiver is just hearing noise: skip one period, then try again
+    s_deep_spurious = 0;
+    ESP_LOGW(TAG, "RF wake disabled for this sleep (noise)");
+    return false;
+  }
+  esp_err_t err = esp_sleep_enable_ext1_wakeup_io(1ULL << RF_RECEIVER_GPIO,
+                                                  ESP_EXT1_WAKEUP_ANY_HIGH);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "EXT1 wake not armed: %s", esp_err_to_name(err));
+    return false;
   }
-  return false;
+  return true;
+}
+
+void rf_receiver_set_callback(rf_receiver_cb_t cb, void *ctx) {
+  s_cb_ctx = ctx;
+  s_cb = cb;
+}
+
+bool rf_receiver_get_event(rf_event_t *out, uint32_t timeout_ms) {
+  if (!out || !s_event_queue)
+    return false;
+  return xQueueReceive(s_event_queue, out, pdMS_TO_TICKS(timeout_ms)) ==
+         pdTRUE;
+}
+
+bool rf_receiver_check_trigger(void) {
+  if (!s_trigger)
+    return false;
+  s_trigger = false;
+  return true;
 }
@@ -28,6 +28,9 @@ esp_err_t aht21_read(aht21_reading_t *out);
 // Read raw + converted in one call
 esp_err_t aht21_read_with_raw(aht21_reading_t *out, uint8_t raw[AHT21_RAW_LEN]);
 
+// Convert 6 raw bytes captured elsewhere (e.g. by the ULP) to units
+void aht21_convert_raw(const uint8_t raw[AHT21_RAW_LEN], aht21_reading_t *out);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
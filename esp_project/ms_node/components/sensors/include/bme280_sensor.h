@@ -16,6 +16,12 @@ typedef struct {
 esp_err_t bme280_init(void);
 esp_err_t bme280_read(bme280_reading_t *out);
 
+// Burst-read block 0xF7..0xFE (press, temp, hum ADC values)
+#define BME280_RAW_LEN 8
+
+// Compensate a raw block captured elsewhere (e.g. by the ULP)
+esp_err_t bme280_convert_raw(const uint8_t data[BME280_RAW_LEN], bme280_reading_t *out);
+
 // Keep your existing raw check if you want
 esp_err_t bme280_raw_check(void);
 
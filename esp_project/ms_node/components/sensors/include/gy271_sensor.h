@@ -21,6 +21,14 @@ typedef struct {
     uint8_t status;
 } gy271_reading_t;
 
+// Status register bits
+#define GY271_STATUS_DRDY   0x01  // New sample; cleared by reading the data
+#define GY271_STATUS_OVL    0x02  // A channel overflowed the range
+#define GY271_STATUS_DOR    0x04  // A sample was overwritten before it was read
+
+// Rough raw-count scale at the configured 2G range (see note in .c)
+#define GY271_UT_PER_LSB    0.0061035f
+
 // Crude sanity check (used by sensors_raw_sanity_check)
 esp_err_t gy271_raw_check(void);
 
@@ -30,6 +38,16 @@ esp_err_t gy271_init(void);
 // Read raw + rough converted XYZ
 esp_err_t gy271_read(gy271_reading_t *out);
 
+// Continuous mode at odr_hz (10, 50, 100 or 200) with the DRDY pin enabled.
+// DRDY rises with each new sample and drops once its data has been read.
+esp_err_t gy271_start_continuous(uint16_t odr_hz);
+
+// Stop conversions. The next gy271_read re-inits at the default rate.
+esp_err_t gy271_standby(void);
+
+// Status, then raw XYZ in one burst (clears DRDY); no conversion
+esp_err_t gy271_read_fast(int16_t xyz[3], uint8_t *status);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
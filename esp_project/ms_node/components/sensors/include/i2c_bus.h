@@ -1,6 +1,7 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -26,6 +27,11 @@ esp_err_t ms_i2c_write_u8(uint8_t addr, uint8_t reg, uint8_t val);
 // NEW: multi-byte write helper (reg + payload)
 esp_err_t ms_i2c_write(uint8_t addr, uint8_t reg, const uint8_t *buf, uint8_t len);
 
+// Register-less transfers (command-style sensors such as the AHT21).
+// All helpers hold a no-light-sleep PM lock for the transaction only.
+esp_err_t ms_i2c_write_raw(uint8_t addr, const uint8_t *buf, size_t len);
+esp_err_t ms_i2c_read_raw(uint8_t addr, uint8_t *buf, size_t len);
+
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -20,7 +20,7 @@ typedef struct {
 } inmp441_config_t;
 
 typedef struct {
-    int16_t *samples;     // PCM samples (16-bit)
+    int16_t *samples;     // PCM samples (16-bit), driver-owned: valid until the next read
     size_t count;         // Number of samples
     float rms_amplitude;  // RMS amplitude (0.0-1.0)
     float peak_amplitude; // Peak amplitude (0.0-1.0)
@@ -10,10 +10,6 @@
 
 static const char *TAG = "sensors";
 
-// This should match your i2c_bus implementation.
-// Your logs show you're using bus on SDA=8/SCL=9 and likely I2C_NUM_0.
-#define AHT21_I2C_PORT I2C_NUM_0
-
 // AHT2x family common commands
 #define CMD_INIT               0xBE
 #define CMD_TRIGGER_MEASURE    0xAC
@@ -25,13 +21,7 @@ static esp_err_t aht21_send_cmd(const uint8_t *cmd, size_t len)
 {
     if (!cmd || len == 0) return ESP_ERR_INVALID_ARG;
 
-    esp_err_t ret = i2c_master_write_to_device(
-        AHT21_I2C_PORT,
-        ADDR_AHT21,
-        cmd,
-        len,
-        pdMS_TO_TICKS(100)
-    );
+    esp_err_t ret = ms_i2c_write_raw(ADDR_AHT21, cmd, len);
 
     if (ret != ESP_OK) {
         ESP_LOGW(TAG, "AHT21 I2C write failed: %s", esp_err_to_name(ret));
@@ -44,13 +34,7 @@ static esp_err_t aht21_read_bytes(uint8_t *buf, size_t len)
 {
     if (!buf || len == 0) return ESP_ERR_INVALID_ARG;
 
-    esp_err_t ret = i2c_master_read_from_device(
-        AHT21_I2C_PORT,
-        ADDR_AHT21,
-        buf,
-        len,
-        pdMS_TO_TICKS(100)
-    );
+    esp_err_t ret = ms_i2c_read_raw(ADDR_AHT21, buf, len);
 
     if (ret != ESP_OK) {
         ESP_LOGW(TAG, "AHT21 I2C read failed: %s", esp_err_to_name(ret));
@@ -123,6 +107,12 @@ static void aht21_convert(const uint8_t raw[AHT21_RAW_LEN], aht21_reading_t *out
     out->temperature_c = (((float)temp_raw * 200.0f) / 1048576.0f) - 50.0f;
 }
 
+void aht21_convert_raw(const uint8_t raw[AHT21_RAW_LEN], aht21_reading_t *out)
+{
+    if (!raw || !out) return;
+    aht21_convert(raw, out);
+}
+
 esp_err_t aht21_read(aht21_reading_t *out)
 {
     if (!out) return ESP_ERR_INVALID_ARG;
@@ -159,4 +149,4 @@ esp_err_t aht21_raw_check(void)
     }
 
     return ret;
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "bme280_sensor.h"
 #include "i2c_bus.h"
 #include "sensors.h"
+#include "mem_plan.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -97,7 +98,9 @@ static esp_err_t read_calibration(void)
     return ESP_OK;
 }
 
-static int32_t compensate_T(int32_t adc_T)
+// Bosch integer compensation; runs on every sample and on every ULP
+// sample drained after deep sleep, so it lives in IRAM
+static MEM_HOT_FN int32_t compensate_T(int32_t adc_T)
 {
     int32_t var1, var2, T;
     var1 = ((((adc_T >> 3) - ((int32_t)calib.dig_T1 << 1))) * ((int32_t)calib.dig_T2)) >> 11;
@@ -108,7 +111,7 @@ static int32_t compensate_T(int32_t adc_T)
     return T;
 }
 
-static uint32_t compensate_P(int32_t adc_P)
+static MEM_HOT_FN uint32_t compensate_P(int32_t adc_P)
 {
     int64_t var1, var2, p;
 
@@ -130,7 +133,7 @@ static uint32_t compensate_P(int32_t adc_P)
     return (uint32_t)p; // pressure in Q24.8 Pa
 }
 
-static uint32_t compensate_H(int32_t adc_H)
+static MEM_HOT_FN uint32_t compensate_H(int32_t adc_H)
 {
     int32_t v_x1;
 
@@ -220,10 +223,23 @@ esp_err_t bme280_read(bme280_reading_t *out)
         vTaskDelay(pdMS_TO_TICKS(5));
     }
 
-    uint8_t data[8] = {0};
+    uint8_t data[BME280_RAW_LEN] = {0};
     ret = ms_i2c_read(ADDR_BME280, REG_PRESS_MSB, data, sizeof(data));
     if (ret != ESP_OK) return ret;
 
+    return bme280_convert_raw(data, out);
+}
+
+esp_err_t bme280_convert_raw(const uint8_t data[BME280_RAW_LEN], bme280_reading_t *out)
+{
+    if (!data || !out) return ESP_ERR_INVALID_ARG;
+
+    // Compensation needs the calibration block
+    if (!bme_inited) {
+        esp_err_t r = bme280_init();
+        if (r != ESP_OK) return r;
+    }
+
     int32_t adc_P = (int32_t)((data[0] << 12) | (data[1] << 4) | (data[2] >> 4));
     int32_t adc_T = (int32_t)((data[3] << 12) | (data[4] << 4) | (data[5] >> 4));
     int32_t adc_H = (int32_t)((data[6] << 8)  |  data[7]);
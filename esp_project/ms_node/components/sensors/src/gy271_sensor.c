@@ -36,6 +36,8 @@ static const char *TAG = "sensors";
 
 // CTRL2 soft reset bit is commonly documented as 0x80 in many libs
 #define CTRL2_SOFT_RESET    0x80
+// CTRL2 bit 0 set masks the DRDY pin; clear drives it
+#define CTRL2_INT_DISABLE   0x01
 
 // Rough scale assumption for 2G range.
 // This is a practical approximation:
@@ -43,7 +45,7 @@ static const char *TAG = "sensors";
 // 1 Gauss = 100 uT
 // => 1 LSB ≈ (2 / 32768) Gauss ≈ 0.000061035 Gauss ≈ 0.0061035 uT
 // Use this for early testing; later you can refine/calibrate.
-#define QMC_2G_UT_PER_LSB   0.0061035f
+#define QMC_2G_UT_PER_LSB   GY271_UT_PER_LSB
 
 static bool gy_inited = false;
 
@@ -143,4 +145,66 @@ esp_err_t gy271_read(gy271_reading_t *out)
     out->z_uT = (float)z * QMC_2G_UT_PER_LSB;
 
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+esp_err_t gy271_start_continuous(uint16_t odr_hz)
+{
+    uint8_t odr;
+    switch (odr_hz) {
+    case 10:  odr = ODR_10HZ;  break;
+    case 50:  odr = ODR_50HZ;  break;
+    case 100: odr = ODR_100HZ; break;
+    case 200: odr = ODR_200HZ; break;
+    default:  return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!gy_inited) {
+        esp_err_t r = gy271_init();
+        if (r != ESP_OK) return r;
+    }
+
+    esp_err_t ret = ms_i2c_write_u8(ADDR_GY271, REG_CTRL2, 0x00);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "GY-271 ctrl2 write failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = ms_i2c_write_u8(ADDR_GY271, REG_CTRL1,
+                          OSR_512 | RNG_2G | odr | MODE_CONTINUOUS);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "GY-271 ctrl1 write failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // Drop whatever was latched at the old rate so DRDY starts low
+    int16_t xyz[3];
+    uint8_t st;
+    (void)gy271_read_fast(xyz, &st);
+
+    ESP_LOGI(TAG, "GY-271 continuous at %u Hz, DRDY enabled", odr_hz);
+    return ESP_OK;
+}
+
+esp_err_t gy271_standby(void)
+{
+    gy_inited = false;
+    return ms_i2c_write_u8(ADDR_GY271, REG_CTRL1, MODE_STANDBY);
+}
+
+esp_err_t gy271_read_fast(int16_t xyz[3], uint8_t *status)
+{
+    if (!xyz || !status) return ESP_ERR_INVALID_ARG;
+
+    // Status first: reading any data register clears DRDY and DOR
+    esp_err_t ret = ms_i2c_read_u8(ADDR_GY271, REG_STATUS, status);
+    if (ret != ESP_OK) return ret;
+
+    uint8_t buf[6];
+    ret = ms_i2c_read(ADDR_GY271, REG_DATA_X_LSB, buf, sizeof(buf));
+    if (ret != ESP_OK) return ret;
+
+    xyz[0] = s16_le(&buf[0]);
+    xyz[1] = s16_le(&buf[2]);
+    xyz[2] = s16_le(&buf[4]);
+    return ESP_OK;
+}
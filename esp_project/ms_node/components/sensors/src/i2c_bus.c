@@ -2,9 +2,33 @@
 #include "driver/i2c.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
 
 static const char *TAG = "i2c_bus";
 
+#if CONFIG_PM_ENABLE
+// Light sleep gates the APB clock the I2C FSM runs from, so hold it off for
+// the length of a transaction only.
+static esp_pm_lock_handle_t s_pm_lock = NULL;
+
+static inline void bus_lock(void)
+{
+    if (s_pm_lock) esp_pm_lock_acquire(s_pm_lock);
+}
+
+static inline void bus_unlock(void)
+{
+    if (s_pm_lock) esp_pm_lock_release(s_pm_lock);
+}
+#else
+static inline void bus_lock(void) {}
+static inline void bus_unlock(void) {}
+#endif
+
 esp_err_t ms_i2c_init(void)
 {
     static bool initialized = false;
@@ -23,6 +47,15 @@ esp_err_t ms_i2c_init(void)
     ESP_LOGI(TAG, "Initializing I2C on SDA=%d SCL=%d",
              MS_I2C_SDA_GPIO, MS_I2C_SCL_GPIO);
 
+#if CONFIG_PM_ENABLE
+    if (!s_pm_lock) {
+        esp_err_t lret = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "i2c_bus", &s_pm_lock);
+        if (lret != ESP_OK) {
+            ESP_LOGW(TAG, "PM lock create failed: %s", esp_err_to_name(lret));
+        }
+    }
+#endif
+
     ESP_ERROR_CHECK(i2c_param_config(MS_I2C_PORT, &conf));
     esp_err_t ret = i2c_driver_install(MS_I2C_PORT, conf.mode, 0, 0, 0);
 
@@ -39,24 +72,22 @@ esp_err_t ms_i2c_read(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len)
 {
     if (!buf || len == 0) return ESP_ERR_INVALID_ARG;
 
-    return i2c_master_write_read_device(
+    bus_lock();
+    esp_err_t ret = i2c_master_write_read_device(
         MS_I2C_PORT,
         addr,
         &reg, 1,
         buf, len,
         pdMS_TO_TICKS(100)
     );
+    bus_unlock();
+    return ret;
 }
 
 esp_err_t ms_i2c_write_u8(uint8_t addr, uint8_t reg, uint8_t val)
 {
     uint8_t data[2] = { reg, val };
-    return i2c_master_write_to_device(
-        MS_I2C_PORT,
-        addr,
-        data, sizeof(data),
-        pdMS_TO_TICKS(100)
-    );
+    return ms_i2c_write_raw(addr, data, sizeof(data));
 }
 
 esp_err_t ms_i2c_write(uint8_t addr, uint8_t reg, const uint8_t *buf, uint8_t len)
@@ -72,10 +103,35 @@ esp_err_t ms_i2c_write(uint8_t addr, uint8_t reg, const uint8_t *buf, uint8_t le
         data[1 + i] = buf[i];
     }
 
-    return i2c_master_write_to_device(
+    return ms_i2c_write_raw(addr, data, (size_t)(1 + len));
+}
+
+esp_err_t ms_i2c_write_raw(uint8_t addr, const uint8_t *buf, size_t len)
+{
+    if (!buf || len == 0) return ESP_ERR_INVALID_ARG;
+
+    bus_lock();
+    esp_err_t ret = i2c_master_write_to_device(
+        MS_I2C_PORT,
+        addr,
+        buf, len,
+        pdMS_TO_TICKS(100)
+    );
+    bus_unlock();
+    return ret;
+}
+
+esp_err_t ms_i2c_read_raw(uint8_t addr, uint8_t *buf, size_t len)
+{
+    if (!buf || len == 0) return ESP_ERR_INVALID_ARG;
+
+    bus_lock();
+    esp_err_t ret = i2c_master_read_from_device(
         MS_I2C_PORT,
         addr,
-        data, (size_t)(1 + len),
+        buf, len,
         pdMS_TO_TICKS(100)
     );
+    bus_unlock();
+    return ret;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "mem_plan.h"
 #include <inttypes.h>
 #include <math.h>
 #include <string.h>
@@ -15,6 +16,9 @@ static i2s_chan_handle_t s_rx_handle = NULL;
 static inmp441_config_t s_config = {0};
 static bool s_initialized = false;
 static bool s_sleeping = false;
+// Capture buffer, sized for buffer_samples at init so reads never allocate
+static int16_t *s_buffer = NULL;
+static size_t s_buffer_cap = 0; // In samples
 
 // Trust filtering: reject samples with suspiciously high DC offset or clipping
 #define MAX_DC_OFFSET 4096      // Reject if DC > 25% of 16-bit range
@@ -51,6 +55,23 @@ static bool validate_samples(const int16_t *samples, size_t count) {
   return true;
 }
 
+static esp_err_t reserve_buffer(size_t samples) {
+  if (s_buffer && samples <= s_buffer_cap)
+    return ESP_OK;
+
+  int16_t *buf = mem_plan_alloc(samples * sizeof(int16_t), MEM_CAPS_BULK);
+  if (!buf) {
+    ESP_LOGE(TAG, "Failed to allocate %u bytes",
+             (unsigned)(samples * sizeof(int16_t)));
+    return ESP_ERR_NO_MEM;
+  }
+  if (s_buffer)
+    heap_caps_free(s_buffer);
+  s_buffer = buf;
+  s_buffer_cap = samples;
+  return ESP_OK;
+}
+
 static void calculate_amplitude(const int16_t *samples, size_t count,
                                 float *rms, float *peak) {
   if (!samples || count == 0) {
@@ -93,13 +114,17 @@ esp_err_t inmp441_init(const inmp441_config_t *config) {
 
   memcpy(&s_config, config, sizeof(inmp441_config_t));
 
+  esp_err_t ret = reserve_buffer(s_config.buffer_samples);
+  if (ret != ESP_OK)
+    return ret;
+
   // Configure I2S in standard RX mode
   i2s_chan_config_t chan_cfg =
       I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
   chan_cfg.dma_desc_num = 4;
   chan_cfg.dma_frame_num = s_config.buffer_samples;
 
-  esp_err_t ret = i2s_new_channel(&chan_cfg, NULL, &s_rx_handle);
+  ret = i2s_new_channel(&chan_cfg, NULL, &s_rx_handle);
   if (ret != ESP_OK) {
     ESP_LOGE(TAG, "Failed to create I2S channel: %s", esp_err_to_name(ret));
     return ret;
@@ -164,6 +189,11 @@ esp_err_t inmp441_deinit(void) {
     s_rx_handle = NULL;
   }
 
+  if (s_buffer)
+    heap_caps_free(s_buffer);
+  s_buffer = NULL;
+  s_buffer_cap = 0;
+
   s_initialized = false;
   ESP_LOGI(TAG, "Deinitialized");
   return ESP_OK;
@@ -177,13 +207,9 @@ esp_err_t inmp441_read(inmp441_reading_t *reading) {
 
   memset(reading, 0, sizeof(inmp441_reading_t));
 
-  // Allocate sample buffer
+  // Reuse the buffer reserved at init
   size_t buffer_size = s_config.buffer_samples * sizeof(int16_t);
-  int16_t *buffer = malloc(buffer_size);
-  if (!buffer) {
-    ESP_LOGE(TAG, "Failed to allocate %u bytes", (unsigned)buffer_size);
-    return ESP_ERR_NO_MEM;
-  }
+  int16_t *buffer = s_buffer;
 
   // Read I2S data with shorter timeout to avoid ISR conflicts
   // Use multiple small reads instead of one long blocking read
@@ -205,7 +231,6 @@ esp_err_t inmp441_read(inmp441_reading_t *reading) {
 
     if (ret != ESP_OK && ret != ESP_ERR_TIMEOUT) {
       ESP_LOGE(TAG, "I2S read failed: %s", esp_err_to_name(ret));
-      free(buffer);
       return ret;
     }
 
@@ -224,7 +249,6 @@ esp_err_t inmp441_read(inmp441_reading_t *reading) {
 
   if (samples_read == 0) {
     ESP_LOGW(TAG, "No samples read");
-    free(buffer);
     reading->valid = false;
     return ESP_OK;
   }
@@ -245,7 +269,6 @@ esp_err_t inmp441_read(inmp441_reading_t *reading) {
              (unsigned)samples_read, reading->rms_amplitude,
              reading->peak_amplitude);
   } else {
-    free(buffer);
     reading->samples = NULL;
     reading->count = 0;
     ESP_LOGW(TAG, "Samples rejected by trust filter");
@@ -270,8 +293,6 @@ esp_err_t inmp441_get_level(float *rms_db) {
     } else {
       *rms_db = -96.0f; // 16-bit noise floor
     }
-
-    free(reading.samples);
   } else {
     *rms_db = -96.0f;
   }
@@ -323,6 +344,11 @@ esp_err_t inmp441_set_buffer_size(size_t samples) {
   if (!s_initialized)
     return ESP_ERR_INVALID_STATE;
 
+  // Resizing is a configuration step, not a per-read cost
+  esp_err_t ret = reserve_buffer(samples);
+  if (ret != ESP_OK)
+    return ret;
+
   s_config.buffer_samples = samples;
   ESP_LOGI(TAG, "Buffer size changed to %u samples", (unsigned)samples);
 
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One SPIFFS partition per data class. Each is sized for its own data,
+// mounts only when first used and garbage-collects independently, so
+// high-churn logs never make a state write or a mount wait on their GC.
+typedef enum {
+  STORAGE_CLASS_LOGS = 0, // High churn: rollup tiers, forward queues
+  STORAGE_CLASS_STATE,    // Small, durable: reputations, cursors
+  STORAGE_CLASS_AUDIO,    // Audio clips
+  STORAGE_CLASS_COUNT
+} storage_class_t;
+
+#define STORAGE_LOGS_PATH "/logs"
+#define STORAGE_STATE_PATH "/state"
+#define STORAGE_AUDIO_PATH "/audio"
+
+// Writes at or above this fill level are also counted separately
+#define STORAGE_LAYOUT_HIGH_FILL_PCT 80
+
+typedef struct {
+  uint32_t mount_us;      // Duration of the last mount, 0 if never mounted
+  uint32_t writes;        // Writes timed with storage_layout_note_write()
+  uint32_t write_us_max;
+  uint64_t write_us_total;
+  uint32_t full_writes;   // ... of which at >= STORAGE_LAYOUT_HIGH_FILL_PCT
+  uint32_t full_write_us_max;
+  uint64_t full_write_us_total;
+} storage_layout_stats_t;
+
+// Mount a class's partition (no-op if mounted). Formats it if it does not
+// mount. Not thread-safe: mount from init code or the class's owner task.
+esp_err_t storage_layout_mount(storage_class_t cls);
+esp_err_t storage_layout_unmount(storage_class_t cls);
+bool storage_layout_mounted(storage_class_t cls);
+
+// Same argument order as esp_spiffs_info()
+esp_err_t storage_layout_info(storage_class_t cls, size_t *total_bytes,
+                              size_t *used_bytes);
+
+// Record one write that started at start_us (esp_timer_get_time())
+void storage_layout_note_write(storage_class_t cls, int64_t start_us);
+
+esp_err_t storage_layout_get_stats(storage_class_t cls,
+                                   storage_layout_stats_t *out);
+
+// Log mount time, fill and write latency of every class
+void storage_layout_log_report(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,155 @@
+#include "storage_layout.h"
+
+#include "esp_log.h"
+#include "esp_spiffs.h"
+#include "esp_timer.h"
+
+#include <inttypes.h>
+
+#define TAG "storage"
+
+typedef struct {
+  const char *label; // Partition label in partitions.csv
+  const char *base_path;
+  size_t max_files;
+  bool mounted;
+  storage_layout_stats_t stats;
+} storage_part_t;
+
+static storage_part_t s_parts[STORAGE_CLASS_COUNT] = {
+    [STORAGE_CLASS_LOGS] = {.label = "logs",
+                            .base_path = STORAGE_LOGS_PATH,
+                            // Rollup tiers and forward queues stay open
+                            .max_files = 8},
+    [STORAGE_CLASS_STATE] = {.label = "state",
+                             .base_path = STORAGE_STATE_PATH,
+                             .max_files = 4},
+    [STORAGE_CLASS_AUDIO] = {.label = "audio",
+                             .base_path = STORAGE_AUDIO_PATH,
+                             .max_files = 2},
+};
+
+static inline bool valid_class(storage_class_t cls) {
+  return (unsigned)cls < STORAGE_CLASS_COUNT;
+}
+
+esp_err_t storage_layout_mount(storage_class_t cls) {
+  if (!valid_class(cls))
+    return ESP_ERR_INVALID_ARG;
+  storage_part_t *p = &s_parts[cls];
+  if (p->mounted)
+    return ESP_OK;
+
+  esp_vfs_spiffs_conf_t conf = {
+      .base_path = p->base_path,
+      .partition_label = p->label,
+      .max_files = p->max_files,
+      .format_if_mount_failed = true,
+  };
+
+  const int64_t t0 = esp_timer_get_time();
+  esp_err_t ret = esp_vfs_spiffs_register(&conf);
+  if (ret == ESP_ERR_INVALID_STATE) {
+    // Corrupted - format and retry
+    ESP_LOGW(TAG, "%s: SPIFFS corrupted, formatting...", p->label);
+    esp_vfs_spiffs_unregister(p->label);
+    ret = esp_spiffs_format(p->label);
+    if (ret == ESP_OK)
+      ret = esp_vfs_spiffs_register(&conf);
+  }
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "%s: mount failed: %s", p->label, esp_err_to_name(ret));
+    return ret;
+  }
+
+  p->stats.mount_us = (uint32_t)(esp_timer_get_time() - t0);
+  p->mounted = true;
+
+  size_t total = 0, used = 0;
+  (void)esp_spiffs_info(p->label, &total, &used);
+  ESP_LOGI(TAG, "%s mounted at %s in %" PRIu32 " ms (%u/%u bytes used)",
+           p->label, p->base_path, p->stats.mount_us / 1000, (unsigned)used,
+           (unsigned)total);
+  return ESP_OK;
+}
+
+esp_err_t storage_layout_unmount(storage_class_t cls) {
+  if (!valid_class(cls))
+    return ESP_ERR_INVALID_ARG;
+  storage_part_t *p = &s_parts[cls];
+  if (!p->mounted)
+    return ESP_OK;
+  esp_err_t ret = esp_vfs_spiffs_unregister(p->label);
+  if (ret == ESP_OK)
+    p->mounted = false;
+  return ret;
+}
+
+bool storage_layout_mounted(storage_class_t cls) {
+  return valid_class(cls) && s_parts[cls].mounted;
+}
+
+esp_err_t storage_layout_info(storage_class_t cls, size_t *total_bytes,
+                              size_t *used_bytes) {
+  if (!valid_class(cls) || !total_bytes || !used_bytes)
+    return ESP_ERR_INVALID_ARG;
+  if (!s_parts[cls].mounted)
+    return ESP_ERR_INVALID_STATE;
+  return esp_spiffs_info(s_parts[cls].label, total_bytes, used_bytes);
+}
+
+void storage_layout_note_write(storage_class_t cls, int64_t start_us) {
+  if (!valid_class(cls))
+    return;
+  storage_layout_stats_t *st = &s_parts[cls].stats;
+  const uint32_t us = (uint32_t)(esp_timer_get_time() - start_us);
+
+  st->writes++;
+  st->write_us_total += us;
+  if (us > st->write_us_max)
+    st->write_us_max = us;
+
+  // SPIFFS GC cost grows as free pages run out; track that tail separately
+  size_t total = 0, used = 0;
+  if (storage_layout_info(cls, &total, &used) == ESP_OK && total > 0 &&
+      used * 100 / total >= STORAGE_LAYOUT_HIGH_FILL_PCT) {
+    st->full_writes++;
+    st->full_write_us_total += us;
+    if (us > st->full_write_us_max)
+      st->full_write_us_max = us;
+  }
+}
+
+esp_err_t storage_layout_get_stats(storage_class_t cls,
+                                   storage_layout_stats_t *out) {
+  if (!valid_class(cls) || !out)
+    return ESP_ERR_INVALID_ARG;
+  *out = s_parts[cls].stats;
+  return ESP_OK;
+}
+
+void storage_layout_log_report(void) {
+  for (int c = 0; c < STORAGE_CLASS_COUNT; c++) {
+    const storage_part_t *p = &s_parts[c];
+    const storage_layout_stats_t *st = &p->stats;
+    if (!p->mounted) {
+      ESP_LOGI(TAG, "%-5s not mounted", p->label);
+      continue;
+    }
+
+    size_t total = 0, used = 0;
+    (void)esp_spiffs_info(p->label, &total, &used);
+    ESP_LOGI(TAG,
+             "%-5s mount=%" PRIu32 "ms fill=%u%% writes=%" PRIu32
+             " avg=%" PRIu32 "us max=%" PRIu32 "us | >=%d%% full: %" PRIu32
+             " avg=%" PRIu32 "us max=%" PRIu32 "us",
+             p->label, st->mount_us / 1000,
+             total ? (unsigned)(used * 100 / total) : 0, st->writes,
+             st->writes ? (uint32_t)(st->write_us_total / st->writes) : 0,
+             st->write_us_max, STORAGE_LAYOUT_HIGH_FILL_PCT, st->full_writes,
+             st->full_writes
+                 ? (uint32_t)(st->full_write_us_total / st->full_writes)
+                 : 0,
+             st->full_write_us_max);
+  }
+}
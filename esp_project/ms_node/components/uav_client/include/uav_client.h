@@ -1,12 +1,15 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
 
 // Configuration
 #define UAV_WIFI_SSID "WSN_AP"
 #define UAV_WIFI_PASS "raspberry"
 #define UAV_SERVER_URL_ONBOARD "http://10.42.0.1:8080/onboard"
 #define UAV_SERVER_URL_ACK "http://10.42.0.1:8080/ack"
+#define UAV_SERVER_URL_OTA "http://10.42.0.1:8080/ota"
 #define UAV_SECRET_KEY "pi_secret_key_12345"
 
 /**
@@ -22,3 +25,24 @@
  * @return ESP_OK on success, failure otherwise
  */
 esp_err_t uav_client_run_onboarding(void);
+
+/**
+ * @brief Receives a downloaded body piece by piece
+ * @param total Full body length (Content-Length)
+ */
+typedef esp_err_t (*uav_client_chunk_cb_t)(const uint8_t *data, size_t len,
+                                           size_t total, void *ctx);
+
+/**
+ * @brief Ask the UAV for a firmware update package
+ *
+ * GET /ota?base=<hex digest of the running image>. The UAV answers 200 with
+ * a delta package built against that image, or 204/404 if it has none.
+ * Joins WSN_AP first unless already connected (e.g. straight after
+ * onboarding).
+ *
+ * @return ESP_OK once the whole body went through cb, ESP_ERR_NOT_FOUND if
+ * there is no update, or the first error from the transfer or cb
+ */
+esp_err_t uav_client_fetch_update(const char *base_sha_hex,
+                                  uav_client_chunk_cb_t cb, void *ctx);
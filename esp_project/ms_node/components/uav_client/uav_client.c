@@ -161,3 +161,56 @@ esp_err_t uav_client_run_onboarding(void) {
 
   return success ? ESP_OK : ESP_FAIL;
 }
+
+esp_err_t uav_client_fetch_update(const char *base_sha_hex,
+                                  uav_client_chunk_cb_t cb, void *ctx) {
+  wifi_ap_record_t ap_info;
+  if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK &&
+      wifi_join(UAV_WIFI_SSID, UAV_WIFI_PASS) != ESP_OK) {
+    return ESP_FAIL;
+  }
+
+  char url[160];
+  snprintf(url, sizeof(url), "%s?base=%s", UAV_SERVER_URL_OTA, base_sha_hex);
+  esp_http_client_config_t config = {
+      .url = url,
+      .method = HTTP_METHOD_GET,
+      .timeout_ms = 10000,
+  };
+  esp_http_client_handle_t client = esp_http_client_init(&config);
+  esp_err_t err = esp_http_client_open(client, 0);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "OTA GET failed: %s", esp_err_to_name(err));
+    esp_http_client_cleanup(client);
+    return err;
+  }
+
+  const int64_t total = esp_http_client_fetch_headers(client);
+  const int status_code = esp_http_client_get_status_code(client);
+  ESP_LOGI(TAG, "OTA Status: %d, %lld bytes", status_code, (long long)total);
+  if (status_code == 204 || status_code == 404) {
+    err = ESP_ERR_NOT_FOUND;
+  } else if (status_code != 200 || total <= 0) {
+    err = ESP_FAIL;
+  }
+
+  // Stream straight into the callback; packages can be far larger than RAM
+  // we would want to spend on a second copy
+  char buffer[1024];
+  int64_t got = 0;
+  while (err == ESP_OK && got < total) {
+    int n = esp_http_client_read(client, buffer, sizeof(buffer));
+    if (n <= 0) {
+      ESP_LOGE(TAG, "OTA body ended at %lld/%lld", (long long)got,
+               (long long)total);
+      err = ESP_FAIL;
+      break;
+    }
+    err = cb((const uint8_t *)buffer, (size_t)n, (size_t)total, ctx);
+    got += n;
+  }
+
+  esp_http_client_close(client);
+  esp_http_client_cleanup(client);
+  return err;
+}
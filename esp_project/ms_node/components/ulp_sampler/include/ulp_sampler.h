@@ -0,0 +1,36 @@
+#pragma once
+
+#include "esp_err.h"
+#include "ulp_shared.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Hand AHT21/BME280 sampling to the ULP for the coming deep sleep
+ * The ULP bit-bangs the sensors on the RTC pins every interval_ms and
+ * buffers the raw bytes in RTC memory. The main cores are woken when the
+ * buffer fills or the AHT21 temperature leaves [temp_low_c, temp_high_c]
+ * (pass temp_low_c >= temp_high_c to disable the threshold). If the ULP is
+ * still running from the previous sleep it is left alone and only the wake
+ * source is re-armed.
+ */
+esp_err_t ulp_sampler_start(uint32_t interval_ms, float temp_low_c,
+                            float temp_high_c);
+
+/**
+ * @brief Halt the ULP and give the pins back to the digital I2C driver
+ * Must run before ms_i2c_init() on every boot; safe if the ULP never ran.
+ */
+void ulp_sampler_stop(void);
+
+/**
+ * @brief Why the ULP last woke the main cores (ULP_WAKE_* in ulp_shared.h)
+ */
+uint32_t ulp_sampler_wake_reason(void);
+
+/**
+ * @brief Convert buffered samples and append them to the logger
+ * Needs ulp_sampler_stop() and the sensor drivers (BME280 calibration).
+ * @return Number of samples logged
+ */
+int ulp_sampler_drain(void);
@@ -0,0 +1,209 @@
+// ULP RISC-V program: sample AHT21 + BME280 while the main cores sleep.
+//
+// Started by the ULP timer every period; each run takes one sample, stores
+// the raw bytes in RTC slow memory and halts. The main cores are woken
+// only when the buffer is full or the AHT21 temperature leaves the window
+// set by ulp_sampler_start(). Conversion to units happens on the main CPU.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ulp_riscv_gpio.h"
+#include "ulp_riscv_utils.h"
+#include "ulp_shared.h"
+
+#define SDA ((gpio_num_t)ULP_I2C_SDA_GPIO)
+#define SCL ((gpio_num_t)ULP_I2C_SCL_GPIO)
+
+// ~100 kHz bit clock
+#define HALF_BIT_CYCLES (5 * ULP_RISCV_CYCLES_PER_US)
+
+// Shared with the main CPU (visible there as ulp_<name>)
+volatile uint32_t samples[ULP_SAMPLER_CAPACITY * ULP_SAMPLE_WORDS];
+volatile uint32_t sample_count;
+volatile uint32_t wake_reason;
+volatile uint32_t temp_low_raw;  // AHT21 20-bit temperature code
+volatile uint32_t temp_high_raw; // 0 disables the threshold wake
+volatile uint32_t temp_outside;  // Last run was outside the window
+
+// ---- Bit-banged I2C (open drain, lines released = high) ----
+
+static inline void half_bit(void) { ulp_riscv_delay_cycles(HALF_BIT_CYCLES); }
+
+static inline void sda(int level) { ulp_riscv_gpio_output_level(SDA, level); }
+
+static inline void scl(int level) { ulp_riscv_gpio_output_level(SCL, level); }
+
+static void bus_init(void) {
+  ulp_riscv_gpio_init(SDA);
+  ulp_riscv_gpio_init(SCL);
+  ulp_riscv_gpio_input_enable(SDA);
+  ulp_riscv_gpio_input_enable(SCL);
+  ulp_riscv_gpio_set_output_mode(SDA, RTCIO_MODE_OUTPUT_OD);
+  ulp_riscv_gpio_set_output_mode(SCL, RTCIO_MODE_OUTPUT_OD);
+  ulp_riscv_gpio_pullup(SDA);
+  ulp_riscv_gpio_pullup(SCL);
+  sda(1);
+  scl(1);
+  ulp_riscv_gpio_output_enable(SDA);
+  ulp_riscv_gpio_output_enable(SCL);
+}
+
+static void i2c_start(void) {
+  sda(1);
+  scl(1);
+  half_bit();
+  sda(0);
+  half_bit();
+  scl(0);
+}
+
+static void i2c_stop(void) {
+  sda(0);
+  half_bit();
+  scl(1);
+  half_bit();
+  sda(1);
+  half_bit();
+}
+
+// Returns true on ACK
+static bool i2c_write_byte(uint8_t b) {
+  for (int i = 7; i >= 0; i--) {
+    sda((b >> i) & 1);
+    half_bit();
+    scl(1);
+    half_bit();
+    scl(0);
+  }
+  sda(1);
+  half_bit();
+  scl(1);
+  half_bit();
+  bool ack = ulp_riscv_gpio_get_level(SDA) == 0;
+  scl(0);
+  return ack;
+}
+
+static uint8_t i2c_read_byte(bool ack) {
+  uint8_t b = 0;
+  sda(1);
+  for (int i = 0; i < 8; i++) {
+    half_bit();
+    scl(1);
+    half_bit();
+    b = (uint8_t)((b << 1) | ulp_riscv_gpio_get_level(SDA));
+    scl(0);
+  }
+  sda(ack ? 0 : 1);
+  half_bit();
+  scl(1);
+  half_bit();
+  scl(0);
+  sda(1);
+  return b;
+}
+
+static bool i2c_write(uint8_t addr, const uint8_t *buf, int len) {
+  i2c_start();
+  bool ok = i2c_write_byte((uint8_t)(addr << 1));
+  for (int i = 0; ok && i < len; i++) {
+    ok = i2c_write_byte(buf[i]);
+  }
+  i2c_stop();
+  return ok;
+}
+
+static bool i2c_read(uint8_t addr, uint8_t *buf, int len) {
+  i2c_start();
+  bool ok = i2c_write_byte((uint8_t)((addr << 1) | 1));
+  for (int i = 0; ok && i < len; i++) {
+    buf[i] = i2c_read_byte(i + 1 < len);
+  }
+  i2c_stop();
+  return ok;
+}
+
+// ---- Sensors ----
+
+static bool aht21_sample(uint8_t raw[6]) {
+  static const uint8_t trigger[3] = {0xAC, 0x33, 0x00};
+  if (!i2c_write(ULP_ADDR_AHT21, trigger, sizeof(trigger)))
+    return false;
+  ulp_riscv_delay_cycles(80 * 1000 * ULP_RISCV_CYCLES_PER_US);
+  if (!i2c_read(ULP_ADDR_AHT21, raw, 6))
+    return false;
+  return (raw[0] & 0x80) == 0; // Busy bit clear
+}
+
+static bool bme280_sample(uint8_t raw[8]) {
+  // Same settings as the main driver: x1 oversampling, forced mode
+  static const uint8_t ctrl_hum[2] = {0xF2, 0x01};
+  static const uint8_t ctrl_meas[2] = {0xF4, 0x25};
+  static const uint8_t data_reg = 0xF7;
+
+  if (!i2c_write(ULP_ADDR_BME280, ctrl_hum, 2) ||
+      !i2c_write(ULP_ADDR_BME280, ctrl_meas, 2))
+    return false;
+  ulp_riscv_delay_cycles(10 * 1000 * ULP_RISCV_CYCLES_PER_US);
+  if (!i2c_write(ULP_ADDR_BME280, &data_reg, 1))
+    return false;
+  return i2c_read(ULP_ADDR_BME280, raw, 8);
+}
+
+static uint32_t pack_le(const uint8_t *b, int n) {
+  uint32_t w = 0;
+  for (int i = 0; i < n; i++) {
+    w |= (uint32_t)b[i] << (8 * i);
+  }
+  return w;
+}
+
+int main(void) {
+  uint32_t idx = sample_count;
+  if (idx >= ULP_SAMPLER_CAPACITY) {
+    // Main cores have not drained yet; nudge them again
+    ulp_riscv_wakeup_main_processor();
+    return 0;
+  }
+
+  bus_init();
+
+  uint8_t aht[6] = {0};
+  uint8_t bme[8] = {0};
+  uint32_t flags = 0;
+  if (aht21_sample(aht))
+    flags |= ULP_SAMPLE_AHT_OK;
+  if (bme280_sample(bme))
+    flags |= ULP_SAMPLE_BME_OK;
+
+  volatile uint32_t *s = &samples[idx * ULP_SAMPLE_WORDS];
+  s[0] = flags;
+  s[1] = pack_le(&aht[0], 4);
+  s[2] = pack_le(&aht[4], 2);
+  s[3] = pack_le(&bme[0], 4);
+  s[4] = pack_le(&bme[4], 4);
+  sample_count = idx + 1;
+
+  bool wake = false;
+  if (sample_count >= ULP_SAMPLER_CAPACITY) {
+    wake_reason = ULP_WAKE_FULL;
+    wake = true;
+  }
+
+  if ((flags & ULP_SAMPLE_AHT_OK) && temp_high_raw != 0) {
+    uint32_t t = ((uint32_t)(aht[3] & 0x0F) << 16) |
+                 ((uint32_t)aht[4] << 8) | aht[5];
+    uint32_t outside = (t < temp_low_raw || t > temp_high_raw) ? 1 : 0;
+    // Wake on the crossing only, not on every sample past it
+    if (outside && !temp_outside) {
+      wake_reason = ULP_WAKE_THRESHOLD;
+      wake = true;
+    }
+    temp_outside = outside;
+  }
+
+  if (wake)
+    ulp_riscv_wakeup_main_processor();
+  return 0;
+}
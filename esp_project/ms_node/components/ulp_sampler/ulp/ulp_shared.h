@@ -0,0 +1,24 @@
+#pragma once
+
+// Layout shared by the ULP program and ulp_sampler.c
+
+// Samples buffered in RTC slow memory before the main cores are woken
+#define ULP_SAMPLER_CAPACITY 32
+
+// Words per sample: flags, AHT21 raw (6 bytes), BME280 raw (8 bytes)
+#define ULP_SAMPLE_WORDS 5
+
+#define ULP_SAMPLE_AHT_OK (1u << 0)
+#define ULP_SAMPLE_BME_OK (1u << 1)
+
+// Why the ULP woke the main cores (wake_reason)
+#define ULP_WAKE_NONE 0
+#define ULP_WAKE_FULL 1
+#define ULP_WAKE_THRESHOLD 2
+
+// Bus pins (RTC GPIOs), same wiring as the main I2C bus
+#define ULP_I2C_SDA_GPIO 8
+#define ULP_I2C_SCL_GPIO 9
+
+#define ULP_ADDR_AHT21 0x38
+#define ULP_ADDR_BME280 0x76
@@ -0,0 +1,179 @@
+#include "ulp_sampler.h"
+
+#include "aht21_sensor.h"
+#include "bme280_sensor.h"
+#include "driver/rtc_io.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "i2c_bus.h"
+#include "logger.h"
+#include "ulp_main.h"
+#include "ulp_riscv.h"
+#include "ulp_shared.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+static const char *TAG = "ULP";
+
+_Static_assert(ULP_I2C_SDA_GPIO == MS_I2C_SDA_GPIO &&
+                   ULP_I2C_SCL_GPIO == MS_I2C_SCL_GPIO,
+               "ULP and main I2C must share the sensor bus");
+
+extern const uint8_t ulp_main_bin_start[] asm("_binary_ulp_main_bin_start");
+extern const uint8_t ulp_main_bin_end[] asm("_binary_ulp_main_bin_end");
+
+// Survive deep sleep so the drain can date the samples
+RTC_DATA_ATTR static bool s_running;
+RTC_DATA_ATTR static int64_t s_start_us;
+RTC_DATA_ATTR static uint32_t s_interval_ms;
+
+static int64_t wall_us(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// AHT21: T = raw / 2^20 * 200 - 50
+static uint32_t aht21_temp_to_raw(float c) {
+  if (c <= -50.0f)
+    return 0;
+  if (c >= 150.0f)
+    return 0xFFFFF;
+  return (uint32_t)((c + 50.0f) / 200.0f * 1048576.0f);
+}
+
+static void unpack_le(uint32_t w, uint8_t *b, int n) {
+  for (int i = 0; i < n; i++) {
+    b[i] = (uint8_t)(w >> (8 * i));
+  }
+}
+
+esp_err_t ulp_sampler_start(uint32_t interval_ms, float temp_low_c,
+                            float temp_high_c) {
+  if (interval_ms == 0)
+    return ESP_ERR_INVALID_ARG;
+
+  // Woken by RF or the timer while the ULP kept sampling: leave its buffer
+  // alone, just re-arm the wake source for this sleep.
+  if (s_running &&
+      esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_UNDEFINED) {
+    return esp_sleep_enable_ulp_wakeup();
+  }
+
+  esp_err_t ret = ulp_riscv_load_binary(
+      ulp_main_bin_start, (size_t)(ulp_main_bin_end - ulp_main_bin_start));
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "load failed: %s", esp_err_to_name(ret));
+    return ret;
+  }
+
+  ulp_sample_count = 0;
+  ulp_wake_reason = ULP_WAKE_NONE;
+  ulp_temp_outside = 0;
+  if (temp_low_c < temp_high_c) {
+    ulp_temp_low_raw = aht21_temp_to_raw(temp_low_c);
+    ulp_temp_high_raw = aht21_temp_to_raw(temp_high_c);
+  } else {
+    ulp_temp_low_raw = 0;
+    ulp_temp_high_raw = 0;
+  }
+
+  // The ULP drives the pins through the RTC mux from here on
+  ESP_ERROR_CHECK(rtc_gpio_init(ULP_I2C_SDA_GPIO));
+  ESP_ERROR_CHECK(rtc_gpio_init(ULP_I2C_SCL_GPIO));
+
+  ret = ulp_set_wakeup_period(0, interval_ms * 1000U);
+  if (ret == ESP_OK)
+    ret = ulp_riscv_run();
+  if (ret == ESP_OK)
+    ret = esp_sleep_enable_ulp_wakeup();
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "start failed: %s", esp_err_to_name(ret));
+    ulp_sampler_stop();
+    return ret;
+  }
+
+  s_running = true;
+  s_start_us = wall_us();
+  s_interval_ms = interval_ms;
+  ESP_LOGI(TAG, "sampling every %" PRIu32 " ms during deep sleep",
+           interval_ms);
+  return ESP_OK;
+}
+
+void ulp_sampler_stop(void) {
+  ulp_riscv_timer_stop();
+  ulp_riscv_halt();
+  (void)rtc_gpio_deinit(ULP_I2C_SDA_GPIO);
+  (void)rtc_gpio_deinit(ULP_I2C_SCL_GPIO);
+  s_running = false;
+}
+
+uint32_t ulp_sampler_wake_reason(void) {
+  if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_ULP)
+    return ULP_WAKE_NONE;
+  return ulp_wake_reason;
+}
+
+int ulp_sampler_drain(void) {
+  // A cold boot leaves RTC slow memory undefined
+  if (s_interval_ms == 0 ||
+      esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UNDEFINED)
+    return 0;
+
+  uint32_t count = ulp_sample_count;
+  if (count > ULP_SAMPLER_CAPACITY)
+    count = ULP_SAMPLER_CAPACITY;
+
+  const volatile uint32_t *samples = &ulp_samples;
+  const int64_t now_us = wall_us();
+  int logged = 0;
+
+  for (uint32_t i = 0; i < count; i++) {
+    const volatile uint32_t *s = &samples[i * ULP_SAMPLE_WORDS];
+    const uint32_t flags = s[0];
+
+    uint8_t aht_raw[8];
+    uint8_t bme_raw[BME280_RAW_LEN];
+    unpack_le(s[1], &aht_raw[0], 4);
+    unpack_le(s[2], &aht_raw[4], 4);
+    unpack_le(s[3], &bme_raw[0], 4);
+    unpack_le(s[4], &bme_raw[4], 4);
+
+    aht21_reading_t aht = {0};
+    bme280_reading_t bme = {0};
+    bool ok_aht = (flags & ULP_SAMPLE_AHT_OK) != 0;
+    bool ok_bme = (flags & ULP_SAMPLE_BME_OK) != 0;
+    if (ok_aht)
+      aht21_convert_raw(aht_raw, &aht);
+    if (ok_bme)
+      ok_bme = bme280_convert_raw(bme_raw, &bme) == ESP_OK;
+
+    // The timer fires one period after start, then every period
+    int64_t taken_us =
+        s_start_us + (int64_t)(i + 1) * (int64_t)s_interval_ms * 1000LL;
+    uint32_t age_s =
+        now_us > taken_us ? (uint32_t)((now_us - taken_us) / 1000000LL) : 0;
+
+    char line[200];
+    int n = snprintf(line, sizeof(line),
+                     "{\"ulp\":{\"i\":%" PRIu32 ",\"age_s\":%" PRIu32 "},"
+                     "\"env\":{\"bme_t\":%.2f,\"bme_h\":%.2f,\"bme_p\":%.2f,"
+                     "\"aht_t\":%.2f,\"aht_h\":%.2f}}",
+                     i, age_s, ok_bme ? bme.temperature_c : 0.0f,
+                     ok_bme ? bme.humidity_pct : 0.0f,
+                     ok_bme ? bme.pressure_hpa : 0.0f,
+                     ok_aht ? aht.temperature_c : 0.0f,
+                     ok_aht ? aht.humidity_pct : 0.0f);
+    if (n > 0 && n < (int)sizeof(line) && logger_append_line(line) == ESP_OK)
+      logged++;
+  }
+
+  ulp_sample_count = 0;
+  s_interval_ms = 0;
+  if (logged > 0)
+    ESP_LOGI(TAG, "logged %d samples taken during deep sleep", logged);
+  return logged;
+}
@@ -0,0 +1,102 @@
+#include "anomaly.h"
+#include "config.h"
+#include "esp_log.h"
+#include <math.h>
+#include <string.h>
+
+static const char *TAG = "ANOMALY";
+
+// Fractional bits kept on the mean, in quantization steps
+#define MEAN_FRAC_BITS 8
+// Samples are clamped to +/- this many steps so diff^2 fits in int64
+#define MAX_COUNTS (1 << 20)
+// z^2 threshold in Q4 so the per-sample path stays integer-only
+#define Z2_THRESHOLD_Q4                                                        \
+  ((int64_t)(ANOMALY_Z_THRESHOLD * ANOMALY_Z_THRESHOLD * 16.0f + 0.5f))
+
+typedef struct {
+  float step;      // Engineering units per count
+  int32_t min_dev; // Deviations below this many counts never flag
+} channel_spec_t;
+
+static const channel_spec_t s_spec[ROLLUP_CH_COUNT] = {
+    [ROLLUP_CH_TEMP] = {0.01f, 20},        // 0.2 C
+    [ROLLUP_CH_HUM] = {0.01f, 100},        // 1 %RH
+    [ROLLUP_CH_PRESS] = {0.01f, 50},       // 0.5 hPa
+    [ROLLUP_CH_AQI] = {1.0f, 1},           // 1 UBA step
+    [ROLLUP_CH_TVOC] = {1.0f, 25},         // 25 ppb
+    [ROLLUP_CH_ECO2] = {1.0f, 50},         // 50 ppm
+    [ROLLUP_CH_MAG_X] = {0.01f, 100},      // 1 uT
+    [ROLLUP_CH_MAG_Y] = {0.01f, 100},      // 1 uT
+    [ROLLUP_CH_MAG_Z] = {0.01f, 100},      // 1 uT
+    [ROLLUP_CH_BUS_V] = {0.001f, 20},      // 20 mV
+    [ROLLUP_CH_CURRENT] = {0.1f, 50},      // 5 mA
+    [ROLLUP_CH_AUDIO_RMS] = {0.0001f, 50}, // 0.005 full scale
+};
+
+typedef struct {
+  int32_t mean; // counts << MEAN_FRAC_BITS
+  int64_t var;  // counts^2 << (2 * MEAN_FRAC_BITS)
+  uint32_t n;
+} channel_state_t;
+
+static channel_state_t s_state[ROLLUP_CH_COUNT];
+
+void anomaly_init(void) { memset(s_state, 0, sizeof(s_state)); }
+
+bool anomaly_update(rollup_channel_t ch, float value) {
+  if (ch >= ROLLUP_CH_COUNT)
+    return false;
+
+  const channel_spec_t *spec = &s_spec[ch];
+  channel_state_t *st = &s_state[ch];
+
+  // Quantize once; everything below is integer arithmetic.
+  long counts = lroundf(value / spec->step);
+  if (counts > MAX_COUNTS)
+    counts = MAX_COUNTS;
+  if (counts < -MAX_COUNTS)
+    counts = -MAX_COUNTS;
+  const int32_t x = (int32_t)counts * (1 << MEAN_FRAC_BITS);
+
+  if (st->n == 0) {
+    st->mean = x;
+    st->var = 0;
+    st->n = 1;
+    return false;
+  }
+
+  const int64_t diff = (int64_t)x - st->mean;
+  const int64_t diff2 = diff * diff;
+
+  bool flagged = false;
+  if (st->n >= ANOMALY_WARMUP_SAMPLES) {
+    const int64_t min_dev = (int64_t)spec->min_dev << MEAN_FRAC_BITS;
+    // z^2 = diff^2 / var, compared without dividing
+    flagged = (diff2 > Z2_THRESHOLD_Q4 * (st->var >> 4)) &&
+              (diff2 > min_dev * min_dev);
+  } else {
+    st->n++;
+  }
+
+  // Incremental EWMA: mean += a*d, var = (1 - a) * (var + a*d^2), a = 2^-k
+  st->mean += (int32_t)(diff >> ANOMALY_EWMA_SHIFT);
+  st->var = st->var - (st->var >> ANOMALY_EWMA_SHIFT) +
+            (diff2 >> ANOMALY_EWMA_SHIFT) -
+            (diff2 >> (2 * ANOMALY_EWMA_SHIFT));
+
+  if (flagged) {
+    float mean = 0.0f;
+    (void)anomaly_get_mean(ch, &mean);
+    ESP_LOGI(TAG, "ch=%d value=%.4f flagged (ewma mean %.4f)", (int)ch,
+             value, mean);
+  }
+  return flagged;
+}
+
+bool anomaly_get_mean(rollup_channel_t ch, float *out) {
+  if (ch >= ROLLUP_CH_COUNT || !out || s_state[ch].n == 0)
+    return false;
+  *out = ((float)s_state[ch].mean / (1 << MEAN_FRAC_BITS)) * s_spec[ch].step;
+  return true;
+}
@@ -0,0 +1,29 @@
+#ifndef ANOMALY_H
+#define ANOMALY_H
+
+#include "rollup.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Reset all per-channel detectors (called once at boot)
+ */
+void anomaly_init(void);
+
+/**
+ * @brief Feed one sample into the channel's EWMA mean/variance model
+ * @param ch Sensor channel (same ids as the rollup tiers)
+ * @param value Sample in engineering units
+ * @return true if the sample's z-score exceeds ANOMALY_Z_THRESHOLD
+ */
+bool anomaly_update(rollup_channel_t ch, float value);
+
+/**
+ * @brief Current EWMA mean of a channel (for periodic routine summaries)
+ * @param ch Sensor channel
+ * @param out Mean in engineering units
+ * @return false if the channel has not seen any samples yet
+ */
+bool anomaly_get_mean(rollup_channel_t ch, float *out);
+
+#endif // ANOMALY_H
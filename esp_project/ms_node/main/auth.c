@@ -79,6 +79,39 @@ bool auth_verify_hmac(const uint8_t *message, size_t msg_len,
   return diff == 0;
 }
 
+bool auth_frame_tag(const void *frame, size_t len, size_t tag_off, uint8_t *out,
+                    size_t n) {
+  static const uint8_t zeros[32] = {0};
+  const uint8_t *f = (const uint8_t *)frame;
+  uint8_t full[32];
+
+  if (n > sizeof(full) || tag_off > len || n > len - tag_off) {
+    return false;
+  }
+  const mbedtls_md_info_t *md_info =
+      mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+  if (!md_info) {
+    return false;
+  }
+
+  mbedtls_md_context_t ctx;
+  mbedtls_md_init(&ctx);
+  const bool ok =
+      mbedtls_md_setup(&ctx, md_info, 1) == 0 &&
+      mbedtls_md_hmac_starts(&ctx, g_cluster_key, CLUSTER_KEY_SIZE) == 0 &&
+      mbedtls_md_hmac_update(&ctx, f, tag_off) == 0 &&
+      mbedtls_md_hmac_update(&ctx, zeros, n) == 0 &&
+      mbedtls_md_hmac_update(&ctx, f + tag_off + n, len - tag_off - n) == 0 &&
+      mbedtls_md_hmac_finish(&ctx, full) == 0;
+  mbedtls_md_free(&ctx);
+  if (!ok) {
+    ESP_LOGE(TAG, "Frame HMAC failed");
+    return false;
+  }
+  memcpy(out, full, n);
+  return true;
+}
+
 bool auth_check_replay(uint64_t timestamp, uint32_t node_id) {
   uint64_t now_ms = esp_timer_get_time() / 1000;
 
@@ -28,6 +28,23 @@ bool auth_generate_hmac(const uint8_t *message, size_t msg_len,
 bool auth_verify_hmac(const uint8_t *message, size_t msg_len,
                       const uint8_t *received_hmac, const uint8_t *key);
 
+/**
+ * @brief Truncated cluster-key HMAC over a frame whose tag field sits inside it
+ *
+ * The digest covers the frame as sent with the tag bytes taken as zero, so
+ * the sender can fill the tag in afterwards and the receiver can check it in
+ * place. The frame itself is not modified; out may point at its tag field.
+ *
+ * @param frame Frame to authenticate
+ * @param len Frame length, tag included
+ * @param tag_off Offset of the tag field within the frame
+ * @param out Output buffer for the truncated tag
+ * @param n Tag length (at most 32 bytes)
+ * @return true on success
+ */
+bool auth_frame_tag(const void *frame, size_t len, size_t tag_off, uint8_t *out,
+                    size_t n);
+
 /**
  * @brief Check for replay attacks using timestamp
  * @param timestamp Message timestamp
@@ -1,10 +1,13 @@
 #include "ble_manager.h"
 #include "auth.h"
 #include "config.h"
+#include "config_sync.h"
 #include "esp_bt.h"
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_nimble_hci.h"
+#include "esp_now_manager.h"
+#include "esp_random.h"
 #include "esp_timer.h"
 #include "esp_wifi.h"
 #include "host/ble_gap.h"
@@ -14,7 +17,10 @@
 #include "neighbor_manager.h"
 #include "nimble/nimble_port.h"
 #include "nimble/nimble_port_freertos.h"
+#include "sensor_config.h"
 #include "services/gap/ble_svc_gap.h"
+#include "tx_power.h"
+#include <math.h>
 #include <string.h>
 
 static const char *TAG = "BLE";
@@ -24,6 +30,13 @@ static bool advertising = false;
 static bool scanning = false;
 static uint8_t g_seq_num = 0; // Global sequence number for PER calculation
 
+// Beacon schedule (see adv_interval_ms)
+static uint32_t s_adv_itvl_ms = 0;    // Interval in use
+static uint64_t s_adv_started_ms = 0; // Last (re)start
+static uint32_t s_density = 0;        // Distinct beaconing nodes, last window
+static uint32_t s_seen[8];            // Linear-counting bitmap of node IDs
+static uint64_t s_seen_since_ms = 0;
+
 // Forward declarations
 extern uint32_t g_node_id;
 extern uint8_t g_cluster_key[CLUSTER_KEY_SIZE];
@@ -186,7 +199,7 @@ static int ble_gap_event(struct ble_gap_event *event, void *arg) {
         }
         ESP_LOGI(TAG, "Mfg Data Hex: %s", hex_str);
 
-        // Check if we have enough data for our packet (20 bytes)
+        // Check if we have enough data for our packet
         // Also verify we don't read past buffer
         ESP_LOGW(TAG,
                  "Mfg data check: mfg_data_len=%d, needed=%d, offset=%d, "
@@ -271,13 +284,28 @@ static int ble_gap_event(struct ble_gap_event *event, void *arg) {
                 float link_quality_f =
                     (float)pkt->link_quality / 10000.0f; // 0-10000 -> 0.00-1.00
 
+                // RSSI as if the beacon had gone out at the reference
+                // power, so a neighbor turning its power down does not look
+                // like it moved away (see tx_power)
+                int rssi_norm = disc->rssi + TXP_BLE_REF_DBM - pkt->tx_dbm;
+                if (rssi_norm > 0)
+                  rssi_norm = 0;
+                if (rssi_norm < -127)
+                  rssi_norm = -127;
+                const int8_t rssi = (int8_t)rssi_norm;
+
                 ESP_LOGI(TAG,
                          "Discovered neighbor: node_id=%lu, score=%.2f, "
-                         "rssi=%d, seq=%d",
-                         pkt->node_id, pkt->score, disc->rssi, pkt->seq_num);
+                         "rssi=%d (tx %d dBm), seq=%d",
+                         pkt->node_id, pkt->score, disc->rssi, pkt->tx_dbm,
+                         pkt->seq_num);
 
                 // Update our own RSSI metric (average of neighbors)
-                metrics_update_rssi((float)disc->rssi);
+                metrics_update_rssi((float)rssi);
+
+                // Every node counts towards density, table full or not
+                const uint32_t bit = (pkt->node_id * 2654435761u) >> 24;
+                s_seen[bit >> 5] |= 1u << (bit & 31);
 
                 // Update our Trust Metric (using Neighbor's Trust as
                 // Reputation)
@@ -295,10 +323,14 @@ static int ble_gap_event(struct ble_gap_event *event, void *arg) {
 
                 // MODIFIED: Pass seq_num to neighbor manager for PER
                 // calculation
-                neighbor_manager_update(pkt->node_id, full_mac_recon,
-                                        disc->rssi, pkt->score, battery_f, 0,
+                neighbor_manager_update(pkt->node_id, full_mac_recon, rssi,
+                                        pkt->score, battery_f, 0,
                                         trust_f, link_quality_f, pkt->is_ch,
-                                        pkt->seq_num);
+                                        pkt->seq_num, pkt->channel);
+                if (pkt->is_ch) {
+                  config_sync_on_ch_beacon(pkt->node_id, pkt->cfg_version,
+                                           pkt->cfg_crc);
+                }
                 break; // Found and processed, no need to continue
               } else {
                 ESP_LOGW(TAG, "HMAC verification failed for node %lu",
@@ -343,22 +375,80 @@ static int ble_gap_event(struct ble_gap_event *event, void *arg) {
   }
 }
 
-void ble_manager_start_advertising(void) {
-  if (!ble_ready || advertising) {
+// Distinct nodes heard in the last window, from the bitmap (linear
+// counting: n = -m ln(empty / m), good to a few percent well past 100)
+static void update_density(uint64_t now_ms) {
+  if (now_ms - s_seen_since_ms < BLE_BEACON_DENSITY_WINDOW_MS) {
     return;
   }
+  int empty = 0;
+  for (int i = 0; i < 8; i++) {
+    empty += 32 - __builtin_popcount(s_seen[i]);
+  }
+  s_density = (empty == 0) ? 256
+                           : (uint32_t)(-256.0f * logf((float)empty / 256.0f) +
+                                        0.5f);
+  memset(s_seen, 0, sizeof(s_seen));
+  s_seen_since_ms = now_ms;
+}
 
+// Beacon interval: the configured base, stretched once more than
+// BLE_BEACON_DENSITY_REF nodes share the air, plus a per-node offset (from
+// beacon_offset_ms, or a MAC hash when that is 0) so two nodes never keep
+// the same period, plus fresh random jitter on every (re)start so nodes
+// that did line up drift apart again.
+static uint32_t adv_interval_ms(void) {
+  static uint32_t s_offset_ms = UINT32_MAX;
+  sensor_config_t cfg;
+  uint32_t base_ms = 1000;
+  uint32_t offset_ms = 0;
+  if (sensor_config_get(&cfg) == ESP_OK) {
+    base_ms = cfg.beacon_interval_ms;
+    offset_ms = cfg.beacon_offset_ms;
+  }
+  if (offset_ms == 0) {
+    if (s_offset_ms == UINT32_MAX) {
+      // FNV-1a over the whole MAC; the last byte alone repeats across lots
+      uint8_t mac[6];
+      esp_read_mac(mac, ESP_MAC_BT);
+      uint32_t h = 2166136261u;
+      for (int i = 0; i < 6; i++) {
+        h = (h ^ mac[i]) * 16777619u;
+      }
+      s_offset_ms = h % BLE_BEACON_OFFSET_SPAN_MS;
+    }
+    offset_ms = s_offset_ms;
+  }
+
+  uint32_t scale_x10 = 10;
+  if (s_density > BLE_BEACON_DENSITY_REF) {
+    scale_x10 = s_density * 10 / BLE_BEACON_DENSITY_REF;
+    if (scale_x10 > BLE_BEACON_MAX_SCALE * 10) {
+      scale_x10 = BLE_BEACON_MAX_SCALE * 10;
+    }
+  }
+  return base_ms * scale_x10 / 10 + offset_ms +
+         esp_random() % (BLE_BEACON_JITTER_MS + 1);
+}
+
+static void adv_start(void) {
   // Use regular BLE advertising (extended advertising API changed in v6.1)
-  // Set advertising data first
-  ble_manager_update_advertisement();
+  s_adv_itvl_ms = adv_interval_ms();
+  uint32_t units = s_adv_itvl_ms * 1000 / 625; // 0.625 ms units
+  if (units < BLE_HCI_ADV_ITVL_MIN) {
+    units = BLE_HCI_ADV_ITVL_MIN;
+  }
+  if (units > BLE_HCI_ADV_ITVL_MAX) {
+    units = BLE_HCI_ADV_ITVL_MAX;
+  }
 
   // Configure advertising parameters
   struct ble_gap_adv_params adv_params;
   memset(&adv_params, 0, sizeof(adv_params));
   adv_params.conn_mode = BLE_GAP_CONN_MODE_NON;
   adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
-  adv_params.itvl_min = BLE_GAP_ADV_FAST_INTERVAL1_MIN;
-  adv_params.itvl_max = BLE_GAP_ADV_FAST_INTERVAL1_MAX;
+  adv_params.itvl_min = (uint16_t)units;
+  adv_params.itvl_max = (uint16_t)units;
 
   // Start advertising
   int rc = ble_gap_adv_start(BLE_OWN_ADDR_PUBLIC, NULL, BLE_HS_FOREVER,
@@ -369,7 +459,19 @@ void ble_manager_start_advertising(void) {
   }
 
   advertising = true;
-  ESP_LOGI(TAG, "BLE advertising started");
+  s_adv_started_ms = esp_timer_get_time() / 1000;
+  ESP_LOGI(TAG, "BLE advertising every %lu ms (%lu nodes heard)",
+           (unsigned long)s_adv_itvl_ms, (unsigned long)s_density);
+}
+
+void ble_manager_start_advertising(void) {
+  if (!ble_ready || advertising) {
+    return;
+  }
+
+  // Set advertising data first
+  ble_manager_update_advertisement();
+  adv_start();
 }
 
 // Forward declaration
@@ -453,6 +555,12 @@ void ble_manager_update_advertisement(void) {
   // Increment sequence number
   pkt->seq_num = g_seq_num++;
 
+  // Advertising power follows the weakest in-cluster link
+  pkt->tx_dbm = tx_power_ble_update();
+  pkt->channel = esp_now_manager_get_channel();
+  pkt->cfg_version = config_sync_version();
+  pkt->cfg_crc = config_sync_crc16();
+
   // Get Wi-Fi MAC address (read from EFUSE to avoid Wi-Fi driver dependency)
   // Store only last 2 bytes (first 4 bytes are typically ESP32 prefix:
   // 10:20:BA:XX)
@@ -460,7 +568,8 @@ void ble_manager_update_advertisement(void) {
   esp_read_mac(wifi_mac, ESP_MAC_WIFI_STA);
   memcpy(pkt->wifi_mac, &wifi_mac[4], 2); // Copy last 2 bytes
 
-  // Generate HMAC (1 byte - reduced to fit BLE 20-byte limit)
+  // Generate HMAC (1 byte, so the packet and its AD header stay within the
+  // 31-byte legacy advertising payload)
   // Message is all fields except HMAC (last 1 byte) and company_id (first 2
   // bytes)
   size_t message_len = sizeof(ble_score_packet_t) - 1 -
@@ -470,8 +579,7 @@ void ble_manager_update_advertisement(void) {
 
   uint8_t temp_hmac[32]; // SHA256 produces 32 bytes
   auth_generate_hmac(message, message_len, g_cluster_key, temp_hmac);
-  memcpy(pkt->hmac, temp_hmac,
-         1); // Copy only 1 byte for truncated HMAC (reduced to fit 20 bytes)
+  memcpy(pkt->hmac, temp_hmac, 1); // Truncated HMAC
 
   // Debug: Verify HMAC was set correctly
   ESP_LOGI(
@@ -511,6 +619,16 @@ void ble_manager_update_advertisement(void) {
     return;
   }
 
+  // Re-pick the interval (density, jitter) now and then
+  const uint64_t now_ms = esp_timer_get_time() / 1000;
+  update_density(now_ms);
+  if (advertising && now_ms - s_adv_started_ms >= BLE_BEACON_RESCHEDULE_MS) {
+    if (ble_gap_adv_stop() == 0) {
+      advertising = false;
+      adv_start();
+    }
+  }
+
   ESP_LOGD(TAG, "Advertisement updated successfully");
 }
 
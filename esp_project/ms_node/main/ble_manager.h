@@ -7,9 +7,9 @@
 
 // BLE Advertisement packet structure
 // BLE Score Advertisement Packet (optimized for 31-byte BLE limit)
-// Reduced to 17 bytes to fit in manufacturer data (22 byte AD structure - 4
-// byte overhead = 18 bytes, but getting 17) Structure:
-// [Length(1)][Type(1)][CompanyID(2)][OurData(17)] = 21 bytes total
+// Sent as the only AD structure (no flags, name or TX power field):
+// [Length(1)][Type 0xFF(1)][CompanyID(2)][OurData(25)] = 29 bytes total,
+// leaving 2 of the 31 legacy advertising bytes spare.
 typedef struct __attribute__((packed)) {
   uint16_t company_id;   // 2 bytes - Company Identifier (0x02E5 for Espressif)
   uint32_t node_id;      // 4 bytes - Node identifier
@@ -21,8 +21,12 @@ typedef struct __attribute__((packed)) {
                        // can be derived)
   bool is_ch;          // 1 byte - Is Cluster Head
   uint8_t seq_num;     // 1 byte - Sequence number for PER calculation
+  int8_t tx_dbm;       // 1 byte - Advertising power (RSSI normalisation)
+  uint8_t channel;     // 1 byte - ESP-NOW data channel (the CH's, for members)
+  uint16_t cfg_version; // 2 bytes - Sensor config version (see config_sync)
+  uint16_t cfg_crc;     // 2 bytes - Low half of that config's CRC32
   uint8_t hmac[1];     // 1 byte - Truncated HMAC
-} ble_score_packet_t;  // Total: 20 bytes (2+4+4+2+2+2+2+1+1+1)
+} ble_score_packet_t;  // Total: 27 bytes (2+4+4+2+2+2+2+1+1+1+1+2+2+1)
 
 /**
  * @brief Initialize BLE manager
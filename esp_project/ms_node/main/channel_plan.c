@@ -0,0 +1,116 @@
+#include "channel_plan.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_now_manager.h"
+#include "esp_wifi.h"
+#include "neighbor_manager.h"
+#include "state_machine.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "CHAN_PLAN";
+
+static const uint8_t s_candidates[] = ESPNOW_CHANNELS;
+#define CANDIDATE_COUNT ((int)sizeof(s_candidates))
+
+#define SCAN_MAX_APS 8
+
+// Interference weight of a transmitter heard at this RSSI
+static int rssi_weight(float rssi) {
+  const int w = (int)(rssi + 100.0f);
+  return w < 1 ? 1 : (w > 70 ? 70 : w);
+}
+
+static int candidate_index(uint8_t channel) {
+  for (int i = 0; i < CANDIDATE_COUNT; i++) {
+    if (s_candidates[i] == channel) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Other CHs by their announced channel. When two CHs share a channel the
+// higher node ID moves, so a CH above us on our own channel is not counted
+// against it; both CHs replanning at once would otherwise hop together.
+static void score_neighbor_chs(int *busy, uint8_t current) {
+  static neighbor_entry_t s_nbrs[MAX_NEIGHBORS];
+  const size_t count = neighbor_manager_get_all(s_nbrs, MAX_NEIGHBORS);
+  for (size_t i = 0; i < count; i++) {
+    const neighbor_entry_t *n = &s_nbrs[i];
+    const int idx = candidate_index(n->channel);
+    if (!n->is_ch || idx < 0) {
+      continue;
+    }
+    if (n->channel == current && n->node_id > g_node_id) {
+      continue;
+    }
+    busy[idx] += ESPNOW_CHANNEL_CH_WEIGHT * rssi_weight(n->rssi_ewma);
+  }
+}
+
+// Foreign networks heard in a short passive dwell on each candidate
+static void score_scan(int *busy) {
+  static wifi_ap_record_t s_aps[SCAN_MAX_APS];
+  esp_now_manager_radio_hold();
+  for (int i = 0; i < CANDIDATE_COUNT; i++) {
+    wifi_scan_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.channel = s_candidates[i];
+    cfg.show_hidden = true;
+    cfg.scan_type = WIFI_SCAN_TYPE_PASSIVE;
+    cfg.scan_time.passive = ESPNOW_CHANNEL_SCAN_MS;
+    esp_err_t err = esp_wifi_scan_start(&cfg, true);
+    if (err != ESP_OK) {
+      ESP_LOGW(TAG, "Scan of channel %u failed: %s", s_candidates[i],
+               esp_err_to_name(err));
+      continue;
+    }
+    uint16_t num = SCAN_MAX_APS;
+    if (esp_wifi_scan_get_ap_records(&num, s_aps) != ESP_OK) {
+      num = 0;
+    }
+    esp_wifi_clear_ap_list();
+    for (uint16_t a = 0; a < num; a++) {
+      busy[i] += rssi_weight(s_aps[a].rssi);
+    }
+  }
+  esp_now_manager_radio_release();
+}
+
+uint8_t channel_plan_select(bool initial) {
+  const uint8_t current = esp_now_manager_get_channel();
+  int busy[CANDIDATE_COUNT];
+  memset(busy, 0, sizeof(busy));
+
+  score_neighbor_chs(busy, current);
+  if (initial) {
+    score_scan(busy);
+  }
+
+  // Start from a node-specific candidate so CHs elected at the same moment
+  // with nothing heard yet still spread out
+  int best = (int)(g_node_id % CANDIDATE_COUNT);
+  for (int k = 1; k < CANDIDATE_COUNT; k++) {
+    const int i = (int)((g_node_id + k) % CANDIDATE_COUNT);
+    if (busy[i] < busy[best]) {
+      best = i;
+    }
+  }
+
+  // Moving a formed cluster costs its members a retune and a lost schedule
+  const int cur = candidate_index(current);
+  if (!initial && cur >= 0 &&
+      busy[cur] <= busy[best] + ESPNOW_CHANNEL_HYST) {
+    best = cur;
+  }
+
+  char line[64] = "";
+  int off = 0;
+  for (int i = 0; i < CANDIDATE_COUNT && off < (int)sizeof(line); i++) {
+    off += snprintf(line + off, sizeof(line) - off, " %u:%d", s_candidates[i],
+                    busy[i]);
+  }
+  ESP_LOGI(TAG, "Busy%s -> channel %u", line, s_candidates[best]);
+  return s_candidates[best];
+}
@@ -0,0 +1,27 @@
+#ifndef CHANNEL_PLAN_H
+#define CHANNEL_PLAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Data channel planning for cluster heads
+ *
+ * Each CH puts its cluster on the least busy of ESPNOW_CHANNELS, judged
+ * from the channels neighbor CHs announce in their beacons and, when
+ * asked, a passive scan for foreign access points. Members follow the
+ * channel in their CH's beacon (see state_machine), so neighboring
+ * clusters' TDMA slots stop colliding on one channel.
+ */
+
+/**
+ * @brief Pick the data channel for our cluster
+ * @param initial true when the cluster is forming: adds a passive scan of
+ * the candidates (about ESPNOW_CHANNEL_SCAN_MS each) and ignores
+ * hysteresis. false to replan from neighbor CH announcements only.
+ * @return Channel to use; on a replan, the current one unless another is
+ * clearly less busy
+ */
+uint8_t channel_plan_select(bool initial);
+
+#endif // CHANNEL_PLAN_H
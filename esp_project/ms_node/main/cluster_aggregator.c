@@ -0,0 +1,283 @@
+#include "cluster_aggregator.h"
+#include "config.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "logger.h"
+#include "neighbor_manager.h"
+#include "pme.h"
+#include "rollup.h"
+#include "state_machine.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "CLUSTER_AGG";
+
+#define RAW_QUEUE_DEPTH 8
+
+// Short keys, shared with the member forwarding lines
+static const char *const s_field_key[ROLLUP_CH_COUNT] = {
+    [ROLLUP_CH_TEMP] = "T",  [ROLLUP_CH_HUM] = "H",
+    [ROLLUP_CH_PRESS] = "P", [ROLLUP_CH_AQI] = "q",
+    [ROLLUP_CH_TVOC] = "v",  [ROLLUP_CH_ECO2] = "c",
+    [ROLLUP_CH_MAG_X] = "x", [ROLLUP_CH_MAG_Y] = "y",
+    [ROLLUP_CH_MAG_Z] = "z", [ROLLUP_CH_BUS_V] = "bv",
+    [ROLLUP_CH_CURRENT] = "i", [ROLLUP_CH_AUDIO_RMS] = "a",
+};
+
+typedef struct {
+  uint32_t n;
+  double mean; // Welford running mean
+  double m2;   // Welford sum of squared deviations
+  float min;
+  float max;
+} field_stats_t;
+
+typedef struct {
+  uint32_t node_id;
+  uint16_t anomaly_mask; // OR of the member's flags this window
+  uint16_t n[ROLLUP_CH_COUNT];
+  float sum[ROLLUP_CH_COUNT];
+} member_stats_t;
+
+typedef struct {
+  uint64_t start_ms;
+  uint32_t samples;
+  field_stats_t field[ROLLUP_CH_COUNT];
+  member_stats_t member[MAX_NEIGHBORS];
+  size_t member_count;
+} agg_window_t;
+
+static agg_window_t s_win;
+static SemaphoreHandle_t s_mutex = NULL;
+static QueueHandle_t s_raw_queue = NULL;
+static volatile bool s_raw_passthrough = true;
+
+// Only channels the member marked present; a real reading may well be 0.
+static bool payload_field(const sensor_payload_t *p, int ch, float *out) {
+  if (!(p->present & (1U << ch)))
+    return false;
+
+  switch (ch) {
+  case ROLLUP_CH_TEMP:
+    *out = p->temp_c;
+    break;
+  case ROLLUP_CH_HUM:
+    *out = p->hum_pct;
+    break;
+  case ROLLUP_CH_PRESS:
+    *out = (float)p->pressure_hpa;
+    break;
+  case ROLLUP_CH_AQI:
+    *out = p->aqi;
+    break;
+  case ROLLUP_CH_TVOC:
+    *out = p->tvoc_ppb;
+    break;
+  case ROLLUP_CH_ECO2:
+    *out = p->eco2_ppm;
+    break;
+  case ROLLUP_CH_MAG_X:
+    *out = p->mag_x;
+    break;
+  case ROLLUP_CH_MAG_Y:
+    *out = p->mag_y;
+    break;
+  case ROLLUP_CH_MAG_Z:
+    *out = p->mag_z;
+    break;
+  case ROLLUP_CH_AUDIO_RMS:
+    *out = p->audio_rms;
+    break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+static member_stats_t *member_slot(uint32_t node_id) {
+  for (size_t i = 0; i < s_win.member_count; i++) {
+    if (s_win.member[i].node_id == node_id)
+      return &s_win.member[i];
+  }
+  if (s_win.member_count >= MAX_NEIGHBORS)
+    return NULL;
+  member_stats_t *m = &s_win.member[s_win.member_count++];
+  memset(m, 0, sizeof(*m));
+  m->node_id = node_id;
+  return m;
+}
+
+void cluster_aggregator_init(void) {
+  if (!s_mutex)
+    s_mutex = xSemaphoreCreateMutex();
+  if (!s_raw_queue)
+    s_raw_queue = xQueueCreate(RAW_QUEUE_DEPTH, sizeof(sensor_payload_t));
+  memset(&s_win, 0, sizeof(s_win));
+}
+
+void cluster_aggregator_add(const sensor_payload_t *payload) {
+  if (!payload || !s_mutex)
+    return;
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+  member_stats_t *m = member_slot(payload->node_id);
+  if (m)
+    m->anomaly_mask |= payload->anomaly_mask;
+
+  for (int ch = 0; ch < ROLLUP_CH_COUNT; ch++) {
+    float v;
+    if (!payload_field(payload, ch, &v))
+      continue;
+
+    field_stats_t *f = &s_win.field[ch];
+    f->n++;
+    double d = v - f->mean;
+    f->mean += d / f->n;
+    f->m2 += d * (v - f->mean);
+    if (f->n == 1 || v < f->min)
+      f->min = v;
+    if (f->n == 1 || v > f->max)
+      f->max = v;
+
+    if (m) {
+      m->sum[ch] += v;
+      m->n[ch]++;
+    }
+  }
+  s_win.samples++;
+  xSemaphoreGive(s_mutex);
+
+  // Writing to flash from the Wi-Fi task is not allowed; the tick drains this.
+  if (s_raw_passthrough && s_raw_queue)
+    (void)xQueueSend(s_raw_queue, payload, 0);
+}
+
+static void store_raw_records(void) {
+  sensor_payload_t p;
+  while (s_raw_queue && xQueueReceive(s_raw_queue, &p, 0) == pdTRUE) {
+    char line[256];
+    int n = snprintf(line, sizeof(line),
+                     "{\"member\":%" PRIu32 ",\"s\":%" PRIu32 ",\"f\":%u,"
+                     "\"pm\":%u,\"am\":%u,\"T\":%.2f,\"H\":%.2f,"
+                     "\"Ts\":%u,\"Hs\":%u,\"P\":%" PRIu32
+                     ",\"q\":%u,\"v\":%u,\"c\":%u,\"x\":%.2f,\"y\":%.2f,"
+                     "\"z\":%.2f,\"a\":%.4f}",
+                     p.node_id, p.seq_num, p.flags, p.present, p.anomaly_mask,
+                     p.temp_c, p.hum_pct, p.temp_sigma, p.hum_sigma,
+                     p.pressure_hpa, p.aqi, p.tvoc_ppb, p.eco2_ppm, p.mag_x,
+                     p.mag_y, p.mag_z, p.audio_rms);
+    if (n > 0 && n < (int)sizeof(line))
+      (void)logger_append_line(line);
+  }
+}
+
+// Build and store the summary for a closed window (runs on a private copy).
+static void store_summary(const agg_window_t *w, uint64_t end_ms) {
+  char line[1024];
+  size_t pos = 0;
+  int n = snprintf(line, sizeof(line),
+                   "{\"agg\":{\"ch\":%" PRIu32 ",\"w0\":%llu,\"w1\":%llu,"
+                   "\"members\":%u,\"samples\":%" PRIu32 "}",
+                   g_node_id, (unsigned long long)w->start_ms,
+                   (unsigned long long)end_ms, (unsigned)w->member_count,
+                   w->samples);
+  if (n < 0)
+    return;
+  pos = (size_t)n;
+
+  // Per field: [mean, stddev, min, max]
+  float sd[ROLLUP_CH_COUNT] = {0};
+  for (int ch = 0; ch < ROLLUP_CH_COUNT && pos < sizeof(line); ch++) {
+    const field_stats_t *f = &w->field[ch];
+    if (f->n == 0)
+      continue;
+    sd[ch] = (f->n > 1) ? (float)sqrt(f->m2 / (f->n - 1)) : 0.0f;
+    n = snprintf(line + pos, sizeof(line) - pos,
+                 ",\"%s\":[%.3f,%.3f,%.3f,%.3f]", s_field_key[ch],
+                 (float)f->mean, sd[ch], f->min, f->max);
+    if (n < 0)
+      return;
+    pos += (size_t)n;
+  }
+
+  // Outliers: member means far from the cluster mean, plus members that
+  // flagged anomalies themselves. Capped so size stays independent of N.
+  int outliers = 0;
+  if (pos < sizeof(line)) {
+    n = snprintf(line + pos, sizeof(line) - pos, ",\"out\":[");
+    pos += (n > 0) ? (size_t)n : 0;
+  }
+  for (size_t i = 0; i < w->member_count && pos < sizeof(line); i++) {
+    const member_stats_t *m = &w->member[i];
+    for (int ch = 0; ch < ROLLUP_CH_COUNT && pos < sizeof(line); ch++) {
+      if (outliers >= CLUSTER_AGG_MAX_OUTLIERS)
+        break;
+      if (m->n[ch] == 0)
+        continue;
+      float mm = m->sum[ch] / m->n[ch];
+      bool flagged = (m->anomaly_mask & (1U << ch)) != 0;
+      // A spread needs at least three members to say who is off.
+      bool deviates = w->member_count >= 3 && sd[ch] > 0.0f &&
+                      fabsf(mm - (float)w->field[ch].mean) >
+                          CLUSTER_AGG_OUTLIER_Z * sd[ch];
+      if (!flagged && !deviates)
+        continue;
+      n = snprintf(line + pos, sizeof(line) - pos,
+                   "%s{\"n\":%" PRIu32 ",\"f\":\"%s\",\"v\":%.3f%s}",
+                   outliers ? "," : "", m->node_id, s_field_key[ch], mm,
+                   flagged ? ",\"self\":1" : "");
+      if (n < 0)
+        return;
+      pos += (size_t)n;
+      outliers++;
+    }
+  }
+  if (pos < sizeof(line)) {
+    n = snprintf(line + pos, sizeof(line) - pos, "]}");
+    pos += (n > 0) ? (size_t)n : 0;
+  }
+
+  if (pos >= sizeof(line)) {
+    ESP_LOGW(TAG, "Summary truncated, skipped");
+    return;
+  }
+  if (logger_append_line(line) == ESP_OK) {
+    ESP_LOGI(TAG, "Window stored: %u members, %" PRIu32 " samples, %d outliers",
+             (unsigned)w->member_count, w->samples, outliers);
+  }
+}
+
+void cluster_aggregator_tick(uint64_t now_ms) {
+  if (!s_mutex)
+    return;
+
+  // Raw member records are a luxury: only while power, storage and cluster
+  // size allow. Otherwise only the summaries below are kept.
+  s_raw_passthrough =
+      pme_get_mode() == PME_MODE_NORMAL && !logger_storage_warning() &&
+      neighbor_manager_get_member_count() <= CLUSTER_AGG_RAW_MAX_MEMBERS;
+  store_raw_records();
+
+  static agg_window_t closed;
+  bool have_closed = false;
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+  if (s_win.start_ms == 0) {
+    s_win.start_ms = now_ms;
+  } else if (now_ms - s_win.start_ms >= CLUSTER_AGG_WINDOW_MS) {
+    if (s_win.samples > 0) {
+      closed = s_win;
+      have_closed = true;
+    }
+    memset(&s_win, 0, sizeof(s_win));
+    s_win.start_ms = now_ms;
+  }
+  xSemaphoreGive(s_mutex);
+
+  if (have_closed)
+    store_summary(&closed, now_ms);
+}
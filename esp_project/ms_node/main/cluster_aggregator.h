@@ -0,0 +1,26 @@
+#ifndef CLUSTER_AGGREGATOR_H
+#define CLUSTER_AGGREGATOR_H
+
+#include "metrics.h"
+#include <stdint.h>
+
+/**
+ * @brief Initialize the CH-side aggregation engine
+ */
+void cluster_aggregator_init(void);
+
+/**
+ * @brief Fold one member payload into the current cluster window
+ * Safe to call from the ESP-NOW receive callback.
+ * @param payload Member sensor payload
+ */
+void cluster_aggregator_add(const sensor_payload_t *payload);
+
+/**
+ * @brief Close the window once CLUSTER_AGG_WINDOW_MS has elapsed and store
+ * its summary (call periodically while CH)
+ * @param now_ms Current time in ms
+ */
+void cluster_aggregator_tick(uint64_t now_ms);
+
+#endif // CLUSTER_AGGREGATOR_H
@@ -1,14 +1,19 @@
 // Compression benchmarks: Huffman vs. miniz on representative buffers.
 
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_rom_crc.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 #include "compression.h"
+#include "mem_plan.h"
+#include "storage_layout.h"
 
 static const char *TAG = "comp_bench";
 
@@ -291,3 +296,219 @@ void compression_bench_run_once(void)
         }
     }
 }
+
+// -----------------------------------------------------------------------------
+// Placement bench: encode throughput with the flash cache to itself, then again
+// while another task keeps SPIFFS writing (the cache is off during every
+// program/erase, and SPIFFS/VFS code evicts ours from the shared cache).
+// Run it on a MEM_PLACE_HOT=1 and a MEM_PLACE_HOT=0 build and compare.
+// Allocates its buffers and the scratch file, so not for MEM_PLAN_STRICT.
+// -----------------------------------------------------------------------------
+
+#define PLACE_BENCH_LEN (16 * 1024)
+#define PLACE_BENCH_ROUNDS 8
+#define PLACE_LOAD_CHUNK 4096
+#define PLACE_LOAD_SPAN (64 * 1024) // Rewritten in place so the file stays small
+#define PLACE_LOAD_FILE STORAGE_AUDIO_PATH "/bench.tmp"
+
+typedef struct {
+    volatile bool stop;
+    volatile bool done;
+    volatile uint32_t bytes;
+} flash_load_t;
+
+static void flash_load_task(void *arg)
+{
+    flash_load_t *ld = (flash_load_t *)arg;
+    static uint8_t chunk[PLACE_LOAD_CHUNK];
+    memset(chunk, 0xA5, sizeof(chunk));
+
+    FILE *f = fopen(PLACE_LOAD_FILE, "w");
+    size_t off = 0;
+    while (f && !ld->stop) {
+        if (fwrite(chunk, 1, sizeof(chunk), f) != sizeof(chunk)) break;
+        fflush(f);
+        fsync(fileno(f));
+        ld->bytes += sizeof(chunk);
+        off += sizeof(chunk);
+        if (off >= PLACE_LOAD_SPAN) {
+            rewind(f);
+            off = 0;
+        }
+    }
+    if (f) fclose(f);
+    unlink(PLACE_LOAD_FILE);
+
+    ld->done = true;
+    vTaskSuspend(NULL); // Deleted by the bench
+}
+
+// Log-shaped input, like a real blockbuf flush
+static void fill_log_lines(uint8_t *buf, size_t len)
+{
+    size_t pos = 0;
+    for (uint32_t i = 0; pos < len; i++) {
+        char line[96];
+        int n = snprintf(line, sizeof(line),
+                         "{\"ts_ms\":%lu,\"env\":{\"t\":%u.%u,\"h\":%u.%u},\"gas\":{\"tvoc\":%u}}\n",
+                         (unsigned long)(i * 1000), (unsigned)(20 + i % 7), (unsigned)(i % 10),
+                         (unsigned)(60 + i % 13), (unsigned)(i * 7 % 10), (unsigned)(200 + i % 31));
+        size_t take = (pos + (size_t)n > len) ? len - pos : (size_t)n;
+        memcpy(buf + pos, line, take);
+        pos += take;
+    }
+}
+
+typedef esp_err_t (*place_kernel_t)(const uint8_t *in, size_t len, uint8_t *out, size_t out_max);
+
+static esp_err_t kernel_huffman(const uint8_t *in, size_t len, uint8_t *out, size_t out_max)
+{
+    size_t n = 0;
+    return huffman_compress(in, len, out, out_max, &n, NULL);
+}
+
+static esp_err_t kernel_miniz(const uint8_t *in, size_t len, uint8_t *out, size_t out_max)
+{
+    size_t n = out_max;
+    return lz_compress_miniz(in, len, out, out_max, &n, 1, NULL);
+}
+
+static esp_err_t kernel_crc32(const uint8_t *in, size_t len, uint8_t *out, size_t out_max)
+{
+    (void)out_max;
+    const uint32_t crc = esp_rom_crc32_le(0, in, len);
+    memcpy(out, &crc, sizeof(crc));
+    return ESP_OK;
+}
+
+// Bytes per microsecond is MB/s
+static float kernel_mbps(place_kernel_t k, const uint8_t *in, uint8_t *out, size_t out_max)
+{
+    const int64_t t0 = esp_timer_get_time();
+    for (int r = 0; r < PLACE_BENCH_ROUNDS; r++) {
+        if (k(in, PLACE_BENCH_LEN, out, out_max) != ESP_OK) return 0.0f;
+    }
+    const int64_t dt = esp_timer_get_time() - t0;
+    return dt > 0 ? (float)PLACE_BENCH_LEN * PLACE_BENCH_ROUNDS / (float)dt : 0.0f;
+}
+
+void compression_bench_placement(void)
+{
+    static const struct {
+        const char *name;
+        place_kernel_t fn;
+    } kernels[] = {
+        {"huffman", kernel_huffman},
+        {"miniz-1", kernel_miniz},
+        {"crc32", kernel_crc32},
+    };
+    const size_t nk = sizeof(kernels) / sizeof(kernels[0]);
+
+    if (storage_layout_mount(STORAGE_CLASS_AUDIO) != ESP_OK) {
+        ESP_LOGE(TAG, "placement: audio partition unavailable for the write load");
+        return;
+    }
+
+    const size_t out_max = huffman_bound(PLACE_BENCH_LEN);
+    uint8_t *in = mem_plan_alloc(PLACE_BENCH_LEN, MEM_CAPS_BULK);
+    uint8_t *out = mem_plan_alloc(out_max, MEM_CAPS_BULK);
+    if (!in || !out) {
+        ESP_LOGE(TAG, "placement: no memory for buffers");
+        heap_caps_free(in);
+        heap_caps_free(out);
+        return;
+    }
+    fill_log_lines(in, PLACE_BENCH_LEN);
+
+    float idle[3] = {0};
+    for (size_t k = 0; k < nk; k++) {
+        (void)kernels[k].fn(in, PLACE_BENCH_LEN, out, out_max); // Warm the cache
+        idle[k] = kernel_mbps(kernels[k].fn, in, out, out_max);
+    }
+
+    static StackType_t s_load_stack[4096];
+    static StaticTask_t s_load_tcb;
+    static flash_load_t s_load;
+    memset((void *)&s_load, 0, sizeof(s_load));
+    TaskHandle_t load = xTaskCreateStaticPinnedToCore(flash_load_task, "bench_load", sizeof(s_load_stack),
+                                                      &s_load, tskIDLE_PRIORITY + 1, s_load_stack,
+                                                      &s_load_tcb, 0);
+    vTaskDelay(pdMS_TO_TICKS(50)); // Let the writer get going
+
+    float busy[3] = {0};
+    for (size_t k = 0; k < nk; k++) {
+        busy[k] = kernel_mbps(kernels[k].fn, in, out, out_max);
+    }
+
+    s_load.stop = true;
+    while (!s_load.done) vTaskDelay(pdMS_TO_TICKS(10));
+    vTaskDelete(load);
+
+    ESP_LOGI(TAG, "placement profile=%s | flash written during run: %u KB",
+             MEM_PLACE_HOT ? "hot (IRAM/DRAM)" : "flash", (unsigned)(s_load.bytes / 1024));
+    for (size_t k = 0; k < nk; k++) {
+        ESP_LOGI(TAG, "placement %-8s idle=%.2f MB/s  flash-busy=%.2f MB/s  (%.0f%%)",
+                 kernels[k].name, idle[k], busy[k], idle[k] > 0 ? 100.0f * busy[k] / idle[k] : 0.0f);
+    }
+
+    heap_caps_free(in);
+    heap_caps_free(out);
+}
+
+// -----------------------------------------------------------------------------
+// Parallel bench: one large buffer through lz_compress_miniz() on this core,
+// then through lz_compress_parallel() on both, at a few block sizes. Smaller
+// blocks balance better across the cores but each restarts the dictionary.
+// -----------------------------------------------------------------------------
+
+#define PAR_BENCH_LEN (256 * 1024)
+#define PAR_BENCH_LEVEL 1
+
+void compression_bench_parallel(void)
+{
+    static const size_t block_sizes[] = {16 * 1024, 32 * 1024, 64 * 1024};
+
+    const size_t serial_max = lz_miniz_bound(PAR_BENCH_LEN);
+    const size_t par_max = lz_parallel_bound(PAR_BENCH_LEN, 16 * 1024); // Smallest block, largest bound
+    uint8_t *in = mem_plan_alloc(PAR_BENCH_LEN, MEM_CAPS_BULK);
+    uint8_t *out = mem_plan_alloc(par_max > serial_max ? par_max : serial_max, MEM_CAPS_BULK);
+    uint8_t *back = mem_plan_alloc(PAR_BENCH_LEN, MEM_CAPS_BULK);
+    if (!in || !out || !back || lz_parallel_init() != ESP_OK) {
+        ESP_LOGE(TAG, "parallel: no memory for buffers");
+        heap_caps_free(in);
+        heap_caps_free(out);
+        heap_caps_free(back);
+        return;
+    }
+    fill_log_lines(in, PAR_BENCH_LEN);
+
+    comp_stats_t cs = {0};
+    size_t n = serial_max;
+    if (lz_compress_miniz(in, PAR_BENCH_LEN, out, serial_max, &n, PAR_BENCH_LEVEL, &cs) != ESP_OK) {
+        ESP_LOGE(TAG, "parallel: serial compress failed");
+        cs.time_us = 0;
+    } else {
+        ESP_LOGI(TAG, "parallel serial      %u -> %u bytes in %lld us (%.2f MB/s)", (unsigned)PAR_BENCH_LEN,
+                 (unsigned)n, (long long)cs.time_us, cs.time_us > 0 ? (float)PAR_BENCH_LEN / cs.time_us : 0.0f);
+    }
+    const int64_t serial_us = cs.time_us;
+
+    for (size_t b = 0; serial_us > 0 && b < sizeof(block_sizes) / sizeof(block_sizes[0]); b++) {
+        if (lz_compress_parallel(in, PAR_BENCH_LEN, out, par_max, &n, PAR_BENCH_LEVEL, block_sizes[b], &cs) !=
+            ESP_OK) {
+            ESP_LOGE(TAG, "parallel: %uK blocks failed", (unsigned)(block_sizes[b] / 1024));
+            continue;
+        }
+        size_t back_len = 0;
+        const bool ok = lz_decompress_parallel(out, n, back, PAR_BENCH_LEN, &back_len, NULL) == ESP_OK &&
+                        back_len == PAR_BENCH_LEN && verify_equal(in, back, PAR_BENCH_LEN);
+        ESP_LOGI(TAG, "parallel %2uK blocks  %u -> %u bytes in %lld us (%.2f MB/s, x%.2f) %s",
+                 (unsigned)(block_sizes[b] / 1024), (unsigned)PAR_BENCH_LEN, (unsigned)n, (long long)cs.time_us,
+                 cs.time_us > 0 ? (float)PAR_BENCH_LEN / cs.time_us : 0.0f,
+                 cs.time_us > 0 ? (float)serial_us / cs.time_us : 0.0f, ok ? "verified" : "VERIFY FAILED");
+    }
+
+    heap_caps_free(in);
+    heap_caps_free(out);
+    heap_caps_free(back);
+}
@@ -10,7 +10,7 @@
 #define CLUSTER_KEY_SIZE 32
 #define MAX_NEIGHBORS 10
 #define MAX_CLUSTER_SIZE 5
-#define ELECTION_WINDOW_MS 10000
+#define ELECTION_WINDOW_MS 10000 // Cap; gossip usually ends the phase sooner
 #define ELECTION_STAGGER_MS                                                    \
   3000 // Stagger by node_id so lowest runs first → single CH
 #define SLOT_DURATION_SEC 10 // User Requested: 10s per node (Githmi Style)
@@ -34,6 +34,8 @@
   10000 // 10 seconds - Faster failure detection (was 60s)
 #define CH_MEMBER_HYSTERESIS_MS                                                \
   8000 // Require CH missing this long before leaving MEMBER (reduces flicker)
+#define MEMBER_JOIN_GRACE_MS                                                   \
+  3000 // New MEMBER waits this long for its elected CH's first beacon
 #define CH_MEMBER_MISSING_CONSECUTIVE                                          \
   15 // Consecutive runs with CH missing before starting hysteresis (stability)
 
@@ -64,18 +66,134 @@
 #define DISAGREE_LINKQ 0.1f
 #define PDR_EWMA_ALPHA 0.1f
 #define TRUST_FLOOR 0.2f
+#define TRUST_REPORT_ALPHA 0.3f // Weight of a beacon's self-reported trust
 #define BATTERY_LOW_THRESHOLD 0.2f
 #define LINK_QUALITY_FLOOR 0.2f
 
+// Edge anomaly detection (per-channel EWMA z-score, fixed point)
+#define ANOMALY_EWMA_SHIFT 4    // alpha = 1/16
+#define ANOMALY_Z_THRESHOLD 3.5f // |z| above this flags the sample
+#define ANOMALY_WARMUP_SAMPLES 16 // No flags until the model has settled
+#define ANOMALY_SUMMARY_PERIOD_MS                                              \
+  600000 // Routine samples are folded into one summary line per 10 minutes
+#define MEMBER_ROUTINE_SEND_MS                                                 \
+  60000 // Live payload to CH at most this often unless it carries an anomaly
+
+// CH in-network aggregation
+#define CLUSTER_AGG_WINDOW_MS 300000 // One cluster summary per 5 minutes
+#define CLUSTER_AGG_OUTLIER_Z 2.5f   // Member mean this many sd off = outlier
+#define CLUSTER_AGG_MAX_OUTLIERS 8   // Bounds summary size
+#define CLUSTER_AGG_RAW_MAX_MEMBERS                                            \
+  2 // Raw member records are also stored only for clusters this small
+
+// Temperature/humidity fusion (env_fusion.c)
+#define ENV_FUSION_CROSSCHECK_EVERY 10 // Secondary sensor read every Nth time
+#define ENV_FUSION_WARMUP_PAIRS 3   // ... and every time until this many pairs
+#define ENV_FUSION_OFFSET_ALPHA 0.2f // EWMA of the BME280-AHT21 offset
+#define ENV_FUSION_GATE_K 3.0f // Pair this many sd off the offset disagrees
+#define ENV_FUSION_Q_TEMP 0.002f // Random walk, degC^2 per second
+#define ENV_FUSION_Q_HUM 0.02f   // ... and %RH^2 per second
+
+// Magnetometer event capture (mag_events.c)
+#define MAG_DRDY_GPIO 11          // GY-271 DRDY, active high
+#define MAG_EVENT_ODR_HZ 50       // 10, 50, 100 or 200
+#define MAG_EVENT_BASELINE_TAU_S 30 // Baseline and noise EWMA time constant
+#define MAG_EVENT_WARMUP_S 5      // Baseline settles this long before events
+#define MAG_EVENT_K 6.0f          // Open: deviation this many noise sd ...
+#define MAG_EVENT_MIN_UT 1.5f     // ... and at least this far off baseline
+#define MAG_EVENT_TRIGGER_SAMPLES 3 // Consecutive samples over to open
+#define MAG_EVENT_PRE_MS 500      // History stored ahead of the trigger
+#define MAG_EVENT_RELEASE_MS 500  // Below half the threshold this long: closed
+#define MAG_EVENT_MAX_MS 5000     // Longer: closed and the baseline re-seated
+
+// Power management (automatic light sleep; needs CONFIG_PM_ENABLE and
+// CONFIG_FREERTOS_USE_TICKLESS_IDLE)
+#define PM_CPU_FREQ_MAX_MHZ 240
+#define PM_CPU_FREQ_MIN_MHZ 40 // XTAL; APB drops with it while idle
+#define SM_POLL_FAST_MS 100    // INIT/DISCOVER/CANDIDATE/UAV: election timing
+#define SM_POLL_IDLE_MS 1000   // CH/MEMBER: woken early by notifications
+#define METRICS_PERIOD_FAST_MS 1000
+#define METRICS_PERIOD_IDLE_MS 10000 // Settled CH/MEMBER role
+#define ESPNOW_WAKE_INTERVAL_MS 100 // MEMBER radio duty cycle period
+#define ESPNOW_WAKE_WINDOW_MS 25    // Radio on this long per interval
+
+#define PME_CRITICAL_SLEEP_MS 1800000 // Deep sleep per battery recheck
+#define RF_WAKE_CONFIRM_MS 3000 // After an RF deep-sleep wake, wait this long
+                                // for the trigger code before sleeping again
+#define ULP_SAMPLE_INTERVAL_MS 60000 // AHT21/BME280 period in deep sleep
+#define ULP_TEMP_WAKE_LOW_C 0.0f      // Wake the main cores below this
+#define ULP_TEMP_WAKE_HIGH_C 45.0f    // ... or above this
+
 // ESP-NOW
-#define ESP_NOW_CHANNEL 1
+#define ESP_NOW_CHANNEL 1 // Until a CH picks the cluster's channel
+#define ESPNOW_CHANNELS {1, 6, 11} // Non-overlapping candidates
+#define ESPNOW_CHANNEL_SCAN_MS 120 // Passive dwell per candidate at CH start
+#define ESPNOW_CHANNEL_CH_WEIGHT 2 // A neighbor CH counts as this many APs
+#define ESPNOW_CHANNEL_HYST 20     // Busy-score gain needed to move a cluster
+#define ESPNOW_CHANNEL_REPLAN_MS 60000 // CH re-checks its channel this often
 #define ESP_NOW_PMK "pmk1234567890123"
 #define ESP_NOW_LMK "lmk1234567890123"
+#define ESPNOW_QOS_CONTROL_DEPTH MAX_NEIGHBORS // One schedule per member
+#define ESPNOW_QOS_REALTIME_DEPTH 4
+#define ESPNOW_QOS_BULK_DEPTH 16
+#define ESPNOW_QOS_REALTIME_MAX_AGE_MS 2000 // Older readings are dropped
+#define ESPNOW_QOS_REALTIME_WEIGHT 4 // Realtime frames per bulk frame when
+                                     // both are backlogged
+#define ESPNOW_TX_DONE_TIMEOUT_MS 100 // Give up on a missing send callback
+#define ESPNOW_RATE_TARGET_PDR 0.90f // Fastest rate delivering at least this
+#define ESPNOW_RATE_HYST_PDR 0.05f   // Slack before leaving the current rate
+#define ESPNOW_RATE_PROBE_PCT 10     // Share of frames sent at a faster rate
+#define ESPNOW_RATE_WINDOW 4 // Frames per rate folded into its EWMA at once
+
+// Transmit power control (tx_power.c)
+#define TXP_BLE_REF_DBM 9    // CONFIG_BT_CTRL_DFT_TX_POWER_LEVEL; beacon RSSI
+                             // is normalised to this power
+#define TXP_WIFI_MARGIN_DB 10 // Above the PHY rate's sensitivity
+#define TXP_STEP_UP_DB 3      // Per undelivered frame
+#define TXP_STEP_DOWN_FRAMES 16 // Delivered in a row before trying 1 dB less
+#define TXP_MAX_OFFSET_DB 20  // Cap on the closed-loop correction
+#define TXP_BLE_SENS_DBM (-97) // BLE 1M receiver sensitivity
+#define TXP_BLE_MARGIN_DB 12   // Beacons are not acknowledged; keep more slack
+#define TXP_BLE_MIN_DBM (-12)  // Lowest settled advertising power
+#define TXP_SUPPLY_MV 3300     // Energy estimate: supply voltage
+#define TXP_I_BASE_MA 100      // ... and TX current, base + per dBm of output
+#define TXP_I_MA_PER_DB 12
+
+// Neighbor reputation persistence (persistence.c)
+#define REPUTATION_SAVE_DELTA 0.05f // Trust/PDR move worth a flash write
+#define REPUTATION_SAVE_PERIOD_MS 600000 // ... written at most this often
+#define REPUTATION_ROLE_SAVE_MS 30000 // CH change written at most this often
+#define REPUTATION_MAX_AGE_S 86400    // Older records are not restored
+
+// Cluster firmware update (ota_mesh.c)
+#define OTA_MESH_FRAG_BYTES 200 // Package bytes per ESP-NOW data frame
+#define OTA_MESH_MAX_PKG_BYTES (1024 * 1024) // PSRAM held for one package
+#define OTA_MESH_MAX_ROUNDS 8   // Offer/repair rounds before the CH gives up
+#define OTA_MESH_OFFER_REPEATS 3 // Offers per round (broadcast, unacked)
+#define OTA_MESH_STATUS_WINDOW_MS 1500 // CH collects member bitmaps this long
+#define OTA_MESH_STATUS_BACKOFF_MS 300 // Random delay before a member replies
+#define OTA_MESH_IDLE_TIMEOUT_MS 120000 // Member drops a stalled session
+#define OTA_MESH_REBOOT_DELAY_MS 2000 // Let the final status frame go out
+#define OTA_MESH_HMAC_BYTES 4 // Truncated cluster-key tag on each offer
+#define OTA_MESH_VERIFY_TIMEOUT_MS 600000 // New image rolls back if no cluster
+
+// Cluster config distribution (config_sync.c)
+#define CFG_SYNC_RETRY_MS 3000 // A stale member re-asks its CH this often
+#define CFG_SYNC_HMAC_BYTES 4  // Truncated cluster-key tag on each diff
 
-// Persistence
-#define SPIFFS_BASE_PATH "/spiffs"
+// Election gossip (gossip.c)
+#define GOSSIP_INTERVAL_MS 500    // Digest period while a candidate (+-25%)
+#define GOSSIP_QUIET_MS 1500      // View unchanged and agreed this long: done
+#define GOSSIP_MIN_WINDOW_MS 2000 // Two beacon periods to find neighbors first
+#define GOSSIP_HMAC_BYTES 4       // Truncated cluster-key tag on each digest
 
 // BLE Configuration
 #define BLE_DEVICE_NAME_PREFIX "MSN-"
 #define BLE_SCAN_INTERVAL_MS 100 // Scan interval
 #define BLE_SCAN_WINDOW_MS 50 // Scan window (50% duty cycle to allow CPU idle)
+#define BLE_BEACON_OFFSET_SPAN_MS 100 // MAC-hash offset when beacon_offset_ms=0
+#define BLE_BEACON_JITTER_MS 50 // Random extra interval, re-drawn per restart
+#define BLE_BEACON_RESCHEDULE_MS 30000    // Restart (new jitter) this often
+#define BLE_BEACON_DENSITY_WINDOW_MS 20000 // Distinct beacons counted over this
+#define BLE_BEACON_DENSITY_REF 15 // Nodes in range before the interval grows
+#define BLE_BEACON_MAX_SCALE 4    // ... up to this many times the base
@@ -0,0 +1,407 @@
+#include "config_sync.h"
+#include "auth.h"
+#include "esp_log.h"
+#include "esp_now_manager.h"
+#include "esp_rom_crc.h"
+#include "neighbor_manager.h"
+#include "nvs.h"
+#include "sensor_config.h"
+#include "state_machine.h"
+#include <freertos/FreeRTOS.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "CFG_SYNC";
+static const char *NVS_NAMESPACE = "cfg_sync";
+
+
+typedef enum { FIELD_BOOL, FIELD_U32 } field_type_t;
+
+typedef struct {
+  const char *key; // Console / GATT key
+  size_t offset;   // In sensor_config_t
+  field_type_t type;
+} cfg_field_t;
+
+#define FIELD(name, type) {#name, offsetof(sensor_config_t, name), type}
+
+// Entry ids on the air are indexes here: append only
+static const cfg_field_t s_fields[] = {
+    FIELD(bme280_enabled, FIELD_BOOL),
+    FIELD(aht21_enabled, FIELD_BOOL),
+    FIELD(ens160_enabled, FIELD_BOOL),
+    FIELD(gy271_enabled, FIELD_BOOL),
+    FIELD(ina219_enabled, FIELD_BOOL),
+    FIELD(inmp441_enabled, FIELD_BOOL),
+    FIELD(env_sensor_interval_ms, FIELD_U32),
+    FIELD(gas_sensor_interval_ms, FIELD_U32),
+    FIELD(mag_sensor_interval_ms, FIELD_U32),
+    FIELD(power_sensor_interval_ms, FIELD_U32),
+    FIELD(audio_interval_ms, FIELD_U32),
+    FIELD(audio_sample_rate, FIELD_U32),
+    FIELD(audio_duration_ms, FIELD_U32),
+    FIELD(beacon_interval_ms, FIELD_U32),
+    FIELD(beacon_offset_ms, FIELD_U32),
+};
+#define FIELD_COUNT ((int)(sizeof(s_fields) / sizeof(s_fields[0])))
+_Static_assert(FIELD_COUNT <= CFG_SYNC_MAX_FIELDS, "cfg_diff_msg_t too small");
+
+// Persisted with the config it describes
+typedef struct {
+  uint16_t version;
+  uint16_t field_ver[FIELD_COUNT]; // Version of each field's last change
+} cfg_versions_t;
+
+static cfg_versions_t s_ver;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// CH: requests gathered since the last answer
+static bool s_req_pending = false;
+static uint16_t s_req_min = 0;
+
+// Member: what our CH announces, and its last diff
+static uint32_t s_ch_id = 0;
+static uint16_t s_ch_version = 0;
+static uint16_t s_ch_crc16 = 0;
+static bool s_want_full = false;
+static cfg_diff_msg_t s_rx;
+static int s_rx_len = 0;
+static uint64_t s_last_req_ms = 0;
+
+static struct {
+  uint32_t diffs_sent, diff_bytes, requests_sent, requests_heard;
+  uint32_t diffs_applied, diffs_rejected;
+} s_stats;
+
+static uint32_t field_get(const sensor_config_t *cfg, int id) {
+  const uint8_t *p = (const uint8_t *)cfg + s_fields[id].offset;
+  if (s_fields[id].type == FIELD_BOOL) {
+    return *(const bool *)p ? 1 : 0;
+  }
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static void field_put(sensor_config_t *cfg, int id, uint32_t value) {
+  uint8_t *p = (uint8_t *)cfg + s_fields[id].offset;
+  if (s_fields[id].type == FIELD_BOOL) {
+    *(bool *)p = (value != 0);
+  } else {
+    memcpy(p, &value, sizeof(value));
+  }
+}
+
+static uint32_t config_crc(const sensor_config_t *cfg) {
+  uint32_t crc = 0;
+  for (int i = 0; i < FIELD_COUNT; i++) {
+    const uint32_t v = field_get(cfg, i);
+    crc = esp_rom_crc32_le(crc, (const uint8_t *)&v, sizeof(v));
+  }
+  return crc;
+}
+
+static void versions_save(void) {
+  nvs_handle_t h;
+  if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h) != ESP_OK) {
+    return;
+  }
+  if (nvs_set_blob(h, "vers", &s_ver, sizeof(s_ver)) == ESP_OK) {
+    nvs_commit(h);
+  }
+  nvs_close(h);
+}
+
+// Fields changed after 'from' (all of them for 0), as one broadcast
+static void send_diff(uint16_t from) {
+  sensor_config_t cfg;
+  sensor_config_get(&cfg);
+
+  cfg_diff_msg_t msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.magic = CFG_MSG_DIFF;
+  msg.ch_id = g_node_id;
+  msg.from = from;
+  msg.to = s_ver.version;
+  msg.crc = config_crc(&cfg);
+  for (int i = 0; i < FIELD_COUNT; i++) {
+    if (from == 0 || s_ver.field_ver[i] > from) {
+      msg.entries[msg.count].id = (uint8_t)i;
+      msg.entries[msg.count].value = field_get(&cfg, i);
+      msg.count++;
+    }
+  }
+  const size_t len =
+      offsetof(cfg_diff_msg_t, entries) + msg.count * sizeof(cfg_entry_t);
+  auth_frame_tag(&msg, len, offsetof(cfg_diff_msg_t, hmac), msg.hmac,
+                 sizeof(msg.hmac));
+  if (esp_now_manager_send_data(ESP_NOW_CLASS_CONTROL, NULL,
+                                (const uint8_t *)&msg, len) == ESP_OK) {
+    s_stats.diffs_sent++;
+    s_stats.diff_bytes += len;
+  }
+  ESP_LOGI(TAG, "Sent config v%u diff from v%u: %u fields, %u B", msg.to,
+           from, msg.count, (unsigned)len);
+}
+
+esp_err_t config_sync_init(void) {
+  // The NVS copy is the active one from boot, so a console change or a
+  // diff starts from what is really stored
+  sensor_config_t cfg;
+  sensor_config_load(&cfg);
+  sensor_config_update(&cfg);
+
+  memset(&s_ver, 0, sizeof(s_ver));
+  nvs_handle_t h;
+  if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) == ESP_OK) {
+    size_t len = sizeof(s_ver);
+    if (nvs_get_blob(h, "vers", &s_ver, &len) != ESP_OK ||
+        len != sizeof(s_ver)) {
+      memset(&s_ver, 0, sizeof(s_ver)); // Field table changed: start over
+    }
+    nvs_close(h);
+  }
+  ESP_LOGI(TAG, "Config v%u, crc %08lx", s_ver.version,
+           (unsigned long)config_crc(&cfg));
+  return ESP_OK;
+}
+
+esp_err_t config_sync_set(const char *key_value) {
+  char buf[128];
+  const size_t len = strlen(key_value);
+  if (len >= sizeof(buf)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  memcpy(buf, key_value, len + 1);
+  char *eq = strchr(buf, '=');
+  if (!eq) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *eq = '\0';
+  const char *key = buf;
+  const char *value = eq + 1;
+
+  int id = 0;
+  while (id < FIELD_COUNT && strcmp(s_fields[id].key, key) != 0) {
+    id++;
+  }
+  if (id == FIELD_COUNT) {
+    ESP_LOGW(TAG, "Unknown config key: %s", key);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  sensor_config_t cfg;
+  sensor_config_get(&cfg);
+  const uint32_t v = (s_fields[id].type == FIELD_BOOL)
+                         ? (atoi(value) != 0)
+                         : (uint32_t)strtoul(value, NULL, 10);
+  if (field_get(&cfg, id) == v) {
+    return ESP_OK; // No new version for a no-op
+  }
+  field_put(&cfg, id, v);
+  sensor_config_update(&cfg);
+  sensor_config_save(&cfg);
+
+  s_ver.version++;
+  s_ver.field_ver[id] = s_ver.version;
+  versions_save();
+  ESP_LOGI(TAG, "Config v%u: %s=%s", s_ver.version, key, value);
+
+  if (g_is_ch) {
+    // Members one version behind take it straight away; the rest see the
+    // new version in our beacon and ask
+    send_diff(s_ver.version - 1);
+  } else {
+    ESP_LOGW(TAG, "Not CH: our CH's config will replace this change");
+  }
+  return ESP_OK;
+}
+
+uint16_t config_sync_version(void) { return s_ver.version; }
+
+static uint16_t local_crc16(void) {
+  sensor_config_t cfg;
+  sensor_config_get(&cfg);
+  return (uint16_t)config_crc(&cfg);
+}
+
+uint16_t config_sync_crc16(void) { return local_crc16(); }
+
+void config_sync_on_ch_beacon(uint32_t ch_id, uint16_t version,
+                              uint16_t crc16) {
+  if (ch_id != neighbor_manager_get_current_ch()) {
+    return;
+  }
+  taskENTER_CRITICAL(&s_mux);
+  s_ch_id = ch_id;
+  s_ch_version = version;
+  s_ch_crc16 = crc16;
+  taskEXIT_CRITICAL(&s_mux);
+}
+
+bool config_sync_handle_frame(const uint8_t *data, int len) {
+  if (len < (int)sizeof(uint32_t)) {
+    return false;
+  }
+  uint32_t magic;
+  memcpy(&magic, data, sizeof(magic));
+
+  if (magic == CFG_MSG_REQUEST && len == sizeof(cfg_request_msg_t)) {
+    cfg_request_msg_t req;
+    memcpy(&req, data, sizeof(req));
+    if (g_is_ch && req.ch_id == g_node_id) {
+      taskENTER_CRITICAL(&s_mux);
+      if (!s_req_pending || req.have < s_req_min) {
+        s_req_min = req.have;
+      }
+      s_req_pending = true;
+      s_stats.requests_heard++;
+      taskEXIT_CRITICAL(&s_mux);
+      state_machine_notify(); // Answer on the next pass, batched
+    }
+    return true;
+  }
+  if (magic == CFG_MSG_DIFF && len >= (int)offsetof(cfg_diff_msg_t, entries) &&
+      len <= (int)sizeof(cfg_diff_msg_t)) {
+    if (!g_is_ch) {
+      taskENTER_CRITICAL(&s_mux);
+      memcpy(&s_rx, data, len);
+      s_rx_len = len;
+      taskEXIT_CRITICAL(&s_mux);
+      state_machine_notify();
+    }
+    return true;
+  }
+  return false;
+}
+
+static bool diff_valid(cfg_diff_msg_t *msg, int len) {
+  uint8_t tag[CFG_SYNC_HMAC_BYTES];
+  if (msg->ch_id != neighbor_manager_get_current_ch() ||
+      msg->count > FIELD_COUNT ||
+      len != (int)(offsetof(cfg_diff_msg_t, entries) +
+                   msg->count * sizeof(cfg_entry_t))) {
+    return false;
+  }
+  auth_frame_tag(msg, len, offsetof(cfg_diff_msg_t, hmac), tag, sizeof(tag));
+  return memcmp(tag, msg->hmac, sizeof(tag)) == 0;
+}
+
+static void apply_diff(cfg_diff_msg_t *msg, int len) {
+  const bool applies = (msg->from == 0)
+                           ? (s_ver.version != msg->to || s_want_full)
+                           : (s_ver.version >= msg->from &&
+                              s_ver.version < msg->to);
+  if (!applies) {
+    return; // Already there, or too far behind for this one
+  }
+  if (!diff_valid(msg, len)) {
+    s_stats.diffs_rejected++;
+    ESP_LOGW(TAG, "Config diff from %lu rejected", (unsigned long)msg->ch_id);
+    return;
+  }
+
+  sensor_config_t cfg;
+  sensor_config_get(&cfg);
+  for (int i = 0; i < msg->count; i++) {
+    const int id = msg->entries[i].id;
+    if (id < FIELD_COUNT) {
+      field_put(&cfg, id, msg->entries[i].value);
+      s_ver.field_ver[id] = msg->to;
+    }
+  }
+  sensor_config_update(&cfg);
+  sensor_config_save(&cfg);
+  s_ver.version = msg->to;
+  versions_save();
+  s_stats.diffs_applied++;
+
+  // Same version number, different history (we came from another
+  // cluster): only a full snapshot fixes that
+  s_want_full = (config_crc(&cfg) != msg->crc);
+  ESP_LOGI(TAG, "Config v%u applied (%u fields)%s", msg->to, msg->count,
+           s_want_full ? ", crc differs: asking for all" : "");
+}
+
+void config_sync_tick(uint64_t now_ms) {
+  if (g_is_ch) {
+    taskENTER_CRITICAL(&s_mux);
+    const bool pending = s_req_pending;
+    uint16_t from = s_req_min;
+    s_req_pending = false;
+    taskEXIT_CRITICAL(&s_mux);
+    if (pending) {
+      // Anyone claiming a version we never issued gets everything
+      send_diff(from > s_ver.version ? 0 : from);
+    }
+    return;
+  }
+  if (g_current_state != STATE_MEMBER) {
+    return;
+  }
+
+  cfg_diff_msg_t msg;
+  taskENTER_CRITICAL(&s_mux);
+  const int len = s_rx_len;
+  if (len > 0) {
+    memcpy(&msg, &s_rx, len);
+  }
+  s_rx_len = 0;
+  taskEXIT_CRITICAL(&s_mux);
+  if (len > 0) {
+    apply_diff(&msg, len);
+  }
+
+  // Same version as our CH but other values: the version says nothing
+  // about which fields differ, so take its config whole
+  if (!s_want_full && config_sync_pending() &&
+      s_ch_version == s_ver.version) {
+    ESP_LOGW(TAG, "Config v%u crc differs from CH's, asking for all",
+             s_ver.version);
+    s_want_full = true;
+  }
+
+  if (config_sync_pending() &&
+      now_ms - s_last_req_ms >= CFG_SYNC_RETRY_MS) {
+    cfg_request_msg_t req = {
+        .magic = CFG_MSG_REQUEST,
+        .ch_id = s_ch_id,
+        // Ahead of our CH (or a diverged history): take its config whole
+        .have = (s_want_full || s_ver.version > s_ch_version) ? 0
+                                                              : s_ver.version,
+    };
+    if (esp_now_manager_send_data(ESP_NOW_CLASS_CONTROL, NULL,
+                                  (const uint8_t *)&req, sizeof(req)) ==
+        ESP_OK) {
+      s_stats.requests_sent++;
+    }
+    s_last_req_ms = now_ms;
+  }
+}
+
+bool config_sync_pending(void) {
+  if (g_current_state != STATE_MEMBER || s_ch_id == 0 ||
+      s_ch_id != neighbor_manager_get_current_ch()) {
+    return false;
+  }
+  return s_want_full || s_ch_version != s_ver.version ||
+         s_ch_crc16 != local_crc16();
+}
+
+void config_sync_log_report(void) {
+  sensor_config_t cfg;
+  sensor_config_get(&cfg);
+  ESP_LOGI(TAG, "Config v%u crc %08lx | CH %lu at v%u crc %04x%s",
+           s_ver.version, (unsigned long)config_crc(&cfg),
+           (unsigned long)s_ch_id, s_ch_version, s_ch_crc16,
+           config_sync_pending() ? " (stale)" : "");
+  ESP_LOGI(TAG,
+           "Diffs sent %lu (%lu B), requests heard %lu | requests sent %lu, "
+           "diffs applied %lu, rejected %lu",
+           (unsigned long)s_stats.diffs_sent, (unsigned long)s_stats.diff_bytes,
+           (unsigned long)s_stats.requests_heard,
+           (unsigned long)s_stats.requests_sent,
+           (unsigned long)s_stats.diffs_applied,
+           (unsigned long)s_stats.diffs_rejected);
+}
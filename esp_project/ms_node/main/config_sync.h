@@ -0,0 +1,109 @@
+#ifndef CONFIG_SYNC_H
+#define CONFIG_SYNC_H
+
+#include "config.h"
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Cluster-wide sensor configuration
+ *
+ * Every distributable sensor_config_t field carries the config version at
+ * which it last changed. A change made on the CH (console CONFIG) bumps the
+ * version and is broadcast at once as a diff; the version also rides in
+ * every beacon. A member whose CH announces a newer version asks for the
+ * fields changed since its own, and the CH answers all such requests of one
+ * state machine pass with a single broadcast diff, so a change reaches the
+ * whole cluster in one round.
+ *
+ * Diffs are authenticated with the cluster key and carry a CRC of the CH's
+ * complete field set; a member whose result does not match (its history came
+ * from another cluster) asks for a full snapshot instead. The beacon carries
+ * the low half of that CRC next to the version, so a member at the CH's
+ * version with different values (a change that never went through
+ * config_sync, or another cluster's history) asks for a snapshot too.
+ */
+
+#define CFG_MSG_REQUEST 0x5243534DU // 'MSCR' member -> broadcast
+#define CFG_MSG_DIFF 0x4443534DU    // 'MSCD' CH -> broadcast
+
+#define CFG_SYNC_MAX_FIELDS 16
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t ch_id;   // CH expected to answer
+  uint16_t have;    // Requester's version; 0 asks for everything
+  uint16_t reserved;
+} cfg_request_msg_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t id; // Index in the field table
+  uint32_t value;
+} cfg_entry_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t ch_id;
+  uint16_t from; // Applies to members at this version or later; 0 = full
+  uint16_t to;   // Version after applying
+  uint32_t crc;  // Of every field value at version 'to'
+  uint8_t count;
+  uint8_t hmac[CFG_SYNC_HMAC_BYTES]; // Over the frame as sent, tag zeroed
+  cfg_entry_t entries[CFG_SYNC_MAX_FIELDS];
+} cfg_diff_msg_t; // Sent only up to entries[count]
+
+/**
+ * @brief Load the active config and field versions from NVS
+ */
+esp_err_t config_sync_init(void);
+
+/**
+ * @brief Apply one "key=value" locally (console). On the CH this starts a
+ * new config version and broadcasts it to the members.
+ */
+esp_err_t config_sync_set(const char *key_value);
+
+/**
+ * @brief Version announced in our beacon
+ */
+uint16_t config_sync_version(void);
+
+/**
+ * @brief Low 16 bits of the CRC of the active config, announced in our
+ * beacon next to the version
+ */
+uint16_t config_sync_crc16(void);
+
+/**
+ * @brief Our CH's beacon announced this version and config CRC (BLE host
+ * task)
+ */
+void config_sync_on_ch_beacon(uint32_t ch_id, uint16_t version,
+                              uint16_t crc16);
+
+/**
+ * @brief Handle an ESP-NOW frame if it belongs to config sync
+ * @return true if consumed (called from the Wi-Fi task)
+ */
+bool config_sync_handle_frame(const uint8_t *data, int len);
+
+/**
+ * @brief Answer pending requests (CH) or apply a received diff and re-ask
+ * while still stale (member); run from the state machine
+ */
+void config_sync_tick(uint64_t now_ms);
+
+/**
+ * @brief true while a member's config differs from its CH's (version or
+ * CRC); it keeps its radio awake so the broadcast answer is not slept
+ * through
+ */
+bool config_sync_pending(void);
+
+/**
+ * @brief Log version, staleness and diff traffic
+ */
+void config_sync_log_report(void);
+
+#endif // CONFIG_SYNC_H
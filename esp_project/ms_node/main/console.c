@@ -0,0 +1,200 @@
+#include "console.h"
+#include "driver/uart.h"
+#include "driver/uart_vfs.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "mem_plan.h"
+#include "sdkconfig.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "CONSOLE";
+
+#define CONSOLE_UART UART_NUM_0
+#define CONSOLE_RX_BUF 512
+#define CONSOLE_EVENT_DEPTH 16
+#define CONSOLE_PATTERN_DEPTH 8 // Lines the driver can hold un-popped
+#define CONSOLE_LINE_MAX 128
+#define CONSOLE_MAX_CMDS 16
+#define CONSOLE_ASYNC_DEPTH 4
+
+typedef struct {
+  const console_cmd_t *cmd;
+  char args[CONSOLE_LINE_MAX];
+} async_job_t;
+
+static const console_cmd_t *s_cmds[CONSOLE_MAX_CMDS];
+static size_t s_cmd_count = 0;
+static QueueHandle_t s_uart_queue = NULL;
+static StackType_t s_rx_stack[4096];
+static StaticTask_t s_rx_tcb;
+// Async handlers run here; BENCH needs room for the codecs
+static StackType_t s_wrk_stack[6144];
+static StaticTask_t s_wrk_tcb;
+static QueueHandle_t s_async_queue = NULL;
+
+esp_err_t console_register(const console_cmd_t *cmds, size_t count) {
+  if (!cmds)
+    return ESP_ERR_INVALID_ARG;
+  if (s_cmd_count + count > CONSOLE_MAX_CMDS)
+    return ESP_ERR_NO_MEM;
+  for (size_t i = 0; i < count; i++) {
+    s_cmds[s_cmd_count++] = &cmds[i];
+  }
+  return ESP_OK;
+}
+
+static const console_cmd_t *find_cmd(const char *name, size_t len) {
+  for (size_t i = 0; i < s_cmd_count; i++) {
+    if (strlen(s_cmds[i]->name) == len &&
+        strncmp(s_cmds[i]->name, name, len) == 0) {
+      return s_cmds[i];
+    }
+  }
+  return NULL;
+}
+
+static void dispatch_line(char *line) {
+  // Trim trailing CR/whitespace and leading blanks
+  size_t n = strlen(line);
+  while (n > 0 && (line[n - 1] == '\r' || line[n - 1] == ' '))
+    line[--n] = '\0';
+  while (*line == ' ')
+    line++;
+  if (*line == '\0')
+    return;
+
+  size_t name_len = strcspn(line, " ");
+  const char *args = line + name_len;
+  while (*args == ' ')
+    args++;
+
+  const console_cmd_t *cmd = find_cmd(line, name_len);
+  if (!cmd) {
+    printf("ERR unknown command\n");
+    return;
+  }
+
+  if (!cmd->async) {
+    cmd->handler(args);
+    return;
+  }
+
+  // Long commands go to the worker so the next line is still read
+  async_job_t job = {.cmd = cmd};
+  strlcpy(job.args, args, sizeof(job.args));
+  if (xQueueSend(s_async_queue, &job, 0) != pdTRUE) {
+    printf("ERR busy\n");
+  }
+}
+
+static void console_worker_task(void *pvParameters) {
+  async_job_t job;
+  for (;;) {
+    if (xQueueReceive(s_async_queue, &job, portMAX_DELAY) == pdTRUE) {
+      job.cmd->handler(job.args);
+    }
+  }
+}
+
+static void console_rx_task(void *pvParameters) {
+  uart_event_t event;
+  char line[CONSOLE_LINE_MAX];
+
+  for (;;) {
+    // Blocks until the driver ISR posts an event; no polling while idle
+    if (xQueueReceive(s_uart_queue, &event, portMAX_DELAY) != pdTRUE)
+      continue;
+
+    switch (event.type) {
+    case UART_PATTERN_DET: {
+      int pos = uart_pattern_pop_pos(CONSOLE_UART);
+      if (pos < 0) {
+        // Pattern queue overflowed; positions are lost, start clean
+        uart_flush_input(CONSOLE_UART);
+        break;
+      }
+      // Line plus its '\n'
+      size_t want = (size_t)pos + 1;
+      if (want > sizeof(line)) {
+        ESP_LOGW(TAG, "Line too long (%u bytes), dropped", (unsigned)want);
+        uint8_t sink[32];
+        while (want > 0) {
+          size_t chunk = want < sizeof(sink) ? want : sizeof(sink);
+          int r = uart_read_bytes(CONSOLE_UART, sink, chunk, 0);
+          if (r <= 0)
+            break;
+          want -= (size_t)r;
+        }
+        break;
+      }
+      int r = uart_read_bytes(CONSOLE_UART, (uint8_t *)line, want,
+                              pdMS_TO_TICKS(20));
+      if (r <= 0)
+        break;
+      line[r - 1] = '\0'; // Replaces the '\n'
+      dispatch_line(line);
+      break;
+    }
+
+    case UART_FIFO_OVF:
+    case UART_BUFFER_FULL:
+      ESP_LOGW(TAG, "RX overflow, input flushed");
+      uart_flush_input(CONSOLE_UART);
+      xQueueReset(s_uart_queue);
+      break;
+
+    default:
+      // UART_DATA etc.: bytes stay buffered until the '\n' arrives
+      break;
+    }
+  }
+}
+
+esp_err_t console_init(void) {
+  if (s_uart_queue)
+    return ESP_OK;
+
+  esp_err_t err = uart_driver_install(CONSOLE_UART, CONSOLE_RX_BUF, 0,
+                                      CONSOLE_EVENT_DEPTH, &s_uart_queue, 0);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "UART driver install failed: %s", esp_err_to_name(err));
+    return err;
+  }
+  // stdout keeps going through the same port, now via the driver
+  uart_vfs_dev_use_driver(CONSOLE_UART);
+
+  // One '\n' per line; 9-bit-time gap so pasted text still splits per line
+  uart_enable_pattern_det_baud_intr(CONSOLE_UART, '\n', 1, 9, 0, 0);
+  uart_pattern_queue_reset(CONSOLE_UART, CONSOLE_PATTERN_DEPTH);
+
+#if CONFIG_PM_ENABLE
+  // RX edges wake the chip from light sleep; the waking bytes are lost, so
+  // hosts should lead a command with a newline.
+  uart_set_wakeup_threshold(CONSOLE_UART, 3);
+  esp_sleep_enable_uart_wakeup(CONSOLE_UART);
+#endif
+
+  s_async_queue = xQueueCreate(CONSOLE_ASYNC_DEPTH, sizeof(async_job_t));
+  if (!s_async_queue)
+    return ESP_ERR_NO_MEM;
+
+  TaskHandle_t rx = xTaskCreateStatic(console_rx_task, "console_rx",
+                                      sizeof(s_rx_stack), NULL,
+                                      tskIDLE_PRIORITY + 2, s_rx_stack,
+                                      &s_rx_tcb);
+  TaskHandle_t wrk = xTaskCreateStatic(console_worker_task, "console_wrk",
+                                       sizeof(s_wrk_stack), NULL,
+                                       tskIDLE_PRIORITY + 1, s_wrk_stack,
+                                       &s_wrk_tcb);
+  if (!rx || !wrk)
+    return ESP_ERR_NO_MEM;
+  mem_plan_watch_task(rx);
+  mem_plan_watch_task(wrk);
+
+  ESP_LOGI(TAG, "Console ready (%u commands)", (unsigned)s_cmd_count);
+  return ESP_OK;
+}
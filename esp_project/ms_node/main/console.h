@@ -0,0 +1,34 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Command handler
+ * @param args Text after the command name (never NULL, may be empty)
+ */
+typedef void (*console_handler_t)(const char *args);
+
+typedef struct {
+  const char *name;          // Matched against the first word of the line
+  console_handler_t handler;
+  bool async; // Run on the worker task (long output, slow I/O)
+} console_cmd_t;
+
+/**
+ * @brief Register a table of commands (call before console_init)
+ * @param cmds Static array, must outlive the console
+ * @param count Number of entries
+ * @return ESP_ERR_NO_MEM if the handler table is full
+ */
+esp_err_t console_register(const console_cmd_t *cmds, size_t count);
+
+/**
+ * @brief Install the UART driver with '\n' pattern detection and start the
+ * receive and worker tasks
+ */
+esp_err_t console_init(void);
+
+#endif // CONSOLE_H
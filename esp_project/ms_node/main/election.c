@@ -2,6 +2,7 @@
 #include "config.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "gossip.h"
 #include "metrics.h"
 #include "neighbor_manager.h"
 #include <math.h>
@@ -265,17 +266,6 @@ static uint32_t election_run_stellar(void) {
   candidates[candidate_count].raw_metrics[1] = uptime_norm;
   candidates[candidate_count].raw_metrics[2] = self_metrics.trust;
   candidates[candidate_count].raw_metrics[3] = self_metrics.link_quality;
-
-  // Apply non-linear utility functions
-  candidates[candidate_count].utility_values[0] =
-      stellar_utility_battery(self_metrics.battery);
-  candidates[candidate_count].utility_values[1] =
-      stellar_utility_uptime(uptime_norm);
-  candidates[candidate_count].utility_values[2] =
-      stellar_utility_trust(self_metrics.trust);
-  candidates[candidate_count].utility_values[3] =
-      stellar_utility_linkq(self_metrics.link_quality);
-
   candidates[candidate_count].centrality =
       compute_centrality(neighbors, neighbor_count);
   candidates[candidate_count].is_self = true;
@@ -285,15 +275,14 @@ static uint32_t election_run_stellar(void) {
 
   // Add neighbors
   for (size_t i = 0; i < neighbor_count; i++) {
-    if (!neighbor_manager_is_in_cluster(&neighbors[i]) ||
-        !neighbors[i].verified) {
-      continue;
-    }
-
-    // Check trust threshold (trust-based filtering)
-    if (neighbors[i].trust < TRUST_FLOOR) {
-      ESP_LOGW(TAG, "[STELLAR] Excluding node_%lu: trust %.2f < threshold %.2f",
-               neighbors[i].node_id, neighbors[i].trust, TRUST_FLOOR);
+    if (!election_is_candidate(&neighbors[i])) {
+      // Log the trust-based exclusions (the others are just out of range)
+      if (neighbors[i].verified &&
+          neighbor_manager_is_in_cluster(&neighbors[i])) {
+        ESP_LOGW(TAG,
+                 "[STELLAR] Excluding node_%lu: trust %.2f < threshold %.2f",
+                 neighbors[i].node_id, neighbors[i].trust, TRUST_FLOOR);
+      }
       continue;
     }
 
@@ -307,17 +296,6 @@ static uint32_t election_run_stellar(void) {
     candidates[candidate_count].raw_metrics[1] = uptime_norm;
     candidates[candidate_count].raw_metrics[2] = neighbors[i].trust;
     candidates[candidate_count].raw_metrics[3] = neighbors[i].link_quality;
-
-    // Apply utility functions
-    candidates[candidate_count].utility_values[0] =
-        stellar_utility_battery(neighbors[i].battery);
-    candidates[candidate_count].utility_values[1] =
-        stellar_utility_uptime(uptime_norm);
-    candidates[candidate_count].utility_values[2] =
-        stellar_utility_trust(neighbors[i].trust);
-    candidates[candidate_count].utility_values[3] =
-        stellar_utility_linkq(neighbors[i].link_quality);
-
     candidates[candidate_count].centrality = 0.8f; // Default for remote nodes
     candidates[candidate_count].is_self = false;
     candidates[candidate_count].on_pareto_frontier = false;
@@ -330,6 +308,28 @@ static uint32_t election_run_stellar(void) {
     return 0;
   }
 
+  // Inputs the candidates gossiped at the start of this phase (ours
+  // included) replace our local view of them, so every node scores from the
+  // same numbers
+  int gossiped = 0;
+  for (size_t i = 0; i < candidate_count; i++) {
+    stellar_candidate_t *c = &candidates[i];
+    float v[GOSSIP_METRICS];
+    if (gossip_lookup(c->node_id, v)) {
+      memcpy(c->raw_metrics, v, sizeof(c->raw_metrics));
+      c->centrality = v[4];
+      gossiped++;
+    }
+
+    // Apply non-linear utility functions
+    c->utility_values[0] = stellar_utility_battery(c->raw_metrics[0]);
+    c->utility_values[1] = stellar_utility_uptime(c->raw_metrics[1]);
+    c->utility_values[2] = stellar_utility_trust(c->raw_metrics[2]);
+    c->utility_values[3] = stellar_utility_linkq(c->raw_metrics[3]);
+  }
+  ESP_LOGI(TAG, "[STELLAR] %d of %zu candidates scored from gossip", gossiped,
+           candidate_count);
+
   // Single candidate (self or only node): always elect as CH
   if (candidate_count == 1) {
     uint32_t sole_winner = candidates[0].node_id;
@@ -628,9 +628,26 @@ uint64_t election_get_window_start(void) { return election_window_start; }
 
 void election_reset_window(void) {
   election_window_start = esp_timer_get_time() / 1000;
+
+  // Our inputs for this phase, frozen so the gossiped view can settle
+  node_metrics_t self_metrics = metrics_get_current();
+  neighbor_entry_t neighbors[MAX_NEIGHBORS];
+  size_t neighbor_count = neighbor_manager_get_all(neighbors, MAX_NEIGHBORS);
+  float uptime_norm =
+      (float)self_metrics.uptime_seconds / (UPTIME_MAX_DAYS * 86400.0f);
+  const float v[GOSSIP_METRICS] = {
+      self_metrics.battery, uptime_norm > 1.0f ? 1.0f : uptime_norm,
+      self_metrics.trust, self_metrics.link_quality,
+      compute_centrality(neighbors, neighbor_count)};
+  gossip_begin_round(v);
   ESP_LOGI(TAG, "Election window reset");
 }
 
+bool election_is_candidate(const neighbor_entry_t *neighbor) {
+  return neighbor->verified && neighbor_manager_is_in_cluster(neighbor) &&
+         neighbor->trust >= TRUST_FLOOR;
+}
+
 void election_init(void) {
   election_window_start = 0;
   election_in_progress = false;
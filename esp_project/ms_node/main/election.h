@@ -1,6 +1,7 @@
 #ifndef ELECTION_H
 #define ELECTION_H
 
+#include "neighbor_manager.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -28,9 +29,16 @@ bool election_check_reelection_needed(void);
 uint64_t election_get_window_start(void);
 
 /**
- * @brief Reset election window
+ * @brief Reset election window (also starts a gossip round with our
+ *        current inputs)
  */
 void election_reset_window(void);
 
+/**
+ * @brief Whether a neighbor takes part in our election (verified, within
+ *        the cluster radius, trusted)
+ */
+bool election_is_candidate(const neighbor_entry_t *neighbor);
+
 #endif // ELECTION_H
 
@@ -0,0 +1,203 @@
+#include "env_fusion.h"
+#include "esp_log.h"
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+
+static const char *TAG = "ENV_FUSION";
+
+enum { Q_TEMP = 0, Q_HUM, Q_COUNT };
+
+// Datasheet accuracy squared: {degC^2, %RH^2}
+static const float s_meas_var[ENV_SENSOR_COUNT][Q_COUNT] = {
+    [ENV_SENSOR_BME280] = {0.25f, 9.0f}, // +-0.5 degC, +-3 %RH
+    [ENV_SENSOR_AHT21] = {0.09f, 4.0f},  // +-0.3 degC, +-2 %RH
+};
+static const float s_process_var[Q_COUNT] = {ENV_FUSION_Q_TEMP,
+                                             ENV_FUSION_Q_HUM};
+
+typedef struct {
+  bool init;
+  float x; // Estimate
+  float p; // Its variance
+} kf_t;
+
+static kf_t s_kf[Q_COUNT];
+static uint64_t s_last_ms = 0;
+static float s_offset[Q_COUNT]; // BME280 minus AHT21
+static uint32_t s_pairs = 0;    // Cross-checks folded into s_offset
+static uint32_t s_since_pair = 0;
+static bool s_recheck = false; // Last pair disagreed
+static bool s_failed[ENV_SENSOR_COUNT];
+static uint32_t s_reads[ENV_SENSOR_COUNT];
+static uint32_t s_skipped = 0, s_disagree = 0, s_relearned = 0;
+
+void env_fusion_plan(const bool allowed[ENV_SENSOR_COUNT],
+                     bool read[ENV_SENSOR_COUNT]) {
+  memset(read, 0, ENV_SENSOR_COUNT * sizeof(read[0]));
+
+  // Primary: the first allowed sensor whose last read worked
+  int primary = -1;
+  for (int s = 0; s < ENV_SENSOR_COUNT; s++) {
+    if (allowed[s] && !s_failed[s]) {
+      primary = s;
+      break;
+    }
+  }
+  if (primary < 0) {
+    // Nothing healthy: try everything we may
+    memcpy(read, allowed, ENV_SENSOR_COUNT * sizeof(read[0]));
+    return;
+  }
+  read[primary] = true;
+
+  bool due = s_recheck || s_since_pair + 1 >= ENV_FUSION_CROSSCHECK_EVERY;
+  for (int s = 0; s < ENV_SENSOR_COUNT; s++) {
+    if (s == primary || !allowed[s]) {
+      continue;
+    }
+    if (due || (s_pairs < ENV_FUSION_WARMUP_PAIRS && !s_failed[s])) {
+      read[s] = true;
+    } else {
+      s_skipped++;
+    }
+  }
+}
+
+// Share of the offset attributed to one sensor, by its variance
+static float bias(env_sensor_t s, int q) {
+  float vb = s_meas_var[ENV_SENSOR_BME280][q];
+  float va = s_meas_var[ENV_SENSOR_AHT21][q];
+  if (s == ENV_SENSOR_BME280) {
+    return s_offset[q] * vb / (vb + va);
+  }
+  return -s_offset[q] * va / (vb + va);
+}
+
+// Compare a BME280/AHT21 pair against the tracked offset.
+// Returns false if the AHT21 reading should not be used this interval.
+static bool cross_check(const env_sample_t *b, const env_sample_t *a) {
+  float d[Q_COUNT] = {b->temp_c - a->temp_c, b->hum_pct - a->hum_pct};
+
+  if (s_pairs == 0) {
+    memcpy(s_offset, d, sizeof(s_offset));
+    s_pairs = 1;
+    return true;
+  }
+
+  bool agree = true;
+  for (int q = 0; q < Q_COUNT; q++) {
+    float spread = sqrtf(s_meas_var[ENV_SENSOR_BME280][q] +
+                         s_meas_var[ENV_SENSOR_AHT21][q]);
+    if (s_pairs >= ENV_FUSION_WARMUP_PAIRS &&
+        fabsf(d[q] - s_offset[q]) > ENV_FUSION_GATE_K * spread) {
+      agree = false;
+    }
+  }
+
+  if (agree) {
+    for (int q = 0; q < Q_COUNT; q++) {
+      s_offset[q] += ENV_FUSION_OFFSET_ALPHA * (d[q] - s_offset[q]);
+    }
+    s_pairs++;
+    s_recheck = false;
+    return true;
+  }
+
+  s_disagree++;
+  if (!s_recheck) {
+    // Check again next interval before believing either sensor moved
+    ESP_LOGW(TAG, "Sensors disagree: dT=%+.2f C dH=%+.1f %% (offset %+.2f, "
+                  "%+.1f)",
+             d[Q_TEMP], d[Q_HUM], s_offset[Q_TEMP], s_offset[Q_HUM]);
+    s_recheck = true;
+    return false;
+  }
+
+  // Second in a row: a real shift, learn the new offset from here
+  ESP_LOGW(TAG, "Sensors still disagree, relearning offset");
+  memcpy(s_offset, d, sizeof(s_offset));
+  s_pairs = 1;
+  s_recheck = false;
+  s_relearned++;
+  return true;
+}
+
+static void kf_update(kf_t *kf, float z, float r) {
+  if (!kf->init) {
+    kf->x = z;
+    kf->p = r;
+    kf->init = true;
+    return;
+  }
+  float k = kf->p / (kf->p + r);
+  kf->x += k * (z - kf->x);
+  kf->p *= 1.0f - k;
+}
+
+bool env_fusion_update(const bool tried[ENV_SENSOR_COUNT],
+                       const env_sample_t samples[ENV_SENSOR_COUNT],
+                       uint64_t now_ms, env_fused_t *out) {
+  bool use[ENV_SENSOR_COUNT];
+  for (int s = 0; s < ENV_SENSOR_COUNT; s++) {
+    use[s] = samples[s].ok;
+    if (tried[s]) {
+      s_failed[s] = !samples[s].ok;
+      if (samples[s].ok) {
+        s_reads[s]++;
+      }
+    }
+  }
+
+  // Predict: the air has had this long to change
+  if (s_last_ms != 0 && now_ms > s_last_ms) {
+    float dt_s = (float)(now_ms - s_last_ms) / 1000.0f;
+    for (int q = 0; q < Q_COUNT; q++) {
+      s_kf[q].p += s_process_var[q] * dt_s;
+    }
+  }
+  s_last_ms = now_ms;
+
+  if (use[ENV_SENSOR_BME280] && use[ENV_SENSOR_AHT21]) {
+    use[ENV_SENSOR_AHT21] = cross_check(&samples[ENV_SENSOR_BME280],
+                                        &samples[ENV_SENSOR_AHT21]);
+    s_since_pair = 0;
+  } else {
+    s_since_pair++;
+  }
+
+  for (int s = 0; s < ENV_SENSOR_COUNT; s++) {
+    if (!use[s]) {
+      continue;
+    }
+    kf_update(&s_kf[Q_TEMP], samples[s].temp_c - bias(s, Q_TEMP),
+              s_meas_var[s][Q_TEMP]);
+    kf_update(&s_kf[Q_HUM], samples[s].hum_pct - bias(s, Q_HUM),
+              s_meas_var[s][Q_HUM]);
+  }
+
+  if (!s_kf[Q_TEMP].init) {
+    return false;
+  }
+  out->temp_c = s_kf[Q_TEMP].x;
+  out->hum_pct = fminf(fmaxf(s_kf[Q_HUM].x, 0.0f), 100.0f);
+  out->temp_sigma = sqrtf(s_kf[Q_TEMP].p);
+  out->hum_sigma = sqrtf(s_kf[Q_HUM].p);
+  return true;
+}
+
+void env_fusion_log_report(void) {
+  if (!s_kf[Q_TEMP].init) {
+    ESP_LOGI(TAG, "No estimate yet");
+  } else {
+    ESP_LOGI(TAG, "T=%.2f +-%.2f C | H=%.1f +-%.1f %%", s_kf[Q_TEMP].x,
+             sqrtf(s_kf[Q_TEMP].p), s_kf[Q_HUM].x, sqrtf(s_kf[Q_HUM].p));
+  }
+  ESP_LOGI(TAG, "Offset BME-AHT T=%+.2f C H=%+.1f %% from %" PRIu32 " pairs",
+           s_offset[Q_TEMP], s_offset[Q_HUM], s_pairs);
+  ESP_LOGI(TAG,
+           "Reads BME=%" PRIu32 " AHT=%" PRIu32 " | secondary skipped %" PRIu32
+           " | disagree %" PRIu32 " relearned %" PRIu32,
+           s_reads[ENV_SENSOR_BME280], s_reads[ENV_SENSOR_AHT21], s_skipped,
+           s_disagree, s_relearned);
+}
@@ -0,0 +1,64 @@
+#ifndef ENV_FUSION_H
+#define ENV_FUSION_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Temperature/humidity fusion of the BME280 and AHT21
+ *
+ * Both sensors measure the same air, so only one (the primary) is read every
+ * env interval. The other is read every ENV_FUSION_CROSSCHECK_EVERY intervals
+ * to track the offset between the two, more often while that offset is still
+ * being learned or after a reading fell outside the expected spread.
+ *
+ * Each quantity is a scalar Kalman filter over a random walk. Readings are
+ * corrected by the sensor's share of the tracked offset (split by datasheet
+ * variance) before the update, so switching the primary does not step the
+ * output. The filter's standard deviation is reported as the confidence.
+ */
+
+typedef enum {
+  ENV_SENSOR_BME280 = 0, // Primary when allowed (also provides pressure)
+  ENV_SENSOR_AHT21,
+  ENV_SENSOR_COUNT
+} env_sensor_t;
+
+typedef struct {
+  bool ok; // Read this interval
+  float temp_c;
+  float hum_pct;
+} env_sample_t;
+
+typedef struct {
+  float temp_c;
+  float hum_pct;
+  float temp_sigma; // 1-sigma, degC
+  float hum_sigma;  // 1-sigma, %RH
+} env_fused_t;
+
+/**
+ * @brief Choose which sensors to read this env interval
+ * @param allowed Sensors the PME mode and sensor config permit
+ * @param read    Set for each sensor to read now
+ */
+void env_fusion_plan(const bool allowed[ENV_SENSOR_COUNT],
+                     bool read[ENV_SENSOR_COUNT]);
+
+/**
+ * @brief Fold this interval's readings into the estimate
+ * @param tried   Sensors env_fusion_plan asked for (a failed read counts
+ *                against the sensor)
+ * @return false until the first reading has been accepted
+ */
+bool env_fusion_update(const bool tried[ENV_SENSOR_COUNT],
+                       const env_sample_t samples[ENV_SENSOR_COUNT],
+                       uint64_t now_ms, env_fused_t *out);
+
+/**
+ * @brief Log the estimate, tracked offsets and cross-check counters
+ */
+void env_fusion_log_report(void);
+
+#endif // ENV_FUSION_H
@@ -1,41 +1,346 @@
 #include "esp_now_manager.h"
+#include "cluster_aggregator.h"
 #include "config.h"
+#include "config_sync.h"
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_now.h"
+#include "esp_now_rate.h"
 #include "esp_wifi.h"
+#include "gossip.h"
+#include "mem_plan.h"
+#include "sdkconfig.h"
 #include "metrics.h"
 #include "neighbor_manager.h"
+#include "ota_mesh.h"
+#include "state_machine.h"
+#include "tx_power.h"
+#include "esp_timer.h"
 #include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <freertos/task.h>
+#include <inttypes.h>
 #include <string.h>
 
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
 static const char *TAG = "ESP_NOW";
 
-static void esp_now_send_cb(const void *arg, esp_now_send_status_t status) {
-  // Update Self Link Quality (PER)
-  // 1.0 for success, 0.0 for failure
-  // metrics_update_per((status == ESP_NOW_SEND_SUCCESS) ? 1.0f : 0.0f); //
-  // REMOVED: Using BLE PER
+// ESP-NOW wake window value that keeps the radio on continuously
+#define WAKE_WINDOW_ALWAYS 65535
+
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t s_radio_pm_lock = NULL;
+#endif
+static bool s_radio_awake = false;
+
+// -----------------------------------------------------------------------------
+// Transmit classes. Producers copy frames into per-class queues; one TX task
+// keeps a single frame in flight (the next goes out from the send callback's
+// signal), so a schedule never waits behind more than one bulk frame.
+// -----------------------------------------------------------------------------
+
+typedef enum {
+  DROP_NEWEST, // Reject the new frame; the producer still holds the data
+  DROP_OLDEST, // Displace the oldest waiting frame; newer supersedes older
+} drop_policy_t;
+
+typedef struct {
+  const char *name;
+  uint8_t depth;
+  drop_policy_t drop;
+  uint16_t max_age_ms; // 0 = never aged out
+} class_cfg_t;
+
+static const class_cfg_t s_class_cfg[ESP_NOW_CLASS_COUNT] = {
+    [ESP_NOW_CLASS_CONTROL] = {"control", ESPNOW_QOS_CONTROL_DEPTH,
+                               DROP_NEWEST, 0},
+    [ESP_NOW_CLASS_REALTIME] = {"realtime", ESPNOW_QOS_REALTIME_DEPTH,
+                                DROP_OLDEST, ESPNOW_QOS_REALTIME_MAX_AGE_MS},
+    [ESP_NOW_CLASS_BULK] = {"bulk", ESPNOW_QOS_BULK_DEPTH, DROP_NEWEST, 0},
+};
+
+typedef struct {
+  int64_t queued_us;
+  uint8_t mac[ESP_NOW_ETH_ALEN];
+  bool broadcast;
+  uint8_t len;
+  uint8_t data[ESP_NOW_MAX_DATA_LEN];
+} tx_item_t;
 
-  // Handle opaque argument (points to struct with MAC as first member)
-  const uint8_t **ptr_to_mac = (const uint8_t **)arg;
-  const uint8_t *mac_addr = *ptr_to_mac;
+// Counters are written by producers and the TX task; each field has one
+// writer in practice, and these are soak statistics
+typedef struct {
+  volatile uint32_t queued, sent, failed, dropped_full, dropped_stale;
+  volatile uint32_t depth_max, latency_max_us;
+  volatile uint64_t latency_total_us;
+} class_stats_t;
 
-  if (mac_addr) {
-    neighbor_entry_t *n = neighbor_manager_get_by_mac(mac_addr);
+static uint8_t s_ctl_storage[ESPNOW_QOS_CONTROL_DEPTH * sizeof(tx_item_t)];
+static uint8_t s_rt_storage[ESPNOW_QOS_REALTIME_DEPTH * sizeof(tx_item_t)];
+static uint8_t s_bulk_storage[ESPNOW_QOS_BULK_DEPTH * sizeof(tx_item_t)];
+static uint8_t *const s_q_storage[ESP_NOW_CLASS_COUNT] = {
+    s_ctl_storage, s_rt_storage, s_bulk_storage};
+static StaticQueue_t s_q_buf[ESP_NOW_CLASS_COUNT];
+static QueueHandle_t s_q[ESP_NOW_CLASS_COUNT];
+static class_stats_t s_stats[ESP_NOW_CLASS_COUNT];
+
+static StackType_t s_tx_stack[3072];
+static StaticTask_t s_tx_tcb;
+static TaskHandle_t s_tx_task = NULL;
+static StaticSemaphore_t s_tx_done_buf;
+static SemaphoreHandle_t s_tx_done = NULL;
+// Held by the TX task while it uses the radio; a Wi-Fi scan takes it to keep
+// frames off the air while the radio hops channels
+static StaticSemaphore_t s_radio_mutex_buf;
+static SemaphoreHandle_t s_radio_mutex = NULL;
+static volatile bool s_radio_wanted = false;
+
+// Broadcasts go to this peer: esp_now_send(NULL) would unicast the frame to
+// every registered neighbor instead, one send callback each
+static const uint8_t s_bcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF,
+                                                       0xFF, 0xFF, 0xFF};
+
+// The frame on air, shared with the send callback. Callbacks arrive in send
+// order; s_orphaned counts the ones still due for frames the TX task timed
+// out on, so they are not taken for the frame now in flight.
+static portMUX_TYPE s_tx_mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool s_inflight = false;
+static uint8_t s_orphaned = 0;
+static uint8_t s_inflight_mac[ESP_NOW_ETH_ALEN];
+static bool s_inflight_unicast = false;
+static int s_inflight_rate = -1;
+static volatile bool s_inflight_ok = false;
+static volatile int64_t s_inflight_done_us = 0;
+
+// Channel in use and the one asked for; the TX task moves between them
+static uint8_t s_channel = ESP_NOW_CHANNEL;
+static volatile uint8_t s_channel_want = ESP_NOW_CHANNEL;
+
+static portMUX_TYPE s_sched_mux = portMUX_INITIALIZER_UNLOCKED;
+static schedule_msg_t s_schedule = {0};
+
+static MEM_HOT_FN void esp_now_send_cb(const void *arg,
+                                       esp_now_send_status_t status) {
+  // Only one frame is ever in flight, so the peer comes from our own record
+  // rather than the callback argument (whose type changed across IDF 5.x)
+  (void)arg;
+  const bool ok = (status == ESP_NOW_SEND_SUCCESS);
+  uint8_t mac[ESP_NOW_ETH_ALEN];
+  taskENTER_CRITICAL(&s_tx_mux);
+  const bool mine = s_inflight && s_orphaned == 0;
+  if (s_orphaned > 0) {
+    s_orphaned--; // Late answer for a frame written off by the TX timeout
+  }
+  const bool unicast = s_inflight_unicast;
+  const int rate = s_inflight_rate;
+  if (mine) {
+    memcpy(mac, s_inflight_mac, sizeof(mac));
+    s_inflight_ok = ok;
+    s_inflight_done_us = esp_timer_get_time();
+    s_inflight = false;
+  }
+  taskEXIT_CRITICAL(&s_tx_mux);
+  if (!mine) {
+    return;
+  }
+
+  if (unicast) {
+    neighbor_entry_t *n = neighbor_manager_get_by_mac(mac);
     if (n) {
-      neighbor_manager_update_trust(n->node_id, status == ESP_NOW_SEND_SUCCESS);
+      neighbor_manager_update_trust(n->node_id, ok);
+    }
+    esp_now_rate_report(mac, rate, ok);
+  }
+  xSemaphoreGive(s_tx_done);
+}
+
+// Strict priority for CONTROL; REALTIME gets ESPNOW_QOS_REALTIME_WEIGHT
+// frames for every BULK frame while both are backlogged. Aged-out frames
+// are dropped here. Returns the class served, or -1 if all queues are empty.
+static int tx_pick(tx_item_t *item) {
+  static int s_rt_run = 0;
+
+  for (;;) {
+    int cls = -1;
+    if (uxQueueMessagesWaiting(s_q[ESP_NOW_CLASS_CONTROL]) > 0) {
+      cls = ESP_NOW_CLASS_CONTROL;
+    } else {
+      const bool rt = uxQueueMessagesWaiting(s_q[ESP_NOW_CLASS_REALTIME]) > 0;
+      const bool bulk = uxQueueMessagesWaiting(s_q[ESP_NOW_CLASS_BULK]) > 0;
+      if (rt && (!bulk || s_rt_run < ESPNOW_QOS_REALTIME_WEIGHT)) {
+        cls = ESP_NOW_CLASS_REALTIME;
+        s_rt_run++;
+      } else if (bulk) {
+        cls = ESP_NOW_CLASS_BULK;
+        s_rt_run = 0;
+      }
+    }
+    if (cls < 0) {
+      return -1;
+    }
+    if (xQueueReceive(s_q[cls], item, 0) != pdTRUE) {
+      continue; // Emptied by a DROP_OLDEST producer meanwhile
+    }
+
+    const uint16_t max_age = s_class_cfg[cls].max_age_ms;
+    if (max_age &&
+        esp_timer_get_time() - item->queued_us > (int64_t)max_age * 1000) {
+      s_stats[cls].dropped_stale++;
+      continue;
     }
+    return cls;
   }
+}
+
+// One transmission and its send callback; true if acknowledged (broadcasts
+// are reported as sent once they leave)
+static bool tx_send(const tx_item_t *item, bool probe_ok, bool *probed) {
+  *probed = false;
+  const uint8_t *mac = item->broadcast ? NULL : item->mac;
+  s_inflight_rate = mac ? esp_now_rate_select(mac, probe_ok, probed) : -1;
+  const int8_t power = tx_power_select(mac, s_inflight_rate);
+  memcpy(s_inflight_mac, mac ? mac : s_bcast_mac, sizeof(s_inflight_mac));
+  s_inflight_unicast = !item->broadcast;
+  s_inflight_ok = false;
+  (void)xSemaphoreTake(s_tx_done, 0); // A give that raced the last timeout
+  s_inflight = true;
+
+  esp_err_t err = esp_now_send(s_inflight_mac, item->data, item->len);
+  if (err != ESP_OK) {
+    s_inflight = false;
+    ESP_LOGW(TAG, "Send error: %s", esp_err_to_name(err));
+    return false;
+  }
+  bool ok = false;
+  if (xSemaphoreTake(s_tx_done, pdMS_TO_TICKS(ESPNOW_TX_DONE_TIMEOUT_MS)) !=
+      pdTRUE) {
+    taskENTER_CRITICAL(&s_tx_mux);
+    const bool lost = s_inflight;
+    if (lost) {
+      s_inflight = false;
+      s_orphaned++; // Its callback is still to come
+    }
+    taskEXIT_CRITICAL(&s_tx_mux);
+    if (!lost) {
+      ok = s_inflight_ok; // Answered just as the wait ran out
+    } else if (s_inflight_unicast) {
+      esp_now_rate_report(item->mac, s_inflight_rate, false);
+    }
+  } else {
+    ok = s_inflight_ok;
+  }
+  tx_power_report(mac, power, s_inflight_rate, item->len, ok, *probed);
+  return ok;
+}
 
-  if (status != ESP_NOW_SEND_SUCCESS) {
-    ESP_LOGW(TAG, "ESP-NOW send failed, status: %d", status);
+// Retune between frames; nothing is in flight here
+static void tx_apply_channel(void) {
+  const uint8_t want = s_channel_want;
+  if (want == s_channel) {
+    return;
   }
+  esp_err_t err = esp_wifi_set_channel(want, WIFI_SECOND_CHAN_NONE);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Channel %u not set: %s", want, esp_err_to_name(err));
+    if (s_channel != 0) {
+      s_channel_want = s_channel; // Still there; otherwise retry next time
+    }
+    return;
+  }
+  ESP_LOGI(TAG, "Channel %u -> %u", s_channel, want);
+  s_channel = want;
 }
 
-static void esp_now_recv_cb(const esp_now_recv_info_t *info,
-                            const uint8_t *data, int len) {
+static void tx_task(void *arg) {
+  static tx_item_t item; // Only this task touches it
+  for (;;) {
+    int cls;
+    xSemaphoreTake(s_radio_mutex, portMAX_DELAY);
+    tx_apply_channel();
+    while (!s_radio_wanted && (cls = tx_pick(&item)) >= 0) {
+      bool probed = false;
+      bool ok = tx_send(&item, true, &probed);
+      if (!ok && probed) {
+        // A failed rate probe costs one retry at the known-good rate, not
+        // the frame
+        ok = tx_send(&item, false, &probed);
+      }
+
+      class_stats_t *st = &s_stats[cls];
+      if (ok) {
+        const uint32_t lat = (uint32_t)(s_inflight_done_us - item.queued_us);
+        st->sent++;
+        st->latency_total_us += lat;
+        if (lat > st->latency_max_us) {
+          st->latency_max_us = lat;
+        }
+      } else {
+        st->failed++;
+        ESP_LOGW(TAG, "%s frame not delivered", s_class_cfg[cls].name);
+      }
+      tx_apply_channel();
+    }
+    xSemaphoreGive(s_radio_mutex);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+
+static void qos_init(void) {
+  esp_now_rate_init();
+  for (int c = 0; c < ESP_NOW_CLASS_COUNT; c++) {
+    s_q[c] = xQueueCreateStatic(s_class_cfg[c].depth, sizeof(tx_item_t),
+                                s_q_storage[c], &s_q_buf[c]);
+  }
+  s_tx_done = xSemaphoreCreateBinaryStatic(&s_tx_done_buf);
+  s_radio_mutex = xSemaphoreCreateMutexStatic(&s_radio_mutex_buf);
+  // Above the state machine (5) so queued control frames go out promptly
+  s_tx_task = xTaskCreateStatic(tx_task, "espnow_tx", sizeof(s_tx_stack),
+                                NULL, 6, s_tx_stack, &s_tx_tcb);
+  mem_plan_watch_task(s_tx_task);
+}
+
+// Slot times arrive on the CH clock; shift them by the sender's queueing
+// instant so they can be compared with our own esp_timer
+static MEM_HOT_FN void store_schedule(const schedule_msg_t *msg) {
+  schedule_msg_t local = *msg;
+  const int64_t now_us = esp_timer_get_time();
+  local.epoch_us = now_us + (msg->epoch_us - msg->sent_us);
+  local.sent_us = now_us;
+
+  taskENTER_CRITICAL(&s_sched_mux);
+  s_schedule = local;
+  taskEXIT_CRITICAL(&s_sched_mux);
+  state_machine_notify();
+}
+
+static MEM_HOT_FN void esp_now_recv_cb(const esp_now_recv_info_t *info,
+                                       const uint8_t *data, int len) {
+  if (len == sizeof(schedule_msg_t)) {
+    schedule_msg_t msg;
+    memcpy(&msg, data, sizeof(msg));
+    if (msg.magic == ESP_NOW_MAGIC_SCHEDULE) {
+      store_schedule(&msg);
+      neighbor_entry_t *n = neighbor_manager_get_by_mac(info->src_addr);
+      if (n) {
+        neighbor_manager_update_trust(n->node_id, true);
+      }
+      ESP_LOGI(TAG, "RX schedule: slot %" PRId32 " x %" PRId32 " s",
+               msg.slot_index, msg.slot_duration_sec);
+      return;
+    }
+  }
+
+  // Firmware update, config and gossip frames carry their own magic and
+  // vary in length
+  if (ota_mesh_handle_frame(info->src_addr, data, len) ||
+      config_sync_handle_frame(data, len) || gossip_handle_frame(data, len)) {
+    return;
+  }
+
   if (len == sizeof(sensor_payload_t)) {
     // It's a sensor packet!
     const sensor_payload_t *payload = (const sensor_payload_t *)data;
@@ -45,6 +350,10 @@ static void esp_now_recv_cb(const esp_now_recv_info_t *info,
              payload->node_id, payload->temp_c, payload->hum_pct, payload->aqi,
              payload->audio_rms);
 
+    if (g_is_ch) {
+      cluster_aggregator_add(payload);
+    }
+
     // Update neighbor trust
     neighbor_entry_t *n = neighbor_manager_get_by_mac(info->src_addr);
     if (n) {
@@ -85,18 +394,37 @@ esp_err_t esp_now_manager_init(void) {
 
   // Set channel (must match other nodes)
   ESP_ERROR_CHECK(esp_wifi_set_channel(ESP_NOW_CHANNEL, WIFI_SECOND_CHAN_NONE));
+  tx_power_init();
 
   // Enable power save for coexistence
   ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_MIN_MODEM));
 
   // Initialize ESP-NOW
+  qos_init();
   ESP_ERROR_CHECK(esp_now_init());
   ESP_ERROR_CHECK(esp_now_register_send_cb((esp_now_send_cb_t)esp_now_send_cb));
   ESP_ERROR_CHECK(esp_now_register_recv_cb(esp_now_recv_cb));
+  ESP_ERROR_CHECK(esp_now_manager_register_peer(s_bcast_mac, false));
 
   // Set PMK (Primary Master Key)
   ESP_ERROR_CHECK(esp_now_set_pmk((uint8_t *)ESP_NOW_PMK));
 
+  // Radio duty cycle used while not held awake (see set_radio_awake)
+  esp_err_t err =
+      esp_wifi_connectionless_module_set_wake_interval(ESPNOW_WAKE_INTERVAL_MS);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Wake interval not set: %s", esp_err_to_name(err));
+  }
+#if CONFIG_PM_ENABLE
+  if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "espnow",
+                         &s_radio_pm_lock) != ESP_OK) {
+    ESP_LOGW(TAG, "Radio PM lock not created");
+    s_radio_pm_lock = NULL;
+  }
+#endif
+  // Awake until the state machine settles into MEMBER
+  esp_now_manager_set_radio_awake(true);
+
   ESP_LOGI(TAG, "ESP-NOW initialized on channel %d", ESP_NOW_CHANNEL);
   return ESP_OK;
 }
@@ -106,7 +434,7 @@ esp_err_t esp_now_manager_register_peer(const uint8_t *peer_addr,
   esp_now_peer_info_t peer;
   memset(&peer, 0, sizeof(esp_now_peer_info_t));
   memcpy(peer.peer_addr, peer_addr, ESP_NOW_ETH_ALEN);
-  peer.channel = ESP_NOW_CHANNEL;
+  peer.channel = 0; // Whatever channel we are on (see set_channel)
   peer.ifidx = WIFI_IF_STA;
   peer.encrypt = encrypt;
 
@@ -121,7 +449,153 @@ esp_err_t esp_now_manager_register_peer(const uint8_t *peer_addr,
   return esp_now_add_peer(&peer);
 }
 
-esp_err_t esp_now_manager_send_data(const uint8_t *peer_addr,
+esp_err_t esp_now_manager_send_data(esp_now_class_t cls,
+                                    const uint8_t *peer_addr,
                                     const uint8_t *data, size_t len) {
-  return esp_now_send(peer_addr, data, len);
+  if ((unsigned)cls >= ESP_NOW_CLASS_COUNT || !data || len == 0 ||
+      len > ESP_NOW_MAX_DATA_LEN) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!s_tx_task) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  tx_item_t item;
+  item.queued_us = esp_timer_get_time();
+  item.broadcast = (peer_addr == NULL);
+  if (peer_addr) {
+    memcpy(item.mac, peer_addr, ESP_NOW_ETH_ALEN);
+  }
+  item.len = (uint8_t)len;
+  memcpy(item.data, data, len);
+
+  class_stats_t *st = &s_stats[cls];
+  if (xQueueSend(s_q[cls], &item, 0) != pdTRUE) {
+    st->dropped_full++;
+    if (s_class_cfg[cls].drop == DROP_NEWEST) {
+      return ESP_ERR_NO_MEM;
+    }
+    tx_item_t oldest;
+    (void)xQueueReceive(s_q[cls], &oldest, 0);
+    if (xQueueSend(s_q[cls], &item, 0) != pdTRUE) {
+      return ESP_ERR_NO_MEM;
+    }
+  }
+
+  st->queued++;
+  const uint32_t depth = uxQueueMessagesWaiting(s_q[cls]);
+  if (depth > st->depth_max) {
+    st->depth_max = depth;
+  }
+  xTaskNotifyGive(s_tx_task);
+  return ESP_OK;
+}
+
+size_t esp_now_manager_queue_free(esp_now_class_t cls) {
+  if ((unsigned)cls >= ESP_NOW_CLASS_COUNT || !s_q[cls]) {
+    return 0;
+  }
+  return uxQueueSpacesAvailable(s_q[cls]);
+}
+
+schedule_msg_t esp_now_get_current_schedule(void) {
+  taskENTER_CRITICAL(&s_sched_mux);
+  schedule_msg_t sched = s_schedule;
+  taskEXIT_CRITICAL(&s_sched_mux);
+  return sched;
+}
+
+esp_err_t esp_now_manager_get_class_stats(esp_now_class_t cls,
+                                          esp_now_class_stats_t *out) {
+  if ((unsigned)cls >= ESP_NOW_CLASS_COUNT || !out) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  const class_stats_t *st = &s_stats[cls];
+  out->queued = st->queued;
+  out->sent = st->sent;
+  out->failed = st->failed;
+  out->dropped_full = st->dropped_full;
+  out->dropped_stale = st->dropped_stale;
+  out->depth = s_q[cls] ? uxQueueMessagesWaiting(s_q[cls]) : 0;
+  out->depth_max = st->depth_max;
+  out->latency_avg_us =
+      st->sent ? (uint32_t)(st->latency_total_us / st->sent) : 0;
+  out->latency_max_us = st->latency_max_us;
+  return ESP_OK;
+}
+
+void esp_now_manager_log_report(void) {
+  ESP_LOGI(TAG, "Channel %u", s_channel);
+  esp_now_rate_log_report();
+  tx_power_log_report();
+  for (int c = 0; c < ESP_NOW_CLASS_COUNT; c++) {
+    esp_now_class_stats_t st;
+    esp_now_manager_get_class_stats((esp_now_class_t)c, &st);
+    ESP_LOGI(TAG,
+             "%-8s queued=%" PRIu32 " sent=%" PRIu32 " failed=%" PRIu32
+             " drop full=%" PRIu32 " stale=%" PRIu32 " | depth=%" PRIu32
+             "/%u max=%" PRIu32 " | latency avg=%" PRIu32 "us max=%" PRIu32
+             "us",
+             s_class_cfg[c].name, st.queued, st.sent, st.failed,
+             st.dropped_full, st.dropped_stale, st.depth,
+             (unsigned)s_class_cfg[c].depth, st.depth_max, st.latency_avg_us,
+             st.latency_max_us);
+  }
+}
+
+void esp_now_manager_set_channel(uint8_t channel) {
+  if (channel < 1 || channel > 13) {
+    return;
+  }
+  s_channel_want = channel;
+  if (s_tx_task) {
+    xTaskNotifyGive(s_tx_task);
+  }
+}
+
+uint8_t esp_now_manager_get_channel(void) { return s_channel_want; }
+
+void esp_now_manager_radio_hold(void) {
+  if (!s_radio_mutex) {
+    return;
+  }
+  // The TX task checks this between frames and gives the mutex back
+  s_radio_wanted = true;
+  xSemaphoreTake(s_radio_mutex, portMAX_DELAY);
+}
+
+void esp_now_manager_radio_release(void) {
+  if (!s_radio_mutex) {
+    return;
+  }
+  // The radio was left wherever the scan stopped; force the retune
+  s_channel = 0;
+  s_radio_wanted = false;
+  xSemaphoreGive(s_radio_mutex);
+  if (s_tx_task) {
+    xTaskNotifyGive(s_tx_task);
+  }
+}
+
+void esp_now_manager_set_radio_awake(bool awake) {
+  if (awake == s_radio_awake) {
+    return;
+  }
+  s_radio_awake = awake;
+
+#if CONFIG_PM_ENABLE
+  if (s_radio_pm_lock) {
+    if (awake) {
+      esp_pm_lock_acquire(s_radio_pm_lock);
+    } else {
+      esp_pm_lock_release(s_radio_pm_lock);
+    }
+  }
+#endif
+  esp_err_t err = esp_now_set_wake_window(awake ? WAKE_WINDOW_ALWAYS
+                                                : ESPNOW_WAKE_WINDOW_MS);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Wake window not set: %s", esp_err_to_name(err));
+  }
+  ESP_LOGD(TAG, "Radio %s", awake ? "held awake" : "duty-cycled");
 }
@@ -3,6 +3,7 @@
 
 #include "esp_err.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 // Data structure for cluster messages
@@ -12,6 +13,40 @@ typedef struct {
   uint8_t payload[240]; // Max ESP-NOW payload is 250 bytes
 } cluster_message_t;
 
+// TDMA slot assignment, unicast by the CH to each member. epoch_us and
+// sent_us are on the CH clock; the receiver rebases epoch_us onto its own
+// clock, so esp_now_get_current_schedule() is in local esp_timer time.
+#define ESP_NOW_MAGIC_SCHEDULE 0x44484353U // 'SCHD'
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;   // ESP_NOW_MAGIC_SCHEDULE
+  int64_t epoch_us; // Start of slot 0
+  int64_t sent_us;  // When the CH queued this message
+  int32_t slot_index;
+  int32_t slot_duration_sec;
+} schedule_msg_t;
+
+// Transmit classes, served strict-priority for CONTROL and weighted
+// (ESPNOW_QOS_REALTIME_WEIGHT : 1) between REALTIME and BULK.
+typedef enum {
+  ESP_NOW_CLASS_CONTROL = 0, // Schedules; tail drop, never aged out
+  ESP_NOW_CLASS_REALTIME,    // Live readings; oldest dropped, aged out
+  ESP_NOW_CLASS_BULK,        // History bursts; tail drop, caller retries
+  ESP_NOW_CLASS_COUNT
+} esp_now_class_t;
+
+typedef struct {
+  uint32_t queued;         // Accepted into the class queue
+  uint32_t sent;           // Send callback reported success
+  uint32_t failed;         // Send error, callback failure or timeout
+  uint32_t dropped_full;   // Rejected or displaced by a full queue
+  uint32_t dropped_stale;  // Aged out before reaching the radio
+  uint32_t depth;          // Frames waiting now
+  uint32_t depth_max;
+  uint32_t latency_avg_us; // Queued until the send callback
+  uint32_t latency_max_us;
+} esp_now_class_stats_t;
+
 /**
  * @brief Initialize ESP-NOW and Wi-Fi
  *
@@ -29,14 +64,83 @@ esp_err_t esp_now_manager_init(void);
 esp_err_t esp_now_manager_register_peer(const uint8_t *peer_addr, bool encrypt);
 
 /**
- * @brief Send data to a specific peer
+ * @brief Queue data for a specific peer
  *
- * @param peer_addr MAC address of the peer (NULL for broadcast)
+ * The frame is copied; it goes on air from the ESP-NOW TX task once every
+ * frame of a higher class has gone. ESP_OK means queued, not delivered.
+ *
+ * @param cls Transmit class
+ * @param peer_addr MAC address of the peer (NULL: one broadcast frame to
+ *        FF:FF:FF:FF:FF:FF, not a copy per registered peer)
  * @param data Pointer to data buffer
- * @param len Length of data
- * @return esp_err_t ESP_OK on success
+ * @param len Length of data (at most ESP_NOW_MAX_DATA_LEN)
+ * @return esp_err_t ESP_OK if queued, ESP_ERR_NO_MEM if the class queue is
+ * full and its policy is tail drop
  */
-esp_err_t esp_now_manager_send_data(const uint8_t *peer_addr,
+esp_err_t esp_now_manager_send_data(esp_now_class_t cls,
+                                    const uint8_t *peer_addr,
                                     const uint8_t *data, size_t len);
 
+/**
+ * @brief Free slots in a class queue, for producers that pace themselves
+ */
+size_t esp_now_manager_queue_free(esp_now_class_t cls);
+
+/**
+ * @brief Latest schedule from the CH (magic is 0 if none was received)
+ */
+schedule_msg_t esp_now_get_current_schedule(void);
+
+esp_err_t esp_now_manager_get_class_stats(esp_now_class_t cls,
+                                          esp_now_class_stats_t *out);
+
+/**
+ * @brief Log the channel, per-peer PHY rates and TX power, and per-class
+ * queue and latency statistics
+ */
+void esp_now_manager_log_report(void);
+
+/**
+ * @brief Hold the radio (and the system) awake, or let it duty-cycle
+ *
+ * Awake takes a no-light-sleep PM lock and keeps the ESP-NOW wake window
+ * open; otherwise the radio only listens for ESPNOW_WAKE_WINDOW_MS every
+ * ESPNOW_WAKE_INTERVAL_MS and the chip may enter automatic light sleep.
+ * Call from the state machine task only.
+ *
+ * @param awake true for CH / election / slot bursts, false for idle MEMBER
+ */
+void esp_now_manager_set_radio_awake(bool awake);
+
+/**
+ * @brief Move ESP-NOW to another Wi-Fi channel
+ *
+ * The TX task retunes between frames, so the frame on air is not cut off.
+ * Peers are registered on "the current channel" and follow.
+ *
+ * @param channel 1-13
+ */
+void esp_now_manager_set_channel(uint8_t channel);
+
+/**
+ * @brief Channel ESP-NOW is on (or is about to move to)
+ */
+uint8_t esp_now_manager_get_channel(void);
+
+/**
+ * @brief Keep ESP-NOW frames off the air, e.g. for a blocking Wi-Fi scan
+ *
+ * Returns once the frame in flight (if any) is done; queued frames wait.
+ * Must be paired with esp_now_manager_radio_release().
+ */
+void esp_now_manager_radio_hold(void);
+
+/**
+ * @brief Hand the radio back to ESP-NOW
+ *
+ * The TX task retunes to the ESP-NOW channel before its next frame, since
+ * whatever held the radio may have left it on another channel.
+ */
+void esp_now_manager_radio_release(void);
+
 #endif // ESP_NOW_MANAGER_H
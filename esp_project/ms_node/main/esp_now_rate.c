@@ -0,0 +1,253 @@
+#include "esp_now_rate.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "esp_random.h"
+#include "mem_plan.h"
+#include <string.h>
+
+static const char *TAG = "ESP_NOW_RATE";
+
+#define RATE_PEERS MAX_NEIGHBORS
+
+// 802.11 header, action/vendor element and FCS around the ESP-NOW payload
+#define FRAME_OVERHEAD_BYTES 43
+
+typedef struct {
+  wifi_phy_rate_t phy;
+  wifi_phy_mode_t mode;
+  uint16_t kbps;
+  int8_t sens_dbm; // Receiver sensitivity (ESP32-S3 datasheet, typical)
+} rate_def_t;
+
+// Slowest (most robust) first; selection walks down from the top
+static const rate_def_t s_rates[] = {
+    {WIFI_PHY_RATE_1M_L, WIFI_PHY_MODE_11B, 1000, -98},
+    {WIFI_PHY_RATE_2M_L, WIFI_PHY_MODE_11B, 2000, -96},
+    {WIFI_PHY_RATE_5M_L, WIFI_PHY_MODE_11B, 5500, -93},
+    {WIFI_PHY_RATE_6M, WIFI_PHY_MODE_11G, 6000, -93},
+    {WIFI_PHY_RATE_11M_L, WIFI_PHY_MODE_11B, 11000, -88},
+    {WIFI_PHY_RATE_12M, WIFI_PHY_MODE_11G, 12000, -90},
+    {WIFI_PHY_RATE_18M, WIFI_PHY_MODE_11G, 18000, -88},
+    {WIFI_PHY_RATE_24M, WIFI_PHY_MODE_11G, 24000, -85},
+    {WIFI_PHY_RATE_36M, WIFI_PHY_MODE_11G, 36000, -82},
+    {WIFI_PHY_RATE_48M, WIFI_PHY_MODE_11G, 48000, -78},
+    {WIFI_PHY_RATE_54M, WIFI_PHY_MODE_11G, 54000, -76},
+};
+#define RATE_COUNT ((int)(sizeof(s_rates) / sizeof(s_rates[0])))
+
+typedef struct {
+  float ewma;      // Delivery ratio; < 0 until the first full window
+  uint8_t att, ok; // Current window
+  uint32_t total_att, total_ok;
+} rate_stat_t;
+
+typedef struct {
+  bool used;
+  uint8_t mac[ESP_NOW_ETH_ALEN];
+  uint8_t best;   // Fastest rate meeting the target
+  int8_t applied; // Rate currently set in the driver, -1 for its default
+  uint32_t frames;
+  uint32_t probes;
+  uint32_t changes;
+  uint32_t last_use; // s_clock value, for eviction
+  rate_stat_t r[RATE_COUNT];
+} peer_rate_t;
+
+static peer_rate_t s_peers[RATE_PEERS];
+static uint32_t s_clock = 0;
+
+void esp_now_rate_init(void) {
+  memset(s_peers, 0, sizeof(s_peers));
+  s_clock = 0;
+}
+
+static peer_rate_t *find_peer(const uint8_t *mac) {
+  for (int i = 0; i < RATE_PEERS; i++) {
+    if (s_peers[i].used &&
+        memcmp(s_peers[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+      return &s_peers[i];
+    }
+  }
+  return NULL;
+}
+
+// Reuse the least recently used entry once the table is full
+static peer_rate_t *claim_peer(const uint8_t *mac) {
+  peer_rate_t *victim = &s_peers[0];
+  for (int i = 0; i < RATE_PEERS; i++) {
+    if (!s_peers[i].used) {
+      victim = &s_peers[i];
+      break;
+    }
+    if (s_peers[i].last_use < victim->last_use) {
+      victim = &s_peers[i];
+    }
+  }
+  memset(victim, 0, sizeof(*victim));
+  victim->used = true;
+  victim->applied = -1;
+  memcpy(victim->mac, mac, ESP_NOW_ETH_ALEN);
+  for (int r = 0; r < RATE_COUNT; r++) {
+    victim->r[r].ewma = -1.0f;
+  }
+  return victim;
+}
+
+// Fastest rate whose delivery ratio meets the target; the most robust rate
+// when none does yet. The current rate keeps its place down to
+// ESPNOW_RATE_HYST_PDR below the target, so one unlucky window on a good
+// link does not start a walk down the ladder.
+static uint8_t pick_best(const peer_rate_t *p) {
+  for (int r = RATE_COUNT - 1; r > 0; r--) {
+    const float need = (r == p->best)
+                           ? ESPNOW_RATE_TARGET_PDR - ESPNOW_RATE_HYST_PDR
+                           : ESPNOW_RATE_TARGET_PDR;
+    if (p->r[r].ewma >= need) {
+      return (uint8_t)r;
+    }
+  }
+  return 0;
+}
+
+// A rate above the current best: mostly the next one up (lookaround),
+// sometimes any of them (Minstrel's random sampling)
+static int pick_probe(const peer_rate_t *p) {
+  if (p->best + 1 >= RATE_COUNT) {
+    return -1;
+  }
+  if (p->r[p->best + 1].ewma < 0.0f || (esp_random() & 3) != 0) {
+    return p->best + 1;
+  }
+  return p->best + 1 + (int)(esp_random() % (RATE_COUNT - p->best - 1));
+}
+
+int esp_now_rate_select(const uint8_t *mac, bool probe_ok, bool *probed) {
+  *probed = false;
+  peer_rate_t *p = find_peer(mac);
+  if (!p) {
+    p = claim_peer(mac);
+  }
+  p->last_use = ++s_clock;
+
+  // Until the rate above the best has a full window, every other frame
+  // probes it, so a new peer climbs the ladder within a few dozen frames
+  const bool exploring =
+      p->best + 1 < RATE_COUNT && p->r[p->best + 1].ewma < 0.0f;
+  const bool probe_now = exploring
+                             ? (p->frames++ & 1)
+                             : (esp_random() % 100) < ESPNOW_RATE_PROBE_PCT;
+
+  int rate = p->best;
+  if (probe_ok && probe_now) {
+    const int probe = pick_probe(p);
+    if (probe >= 0) {
+      rate = probe;
+      *probed = true;
+      p->probes++;
+    }
+  }
+
+  if (rate != p->applied) {
+    esp_now_rate_config_t cfg = {
+        .phymode = s_rates[rate].mode,
+        .rate = s_rates[rate].phy,
+        .ersu = false,
+        .dcm = false,
+    };
+    esp_err_t err = esp_now_set_peer_rate_config(mac, &cfg);
+    if (err != ESP_OK) {
+      // Not registered (yet); the driver keeps its default rate (1 Mbps),
+      // which must not be credited to any rate's statistics
+      ESP_LOGD(TAG, "Rate not set for " MACSTR ": %s", MAC2STR(mac),
+               esp_err_to_name(err));
+      p->applied = -1;
+      *probed = false;
+      return -1;
+    }
+    p->applied = (int8_t)rate;
+  }
+  return rate;
+}
+
+MEM_HOT_FN void esp_now_rate_report(const uint8_t *mac, int rate_idx,
+                                    bool ok) {
+  peer_rate_t *p = find_peer(mac);
+  if (!p || rate_idx < 0 || rate_idx >= RATE_COUNT) {
+    return;
+  }
+  rate_stat_t *st = &p->r[rate_idx];
+  st->att++;
+  st->total_att++;
+  if (ok) {
+    st->ok++;
+    st->total_ok++;
+  }
+  if (st->att < ESPNOW_RATE_WINDOW) {
+    return;
+  }
+
+  // Fold the window into the EWMA (Minstrel keeps 75% of the history)
+  const float ratio = (float)st->ok / (float)st->att;
+  st->ewma = (st->ewma < 0.0f) ? ratio : 0.75f * st->ewma + 0.25f * ratio;
+  st->att = 0;
+  st->ok = 0;
+
+  const uint8_t best = pick_best(p);
+  if (best != p->best) {
+    p->best = best;
+    p->changes++;
+  }
+}
+
+static uint32_t airtime_us(int rate, size_t len) {
+  const uint32_t bits = (uint32_t)(len + FRAME_OVERHEAD_BYTES) * 8;
+  const uint32_t kbps = s_rates[rate].kbps;
+  if (s_rates[rate].mode == WIFI_PHY_MODE_11B) {
+    return 192 + bits * 1000 / kbps; // Long preamble + PLCP header
+  }
+  // OFDM: preamble + SIGNAL, then 4 us symbols carrying SERVICE + tail too
+  const uint32_t bits_per_sym = kbps * 4 / 1000;
+  return 20 + 4 * ((16 + bits + 6 + bits_per_sym - 1) / bits_per_sym);
+}
+
+uint32_t esp_now_rate_airtime_us(const uint8_t *mac, size_t len) {
+  const peer_rate_t *p = find_peer(mac);
+  return airtime_us(p ? p->best : 0, len);
+}
+
+// Broadcasts and unregistered peers go out at the driver default (1 Mbps)
+uint32_t esp_now_rate_frame_airtime_us(int rate_idx, size_t len) {
+  return airtime_us((rate_idx >= 0 && rate_idx < RATE_COUNT) ? rate_idx : 0,
+                    len);
+}
+
+int esp_now_rate_sensitivity_dbm(int rate_idx) {
+  return s_rates[(rate_idx >= 0 && rate_idx < RATE_COUNT) ? rate_idx : 0]
+      .sens_dbm;
+}
+
+void esp_now_rate_log_report(void) {
+  for (int i = 0; i < RATE_PEERS; i++) {
+    const peer_rate_t *p = &s_peers[i];
+    if (!p->used) {
+      continue;
+    }
+    const rate_stat_t *st = &p->r[p->best];
+    uint32_t att = 0, ok = 0;
+    for (int r = 0; r < RATE_COUNT; r++) {
+      att += p->r[r].total_att;
+      ok += p->r[r].total_ok;
+    }
+    ESP_LOGI(TAG,
+             MACSTR " rate=%u.%u Mbps pdr=%d%% airtime(250B)=%u us | "
+                    "frames=%u delivered=%u%% probes=%u changes=%u",
+             MAC2STR(p->mac), s_rates[p->best].kbps / 1000,
+             (s_rates[p->best].kbps % 1000) / 100,
+             st->ewma < 0.0f ? -1 : (int)(st->ewma * 100.0f + 0.5f),
+             (unsigned)airtime_us(p->best, ESP_NOW_MAX_DATA_LEN),
+             (unsigned)att, att ? (unsigned)(ok * 100 / att) : 0,
+             (unsigned)p->probes, (unsigned)p->changes);
+  }
+}
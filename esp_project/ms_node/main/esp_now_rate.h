@@ -0,0 +1,70 @@
+#ifndef ESP_NOW_RATE_H
+#define ESP_NOW_RATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Per-peer PHY rate control (Minstrel-style)
+ *
+ * Every unicast frame is sent at the fastest rate whose EWMA delivery ratio
+ * stays at or above ESPNOW_RATE_TARGET_PDR; about ESPNOW_RATE_PROBE_PCT of
+ * frames go out at a faster rate to find out whether the link allows it.
+ * Called by the ESP-NOW TX task with one frame in flight, so select and
+ * report always alternate for a peer.
+ */
+
+/**
+ * @brief Clear all peer state
+ */
+void esp_now_rate_init(void);
+
+/**
+ * @brief Pick and apply (esp_now_set_peer_rate_config) the rate for the
+ * next frame to a registered peer
+ * @param mac Peer MAC address
+ * @param probe_ok false to force the best known rate (e.g. a retry)
+ * @param probed Set if the frame goes out at a probe rate
+ * @return Rate index to pass back to esp_now_rate_report(), -1 if the rate
+ *         could not be set and the frame goes out at 1 Mbps
+ */
+int esp_now_rate_select(const uint8_t *mac, bool probe_ok, bool *probed);
+
+/**
+ * @brief Record the send callback outcome of a frame
+ * @param mac Peer MAC address
+ * @param rate_idx Value returned by esp_now_rate_select() for that frame
+ * @param ok true if the frame was acknowledged
+ */
+void esp_now_rate_report(const uint8_t *mac, int rate_idx, bool ok);
+
+/**
+ * @brief Estimated air time of one frame to a peer at its current rate
+ * @param mac Peer MAC address
+ * @param len ESP-NOW payload length
+ * @return Microseconds (1 Mbps estimate for unknown peers)
+ */
+uint32_t esp_now_rate_airtime_us(const uint8_t *mac, size_t len);
+
+/**
+ * @brief Air time of one frame at a given rate
+ * @param rate_idx Value returned by esp_now_rate_select(), < 0 for 1 Mbps
+ * @param len ESP-NOW payload length
+ * @return Microseconds
+ */
+uint32_t esp_now_rate_frame_airtime_us(int rate_idx, size_t len);
+
+/**
+ * @brief Receiver sensitivity a frame at this rate needs
+ * @param rate_idx Value returned by esp_now_rate_select(), < 0 for 1 Mbps
+ * @return dBm
+ */
+int esp_now_rate_sensitivity_dbm(int rate_idx);
+
+/**
+ * @brief Log each peer's rate, delivery ratio and probe counts
+ */
+void esp_now_rate_log_report(void);
+
+#endif // ESP_NOW_RATE_H
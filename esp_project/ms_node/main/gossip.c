@@ -0,0 +1,395 @@
+#include "gossip.h"
+#include "auth.h"
+#include "election.h"
+#include "esp_log.h"
+#include "esp_now_manager.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "neighbor_manager.h"
+#include "state_machine.h"
+#include <freertos/FreeRTOS.h>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+static const char *TAG = "GOSSIP";
+
+
+#define GOSSIP_RX_SLOTS 4 // Digests buffered between state machine passes
+
+typedef struct {
+  gossip_entry_t e;
+  uint64_t heard_ms;
+} known_t;
+
+typedef struct {
+  uint32_t node_id;
+  uint32_t view;     // Hash in its last digest
+  bool counts_us;    // We were among its entries
+  uint64_t heard_ms; // When that digest was merged
+} peer_t;
+
+// Latest vector of every node heard of, ourselves at index 0
+static known_t s_known[GOSSIP_MAX_ENTRIES];
+static size_t s_known_count = 0;
+static peer_t s_peers[MAX_NEIGHBORS];
+
+static uint32_t s_view = 0;
+static uint64_t s_view_since_ms = 0;
+static uint64_t s_round_start_ms = 0;
+static uint64_t s_next_tx_ms = 0;
+static bool s_round_converged = false;
+static bool s_round_lopsided = false; // Counted by a node we do not count
+
+static gossip_msg_t s_rx[GOSSIP_RX_SLOTS];
+static int s_rx_len[GOSSIP_RX_SLOTS];
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static struct {
+  uint32_t sent;
+  uint32_t merged;
+  uint32_t rejected;
+  uint32_t dropped; // Rx slots full
+  uint32_t rounds;
+  uint32_t converged;
+  uint32_t lopsided;
+  uint64_t converge_ms_total;
+} s_stats;
+
+static uint8_t quantize(float v) {
+  if (v < 0.0f)
+    v = 0.0f;
+  if (v > 1.0f)
+    v = 1.0f;
+  return (uint8_t)lroundf(v * 255.0f);
+}
+
+static known_t *known_find(uint32_t node_id) {
+  for (size_t i = 0; i < s_known_count; i++) {
+    if (s_known[i].e.node_id == node_id) {
+      return &s_known[i];
+    }
+  }
+  return NULL;
+}
+
+// Full table: the longest-unheard other node makes room
+static known_t *known_slot(uint32_t node_id) {
+  known_t *k = known_find(node_id);
+  if (k != NULL) {
+    return k;
+  }
+  if (s_known_count < GOSSIP_MAX_ENTRIES) {
+    k = &s_known[s_known_count++];
+  } else {
+    k = &s_known[1];
+    for (size_t i = 2; i < s_known_count; i++) {
+      if (s_known[i].heard_ms < k->heard_ms) {
+        k = &s_known[i];
+      }
+    }
+  }
+  memset(k, 0, sizeof(*k));
+  k->e.node_id = node_id;
+  return k;
+}
+
+// Our candidates: ourselves plus every neighbor the election would count,
+// sorted by node id so equal sets hash alike everywhere
+static size_t candidate_ids(uint32_t *ids) {
+  neighbor_entry_t neighbors[MAX_NEIGHBORS];
+  const size_t count = neighbor_manager_get_all(neighbors, MAX_NEIGHBORS);
+  size_t n = 0;
+  ids[n++] = g_node_id;
+  for (size_t i = 0; i < count; i++) {
+    if (election_is_candidate(&neighbors[i])) {
+      ids[n++] = neighbors[i].node_id;
+    }
+  }
+  for (size_t i = 1; i < n; i++) {
+    for (size_t j = i; j > 0 && ids[j - 1] > ids[j]; j--) {
+      const uint32_t t = ids[j];
+      ids[j] = ids[j - 1];
+      ids[j - 1] = t;
+    }
+  }
+  return n;
+}
+
+// FNV-1a over (node id, version) of each candidate; 0 = not heard yet
+static uint32_t view_hash(const uint32_t *ids, size_t n) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < n; i++) {
+    const known_t *k = known_find(ids[i]);
+    const uint16_t ver = k ? k->e.version : 0;
+    uint8_t b[6];
+    memcpy(b, &ids[i], 4);
+    memcpy(b + 4, &ver, 2);
+    for (int j = 0; j < 6; j++) {
+      h = (h ^ b[j]) * 16777619u;
+    }
+  }
+  return h;
+}
+
+void gossip_begin_round(const float metrics[GOSSIP_METRICS]) {
+  const uint64_t now_ms = esp_timer_get_time() / 1000;
+  known_t *self = &s_known[0];
+  if (s_known_count == 0) {
+    s_known_count = 1;
+    // Random start: a rebooted node must not reuse versions others hold
+    self->e.version = (uint16_t)esp_random();
+  }
+  self->e.node_id = g_node_id;
+  self->e.version++;
+  for (int i = 0; i < GOSSIP_METRICS; i++) {
+    self->e.m[i] = quantize(metrics[i]);
+  }
+  self->heard_ms = now_ms;
+
+  s_round_start_ms = now_ms;
+  s_view = 0;
+  s_view_since_ms = now_ms;
+  s_next_tx_ms = now_ms; // Announce the new version at once
+  s_round_converged = false;
+  s_round_lopsided = false;
+  s_stats.rounds++;
+}
+
+bool gossip_handle_frame(const uint8_t *data, int len) {
+  if (len < (int)sizeof(uint32_t)) {
+    return false;
+  }
+  uint32_t magic;
+  memcpy(&magic, data, sizeof(magic));
+  if (magic != GOSSIP_MSG_DIGEST) {
+    return false;
+  }
+  if (len < (int)offsetof(gossip_msg_t, entries) ||
+      len > (int)sizeof(gossip_msg_t) ||
+      g_current_state != STATE_CANDIDATE) {
+    return true;
+  }
+
+  bool queued = false;
+  taskENTER_CRITICAL(&s_mux);
+  for (int i = 0; i < GOSSIP_RX_SLOTS; i++) {
+    if (s_rx_len[i] == 0) {
+      memcpy(&s_rx[i], data, len);
+      s_rx_len[i] = len;
+      queued = true;
+      break;
+    }
+  }
+  if (!queued) {
+    s_stats.dropped++;
+  }
+  taskEXIT_CRITICAL(&s_mux);
+  if (queued) {
+    state_machine_notify();
+  }
+  return true;
+}
+
+static void merge(gossip_msg_t *msg, int len, uint64_t now_ms) {
+  uint8_t tag[GOSSIP_HMAC_BYTES];
+  if (s_known_count == 0) {
+    return; // Slot 0 is ours; nothing to compare against before a round
+  }
+  if (msg->sender == g_node_id || msg->count > GOSSIP_MAX_ENTRIES ||
+      len != (int)(offsetof(gossip_msg_t, entries) +
+                   msg->count * sizeof(gossip_entry_t))) {
+    s_stats.rejected++;
+    return;
+  }
+  auth_frame_tag(msg, len, offsetof(gossip_msg_t, hmac), tag, sizeof(tag));
+  if (memcmp(tag, msg->hmac, sizeof(tag)) != 0) {
+    s_stats.rejected++;
+    return;
+  }
+
+  bool counts_us = false;
+  for (int i = 0; i < msg->count; i++) {
+    const gossip_entry_t *e = &msg->entries[i];
+    if (e->node_id == g_node_id) {
+      counts_us = true;
+      continue;
+    }
+    known_t *k = known_find(e->node_id);
+    // A node's own entry is authoritative (it may have rebooted); relayed
+    // ones only replace an older version
+    const bool own = (e->node_id == msg->sender);
+    if (k == NULL || own || (int16_t)(e->version - k->e.version) > 0) {
+      k = known_slot(e->node_id);
+      k->e = *e;
+      k->heard_ms = now_ms;
+    }
+  }
+
+  peer_t *p = NULL;
+  for (int i = 0; i < MAX_NEIGHBORS; i++) {
+    if (s_peers[i].node_id == msg->sender) {
+      p = &s_peers[i];
+      break;
+    }
+    if (p == NULL || s_peers[i].heard_ms < p->heard_ms) {
+      p = &s_peers[i]; // Free or oldest slot, unless the sender is found
+    }
+  }
+  p->node_id = msg->sender;
+  p->view = msg->view;
+  p->counts_us = counts_us;
+  p->heard_ms = now_ms;
+  s_stats.merged++;
+}
+
+static void send_digest(const uint32_t *ids, size_t n) {
+  gossip_msg_t msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.magic = GOSSIP_MSG_DIGEST;
+  msg.sender = g_node_id;
+  msg.view = s_view;
+  for (size_t i = 0; i < n; i++) {
+    const known_t *k = known_find(ids[i]);
+    if (k != NULL) {
+      msg.entries[msg.count++] = k->e;
+    }
+  }
+  const size_t len =
+      offsetof(gossip_msg_t, entries) + msg.count * sizeof(gossip_entry_t);
+  auth_frame_tag(&msg, len, offsetof(gossip_msg_t, hmac), msg.hmac,
+                 sizeof(msg.hmac));
+  if (esp_now_manager_send_data(ESP_NOW_CLASS_CONTROL, NULL,
+                                (const uint8_t *)&msg, len) == ESP_OK) {
+    s_stats.sent++;
+  }
+}
+
+void gossip_tick(uint64_t now_ms) {
+  for (int i = 0; i < GOSSIP_RX_SLOTS; i++) {
+    gossip_msg_t msg;
+    taskENTER_CRITICAL(&s_mux);
+    const int len = s_rx_len[i];
+    if (len > 0) {
+      memcpy(&msg, &s_rx[i], len);
+    }
+    s_rx_len[i] = 0;
+    taskEXIT_CRITICAL(&s_mux);
+    if (len > 0) {
+      merge(&msg, len, now_ms);
+    }
+  }
+  if (s_round_start_ms == 0) {
+    return;
+  }
+
+  uint32_t ids[GOSSIP_MAX_ENTRIES];
+  const size_t n = candidate_ids(ids);
+  const uint32_t view = view_hash(ids, n);
+  if (view != s_view) {
+    // News travels at once, not on the next period
+    s_view = view;
+    s_view_since_ms = now_ms;
+    s_next_tx_ms = now_ms;
+  }
+  if (now_ms >= s_next_tx_ms) {
+    send_digest(ids, n);
+    s_next_tx_ms = now_ms + GOSSIP_INTERVAL_MS -
+                   GOSSIP_INTERVAL_MS / 4 +
+                   esp_random() % (GOSSIP_INTERVAL_MS / 2);
+  }
+}
+
+// A node that counts us but is not among our candidates hears a different
+// neighbourhood (asymmetric link, multi-hop layout). Agreement among the
+// nodes we do count says nothing about its decision, so the round keeps the
+// plain window once one has been heard.
+static void check_lopsided(const uint32_t *ids, size_t n) {
+  for (int j = 0; j < MAX_NEIGHBORS && !s_round_lopsided; j++) {
+    const peer_t *p = &s_peers[j];
+    if (p->node_id == 0 || !p->counts_us ||
+        p->heard_ms < s_round_start_ms) {
+      continue;
+    }
+    bool counted = false;
+    for (size_t i = 1; i < n; i++) {
+      counted |= (ids[i] == p->node_id);
+    }
+    if (!counted) {
+      s_round_lopsided = true;
+      s_stats.lopsided++;
+      ESP_LOGI(TAG, "Node %lu counts us but is not a candidate here, "
+                    "keeping the full window",
+               (unsigned long)p->node_id);
+    }
+  }
+}
+
+bool gossip_converged(uint64_t now_ms) {
+  if (s_round_start_ms == 0) {
+    return false;
+  }
+  uint32_t ids[GOSSIP_MAX_ENTRIES];
+  const size_t n = candidate_ids(ids);
+  check_lopsided(ids, n);
+  if (s_round_lopsided ||
+      now_ms - s_round_start_ms < GOSSIP_MIN_WINDOW_MS ||
+      now_ms - s_view_since_ms < GOSSIP_QUIET_MS) {
+    return false;
+  }
+
+  if (view_hash(ids, n) != s_view) {
+    return false; // Changed since the last tick
+  }
+  // Every candidate has told us, since our view settled, that it sees
+  // exactly what we see
+  for (size_t i = 1; i < n; i++) {
+    bool agreed = false;
+    for (int j = 0; j < MAX_NEIGHBORS; j++) {
+      if (s_peers[j].node_id == ids[i]) {
+        agreed = s_peers[j].view == s_view &&
+                 s_peers[j].heard_ms >= s_view_since_ms;
+        break;
+      }
+    }
+    if (!agreed) {
+      return false;
+    }
+  }
+
+  if (!s_round_converged) {
+    s_round_converged = true;
+    s_stats.converged++;
+    s_stats.converge_ms_total += now_ms - s_round_start_ms;
+    ESP_LOGI(TAG, "View of %u candidate(s) agreed after %llu ms", (unsigned)n,
+             (unsigned long long)(now_ms - s_round_start_ms));
+  }
+  return true;
+}
+
+bool gossip_lookup(uint32_t node_id, float metrics[GOSSIP_METRICS]) {
+  const known_t *k = known_find(node_id);
+  if (k == NULL) {
+    return false;
+  }
+  for (int i = 0; i < GOSSIP_METRICS; i++) {
+    metrics[i] = k->e.m[i] / 255.0f;
+  }
+  return true;
+}
+
+void gossip_log_report(void) {
+  ESP_LOGI(TAG,
+           "Rounds %lu, ended early %lu (mean %llu ms), lopsided %lu | "
+           "digests sent %lu, merged %lu, rejected %lu, dropped %lu | %u "
+           "node(s) known",
+           (unsigned long)s_stats.rounds, (unsigned long)s_stats.converged,
+           (unsigned long long)(s_stats.converged
+                                    ? s_stats.converge_ms_total /
+                                          s_stats.converged
+                                    : 0),
+           (unsigned long)s_stats.lopsided,
+           (unsigned long)s_stats.sent, (unsigned long)s_stats.merged,
+           (unsigned long)s_stats.rejected, (unsigned long)s_stats.dropped,
+           (unsigned)s_known_count);
+}
@@ -0,0 +1,79 @@
+#ifndef GOSSIP_H
+#define GOSSIP_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Election metric gossip
+ *
+ * At the start of each candidate phase a node freezes its election inputs
+ * (battery, uptime, trust, link quality, centrality) under a new version and
+ * broadcasts them over ESP-NOW together with the freshest vectors it holds
+ * for its other candidates. Every node therefore scores every candidate from
+ * the same numbers instead of its own beacon view of them.
+ *
+ * Each digest also carries a hash of the sender's candidate set and versions.
+ * Once ours has not changed for GOSSIP_QUIET_MS and every candidate reports
+ * the same hash, all of us would elect the same winner, so the candidate
+ * phase ends early. ELECTION_WINDOW_MS remains the cap for views that never
+ * agree, and the whole phase once a node that counts us turned out to be
+ * missing from our set this round.
+ */
+
+#define GOSSIP_MSG_DIGEST 0x4447534DU // 'MSGD' candidate -> broadcast
+
+#define GOSSIP_METRICS 5 // battery, uptime, trust, link quality, centrality
+#define GOSSIP_MAX_ENTRIES (MAX_NEIGHBORS + 1)
+
+typedef struct __attribute__((packed)) {
+  uint32_t node_id;
+  uint16_t version;          // Originator's round; newer replaces older
+  uint8_t m[GOSSIP_METRICS]; // 0..255 = 0.0..1.0
+} gossip_entry_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t sender;
+  uint32_t view; // Hash of the sender's candidates and their versions
+  uint8_t count;
+  uint8_t hmac[GOSSIP_HMAC_BYTES]; // Over the frame as sent, tag zeroed
+  gossip_entry_t entries[GOSSIP_MAX_ENTRIES];
+} gossip_msg_t; // Sent only up to entries[count]
+
+/**
+ * @brief Start a candidate phase with our own inputs frozen under a new
+ *        version (called when the election window opens)
+ */
+void gossip_begin_round(const float metrics[GOSSIP_METRICS]);
+
+/**
+ * @brief Handle an ESP-NOW frame if it is a gossip digest
+ * @return true if consumed (called from the Wi-Fi task)
+ */
+bool gossip_handle_frame(const uint8_t *data, int len);
+
+/**
+ * @brief Merge received digests and send ours when due; run from the state
+ *        machine while a candidate
+ */
+void gossip_tick(uint64_t now_ms);
+
+/**
+ * @brief true once our view has been quiet and agreed by every candidate
+ */
+bool gossip_converged(uint64_t now_ms);
+
+/**
+ * @brief Latest gossiped vector for a node (ourselves included)
+ * @return false if the node has never been heard gossiping
+ */
+bool gossip_lookup(uint32_t node_id, float metrics[GOSSIP_METRICS]);
+
+/**
+ * @brief Log digest traffic and how candidate phases ended
+ */
+void gossip_log_report(void);
+
+#endif // GOSSIP_H
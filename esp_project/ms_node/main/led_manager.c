@@ -5,6 +5,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "led_strip.h"
+#include "mem_plan.h"
 
 // GPIO for WS2812 RGB LED on ESP32-S3-DevKitC-1
 #define LED_GPIO 48
@@ -13,12 +14,33 @@
 static const char *TAG = "LED_MANAGER";
 
 static TaskHandle_t led_task_handle = NULL;
+static StackType_t led_task_stack[4096];
+static StaticTask_t led_task_tcb;
 static led_strip_handle_t led_strip;
 static volatile node_state_t current_led_state = STATE_INIT;
 static volatile node_state_t pending_led_state = STATE_INIT;
 static uint64_t pending_since_us = 0;
 
+// Solid colours are written once and the task then sleeps until the state
+// changes, so it does not keep waking the CPU out of light sleep.
+static void led_hold_solid(uint8_t r, uint8_t g, uint8_t b, bool *shown) {
+  if (!*shown) {
+    if (r | g | b) {
+      led_strip_set_pixel(led_strip, 0, r, g, b);
+    } else {
+      led_strip_clear(led_strip);
+    }
+    led_strip_refresh(led_strip);
+    *shown = true;
+  }
+  TickType_t wait = (pending_led_state != current_led_state)
+                        ? pdMS_TO_TICKS(LED_DEBOUNCE_MS)
+                        : portMAX_DELAY;
+  (void)ulTaskNotifyTake(pdTRUE, wait);
+}
+
 static void led_task(void *pvParameters) {
+  bool solid_shown = false;
   while (1) {
     uint64_t now_us = esp_timer_get_time();
     uint64_t pending_duration_us = now_us - pending_since_us;
@@ -32,6 +54,7 @@ static void led_task(void *pvParameters) {
       }
       if (pending_duration_us >= (uint64_t)required_ms * 1000ULL) {
         current_led_state = pending_led_state;
+        solid_shown = false;
         ESP_LOGI(TAG, "LED applied state: %d", (int)current_led_state);
       }
     }
@@ -39,9 +62,7 @@ static void led_task(void *pvParameters) {
     case STATE_CH:
       // CH = SOLID BLUE
       // Standard RGB Mapping verified.
-      led_strip_set_pixel(led_strip, 0, 0, 0, 50); // Blue
-      led_strip_refresh(led_strip);
-      vTaskDelay(pdMS_TO_TICKS(1000));
+      led_hold_solid(0, 0, 50, &solid_shown); // Blue
       break;
 
     case STATE_MEMBER:
@@ -72,9 +93,7 @@ static void led_task(void *pvParameters) {
     case STATE_SLEEP:
     default:
       // OFF
-      led_strip_clear(led_strip);
-      led_strip_refresh(led_strip);
-      vTaskDelay(pdMS_TO_TICKS(1000));
+      led_hold_solid(0, 0, 0, &solid_shown);
       break;
     }
   }
@@ -104,12 +123,18 @@ void led_manager_init(void) {
   led_strip_clear(led_strip);
 
   // Create task for LED control
-  xTaskCreate(led_task, "led_task", 4096, NULL, 1, &led_task_handle);
+  led_task_handle = xTaskCreateStatic(led_task, "led_task",
+                                      sizeof(led_task_stack), NULL, 1,
+                                      led_task_stack, &led_task_tcb);
+  mem_plan_watch_task(led_task_handle);
 }
 
 void led_manager_set_state(node_state_t state) {
   if (pending_led_state != state) {
     pending_led_state = state;
     pending_since_us = esp_timer_get_time();
+    if (led_task_handle) {
+      xTaskNotifyGive(led_task_handle);
+    }
   }
 }
@@ -0,0 +1,452 @@
+#include "mag_events.h"
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "gy271_sensor.h"
+#include "logger.h"
+#include "mem_plan.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "MAG_EVENTS";
+
+#define SAMPLE_MS (1000 / MAG_EVENT_ODR_HZ)
+#define MS_TO_SAMPLES(ms) (((ms) * MAG_EVENT_ODR_HZ + 999) / 1000)
+#define PRE_SAMPLES MS_TO_SAMPLES(MAG_EVENT_PRE_MS)
+#define RELEASE_SAMPLES MS_TO_SAMPLES(MAG_EVENT_RELEASE_MS)
+#define MAX_SAMPLES MS_TO_SAMPLES(MAG_EVENT_MAX_MS)
+#define WARMUP_SAMPLES (MAG_EVENT_WARMUP_S * MAG_EVENT_ODR_HZ)
+#define WINDOW_SAMPLES (PRE_SAMPLES + MAX_SAMPLES)
+#define RING_SAMPLES (WINDOW_SAMPLES + 1)
+#define BASE_ALPHA (1.0f / (MAG_EVENT_ODR_HZ * MAG_EVENT_BASELINE_TAU_S))
+
+// No DRDY for this long: read anyway (pin not wired, or a level was missed)
+#define DRDY_TIMEOUT_MS (4 * SAMPLE_MS + 10)
+// Samples found only by those reads, in a row, before giving up on the pin.
+// The detector counts samples at MAG_EVENT_ODR_HZ, which a timeout-paced
+// read (about a quarter of that) cannot deliver.
+#define DRDY_LOST_LIMIT 10
+
+// Event line: header plus up to 7 characters ("-12345,") per axis value
+#define LINE_BYTES (256 + WINDOW_SAMPLES * 3 * 7)
+
+typedef struct {
+  int16_t v[3];
+} mag_sample_t;
+
+// Ring of recent raw samples (stream task only)
+static mag_sample_t *s_ring = NULL;
+static uint32_t s_head = 0; // Next write
+static uint32_t s_seen = 0; // Since streaming started
+
+// Detector (stream task only)
+static float s_base[3];   // Baseline, raw counts
+static float s_noise_var; // Squared deviation while quiet
+static uint8_t s_over = 0;
+static uint64_t s_over_ms; // First sample of the current s_over run
+static uint64_t s_last_ms;
+static bool s_in_event = false;
+static float s_thr;         // Open threshold frozen for the event
+static uint32_t s_win_len;  // Window so far, pre-trigger history included
+static uint32_t s_quiet;    // Consecutive samples under the release level
+static uint64_t s_start_ms;
+static float s_peak;
+static mag_sample_t s_peak_v;
+
+// Closed window waiting for the store task
+static mag_sample_t *s_win = NULL;
+static uint32_t s_win_n, s_win_pre;
+static int16_t s_win_base[3];
+static mag_event_t s_win_ev;
+static volatile bool s_win_busy = false;
+static char *s_line = NULL;
+
+// Shared with the main loop and console
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static mag_event_t s_latest;
+static bool s_latest_new = false;
+static float s_base_ut[3];
+static bool s_base_ready = false;
+static volatile bool s_want = false;
+static volatile bool s_running = false;
+static bool s_drdy_lost = false; // Streaming refused until reboot
+static uint32_t s_undetected = 0;
+static uint32_t s_samples, s_polled, s_overruns, s_read_errors;
+static uint32_t s_events, s_rebased, s_dropped, s_stored;
+
+static TaskHandle_t s_stream_task = NULL;
+static StackType_t s_stream_stack[3072];
+static StaticTask_t s_stream_tcb;
+static TaskHandle_t s_store_task = NULL;
+static StackType_t s_store_stack[4096];
+static StaticTask_t s_store_tcb;
+
+static void IRAM_ATTR drdy_isr(void *arg) {
+  BaseType_t high_task_wakeup = pdFALSE;
+  // Level interrupt (shared with the light-sleep wake config): masked until
+  // the stream task has read the sample, which drops DRDY.
+  gpio_intr_disable(MAG_DRDY_GPIO);
+  vTaskNotifyGiveFromISR(s_stream_task, &high_task_wakeup);
+  if (high_task_wakeup == pdTRUE)
+    portYIELD_FROM_ISR();
+}
+
+static float deviation(const mag_sample_t *s) {
+  float sum = 0.0f;
+  for (int i = 0; i < 3; i++) {
+    float d = (float)s->v[i] - s_base[i];
+    sum += d * d;
+  }
+  return sqrtf(sum);
+}
+
+static void update_baseline(const mag_sample_t *s, float dev) {
+  // Running mean until the time constant is reached
+  float alpha = (s_seen < MAG_EVENT_ODR_HZ * MAG_EVENT_BASELINE_TAU_S)
+                    ? 1.0f / (float)s_seen
+                    : BASE_ALPHA;
+  for (int i = 0; i < 3; i++) {
+    s_base[i] += alpha * ((float)s->v[i] - s_base[i]);
+  }
+  if (s_seen > 1) {
+    // The first deviation is from an empty baseline
+    s_noise_var += alpha * (dev * dev - s_noise_var);
+  }
+
+  float ut[3];
+  for (int i = 0; i < 3; i++) {
+    ut[i] = s_base[i] * GY271_UT_PER_LSB;
+  }
+  taskENTER_CRITICAL(&s_mux);
+  memcpy(s_base_ut, ut, sizeof(s_base_ut));
+  s_base_ready = s_seen >= WARMUP_SAMPLES;
+  taskEXIT_CRITICAL(&s_mux);
+}
+
+// Copy the window out of the ring and wake the store task
+static void close_event(const mag_sample_t *last, bool rebase) {
+  s_in_event = false;
+  s_over = 0;
+  s_events++;
+
+  mag_event_t ev = {
+      .start_ms = s_start_ms,
+      .dur_ms = (uint32_t)(s_last_ms - s_start_ms) + SAMPLE_MS,
+      .samples = (uint16_t)s_win_len,
+      .peak_ut = s_peak * GY271_UT_PER_LSB,
+  };
+  for (int i = 0; i < 3; i++) {
+    ev.field_ut[i] = s_peak_v.v[i] * GY271_UT_PER_LSB;
+  }
+
+  if (s_win_busy) {
+    s_dropped++;
+  } else {
+    uint32_t first = (s_head + RING_SAMPLES - s_win_len) % RING_SAMPLES;
+    for (uint32_t i = 0; i < s_win_len; i++) {
+      s_win[i] = s_ring[(first + i) % RING_SAMPLES];
+    }
+    s_win_n = s_win_len;
+    for (int i = 0; i < 3; i++) {
+      s_win_base[i] = (int16_t)lroundf(s_base[i]);
+    }
+    s_win_ev = ev;
+    s_win_busy = true;
+    xTaskNotifyGive(s_store_task);
+  }
+
+  taskENTER_CRITICAL(&s_mux);
+  s_latest = ev;
+  s_latest_new = true;
+  taskEXIT_CRITICAL(&s_mux);
+
+  if (rebase) {
+    // Still off after MAG_EVENT_MAX_MS: something parked, not passing
+    for (int i = 0; i < 3; i++) {
+      s_base[i] = last->v[i];
+    }
+    s_rebased++;
+  }
+}
+
+static void process_sample(const mag_sample_t *s, uint64_t now_ms) {
+  s_ring[s_head] = *s;
+  s_head = (s_head + 1) % RING_SAMPLES;
+  s_seen++;
+  s_samples++;
+  s_last_ms = now_ms;
+
+  float dev = deviation(s);
+
+  if (s_in_event) {
+    s_win_len++;
+    if (dev > s_peak) {
+      s_peak = dev;
+      s_peak_v = *s;
+    }
+    s_quiet = (dev < 0.5f * s_thr) ? s_quiet + 1 : 0;
+    if (s_quiet >= RELEASE_SAMPLES) {
+      close_event(s, false);
+    } else if (s_win_len - s_win_pre >= MAX_SAMPLES ||
+               now_ms - s_start_ms >= MAG_EVENT_MAX_MS) {
+      close_event(s, true);
+    }
+    return;
+  }
+
+  float thr = fmaxf(MAG_EVENT_MIN_UT / GY271_UT_PER_LSB,
+                    MAG_EVENT_K * sqrtf(s_noise_var));
+  if (s_seen > WARMUP_SAMPLES && dev > thr) {
+    if (s_over == 0) {
+      s_over_ms = now_ms;
+    }
+    if (++s_over >= MAG_EVENT_TRIGGER_SAMPLES) {
+      s_in_event = true;
+      s_thr = thr;
+      s_quiet = 0;
+      s_peak = dev;
+      s_peak_v = *s;
+      s_start_ms = s_over_ms;
+      // History ahead of the trigger, as far as the ring has it
+      uint32_t before = s_seen - s_over;
+      s_win_pre = before < PRE_SAMPLES ? before : PRE_SAMPLES;
+      s_win_len = s_win_pre + s_over;
+    }
+    return; // Keep the baseline clear of a possible event's leading edge
+  }
+  s_over = 0;
+  update_baseline(s, dev);
+}
+
+static void apply_active(bool on) {
+  if (on) {
+    esp_err_t err = gy271_start_continuous(MAG_EVENT_ODR_HZ);
+    if (err != ESP_OK) {
+      ESP_LOGW(TAG, "Streaming not started: %s", esp_err_to_name(err));
+      s_want = false;
+      return;
+    }
+    s_seen = 0;
+    s_over = 0;
+    s_undetected = 0;
+    s_in_event = false;
+    s_noise_var = 0.0f;
+    memset(s_base, 0, sizeof(s_base));
+    taskENTER_CRITICAL(&s_mux);
+    s_base_ready = false;
+    taskEXIT_CRITICAL(&s_mux);
+    s_running = true;
+    gpio_wakeup_enable(MAG_DRDY_GPIO, GPIO_INTR_HIGH_LEVEL);
+    gpio_intr_enable(MAG_DRDY_GPIO);
+  } else {
+    gpio_intr_disable(MAG_DRDY_GPIO);
+    gpio_wakeup_disable(MAG_DRDY_GPIO);
+    if (s_in_event) {
+      close_event(&s_ring[(s_head + RING_SAMPLES - 1) % RING_SAMPLES], false);
+    }
+    (void)gy271_standby();
+    s_running = false;
+  }
+  if (on) {
+    ESP_LOGI(TAG, "Streaming at %u Hz", (unsigned)MAG_EVENT_ODR_HZ);
+  } else {
+    ESP_LOGI(TAG, "Streaming off");
+  }
+}
+
+static void stream_task(void *pvParameters) {
+  for (;;) {
+    TickType_t wait =
+        s_running ? pdMS_TO_TICKS(DRDY_TIMEOUT_MS) : portMAX_DELAY;
+    bool drdy = ulTaskNotifyTake(pdTRUE, wait) > 0;
+
+    if (s_want != s_running) {
+      apply_active(s_want);
+      continue;
+    }
+    if (!s_running) {
+      continue;
+    }
+    if (!drdy) {
+      s_polled++;
+    }
+
+    mag_sample_t s;
+    uint8_t st = 0;
+    if (gy271_read_fast(s.v, &st) != ESP_OK) {
+      // DRDY stays high until a read succeeds; re-enabling the level
+      // interrupt now would spin this task on the bus
+      s_read_errors++;
+      vTaskDelay(pdMS_TO_TICKS(SAMPLE_MS) + 1);
+    } else if (st & GY271_STATUS_DRDY) {
+      if (st & GY271_STATUS_DOR) {
+        s_overruns++;
+      }
+      s_undetected = drdy ? 0 : s_undetected + 1;
+      if (s_undetected >= DRDY_LOST_LIMIT) {
+        ESP_LOGW(TAG, "No DRDY on GPIO %d, falling back to polled reads",
+                 MAG_DRDY_GPIO);
+        s_drdy_lost = true;
+        s_want = false;
+        apply_active(false);
+        continue;
+      }
+      process_sample(&s, esp_timer_get_time() / 1000ULL);
+    }
+    gpio_intr_enable(MAG_DRDY_GPIO);
+  }
+}
+
+// Event line: raw-count deviations from the baseline, axis-interleaved
+static void store_window(void) {
+  const mag_event_t *ev = &s_win_ev;
+  size_t pos = 0;
+  int n = snprintf(s_line, LINE_BYTES,
+                   "{\"ts_ms\":%llu,\"mag_event\":{\"odr\":%u,\"n\":%" PRIu32
+                   ",\"pre\":%" PRIu32 ",\"dur_ms\":%" PRIu32
+                   ",\"peak_ut\":%.2f,\"lsb_ut\":%.7f,\"base\":[%d,%d,%d],"
+                   "\"d\":[",
+                   (unsigned long long)ev->start_ms, (unsigned)MAG_EVENT_ODR_HZ,
+                   s_win_n,
+                   s_win_pre, ev->dur_ms, ev->peak_ut, GY271_UT_PER_LSB,
+                   s_win_base[0], s_win_base[1], s_win_base[2]);
+  if (n < 0 || n >= LINE_BYTES) {
+    return;
+  }
+  pos = (size_t)n;
+  for (uint32_t i = 0; i < s_win_n && pos < LINE_BYTES; i++) {
+    for (int a = 0; a < 3 && pos < LINE_BYTES; a++) {
+      int d = s_win[i].v[a] - s_win_base[a];
+      n = snprintf(s_line + pos, LINE_BYTES - pos, "%s%d",
+                   (i == 0 && a == 0) ? "" : ",", d);
+      pos += (n > 0) ? (size_t)n : 0;
+    }
+  }
+  n = (pos < LINE_BYTES) ? snprintf(s_line + pos, LINE_BYTES - pos, "]}}")
+                         : -1;
+  if (n < 0 || pos + (size_t)n >= LINE_BYTES) {
+    ESP_LOGW(TAG, "Event line truncated, skipped");
+    return;
+  }
+  if (logger_append_line(s_line) == ESP_OK) {
+    s_stored++;
+  }
+}
+
+static void store_task(void *pvParameters) {
+  for (;;) {
+    (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (!s_win_busy) {
+      continue;
+    }
+    ESP_LOGI(TAG, "Event: %" PRIu32 " ms, peak %.2f uT, %" PRIu32 " samples",
+             s_win_ev.dur_ms, s_win_ev.peak_ut, s_win_n);
+    store_window();
+    s_win_busy = false;
+  }
+}
+
+esp_err_t mag_events_init(void) {
+  s_ring = mem_plan_alloc(RING_SAMPLES * sizeof(mag_sample_t), MEM_CAPS_HOT);
+  s_win = mem_plan_alloc(WINDOW_SAMPLES * sizeof(mag_sample_t), MEM_CAPS_BULK);
+  s_line = mem_plan_alloc(LINE_BYTES, MEM_CAPS_BULK);
+  if (!s_ring || !s_win || !s_line) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  gpio_config_t io = {
+      .pin_bit_mask = 1ULL << MAG_DRDY_GPIO,
+      .mode = GPIO_MODE_INPUT,
+      .pull_down_en = GPIO_PULLDOWN_ENABLE, // Unwired pin reads idle
+      .intr_type = GPIO_INTR_HIGH_LEVEL,
+  };
+  esp_err_t err = gpio_config(&io);
+  if (err != ESP_OK) {
+    return err;
+  }
+  gpio_intr_disable(MAG_DRDY_GPIO);
+
+  s_stream_task =
+      xTaskCreateStatic(stream_task, "mag_stream", sizeof(s_stream_stack),
+                        NULL, 6, s_stream_stack, &s_stream_tcb);
+  s_store_task =
+      xTaskCreateStatic(store_task, "mag_store", sizeof(s_store_stack), NULL,
+                        2, s_store_stack, &s_store_tcb);
+  if (!s_stream_task || !s_store_task) {
+    return ESP_ERR_NO_MEM;
+  }
+  mem_plan_watch_task(s_stream_task);
+  mem_plan_watch_task(s_store_task);
+
+  err = gpio_install_isr_service(0);
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+    return err;
+  }
+  err = gpio_isr_handler_add(MAG_DRDY_GPIO, drdy_isr, NULL);
+  if (err == ESP_OK) {
+    err = esp_sleep_enable_gpio_wakeup();
+  }
+  if (err == ESP_OK) {
+    ESP_LOGI(TAG, "DRDY on GPIO %d, %u Hz, window %u samples",
+             MAG_DRDY_GPIO, (unsigned)MAG_EVENT_ODR_HZ,
+             (unsigned)WINDOW_SAMPLES);
+  }
+  return err;
+}
+
+void mag_events_set_active(bool active) {
+  if (s_drdy_lost) {
+    active = false;
+  }
+  if (s_stream_task && active != s_want) {
+    s_want = active;
+    xTaskNotifyGive(s_stream_task);
+  }
+}
+
+bool mag_events_active(void) { return s_running; }
+
+bool mag_events_take(mag_event_t *out) {
+  taskENTER_CRITICAL(&s_mux);
+  bool fresh = s_latest_new;
+  if (fresh) {
+    *out = s_latest;
+    s_latest_new = false;
+  }
+  taskEXIT_CRITICAL(&s_mux);
+  return fresh;
+}
+
+bool mag_events_baseline(float field_ut[3]) {
+  taskENTER_CRITICAL(&s_mux);
+  bool ready = s_running && s_base_ready;
+  if (ready) {
+    memcpy(field_ut, s_base_ut, sizeof(s_base_ut));
+  }
+  taskEXIT_CRITICAL(&s_mux);
+  return ready;
+}
+
+void mag_events_log_report(void) {
+  float base[3];
+  if (mag_events_baseline(base)) {
+    ESP_LOGI(TAG, "Baseline X=%.2f Y=%.2f Z=%.2f uT | noise %.3f uT", base[0],
+             base[1], base[2], sqrtf(s_noise_var) * GY271_UT_PER_LSB);
+  } else {
+    ESP_LOGI(TAG, "Streaming %s, baseline not settled",
+             s_running ? "on" : (s_drdy_lost ? "off (no DRDY)" : "off"));
+  }
+  ESP_LOGI(TAG,
+           "Samples %" PRIu32 " (polled %" PRIu32 ", overrun %" PRIu32
+           ", errors %" PRIu32 ")",
+           s_samples, s_polled, s_overruns, s_read_errors);
+  ESP_LOGI(TAG,
+           "Events %" PRIu32 " (rebased %" PRIu32 ") | stored %" PRIu32
+           " dropped %" PRIu32,
+           s_events, s_rebased, s_stored, s_dropped);
+}
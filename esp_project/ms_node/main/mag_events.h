@@ -0,0 +1,69 @@
+#ifndef MAG_EVENTS_H
+#define MAG_EVENTS_H
+
+#include "config.h"
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Magnetometer event capture
+ *
+ * In Normal mode the GY-271 runs continuously at MAG_EVENT_ODR_HZ and raises
+ * DRDY (MAG_DRDY_GPIO) with every sample. The pin is a light-sleep wake
+ * source, so the CPU sleeps between samples and wakes only for the short I2C
+ * read. Samples go into a ring buffer and through a detector that subtracts
+ * a slow per-axis baseline; a passing vehicle or animal shows up as a
+ * deviation well above the tracked noise.
+ *
+ * Only event windows leave the node: each is stored as one log line (the
+ * pre-trigger history included) and handed to the main loop as an anomalous
+ * payload. Outside events nothing is logged; the rollups receive the
+ * baseline at the usual mag interval.
+ *
+ * If samples keep turning up without DRDY (pin not wired), streaming is
+ * given up until reboot and the main loop goes back to polled reads.
+ */
+
+typedef struct {
+  uint64_t start_ms;  // First sample over the threshold
+  uint32_t dur_ms;    // Until the deviation fell back (release included)
+  uint16_t samples;   // In the stored window
+  float peak_ut;      // Largest deviation from the baseline
+  float field_ut[3];  // Field at the peak
+} mag_event_t;
+
+/**
+ * @brief Reserve buffers, set up the DRDY interrupt and start the tasks.
+ * The sensor stays in its polled mode until mag_events_set_active(true).
+ */
+esp_err_t mag_events_init(void);
+
+/**
+ * @brief Stream (true) or put the sensor in standby (false); called from the
+ *        main loop with the PME mode and sensor config applied
+ */
+void mag_events_set_active(bool active);
+
+/**
+ * @brief true while streaming; the polled gy271_read must not be used then
+ */
+bool mag_events_active(void);
+
+/**
+ * @brief Newest closed event not taken yet
+ */
+bool mag_events_take(mag_event_t *out);
+
+/**
+ * @brief Current baseline in uT
+ * @return false until the baseline has settled
+ */
+bool mag_events_baseline(float field_ut[3]);
+
+/**
+ * @brief Log detector state, event and sampling counters
+ */
+void mag_events_log_report(void);
+
+#endif // MAG_EVENTS_H
@@ -176,19 +176,30 @@ float stellar_utility_trust(float trust);
 // ============================================
 // Sensor Data Payload
 // ============================================
+#define SENSOR_PAYLOAD_FLAG_SENSORS_REAL (1U << 0) // At least one real sensor
+#define SENSOR_PAYLOAD_FLAG_BATTERY_REAL (1U << 1) // Battery from ADC, not mock
+#define SENSOR_PAYLOAD_FLAG_ANOMALY (1U << 2) // anomaly_mask has channels set
+
 typedef struct {
   uint32_t node_id;
+  uint8_t mac_addr[6];
+  uint16_t flags;     // SENSOR_PAYLOAD_FLAG_*
+  uint8_t temp_sigma; // Fused temp_c 1-sigma, 0.01 degC (255 = unknown)
+  uint8_t hum_sigma;  // Fused hum_pct 1-sigma, 0.1 %RH (255 = unknown)
+  uint16_t present;   // Bit per rollup_channel_t sampled this interval
+  uint64_t timestamp_ms;
+  uint32_t seq_num;
   float temp_c;
   float hum_pct;
   uint32_t pressure_hpa;
   uint16_t eco2_ppm;
   uint16_t tvoc_ppb;
   uint16_t aqi;
+  uint16_t anomaly_mask; // Bit per rollup_channel_t flagged by the detector
   float audio_rms;
   float mag_x;
   float mag_y;
   float mag_z;
-  uint32_t timestamp;
 } sensor_payload_t;
 
 /**
@@ -7,12 +7,19 @@
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "sdkconfig.h"
 #include <math.h>
 #include <stdio.h>
 
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
 #include "aht21_sensor.h"
 #include "bme280_sensor.h"
+#include "compression.h"
 #include "config.h"
+#include "config_sync.h"
 #include "ens160_sensor.h"
 #include "gy271_sensor.h"
 #include "i2c_bus.h"
@@ -21,21 +28,32 @@
 #include "sensor_config.h"
 #include "sensors.h"
 
+#include "anomaly.h"
 #include "auth.h"
 #include "battery.h"
 #include "ble_manager.h"
+#include "cluster_aggregator.h"
+#include "console.h"
 #include "election.h"
+#include "env_fusion.h"
+#include "gossip.h"
 #include "esp_now_manager.h"
 #include "led_manager.h"
 #include "logger.h"
+#include "mag_events.h"
+#include "mem_plan.h"
 #include "metrics.h"
 #include "neighbor_manager.h"
 #include "nvs_flash.h"
+#include "ota_mesh.h"
 #include "persistence.h"
 #include "pme.h"
 #include "rf_receiver.h"
+#include "rollup.h"
 #include "state_machine.h"
+#include "storage_layout.h"
 #include "storage_manager.h"
+#include "ulp_sampler.h"
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
@@ -49,6 +67,8 @@ static const char *TAG = "main";
 #endif
 
 void compression_bench_run_once(void);
+void compression_bench_placement(void);
+void compression_bench_parallel(void);
 
 static sensor_config_t s_sensor_config = {0};
 
@@ -71,8 +91,7 @@ static const float THRESH_SHUNT_MV = 1.0f;
 
 typedef struct {
   bool have;
-  float bme_t, bme_h, bme_p;
-  float aht_t, aht_h;
+  float temp_c, hum_pct, press_hpa;
   uint16_t aqi, tvoc, eco2;
   float mag_x, mag_y, mag_z;
   float bus_v, shunt_mv, current_ma;
@@ -91,6 +110,60 @@ static bool changed_f(float prev, float curr, float thresh) {
   return fabsf(curr - prev) >= thresh;
 }
 
+static void feed_channel(rollup_channel_t ch, float value, uint16_t *mask) {
+  rollup_add(ch, value);
+  if (anomaly_update(ch, value))
+    *mask |= (uint16_t)(1U << ch);
+}
+
+// Store-and-forward routing: anomalous records are queued individually at high
+// priority; routine ones only count towards a periodic low-priority summary of
+// the detector's running means.
+static void queue_for_forwarding(const sensor_payload_t *p) {
+  static uint64_t s_last_summary_ms = 0;
+  static uint32_t s_routine_count = 0;
+  char line[STORAGE_LINE_MAX];
+
+  if (p->flags & SENSOR_PAYLOAD_FLAG_ANOMALY) {
+    int n = snprintf(line, sizeof(line),
+                     "{\"n\":%" PRIu32 ",\"s\":%" PRIu32 ",\"t\":%llu,"
+                     "\"am\":%u,\"T\":%.2f,\"H\":%.2f,\"P\":%" PRIu32
+                     ",\"q\":%u,\"v\":%u,\"c\":%u,\"x\":%.2f,\"y\":%.2f,"
+                     "\"z\":%.2f,\"a\":%.4f}",
+                     p->node_id, p->seq_num, (unsigned long long)p->timestamp_ms,
+                     p->anomaly_mask, p->temp_c, p->hum_pct, p->pressure_hpa,
+                     p->aqi, p->tvoc_ppb, p->eco2_ppm, p->mag_x, p->mag_y,
+                     p->mag_z, p->audio_rms);
+    if (n > 0 && n < (int)sizeof(line))
+      (void)storage_manager_push_line(line, STORAGE_PRIO_HIGH);
+    return;
+  }
+
+  s_routine_count++;
+  if (p->timestamp_ms - s_last_summary_ms < ANOMALY_SUMMARY_PERIOD_MS)
+    return;
+
+  float m[ROLLUP_CH_COUNT] = {0};
+  for (int ch = 0; ch < ROLLUP_CH_COUNT; ch++)
+    (void)anomaly_get_mean((rollup_channel_t)ch, &m[ch]);
+
+  int n = snprintf(line, sizeof(line),
+                   "{\"n\":%" PRIu32 ",\"t\":%llu,\"sum\":%" PRIu32
+                   ",\"T\":%.2f,\"H\":%.2f,\"P\":%.1f,\"q\":%.1f,"
+                   "\"v\":%.0f,\"c\":%.0f,\"x\":%.2f,\"y\":%.2f,\"z\":%.2f,"
+                   "\"a\":%.4f}",
+                   p->node_id, (unsigned long long)p->timestamp_ms,
+                   s_routine_count, m[ROLLUP_CH_TEMP], m[ROLLUP_CH_HUM],
+                   m[ROLLUP_CH_PRESS], m[ROLLUP_CH_AQI], m[ROLLUP_CH_TVOC],
+                   m[ROLLUP_CH_ECO2], m[ROLLUP_CH_MAG_X], m[ROLLUP_CH_MAG_Y],
+                   m[ROLLUP_CH_MAG_Z], m[ROLLUP_CH_AUDIO_RMS]);
+  if (n > 0 && n < (int)sizeof(line) &&
+      storage_manager_push_line(line, STORAGE_PRIO_LOW) == ESP_OK) {
+    s_last_summary_ms = p->timestamp_ms;
+    s_routine_count = 0;
+  }
+}
+
 static uint32_t sample_period_ms_for_mode(pme_mode_t mode) {
   // Main loop rate - runs fast for responsiveness
   // Individual sensors check their own intervals
@@ -112,6 +185,14 @@ static void log_wakeup_reason(void) {
   case ESP_SLEEP_WAKEUP_TIMER:
     ESP_LOGI(TAG, "wakeup cause: timer");
     break;
+  case ESP_SLEEP_WAKEUP_EXT1:
+    ESP_LOGI(TAG, "wakeup cause: RF trigger (ext1)");
+    break;
+  case ESP_SLEEP_WAKEUP_ULP:
+    ESP_LOGI(TAG, "wakeup cause: ULP sampler (%s)",
+             ulp_sampler_wake_reason() == ULP_WAKE_THRESHOLD ? "threshold"
+                                                              : "buffer full");
+    break;
   case ESP_SLEEP_WAKEUP_UNDEFINED:
     ESP_LOGI(TAG, "wakeup cause: power-on or reset");
     break;
@@ -123,57 +204,6 @@ static void log_wakeup_reason(void) {
 
 // Compression bench task removed
 
-// Apply one key=value to sensor config (serial console, same keys as BLE).
-static esp_err_t apply_config_key_value(const char *key_value) {
-  char buf[128];
-  size_t len = strlen(key_value);
-  if (len >= sizeof(buf))
-    return ESP_ERR_INVALID_ARG;
-  memcpy(buf, key_value, len + 1);
-  char *eq = strchr(buf, '=');
-  if (!eq)
-    return ESP_ERR_INVALID_ARG;
-  *eq = '\0';
-  const char *key = buf;
-  const char *value = eq + 1;
-  sensor_config_t cfg;
-  sensor_config_get(&cfg);
-  if (strcmp(key, "audio_interval_ms") == 0) {
-    cfg.audio_interval_ms = (uint32_t)atoi(value);
-  } else if (strcmp(key, "env_sensor_interval_ms") == 0) {
-    cfg.env_sensor_interval_ms = (uint32_t)atoi(value);
-  } else if (strcmp(key, "gas_sensor_interval_ms") == 0) {
-    cfg.gas_sensor_interval_ms = (uint32_t)atoi(value);
-  } else if (strcmp(key, "mag_sensor_interval_ms") == 0) {
-    cfg.mag_sensor_interval_ms = (uint32_t)atoi(value);
-  } else if (strcmp(key, "power_sensor_interval_ms") == 0) {
-    cfg.power_sensor_interval_ms = (uint32_t)atoi(value);
-  } else if (strcmp(key, "inmp441_enabled") == 0) {
-    cfg.inmp441_enabled = (atoi(value) != 0);
-  } else if (strcmp(key, "bme280_enabled") == 0) {
-    cfg.bme280_enabled = (atoi(value) != 0);
-  } else if (strcmp(key, "ens160_enabled") == 0) {
-    cfg.ens160_enabled = (atoi(value) != 0);
-  } else if (strcmp(key, "gy271_enabled") == 0) {
-    cfg.gy271_enabled = (atoi(value) != 0);
-  } else if (strcmp(key, "audio_sample_rate") == 0) {
-    cfg.audio_sample_rate = (uint32_t)atoi(value);
-  } else if (strcmp(key, "audio_duration_ms") == 0) {
-    cfg.audio_duration_ms = (uint32_t)atoi(value);
-  } else if (strcmp(key, "beacon_interval_ms") == 0) {
-    cfg.beacon_interval_ms = (uint32_t)atoi(value);
-  } else if (strcmp(key, "beacon_offset_ms") == 0) {
-    cfg.beacon_offset_ms = (uint32_t)atoi(value);
-  } else {
-    ESP_LOGW(TAG, "Unknown config key: %s", key);
-    return ESP_ERR_NOT_FOUND;
-  }
-  sensor_config_update(&cfg);
-  sensor_config_save(&cfg);
-  ESP_LOGI(TAG, "Config updated: %s=%s", key, value);
-  return ESP_OK;
-}
-
 // Print cluster report for host script (CLUSTER command).
 // Print cluster report for host script (CLUSTER command).
 static void cluster_report_print(void) {
@@ -221,43 +251,74 @@ static void cluster_report_print(void) {
   printf("CLUSTER_REPORT_END\n");
 }
 
-// Serial console task: "CONFIG key=value" and "CLUSTER" for report.
-static void console_config_task(void *pvParameters) {
-  char line[128];
-  int pos = 0;
-  ESP_LOGI(TAG, "Serial: CONFIG key=value or CLUSTER for report");
-  for (;;) {
-    int c = fgetc(stdin);
-    if (c == EOF || c == '\r') {
-      vTaskDelay(pdMS_TO_TICKS(20));
-      continue;
-    }
-    if (c == '\n') {
-      line[pos] = '\0';
-      if (pos > 0) {
-        if (strncmp(line, "CONFIG ", 7) == 0) {
-          esp_err_t err = apply_config_key_value(line + 7);
-          if (err == ESP_OK) {
-            printf("OK config applied\n");
-          } else {
-            printf("ERR config %s\n", esp_err_to_name(err));
-          }
-        } else if (strcmp(line, "CLUSTER") == 0) {
-          cluster_report_print();
-        } else if (strcmp(line, "TRIGGER_UAV") == 0) {
-          ESP_LOGI(TAG, "Command: TRIGGER_UAV (Forcing Transition)");
-          // rf_receiver_force_trigger(); // Old method
-          state_machine_force_uav_test(); // New robust method
-        }
-      }
-      pos = 0;
-      continue;
-    }
-    if (pos < (int)sizeof(line) - 1)
-      line[pos++] = (char)c;
+// Confirmed 433 MHz code: run the state machine now instead of at its next
+// poll, so a UAV trigger is acted on right away.
+static void on_rf_code(const rf_event_t *event, void *ctx) {
+  if (event->code == RF_EXPECTED_CODE && event->bits == RF_EXPECTED_BITS) {
+    state_machine_notify();
+  }
+}
+
+// Serial console commands: "CONFIG key=value" ("CONFIG" alone reports the
+// config version), "CLUSTER" for report, "TRIGGER_UAV".
+static void cmd_config(const char *args) {
+  if (args[0] == '\0') {
+    config_sync_log_report();
+    return;
+  }
+  // On the CH this also reaches every member (config_sync)
+  esp_err_t err = config_sync_set(args);
+  if (err == ESP_OK) {
+    printf("OK config applied\n");
+  } else {
+    printf("ERR config %s\n", esp_err_to_name(err));
   }
 }
 
+static void cmd_cluster(const char *args) { cluster_report_print(); }
+
+static void cmd_storage(const char *args) { storage_layout_log_report(); }
+
+static void cmd_mem(const char *args) { mem_plan_log_report(); }
+
+static void cmd_radio(const char *args) { esp_now_manager_log_report(); }
+
+static void cmd_ota(const char *args) { ota_mesh_log_report(); }
+
+static void cmd_election(const char *args) { gossip_log_report(); }
+
+static void cmd_env(const char *args) { env_fusion_log_report(); }
+
+static void cmd_mag(const char *args) { mag_events_log_report(); }
+
+// "BENCH" for code placement, "BENCH PAR" for dual-core compression
+static void cmd_bench(const char *args) {
+  if (strncmp(args, "PAR", 3) == 0) {
+    compression_bench_parallel();
+  } else {
+    compression_bench_placement();
+  }
+}
+
+static void cmd_trigger_uav(const char *args) {
+  ESP_LOGI(TAG, "Command: TRIGGER_UAV (Forcing Transition)");
+  state_machine_force_uav_test();
+}
+
+static const console_cmd_t s_console_cmds[] = {
+    {.name = "CONFIG", .handler = cmd_config},
+    {.name = "CLUSTER", .handler = cmd_cluster, .async = true},
+    {.name = "STORAGE", .handler = cmd_storage},
+    {.name = "MEM", .handler = cmd_mem},
+    {.name = "RADIO", .handler = cmd_radio},
+    {.name = "OTA", .handler = cmd_ota},
+    {.name = "ELECTION", .handler = cmd_election},
+    {.name = "ENV", .handler = cmd_env},
+    {.name = "MAG", .handler = cmd_mag},
+    {.name = "BENCH", .handler = cmd_bench, .async = true},
+    {.name = "TRIGGER_UAV", .handler = cmd_trigger_uav},
+};
+
 static void logger_force_sample_flush(void) {
 #if LOGGER_FORCE_FLUSH_TEST
   ESP_LOGW(TAG, "FORCE FLUSH TEST: writing sample lines");
@@ -278,19 +339,22 @@ static void logger_force_sample_flush(void) {
 
 // ========== STELLAR CLUSTER TASKS (from original clusterCreation) ==========
 
-// State machine task - runs every 100ms for responsive state transitions
+// State machine task - 100ms while electing, slower once the role is
+// settled (see state_machine_wait_next)
 static void state_machine_task(void *pvParameters) {
   ESP_LOGI(TAG, "State machine task started");
 
   while (1) {
     state_machine_run();
-    vTaskDelay(pdMS_TO_TICKS(100)); // Run every 100ms
+    state_machine_wait_next();
   }
 }
 
-// Metrics update task - updates STELLAR metrics every second
+// Metrics update task - every second while electing, every
+// METRICS_PERIOD_IDLE_MS once CH/MEMBER
 static void metrics_task(void *pvParameters) {
   ESP_LOGI(TAG, "Metrics task started");
+  TickType_t last_wake = xTaskGetTickCount();
 
   while (1) {
     metrics_update();
@@ -299,7 +363,10 @@ static void metrics_task(void *pvParameters) {
     ESP_LOGI(TAG, "STATUS: State=%s, Role=%s, CH=%lu, Size=%zu",
              state_machine_get_state_name(), g_is_ch ? "CH" : "NODE", ch_id,
              cluster_size);
-    vTaskDelay(pdMS_TO_TICKS(1000)); // Update every second
+    bool settled =
+        g_current_state == STATE_CH || g_current_state == STATE_MEMBER;
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(settled ? METRICS_PERIOD_IDLE_MS
+                                                      : METRICS_PERIOD_FAST_MS));
   }
 }
 
@@ -315,6 +382,22 @@ void app_main(void) {
   }
   ESP_ERROR_CHECK(nvs_ret);
 
+#if CONFIG_PM_ENABLE
+  // DFS + automatic light sleep. Radio and I2C hold their own PM locks only
+  // while they are busy; console RX wakes the chip.
+  esp_pm_config_t pm_cfg = {
+      .max_freq_mhz = PM_CPU_FREQ_MAX_MHZ,
+      .min_freq_mhz = PM_CPU_FREQ_MIN_MHZ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+      .light_sleep_enable = true,
+#endif
+  };
+  esp_err_t pm_ret = esp_pm_configure(&pm_cfg);
+  if (pm_ret != ESP_OK) {
+    ESP_LOGW(TAG, "esp_pm_configure failed: %s", esp_err_to_name(pm_ret));
+  }
+#endif
+
   // Initialize Managers
   // Use ble_manager directly (NimBLE) instead of legacy ble_beacon (Bluedroid)
 
@@ -325,10 +408,14 @@ void app_main(void) {
   neighbor_manager_init();
   election_init();
   persistence_init(); // Initialize persistence before other systems
+  persistence_load_reputations(); // Warm trust and the previous CH
 
   ble_manager_init();
   led_manager_init();
   ESP_ERROR_CHECK(logger_init());
+  if (lz_parallel_init() != ESP_OK) {
+    ESP_LOGW(TAG, "Parallel compression unavailable");
+  }
 
   // Initialize Data Storage
   ESP_ERROR_CHECK(storage_manager_init());
@@ -341,15 +428,41 @@ void app_main(void) {
   // Initialize ESP-NOW
   esp_now_manager_init();
 
+  // Cluster firmware updates ride on ESP-NOW
+  ota_mesh_init();
+
   // Initialize RF Receiver
   rf_receiver_init();
+  rf_receiver_set_callback(on_rf_code, NULL);
+#if CONFIG_PM_ENABLE
+  // RMT only runs after an edge on the RF pin, so listening does not keep
+  // the chip out of light sleep
+  rf_receiver_set_low_power(true);
+#endif
+
+  // Woken from critical-mode deep sleep by RF activity: stay up only if it
+  // really was the UAV code (the trigger stays pending for the CH state).
+  if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT1 &&
+      !rf_receiver_confirm_wake(RF_WAKE_CONFIRM_MS)) {
+    ESP_LOGW(TAG, "RF wake not confirmed, back to deep sleep");
+    (void)rf_receiver_prepare_deep_sleep();
+    (void)ulp_sampler_start(ULP_SAMPLE_INTERVAL_MS, ULP_TEMP_WAKE_LOW_C,
+                            ULP_TEMP_WAKE_HIGH_C);
+    ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup(
+        (uint64_t)PME_CRITICAL_SLEEP_MS * 1000ULL));
+    esp_deep_sleep_start();
+  }
 
   // Initialize State Machine (MUST be after all subsystems)
   state_machine_init();
   vTaskDelay(pdMS_TO_TICKS(50));
 
+  anomaly_init();
+  cluster_aggregator_init();
+
   // Load sensor configuration from NVS
   ESP_ERROR_CHECK(sensor_config_load(&s_sensor_config));
+  config_sync_init();
   ESP_LOGI(TAG,
            "Sensor config: audio_interval=%" PRIu32 "ms, env_interval=%" PRIu32
            "ms",
@@ -399,14 +512,28 @@ void app_main(void) {
   // ========== STELLAR CLUSTER TASKS (after battery/PME so metrics_task gets
   // valid battery) ==========
   ESP_LOGI(TAG, "Creating STELLAR cluster tasks...");
-  xTaskCreate(state_machine_task, "state_machine", 8192, NULL, 5, NULL);
-  xTaskCreate(metrics_task, "metrics", 4096, NULL, 4, NULL);
-  (void)xTaskCreate(console_config_task, "console_cfg", 4096, NULL,
-                    tskIDLE_PRIORITY + 1, NULL);
+  static StackType_t s_sm_stack[8192];
+  static StaticTask_t s_sm_tcb;
+  static StackType_t s_metrics_stack[4096];
+  static StaticTask_t s_metrics_tcb;
+  mem_plan_watch_task(xTaskCreateStatic(state_machine_task, "state_machine",
+                                        sizeof(s_sm_stack), NULL, 5,
+                                        s_sm_stack, &s_sm_tcb));
+  mem_plan_watch_task(xTaskCreateStatic(metrics_task, "metrics",
+                                        sizeof(s_metrics_stack), NULL, 4,
+                                        s_metrics_stack, &s_metrics_tcb));
+  ESP_ERROR_CHECK(console_register(
+      s_console_cmds, sizeof(s_console_cmds) / sizeof(s_console_cmds[0])));
+  if (console_init() == ESP_OK) {
+    ESP_LOGI(TAG, "Serial: CONFIG key=value, CLUSTER, STORAGE, MEM or RADIO "
+                  "for reports");
+  }
 
   esp_err_t ret;
 
-  // Initialize I2C bus BEFORE sensor initialization
+  // Initialize I2C bus BEFORE sensor initialization. The ULP may still own
+  // the pins from critical-mode deep sleep.
+  ulp_sampler_stop();
   vTaskDelay(pdMS_TO_TICKS(30));
   ret = ms_i2c_init();
   if (ret != ESP_OK) {
@@ -470,6 +597,9 @@ void app_main(void) {
   }
   if (ret != ESP_OK)
     ESP_LOGW(TAG, "GY-271 init skipped after %d retries", MAX_RETRIES);
+  else if ((ret = mag_events_init()) != ESP_OK)
+    ESP_LOGW(TAG, "GY-271 event capture unavailable, polling only: %s",
+             esp_err_to_name(ret));
 
   for (int attempt = 1; attempt <= MAX_RETRIES; attempt++) {
     ret = ina219_init_basic();
@@ -506,6 +636,13 @@ void app_main(void) {
   sensors_raw_sanity_check();
   vTaskDelay(pdMS_TO_TICKS(200));
 
+  // Log whatever the ULP sampled while we were in deep sleep
+  (void)ulp_sampler_drain();
+
+  // Every hot-path buffer is reserved by now; the loop below must not
+  // allocate
+  mem_plan_seal();
+
   // Dump log file to UART on boot (commented out - triggers watchdog on large
   // files) vTaskDelay(pdMS_TO_TICKS(2000)); // Let system settle before dump
   // logger_dump_to_uart();
@@ -646,14 +783,24 @@ void app_main(void) {
 
     bool ok_bme = false, real_bme = false;
     bool ok_aht = false, real_aht = false;
+    bool ok_env = false;
     bool ok_ens = false, real_ens = false;
     bool ok_mag = false, real_mag = false;
     bool ok_ina = false, real_ina = false;
     bool ok_audio = false, real_audio = false;
 
-    // Environmental sensors (BME280, AHT21): try real read; if not connected
-    // use dummy
-    if (do_full && time_for_env && s_sensor_config.bme280_enabled) {
+    // Environmental sensors (BME280, AHT21): both see the same air, so
+    // env_fusion reads the second one only for periodic cross-checks. Try
+    // real read; if not connected use dummy
+    bool env_allowed[ENV_SENSOR_COUNT] = {
+        [ENV_SENSOR_BME280] = do_full && s_sensor_config.bme280_enabled,
+        [ENV_SENSOR_AHT21] = do_light && s_sensor_config.aht21_enabled,
+    };
+    bool env_read[ENV_SENSOR_COUNT] = {false};
+    if (time_for_env)
+      env_fusion_plan(env_allowed, env_read);
+
+    if (env_read[ENV_SENSOR_BME280]) {
       ok_bme = (bme280_read(&bme) == ESP_OK);
       real_bme = ok_bme;
       if (!ok_bme) {
@@ -667,7 +814,7 @@ void app_main(void) {
         s_last_env_read_ms = now_ms;
     }
 
-    if (do_light && time_for_env && s_sensor_config.aht21_enabled) {
+    if (env_read[ENV_SENSOR_AHT21]) {
       ok_aht = (aht21_read_with_raw(&aht, aht_raw) == ESP_OK);
       real_aht = ok_aht;
       if (!ok_aht) {
@@ -679,6 +826,20 @@ void app_main(void) {
         s_last_env_read_ms = now_ms;
     }
 
+    // A dummy stands in only while the other sensor has no real reading
+    env_fused_t env = {0};
+    if (ok_bme || ok_aht) {
+      env_sample_t samples[ENV_SENSOR_COUNT] = {
+          [ENV_SENSOR_BME280] = {.ok = real_bme || (ok_bme && !real_aht),
+                                 .temp_c = bme.temperature_c,
+                                 .hum_pct = bme.humidity_pct},
+          [ENV_SENSOR_AHT21] = {.ok = real_aht || (ok_aht && !real_bme),
+                                .temp_c = aht.temperature_c,
+                                .hum_pct = aht.humidity_pct},
+      };
+      ok_env = env_fusion_update(env_read, samples, now_ms, &env);
+    }
+
     // Gas sensor (ENS160)
     if (do_light && time_for_gas && s_sensor_config.ens160_enabled) {
       ok_ens = (ens160_read_iaq(&ens) == ESP_OK);
@@ -708,8 +869,19 @@ void app_main(void) {
         s_last_power_read_ms = now_ms;
     }
 
-    // Magnetometer (GY-271)
-    if (do_full && time_for_mag && s_sensor_config.gy271_enabled) {
+    // Magnetometer (GY-271): streamed in Normal mode, where only event
+    // windows are kept and the rollups get the baseline; polled otherwise
+    mag_events_set_active(do_full && s_sensor_config.gy271_enabled);
+    mag_event_t mag_ev;
+    bool ok_mag_ev = mag_events_take(&mag_ev);
+    float mag_base[3];
+    bool ok_mag_base = false;
+    if (mag_events_active()) {
+      if (time_for_mag && mag_events_baseline(mag_base)) {
+        ok_mag_base = true;
+        s_last_mag_read_ms = now_ms;
+      }
+    } else if (do_full && time_for_mag && s_sensor_config.gy271_enabled) {
       ok_mag = (gy271_read(&mag) == ESP_OK);
       real_mag = ok_mag;
       if (!ok_mag) {
@@ -738,8 +910,8 @@ void app_main(void) {
         s_last_audio_read_ms = now_ms;
     }
 
-    if (ok_aht) {
-      (void)ens160_set_env(aht.temperature_c, aht.humidity_pct);
+    if (ok_env) {
+      (void)ens160_set_env(env.temp_c, env.hum_pct);
     }
 
     if (ok_bme)
@@ -748,6 +920,9 @@ void app_main(void) {
     if (ok_aht)
       ESP_LOGI(TAG, "AHT21 T=%.2f C | H=%.2f %%", aht.temperature_c,
                aht.humidity_pct);
+    if (ok_env)
+      ESP_LOGI(TAG, "Fused T=%.2f +-%.2f C | H=%.1f +-%.1f %%", env.temp_c,
+               env.temp_sigma, env.hum_pct, env.hum_sigma);
     if (ok_ens)
       ESP_LOGI(TAG,
                "ENS160 status: 0x%02X | AQI=%u | TVOC=%u ppb | eCO2=%u ppm",
@@ -763,24 +938,54 @@ void app_main(void) {
                (unsigned)audio.count, audio.rms_amplitude, audio.peak_amplitude,
                (unsigned long)audio.timestamp_ms);
 
+    // ---- Rollup tiers + anomaly detector (every sample, independent of
+    // change detection) ----
+    uint16_t anomaly_mask = 0;
+    if (ok_env) {
+      feed_channel(ROLLUP_CH_TEMP, env.temp_c, &anomaly_mask);
+      feed_channel(ROLLUP_CH_HUM, env.hum_pct, &anomaly_mask);
+    }
+    if (ok_bme)
+      feed_channel(ROLLUP_CH_PRESS, bme.pressure_hpa, &anomaly_mask);
+    if (ok_ens) {
+      feed_channel(ROLLUP_CH_AQI, ens.aqi_uba, &anomaly_mask);
+      feed_channel(ROLLUP_CH_TVOC, ens.tvoc_ppb, &anomaly_mask);
+      feed_channel(ROLLUP_CH_ECO2, ens.eco2_ppm, &anomaly_mask);
+    }
+    if (ok_mag) {
+      feed_channel(ROLLUP_CH_MAG_X, mag.x_uT, &anomaly_mask);
+      feed_channel(ROLLUP_CH_MAG_Y, mag.y_uT, &anomaly_mask);
+      feed_channel(ROLLUP_CH_MAG_Z, mag.z_uT, &anomaly_mask);
+    } else if (ok_mag_base) {
+      feed_channel(ROLLUP_CH_MAG_X, mag_base[0], &anomaly_mask);
+      feed_channel(ROLLUP_CH_MAG_Y, mag_base[1], &anomaly_mask);
+      feed_channel(ROLLUP_CH_MAG_Z, mag_base[2], &anomaly_mask);
+    }
+    if (ok_mag_ev) {
+      anomaly_mask |= (uint16_t)((1U << ROLLUP_CH_MAG_X) |
+                                 (1U << ROLLUP_CH_MAG_Y) |
+                                 (1U << ROLLUP_CH_MAG_Z));
+    }
+    if (ok_ina) {
+      feed_channel(ROLLUP_CH_BUS_V, ina.bus_voltage_v, &anomaly_mask);
+      feed_channel(ROLLUP_CH_CURRENT, ina.current_ma, &anomaly_mask);
+    }
+    if (ok_audio)
+      feed_channel(ROLLUP_CH_AUDIO_RMS, audio.rms_amplitude, &anomaly_mask);
+
     // ---- JSON log line ----
-    bool any_ok = ok_bme || ok_aht || ok_ens || ok_mag || ok_ina || ok_audio;
+    bool any_ok = ok_bme || ok_aht || ok_ens || ok_mag || ok_ina || ok_audio ||
+                  ok_mag_ev;
     if (any_ok) {
       bool changed = !s_last_log.have;
 
-      if (ok_bme) {
-        changed |=
-            changed_f(s_last_log.bme_t, bme.temperature_c, THRESH_TEMP_C);
-        changed |=
-            changed_f(s_last_log.bme_h, bme.humidity_pct, THRESH_HUM_PCT);
-        changed |=
-            changed_f(s_last_log.bme_p, bme.pressure_hpa, THRESH_PRESS_HPA);
+      if (ok_env) {
+        changed |= changed_f(s_last_log.temp_c, env.temp_c, THRESH_TEMP_C);
+        changed |= changed_f(s_last_log.hum_pct, env.hum_pct, THRESH_HUM_PCT);
       }
-      if (ok_aht) {
-        changed |=
-            changed_f(s_last_log.aht_t, aht.temperature_c, THRESH_TEMP_C);
+      if (ok_bme) {
         changed |=
-            changed_f(s_last_log.aht_h, aht.humidity_pct, THRESH_HUM_PCT);
+            changed_f(s_last_log.press_hpa, bme.pressure_hpa, THRESH_PRESS_HPA);
       }
       if (ok_ens) {
         changed |= (s_last_log.aqi != ens.aqi_uba) ||
@@ -808,17 +1013,20 @@ void app_main(void) {
       }
 
       if (changed) {
-        char line[400];
+        char line[480];
         int n = snprintf(
             line, sizeof(line),
             "{\"ts_ms\":%llu,"
-            "\"env\":{\"bme_t\":%.2f,\"bme_h\":%.2f,\"bme_p\":%.2f,"
+            "\"env\":{\"t\":%.2f,\"h\":%.2f,\"t_sd\":%.2f,\"h_sd\":%.1f,"
+            "\"bme_t\":%.2f,\"bme_h\":%.2f,\"bme_p\":%.2f,"
             "\"aht_t\":%.2f,\"aht_h\":%.2f},"
             "\"gas\":{\"aqi\":%u,\"tvoc\":%u,\"eco2\":%u},"
             "\"mag\":{\"x\":%.2f,\"y\":%.2f,\"z\":%.2f},"
             "\"power\":{\"bus_v\":%.3f,\"shunt_mv\":%.3f,\"i_ma\":%.2f},"
             "\"audio\":{\"samples\":%u,\"rms\":%.4f,\"peak\":%.4f}}",
             (unsigned long long)(esp_timer_get_time() / 1000ULL),
+            ok_env ? env.temp_c : 0.0f, ok_env ? env.hum_pct : 0.0f,
+            ok_env ? env.temp_sigma : 0.0f, ok_env ? env.hum_sigma : 0.0f,
             ok_bme ? bme.temperature_c : 0.0f, ok_bme ? bme.humidity_pct : 0.0f,
             ok_bme ? bme.pressure_hpa : 0.0f, ok_aht ? aht.temperature_c : 0.0f,
             ok_aht ? aht.humidity_pct : 0.0f, ok_ens ? ens.aqi_uba : 0,
@@ -834,15 +1042,12 @@ void app_main(void) {
         if (n > 0 && n < (int)sizeof(line)) {
           if (logger_append_line(line) == ESP_OK) {
             s_last_log.have = true;
-            if (ok_bme) {
-              s_last_log.bme_t = bme.temperature_c;
-              s_last_log.bme_h = bme.humidity_pct;
-              s_last_log.bme_p = bme.pressure_hpa;
-            }
-            if (ok_aht) {
-              s_last_log.aht_t = aht.temperature_c;
-              s_last_log.aht_h = aht.humidity_pct;
+            if (ok_env) {
+              s_last_log.temp_c = env.temp_c;
+              s_last_log.hum_pct = env.hum_pct;
             }
+            if (ok_bme)
+              s_last_log.press_hpa = bme.pressure_hpa;
             if (ok_ens) {
               s_last_log.aqi = ens.aqi_uba;
               s_last_log.tvoc = ens.tvoc_ppb;
@@ -872,7 +1077,7 @@ void app_main(void) {
       // Update metrics with latest sensor data for CH transmission
       static uint32_t s_packet_seq_num = 0;
       s_sensors_real = real_bme || real_aht || real_ens || real_mag ||
-                       real_ina || real_audio;
+                       ok_mag_ev || real_ina || real_audio;
 
       sensor_payload_t payload = {0};
       payload.node_id = g_node_id;
@@ -885,32 +1090,55 @@ void app_main(void) {
       esp_read_mac(mac, ESP_MAC_BT); // Use BT/BLE MAC as node ID is based on it
       memcpy(payload.mac_addr, mac, 6);
 
+      payload.temp_sigma = UINT8_MAX;
+      payload.hum_sigma = UINT8_MAX;
+      if (ok_env) {
+        payload.temp_c = env.temp_c;
+        payload.hum_pct = env.hum_pct;
+        payload.temp_sigma =
+            (uint8_t)fminf(env.temp_sigma * 100.0f + 0.5f, UINT8_MAX);
+        payload.hum_sigma =
+            (uint8_t)fminf(env.hum_sigma * 10.0f + 0.5f, UINT8_MAX);
+        payload.present |= (1U << ROLLUP_CH_TEMP) | (1U << ROLLUP_CH_HUM);
+      }
       if (ok_bme) {
-        payload.temp_c = bme.temperature_c;
-        payload.hum_pct = bme.humidity_pct;
         payload.pressure_hpa = (uint32_t)bme.pressure_hpa;
-      } else if (ok_aht) {
-        payload.temp_c = aht.temperature_c;
-        payload.hum_pct = aht.humidity_pct;
+        payload.present |= 1U << ROLLUP_CH_PRESS;
       }
 
       if (ok_ens) {
         payload.aqi = ens.aqi_uba;
         payload.tvoc_ppb = ens.tvoc_ppb;
         payload.eco2_ppm = ens.eco2_ppm;
+        payload.present |= (1U << ROLLUP_CH_AQI) | (1U << ROLLUP_CH_TVOC) |
+                           (1U << ROLLUP_CH_ECO2);
       }
 
       if (ok_mag) {
         payload.mag_x = mag.x_uT;
         payload.mag_y = mag.y_uT;
         payload.mag_z = mag.z_uT;
+      } else if (ok_mag_ev) {
+        // Field at the event's peak; the full window is in the event log line
+        payload.mag_x = mag_ev.field_ut[0];
+        payload.mag_y = mag_ev.field_ut[1];
+        payload.mag_z = mag_ev.field_ut[2];
       }
+      if (ok_mag || ok_mag_ev)
+        payload.present |= (1U << ROLLUP_CH_MAG_X) | (1U << ROLLUP_CH_MAG_Y) |
+                           (1U << ROLLUP_CH_MAG_Z);
 
       if (ok_audio) {
         payload.audio_rms = audio.rms_amplitude;
+        payload.present |= 1U << ROLLUP_CH_AUDIO_RMS;
       }
 
+      payload.anomaly_mask = anomaly_mask;
+      if (anomaly_mask)
+        payload.flags |= SENSOR_PAYLOAD_FLAG_ANOMALY;
+
       metrics_set_sensor_data(&payload);
+      queue_for_forwarding(&payload);
     }
 
     // ---- Storage monitoring ----
@@ -924,7 +1152,8 @@ void app_main(void) {
 
     // ---- Deep sleep decision ----
     if (mode == PME_MODE_CRITICAL) {
-      uint32_t sleep_ms = 1800000; // 30 minutes - wake to recheck battery
+      uint32_t sleep_ms =
+          PME_CRITICAL_SLEEP_MS; // 30 minutes - wake to recheck battery
       ESP_LOGW(TAG,
                "PME critical: entering deep sleep for %" PRIu32
                " ms (will recheck battery)",
@@ -932,9 +1161,15 @@ void app_main(void) {
 
       // Ensure buffered logs are written before power-down.
       (void)logger_flush();
+      persistence_flush_reputations();
 
       ESP_ERROR_CHECK(
           esp_sleep_enable_timer_wakeup((uint64_t)sleep_ms * 1000ULL));
+      // 433 MHz activity also wakes us; the code is confirmed after boot
+      (void)rf_receiver_prepare_deep_sleep();
+      // Keep sampling the environment on the ULP while the cores are off
+      (void)ulp_sampler_start(ULP_SAMPLE_INTERVAL_MS, ULP_TEMP_WAKE_LOW_C,
+                              ULP_TEMP_WAKE_HIGH_C);
       esp_deep_sleep_start();
     }
 
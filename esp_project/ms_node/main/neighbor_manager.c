@@ -8,6 +8,7 @@
 #include <math.h>
 #include <stddef.h>
 #include <string.h>
+#include <time.h>
 
 static const char *TAG = "NEIGHBOR";
 
@@ -38,7 +39,7 @@ void neighbor_manager_init(void) {
 void neighbor_manager_update(uint32_t node_id, const uint8_t *mac_addr,
                              int8_t rssi, float score, float battery,
                              uint64_t uptime, float trust, float link_quality,
-                             bool is_ch, uint8_t seq_num) {
+                             bool is_ch, uint8_t seq_num, uint8_t channel) {
   if (neighbor_mutex == NULL)
     return;
 
@@ -71,6 +72,11 @@ void neighbor_manager_update(uint32_t node_id, const uint8_t *mac_addr,
       // Sanity check: if diff is huge (e.g. node rebooted), ignore
       if (missed > 20)
         missed = 0;
+      // First beacon after a restore: the old sequence number means nothing
+      if (entry->restored && !entry->verified)
+        missed = 0;
+
+      entry->pdr += PDR_EWMA_ALPHA * (1.0f / (1.0f + missed) - entry->pdr);
 
       // Update PER metrics (1 received, N missed)
       metrics_record_ble_reception(1, missed);
@@ -96,10 +102,13 @@ void neighbor_manager_update(uint32_t node_id, const uint8_t *mac_addr,
       entry->score = score;
       entry->battery = battery;
       entry->uptime_seconds = uptime;
-      entry->trust = trust;
+      // The self-reported trust is one more observation: it does not wipe
+      // out ESP-NOW evidence or trust restored from before a reboot
+      entry->trust += TRUST_REPORT_ALPHA * (trust - entry->trust);
       entry->link_quality = link_quality;
       entry->last_seen_ms = now_ms;
       entry->is_ch = is_ch;
+      entry->channel = channel;
       if (is_ch) {
         entry->ch_announce_timestamp = now_ms;
         ESP_LOGD(TAG, "CH beacon from node_%lu: timestamp updated to %llu ms",
@@ -133,6 +142,9 @@ void neighbor_manager_update(uint32_t node_id, const uint8_t *mac_addr,
     entry->ch_announce_timestamp = is_ch ? now_ms : 0;
     entry->verified = true;
     entry->last_seq_num = seq_num; // Initialize sequence number
+    entry->channel = channel;
+    entry->pdr = 1.0f;
+    entry->restored = false;
     neighbor_count++;
 
     ESP_LOGI(TAG, "Added neighbor: node_id=%lu, RSSI=%d, Seq=%d", node_id, rssi,
@@ -342,6 +354,67 @@ void neighbor_manager_update_trust(uint32_t node_id, bool success) {
   }
 }
 
+size_t neighbor_manager_export_reputations(neighbor_reputation_t *out,
+                                           size_t max_count) {
+  if (neighbor_mutex == NULL || out == NULL)
+    return 0;
+
+  size_t n = 0;
+  const uint64_t now_ms = esp_timer_get_time() / 1000;
+  const time_t now_s = time(NULL);
+
+  if (xSemaphoreTake(neighbor_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+    for (size_t i = 0; i < neighbor_count && n < max_count; i++) {
+      const neighbor_entry_t *e = &neighbor_table[i];
+      // Restored but not heard again: gone, or it would have been by now
+      if (!e->verified)
+        continue;
+      neighbor_reputation_t *r = &out[n++];
+      r->node_id = e->node_id;
+      memcpy(r->mac_addr, e->mac_addr, 6);
+      r->trust = (uint16_t)lroundf(fminf(fmaxf(e->trust, 0.0f), 1.0f) *
+                                   65535.0f);
+      r->pdr =
+          (uint16_t)lroundf(fminf(fmaxf(e->pdr, 0.0f), 1.0f) * 65535.0f);
+      r->last_seen_s =
+          (uint32_t)(now_s - (time_t)((now_ms - e->last_seen_ms) / 1000));
+    }
+    xSemaphoreGive(neighbor_mutex);
+  }
+  return n;
+}
+
+void neighbor_manager_restore(const neighbor_reputation_t *records,
+                              size_t count) {
+  if (neighbor_mutex == NULL || records == NULL)
+    return;
+  if (xSemaphoreTake(neighbor_mutex, pdMS_TO_TICKS(100)) != pdTRUE)
+    return;
+
+  const uint64_t now_ms = esp_timer_get_time() / 1000;
+  for (size_t i = 0; i < count && neighbor_count < MAX_NEIGHBORS; i++) {
+    bool known = false;
+    for (size_t j = 0; j < neighbor_count; j++) {
+      known |= neighbor_table[j].node_id == records[i].node_id;
+    }
+    if (known)
+      continue;
+
+    neighbor_entry_t *entry = &neighbor_table[neighbor_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->node_id = records[i].node_id;
+    memcpy(entry->mac_addr, records[i].mac_addr, 6);
+    entry->trust = records[i].trust / 65535.0f;
+    entry->pdr = records[i].pdr / 65535.0f;
+    // Kept for one NEIGHBOR_TIMEOUT_MS unless a beacon arrives
+    entry->last_seen_ms = now_ms;
+    entry->restored = true;
+  }
+  ESP_LOGI(TAG, "Restored %u neighbor reputation(s)",
+           (unsigned)neighbor_count);
+  xSemaphoreGive(neighbor_mutex);
+}
+
 size_t neighbor_manager_get_count(void) {
   if (neighbor_mutex == NULL)
     return 0;
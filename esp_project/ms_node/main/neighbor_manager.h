@@ -21,8 +21,22 @@ typedef struct {
   uint64_t ch_announce_timestamp;
   bool verified;        // HMAC verified
   uint8_t last_seq_num; // Last received sequence number
+  uint8_t channel;      // ESP-NOW data channel it announces
+  float pdr;            // Beacon delivery ratio (EWMA over sequence gaps)
+  bool restored;        // Known from before our last reboot
 } neighbor_entry_t;
 
+/**
+ * @brief What survives a reboot for one neighbor (persistence.c)
+ */
+typedef struct __attribute__((packed)) {
+  uint32_t node_id;
+  uint8_t mac_addr[6];
+  uint16_t trust;       // 0..65535 = 0.0..1.0
+  uint16_t pdr;         // 0..65535 = 0.0..1.0
+  uint32_t last_seen_s; // time() when last heard
+} neighbor_reputation_t;
+
 /**
  * @brief Initialize neighbor manager
  */
@@ -31,7 +45,7 @@ void neighbor_manager_init(void);
 void neighbor_manager_update(uint32_t node_id, const uint8_t *mac_addr,
                              int8_t rssi, float score, float battery,
                              uint64_t uptime, float trust, float link_quality,
-                             bool is_ch, uint8_t seq_num);
+                             bool is_ch, uint8_t seq_num, uint8_t channel);
 neighbor_entry_t *neighbor_manager_get(uint32_t node_id);
 neighbor_entry_t *neighbor_manager_get_by_mac(const uint8_t *mac_addr);
 
@@ -80,6 +94,21 @@ uint32_t neighbor_manager_get_current_ch(void);
  */
 void neighbor_manager_update_trust(uint32_t node_id, bool success);
 
+/**
+ * @brief Copy trust and PDR of every neighbor heard since boot
+ * @return Number of records written
+ */
+size_t neighbor_manager_export_reputations(neighbor_reputation_t *out,
+                                           size_t max_count);
+
+/**
+ * @brief Seed the table from a previous boot. Restored entries keep their
+ *        trust and PDR but stay unverified (no election, no CH) until a
+ *        beacon is heard; unheard ones age out like any stale neighbor.
+ */
+void neighbor_manager_restore(const neighbor_reputation_t *records,
+                              size_t count);
+
 /**
  * @brief Get total number of active neighbors
  * @return Count
@@ -0,0 +1,823 @@
+#include "ota_mesh.h"
+#include "auth.h"
+#include "compression.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "esp_now_manager.h"
+#include "esp_now_rate.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "mbedtls/ecdsa.h"
+#include "mbedtls/sha256.h"
+#include "mem_plan.h"
+#include "neighbor_manager.h"
+#include "ota_sign_key.h"
+#include "persistence.h"
+#include "state_machine.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <inttypes.h>
+#include <string.h>
+
+static const char *TAG = "OTA_MESH";
+
+
+#define PKG_TABLE_OFFSET sizeof(ota_pkg_hdr_t)
+
+typedef enum {
+  ROLE_NONE,
+  ROLE_CH,     // Distributing a staged package
+  ROLE_MEMBER, // Receiving one
+} ota_role_t;
+
+typedef enum {
+  EVT_OFFER,
+  EVT_STATUS,
+  EVT_COMPLETE, // Member: last fragment arrived
+  EVT_STAGED,   // CH: package committed
+} ota_evt_type_t;
+
+typedef struct {
+  ota_evt_type_t type;
+  uint8_t src[ESP_NOW_ETH_ALEN];
+  union {
+    ota_offer_msg_t offer;
+    ota_status_msg_t status;
+  };
+} ota_evt_t;
+
+typedef struct {
+  bool used;
+  uint8_t mac[ESP_NOW_ETH_ALEN];
+  ota_status_t status;
+  uint16_t missing;
+} member_t;
+
+// Session state. The Wi-Fi task writes fragments into pkg/have under
+// s_mux; everything else belongs to the OTA task.
+static struct {
+  volatile ota_role_t role;
+  uint32_t session;
+  uint8_t *pkg;
+  uint32_t pkg_len;
+  uint32_t staged; // CH: bytes received from the uplink
+  uint16_t frag_count;
+  uint8_t *have; // Member: received; CH: needed this round
+  volatile uint16_t have_count;
+  volatile ota_status_t status;
+  uint8_t ch_mac[ESP_NOW_ETH_ALEN];
+  int64_t last_rx_us;
+  // CH accounting
+  member_t members[MAX_NEIGHBORS];
+  uint8_t rounds;
+  uint32_t frags_sent, bytes_sent, airtime_us;
+} s_ota;
+
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static const esp_partition_t *s_running = NULL;
+static uint8_t s_running_sha[32];
+static char s_running_hex[65];
+static volatile bool s_pending_verify = false; // Booted from an update
+
+static StackType_t s_task_stack[6144]; // ECDSA verify runs here
+static StaticTask_t s_task_tcb;
+static TaskHandle_t s_task = NULL;
+static uint8_t s_evt_storage[8 * sizeof(ota_evt_t)];
+static StaticQueue_t s_evt_buf;
+static QueueHandle_t s_evt_q = NULL;
+
+static bool bit_get(const uint8_t *map, uint32_t i) {
+  return map[i >> 3] & (1u << (i & 7));
+}
+
+static void bit_set(uint8_t *map, uint32_t i) { map[i >> 3] |= 1u << (i & 7); }
+
+static uint16_t frag_len(uint16_t index) {
+  const uint32_t off = (uint32_t)index * OTA_MESH_FRAG_BYTES;
+  const uint32_t left = s_ota.pkg_len - off;
+  return (uint16_t)(left < OTA_MESH_FRAG_BYTES ? left : OTA_MESH_FRAG_BYTES);
+}
+
+static void session_free(void) {
+  taskENTER_CRITICAL(&s_mux);
+  s_ota.role = ROLE_NONE;
+  uint8_t *pkg = s_ota.pkg;
+  uint8_t *have = s_ota.have;
+  s_ota.pkg = NULL;
+  s_ota.have = NULL;
+  taskEXIT_CRITICAL(&s_mux);
+  heap_caps_free(pkg);
+  free(have);
+  s_ota.session = 0;
+  s_ota.staged = 0;
+  s_ota.have_count = 0;
+}
+
+static void send_to(const uint8_t *mac, esp_now_class_t cls, const void *msg,
+                    size_t len) {
+  if (mac) {
+    esp_now_manager_register_peer(mac, false);
+  }
+  if (esp_now_manager_send_data(cls, mac, msg, len) != ESP_OK) {
+    ESP_LOGD(TAG, "OTA frame not queued");
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Applying a package (both roles)
+// -----------------------------------------------------------------------------
+
+// Signature over the header (signature zeroed) and the source table, as
+// they are in the buffer now. The container needs none: the image rebuilt
+// from it has to match new_sha. The caller has checked that the table is
+// there.
+static bool pkg_authentic(const uint8_t *pkg) {
+  ota_pkg_hdr_t hdr;
+  memcpy(&hdr, pkg, sizeof(hdr));
+  memset(hdr.sig, 0, sizeof(hdr.sig));
+  uint8_t digest[32];
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  bool ok = mbedtls_sha256_starts(&sha, 0) == 0 &&
+            mbedtls_sha256_update(&sha, (const uint8_t *)&hdr,
+                                  sizeof(hdr)) == 0 &&
+            mbedtls_sha256_update(&sha, pkg + PKG_TABLE_OFFSET,
+                                  hdr.block_count * sizeof(uint32_t)) == 0 &&
+            mbedtls_sha256_finish(&sha, digest) == 0;
+  mbedtls_sha256_free(&sha);
+
+  const ota_pkg_hdr_t *sent = (const ota_pkg_hdr_t *)pkg;
+  mbedtls_ecp_group grp;
+  mbedtls_ecp_point pub;
+  mbedtls_mpi r, s;
+  mbedtls_ecp_group_init(&grp);
+  mbedtls_ecp_point_init(&pub);
+  mbedtls_mpi_init(&r);
+  mbedtls_mpi_init(&s);
+  ok = ok && mbedtls_ecp_group_load(&grp, MBEDTLS_ECP_DP_SECP256R1) == 0 &&
+       mbedtls_ecp_point_read_binary(&grp, &pub, k_ota_sign_pub,
+                                     sizeof(k_ota_sign_pub)) == 0 &&
+       mbedtls_mpi_read_binary(&r, sent->sig, 32) == 0 &&
+       mbedtls_mpi_read_binary(&s, sent->sig + 32, 32) == 0 &&
+       mbedtls_ecdsa_verify(&grp, digest, sizeof(digest), &pub, &r, &s) == 0;
+  mbedtls_mpi_free(&s);
+  mbedtls_mpi_free(&r);
+  mbedtls_ecp_point_free(&pub);
+  mbedtls_ecp_group_free(&grp);
+  return ok;
+}
+
+static esp_err_t check_header(const uint8_t *pkg, size_t len,
+                              ota_pkg_hdr_t *hdr) {
+  if (len < sizeof(*hdr)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(hdr, pkg, sizeof(*hdr));
+  if (hdr->magic != OTA_PKG_MAGIC || hdr->version != OTA_PKG_VERSION ||
+      hdr->block_size == 0 || hdr->new_len == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  const uint32_t blocks =
+      (hdr->new_len + hdr->block_size - 1) / hdr->block_size;
+  if (hdr->block_count != blocks ||
+      len < PKG_TABLE_OFFSET + (size_t)blocks * sizeof(uint32_t)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (!pkg_authentic(pkg)) {
+    return ESP_ERR_NOT_ALLOWED; // Not signed with the fleet key
+  }
+  if (memcmp(hdr->base_sha, s_running_sha, sizeof(s_running_sha)) != 0) {
+    return ESP_ERR_INVALID_STATE; // Delta against another image
+  }
+  return ESP_OK;
+}
+
+static esp_err_t apply_package(const uint8_t *pkg, size_t len) {
+  ota_pkg_hdr_t hdr;
+  esp_err_t err = check_header(pkg, len, &hdr);
+  if (err != ESP_OK) {
+    return err;
+  }
+  const uint8_t *table = pkg + PKG_TABLE_OFFSET;
+  const uint8_t *container = table + hdr.block_count * sizeof(uint32_t);
+  const size_t container_len = len - (size_t)(container - pkg);
+
+  const esp_partition_t *target = esp_ota_get_next_update_partition(NULL);
+  if (!target || target->size < hdr.new_len) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  uint8_t *buf = mem_plan_alloc(hdr.block_size, MEM_CAPS_BULK);
+  if (!buf) {
+    return ESP_ERR_NO_MEM;
+  }
+  esp_ota_handle_t h;
+  err = esp_ota_begin(target, hdr.new_len, &h);
+  if (err != ESP_OK) {
+    heap_caps_free(buf);
+    return err;
+  }
+
+  const int64_t t0 = esp_timer_get_time();
+  uint32_t literal = 0;
+  for (uint32_t j = 0; j < hdr.block_count && err == ESP_OK; j++) {
+    const uint32_t off = j * hdr.block_size;
+    const size_t n = (hdr.new_len - off < hdr.block_size) ? hdr.new_len - off
+                                                          : hdr.block_size;
+    uint32_t src;
+    memcpy(&src, table + j * sizeof(uint32_t), sizeof(src));
+    if (src == OTA_SRC_LITERAL) {
+      const uint8_t *blk;
+      size_t blk_len, raw_len, out_len = 0;
+      err = lz_parallel_block(container, container_len, literal++, &blk,
+                              &blk_len, &raw_len);
+      if (err == ESP_OK && raw_len != n) {
+        err = ESP_ERR_INVALID_SIZE;
+      }
+      if (err == ESP_OK) {
+        err = lz_decompress_miniz(blk, blk_len, buf, hdr.block_size, &out_len,
+                                  NULL);
+      }
+      if (err == ESP_OK && out_len != n) {
+        err = ESP_ERR_INVALID_SIZE;
+      }
+    } else if (src + n > hdr.base_len) {
+      err = ESP_ERR_INVALID_SIZE;
+    } else {
+      err = esp_partition_read(s_running, src, buf, n);
+    }
+    if (err == ESP_OK) {
+      err = esp_ota_write(h, buf, n);
+    }
+  }
+  heap_caps_free(buf);
+  if (err != ESP_OK) {
+    esp_ota_abort(h);
+    return err;
+  }
+  err = esp_ota_end(h); // Checks the image and its appended digest
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  uint8_t sha[32];
+  err = esp_partition_get_sha256(target, sha);
+  if (err == ESP_OK && memcmp(sha, hdr.new_sha, sizeof(sha)) != 0) {
+    err = ESP_ERR_INVALID_CRC;
+  }
+  // The image was built from the table as the buffer holds it now: check
+  // once more before the bootloader is pointed at it
+  if (err == ESP_OK && !pkg_authentic(pkg)) {
+    err = ESP_ERR_NOT_ALLOWED;
+  }
+  if (err == ESP_OK) {
+    err = esp_ota_set_boot_partition(target);
+  }
+  ESP_LOGI(TAG, "Image %" PRIu32 " B rebuilt into %s in %lld ms (%" PRIu32
+                " changed blocks of %" PRIu32 "): %s",
+           hdr.new_len, target->label,
+           (long long)((esp_timer_get_time() - t0) / 1000), literal,
+           hdr.block_count, esp_err_to_name(err));
+  return err;
+}
+
+static void reboot_into_update(void) {
+  ESP_LOGW(TAG, "Rebooting into the new image");
+  persistence_flush_reputations(); // The cluster re-forms around the same CH
+  vTaskDelay(pdMS_TO_TICKS(OTA_MESH_REBOOT_DELAY_MS));
+  esp_restart();
+}
+
+// -----------------------------------------------------------------------------
+// Member
+// -----------------------------------------------------------------------------
+
+static void member_send_status(void) {
+  ota_status_msg_t msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.magic = OTA_MSG_STATUS;
+  msg.session = s_ota.session;
+  msg.status = (uint8_t)s_ota.status;
+
+  // Spread the replies of a whole cluster over the collection window
+  vTaskDelay(pdMS_TO_TICKS(esp_random() % OTA_MESH_STATUS_BACKOFF_MS));
+  bool sent = false;
+  if (s_ota.status == OTA_STATUS_RECEIVING && s_ota.have) {
+    // One bitmap per window that still has holes, so a round repairs the
+    // whole package and not just the window of the first hole
+    msg.missing = (uint16_t)(s_ota.frag_count - s_ota.have_count);
+    for (uint32_t first = 0; first < s_ota.frag_count;
+         first += OTA_STATUS_WINDOW) {
+      bool holes = false;
+      memset(msg.bitmap, 0, sizeof(msg.bitmap));
+      for (uint32_t i = 0; i < OTA_STATUS_WINDOW; i++) {
+        const uint32_t f = first + i;
+        if (f < s_ota.frag_count && !bit_get(s_ota.have, f)) {
+          bit_set(msg.bitmap, i);
+          holes = true;
+        }
+      }
+      if (!holes) {
+        continue;
+      }
+      msg.first = (uint16_t)first;
+      while (esp_now_manager_queue_free(ESP_NOW_CLASS_CONTROL) == 0) {
+        vTaskDelay(pdMS_TO_TICKS(2));
+      }
+      send_to(s_ota.ch_mac, ESP_NOW_CLASS_CONTROL, &msg, sizeof(msg));
+      sent = true;
+    }
+  }
+  if (!sent) {
+    send_to(s_ota.ch_mac, ESP_NOW_CLASS_CONTROL, &msg, sizeof(msg));
+  }
+}
+
+static void member_reply(const uint8_t *ch, uint32_t session,
+                         ota_status_t status) {
+  ota_status_msg_t msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.magic = OTA_MSG_STATUS;
+  msg.session = session;
+  msg.status = (uint8_t)status;
+  send_to(ch, ESP_NOW_CLASS_CONTROL, &msg, sizeof(msg));
+}
+
+// Tagged with the cluster key and sent by the CH we are a member of. Its
+// beacon carries only the last two bytes of its Wi-Fi MAC (ble_manager.c),
+// so those are what the sender address can be matched against.
+static bool offer_from_ch(const uint8_t *src, const ota_offer_msg_t *o) {
+  uint8_t tag[OTA_MESH_HMAC_BYTES];
+  auth_frame_tag(o, sizeof(*o), offsetof(ota_offer_msg_t, hmac), tag,
+                 sizeof(tag));
+  if (memcmp(tag, o->hmac, sizeof(tag)) != 0 || o->ch_id == 0 ||
+      o->ch_id != neighbor_manager_get_current_ch()) {
+    return false;
+  }
+  const neighbor_entry_t *ch = neighbor_manager_get(o->ch_id);
+  return ch && memcmp(&ch->mac_addr[4], &src[4], 2) == 0;
+}
+
+static void member_on_offer(const uint8_t *src, const ota_offer_msg_t *o) {
+  if (s_ota.role == ROLE_CH) {
+    return;
+  }
+  if (!offer_from_ch(src, o)) {
+    ESP_LOGW(TAG, "Offer %08" PRIx32 " from " MACSTR " is not from our CH",
+             o->session, MAC2STR(src));
+    return;
+  }
+  if (s_ota.role == ROLE_MEMBER && o->session == s_ota.session) {
+    member_send_status();
+    return;
+  }
+  if (memcmp(o->new_sha, s_running_sha, sizeof(o->new_sha)) == 0) {
+    member_reply(src, o->session, OTA_STATUS_DONE); // Already on it
+    return;
+  }
+  if (memcmp(o->base_sha, s_running_sha, sizeof(o->base_sha)) != 0) {
+    ESP_LOGW(TAG, "Offer %08" PRIx32 " is for another base image",
+             o->session);
+    member_reply(src, o->session, OTA_STATUS_REJECTED);
+    return;
+  }
+  const uint32_t frags =
+      (o->pkg_len + OTA_MESH_FRAG_BYTES - 1) / OTA_MESH_FRAG_BYTES;
+  uint8_t *pkg = NULL, *have = NULL;
+  if (o->pkg_len <= OTA_MESH_MAX_PKG_BYTES && frags == o->frag_count) {
+    pkg = mem_plan_alloc(o->pkg_len, MEM_CAPS_BULK);
+    have = calloc(1, (frags + 7) / 8);
+  }
+  if (!pkg || !have) {
+    heap_caps_free(pkg);
+    free(have);
+    member_reply(src, o->session, OTA_STATUS_FAILED);
+    return;
+  }
+
+  session_free();
+  memcpy(s_ota.ch_mac, src, sizeof(s_ota.ch_mac));
+  s_ota.pkg_len = o->pkg_len;
+  s_ota.frag_count = o->frag_count;
+  s_ota.status = OTA_STATUS_RECEIVING;
+  s_ota.last_rx_us = esp_timer_get_time();
+  taskENTER_CRITICAL(&s_mux);
+  s_ota.pkg = pkg;
+  s_ota.have = have;
+  s_ota.session = o->session;
+  s_ota.role = ROLE_MEMBER;
+  taskEXIT_CRITICAL(&s_mux);
+  ESP_LOGI(TAG, "Receiving update %08" PRIx32 ": %" PRIu32 " B in %u "
+                "fragments",
+           o->session, o->pkg_len, o->frag_count);
+  member_send_status();
+}
+
+static void member_on_complete(void) {
+  s_ota.status = OTA_STATUS_APPLYING;
+  member_send_status();
+  esp_err_t err = apply_package(s_ota.pkg, s_ota.pkg_len);
+  s_ota.status = (err == ESP_OK) ? OTA_STATUS_DONE : OTA_STATUS_FAILED;
+  member_send_status();
+  if (err == ESP_OK) {
+    reboot_into_update();
+  }
+  ESP_LOGE(TAG, "Update failed: %s", esp_err_to_name(err));
+  session_free();
+}
+
+// -----------------------------------------------------------------------------
+// Cluster head
+// -----------------------------------------------------------------------------
+
+static member_t *member_slot(const uint8_t *mac) {
+  member_t *free_slot = NULL;
+  for (int i = 0; i < MAX_NEIGHBORS; i++) {
+    member_t *m = &s_ota.members[i];
+    if (m->used && memcmp(m->mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+      return m;
+    }
+    if (!m->used && !free_slot) {
+      free_slot = m;
+    }
+  }
+  if (free_slot) {
+    free_slot->used = true;
+    memcpy(free_slot->mac, mac, ESP_NOW_ETH_ALEN);
+  }
+  return free_slot;
+}
+
+static void ch_on_status(const uint8_t *src, const ota_status_msg_t *st) {
+  if (s_ota.role != ROLE_CH || st->session != s_ota.session) {
+    return;
+  }
+  member_t *m = member_slot(src);
+  if (!m) {
+    return;
+  }
+  m->status = (ota_status_t)st->status;
+  m->missing = st->missing;
+  if (m->status != OTA_STATUS_RECEIVING) {
+    return;
+  }
+  // Union of everyone's holes is what goes out this round
+  for (uint32_t i = 0; i < OTA_STATUS_WINDOW; i++) {
+    const uint32_t f = st->first + i;
+    if (f < s_ota.frag_count && bit_get(st->bitmap, i) &&
+        !bit_get(s_ota.have, f)) {
+      bit_set(s_ota.have, f);
+      s_ota.have_count++;
+    }
+  }
+}
+
+// Broadcast an offer and gather the statuses it provokes
+static void ch_offer_round(uint8_t round) {
+  const ota_pkg_hdr_t *hdr = (const ota_pkg_hdr_t *)s_ota.pkg;
+  ota_offer_msg_t offer;
+  memset(&offer, 0, sizeof(offer));
+  offer.magic = OTA_MSG_OFFER;
+  offer.session = s_ota.session;
+  offer.pkg_len = s_ota.pkg_len;
+  offer.frag_count = s_ota.frag_count;
+  offer.round = round;
+  memcpy(offer.base_sha, hdr->base_sha, sizeof(offer.base_sha));
+  memcpy(offer.new_sha, hdr->new_sha, sizeof(offer.new_sha));
+  offer.ch_id = g_node_id;
+  auth_frame_tag(&offer, sizeof(offer), offsetof(ota_offer_msg_t, hmac),
+                 offer.hmac, sizeof(offer.hmac));
+
+  memset(s_ota.have, 0, (s_ota.frag_count + 7) / 8);
+  s_ota.have_count = 0;
+  for (int r = 0; r < OTA_MESH_OFFER_REPEATS; r++) {
+    send_to(NULL, ESP_NOW_CLASS_CONTROL, &offer, sizeof(offer));
+    const int64_t until = esp_timer_get_time() +
+                          (int64_t)OTA_MESH_STATUS_WINDOW_MS * 1000 /
+                              OTA_MESH_OFFER_REPEATS;
+    ota_evt_t evt;
+    int64_t left;
+    while ((left = until - esp_timer_get_time()) > 0) {
+      if (xQueueReceive(s_evt_q, &evt, pdMS_TO_TICKS(left / 1000 + 1)) ==
+              pdTRUE &&
+          evt.type == EVT_STATUS) {
+        ch_on_status(evt.src, &evt.status);
+      }
+    }
+  }
+}
+
+static void ch_send_needed(void) {
+  ota_data_msg_t msg;
+  msg.magic = OTA_MSG_DATA;
+  msg.session = s_ota.session;
+  msg.reserved = 0;
+  for (uint32_t f = 0; f < s_ota.frag_count; f++) {
+    if (!bit_get(s_ota.have, f)) {
+      continue;
+    }
+    msg.index = (uint16_t)f;
+    msg.len = (uint8_t)frag_len((uint16_t)f);
+    memcpy(msg.data, s_ota.pkg + f * OTA_MESH_FRAG_BYTES, msg.len);
+    const size_t len = offsetof(ota_data_msg_t, data) + msg.len;
+    while (esp_now_manager_queue_free(ESP_NOW_CLASS_BULK) == 0) {
+      vTaskDelay(pdMS_TO_TICKS(2));
+    }
+    send_to(NULL, ESP_NOW_CLASS_BULK, &msg, len);
+    s_ota.frags_sent++;
+    s_ota.bytes_sent += len;
+    s_ota.airtime_us += esp_now_rate_frame_airtime_us(-1, len);
+  }
+}
+
+static void ch_distribute(void) {
+  const ota_pkg_hdr_t *hdr = (const ota_pkg_hdr_t *)s_ota.pkg;
+  memcpy(&s_ota.session, hdr->new_sha, sizeof(s_ota.session));
+  s_ota.session ^= s_ota.pkg_len;
+  s_ota.frag_count = (uint16_t)((s_ota.pkg_len + OTA_MESH_FRAG_BYTES - 1) /
+                                OTA_MESH_FRAG_BYTES);
+  s_ota.have = calloc(1, (s_ota.frag_count + 7) / 8);
+  memset(s_ota.members, 0, sizeof(s_ota.members));
+  s_ota.frags_sent = s_ota.bytes_sent = s_ota.airtime_us = 0;
+  if (!s_ota.have) {
+    ESP_LOGE(TAG, "No memory for the fragment map");
+    session_free();
+    return;
+  }
+  ESP_LOGI(TAG, "Distributing update %08" PRIx32 ": %" PRIu32 " B, %u "
+                "fragments",
+           s_ota.session, s_ota.pkg_len, s_ota.frag_count);
+
+  int silent = 0;
+  for (s_ota.rounds = 0; s_ota.rounds < OTA_MESH_MAX_ROUNDS;
+       s_ota.rounds++) {
+    ch_offer_round(s_ota.rounds);
+
+    int heard = 0, busy = 0;
+    for (int i = 0; i < MAX_NEIGHBORS; i++) {
+      const member_t *m = &s_ota.members[i];
+      if (m->used) {
+        heard++;
+        busy += (m->status == OTA_STATUS_RECEIVING ||
+                 m->status == OTA_STATUS_APPLYING);
+      }
+    }
+    if (heard == 0 && ++silent >= 2) {
+      break; // Nobody in the cluster is listening
+    }
+    if (heard > 0 && busy == 0) {
+      break; // Every member is done, or cannot take this image
+    }
+    ch_send_needed();
+  }
+  ota_mesh_log_report();
+}
+
+// -----------------------------------------------------------------------------
+// Task and entry points
+// -----------------------------------------------------------------------------
+
+static void ota_task(void *arg) {
+  for (;;) {
+    ota_evt_t evt;
+    if (xQueueReceive(s_evt_q, &evt, pdMS_TO_TICKS(1000)) != pdTRUE) {
+      // A member whose CH went quiet gives up eventually
+      if (s_ota.role == ROLE_MEMBER &&
+          s_ota.status == OTA_STATUS_RECEIVING &&
+          esp_timer_get_time() - s_ota.last_rx_us >
+              (int64_t)OTA_MESH_IDLE_TIMEOUT_MS * 1000) {
+        ESP_LOGW(TAG, "Update %08" PRIx32 " stalled at %u/%u fragments",
+                 s_ota.session, s_ota.have_count, s_ota.frag_count);
+        session_free();
+      }
+      // An update that never gets the node back into a cluster is undone
+      if (s_pending_verify &&
+          esp_timer_get_time() > (int64_t)OTA_MESH_VERIFY_TIMEOUT_MS * 1000) {
+        ESP_LOGE(TAG, "No cluster %d s after the update, rolling back",
+                 OTA_MESH_VERIFY_TIMEOUT_MS / 1000);
+        persistence_flush_reputations();
+        esp_ota_mark_app_invalid_rollback_and_reboot();
+      }
+      continue;
+    }
+    switch (evt.type) {
+    case EVT_OFFER:
+      member_on_offer(evt.src, &evt.offer);
+      break;
+    case EVT_COMPLETE:
+      if (s_ota.role == ROLE_MEMBER) {
+        member_on_complete();
+      }
+      break;
+    case EVT_STAGED: {
+      ch_distribute();
+      // Members first, then ourselves
+      esp_err_t err = apply_package(s_ota.pkg, s_ota.pkg_len);
+      if (err == ESP_OK) {
+        reboot_into_update();
+      }
+      ESP_LOGE(TAG, "Local update failed: %s", esp_err_to_name(err));
+      session_free();
+      break;
+    }
+    case EVT_STATUS:
+      break; // Outside a collection window
+    }
+  }
+}
+
+esp_err_t ota_mesh_init(void) {
+  s_running = esp_ota_get_running_partition();
+  esp_err_t err = s_running ? esp_partition_get_sha256(s_running, s_running_sha)
+                            : ESP_ERR_NOT_FOUND;
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Running image digest unavailable: %s",
+             esp_err_to_name(err));
+    return err;
+  }
+  for (int i = 0; i < 32; i++) {
+    snprintf(&s_running_hex[i * 2], 3, "%02x", s_running_sha[i]);
+  }
+  esp_ota_img_states_t state;
+  s_pending_verify = esp_ota_get_state_partition(s_running, &state) ==
+                         ESP_OK &&
+                     state == ESP_OTA_IMG_PENDING_VERIFY;
+  if (s_pending_verify) {
+    ESP_LOGW(TAG, "Image pending verification until the node rejoins a "
+                  "cluster");
+  }
+
+  s_evt_q = xQueueCreateStatic(8, sizeof(ota_evt_t), s_evt_storage,
+                               &s_evt_buf);
+  s_task = xTaskCreateStatic(ota_task, "ota_mesh", sizeof(s_task_stack), NULL,
+                             4, s_task_stack, &s_task_tcb);
+  mem_plan_watch_task(s_task);
+  ESP_LOGI(TAG, "Running %s, image %.16s...", s_running->label,
+           s_running_hex);
+  return ESP_OK;
+}
+
+static void on_data(const uint8_t *src, const ota_data_msg_t *msg, int len) {
+  bool complete = false;
+  taskENTER_CRITICAL(&s_mux);
+  if (s_ota.role == ROLE_MEMBER && s_ota.pkg && msg->session == s_ota.session &&
+      memcmp(src, s_ota.ch_mac, sizeof(s_ota.ch_mac)) == 0 &&
+      msg->index < s_ota.frag_count && !bit_get(s_ota.have, msg->index) &&
+      msg->len == frag_len(msg->index) &&
+      len >= (int)(offsetof(ota_data_msg_t, data) + msg->len)) {
+    memcpy(s_ota.pkg + (uint32_t)msg->index * OTA_MESH_FRAG_BYTES, msg->data,
+           msg->len);
+    bit_set(s_ota.have, msg->index);
+    s_ota.have_count++;
+    complete = (s_ota.have_count == s_ota.frag_count);
+  }
+  taskEXIT_CRITICAL(&s_mux);
+  s_ota.last_rx_us = esp_timer_get_time();
+
+  if (complete) {
+    ota_evt_t evt = {.type = EVT_COMPLETE};
+    xQueueSend(s_evt_q, &evt, 0);
+  }
+}
+
+bool ota_mesh_handle_frame(const uint8_t *src, const uint8_t *data, int len) {
+  if (len < (int)sizeof(uint32_t) || !s_evt_q) {
+    return false;
+  }
+  uint32_t magic;
+  memcpy(&magic, data, sizeof(magic));
+
+  ota_evt_t evt;
+  if (magic == OTA_MSG_DATA) {
+    if (len >= (int)offsetof(ota_data_msg_t, data)) {
+      ota_data_msg_t msg;
+      memcpy(&msg, data, len < (int)sizeof(msg) ? (size_t)len : sizeof(msg));
+      on_data(src, &msg, len);
+    }
+    return true;
+  } else if (magic == OTA_MSG_OFFER && len == sizeof(ota_offer_msg_t)) {
+    evt.type = EVT_OFFER;
+    memcpy(&evt.offer, data, sizeof(evt.offer));
+  } else if (magic == OTA_MSG_STATUS && len == sizeof(ota_status_msg_t)) {
+    evt.type = EVT_STATUS;
+    memcpy(&evt.status, data, sizeof(evt.status));
+  } else {
+    return false;
+  }
+  memcpy(evt.src, src, sizeof(evt.src));
+  if (xQueueSend(s_evt_q, &evt, 0) != pdTRUE) {
+    ESP_LOGD(TAG, "Event queue full");
+  }
+  return true;
+}
+
+esp_err_t ota_mesh_stage_chunk(const uint8_t *data, size_t len, size_t total,
+                               void *ctx) {
+  (void)ctx;
+  if (!s_evt_q || s_ota.role != ROLE_NONE) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (!s_ota.pkg) {
+    if (total < sizeof(ota_pkg_hdr_t) || total > OTA_MESH_MAX_PKG_BYTES) {
+      return ESP_ERR_INVALID_SIZE;
+    }
+    s_ota.pkg = mem_plan_alloc(total, MEM_CAPS_BULK);
+    if (!s_ota.pkg) {
+      return ESP_ERR_NO_MEM;
+    }
+    s_ota.pkg_len = (uint32_t)total;
+    s_ota.staged = 0;
+  }
+  if (total != s_ota.pkg_len || len > s_ota.pkg_len - s_ota.staged) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(s_ota.pkg + s_ota.staged, data, len);
+  s_ota.staged += len;
+  return ESP_OK;
+}
+
+esp_err_t ota_mesh_stage_commit(void) {
+  if (!s_evt_q || s_ota.role != ROLE_NONE) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (!s_ota.pkg || s_ota.staged != s_ota.pkg_len) {
+    session_free();
+    return ESP_ERR_INVALID_SIZE;
+  }
+  ota_pkg_hdr_t hdr;
+  esp_err_t err = check_header(s_ota.pkg, s_ota.pkg_len, &hdr);
+  if (err == ESP_OK &&
+      memcmp(hdr.new_sha, s_running_sha, sizeof(s_running_sha)) == 0) {
+    err = ESP_ERR_INVALID_STATE;
+  }
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Staged package rejected: %s", esp_err_to_name(err));
+    session_free();
+    return err;
+  }
+  s_ota.role = ROLE_CH;
+  ota_evt_t evt = {.type = EVT_STAGED};
+  xQueueSend(s_evt_q, &evt, portMAX_DELAY);
+  return ESP_OK;
+}
+
+const char *ota_mesh_running_sha_hex(void) { return s_running_hex; }
+
+void ota_mesh_on_cluster_joined(void) {
+  if (!s_pending_verify) {
+    return;
+  }
+  s_pending_verify = false;
+  esp_err_t err = esp_ota_mark_app_valid_cancel_rollback();
+  ESP_LOGI(TAG, "Back in a cluster, image %.16s... marked valid: %s",
+           s_running_hex, esp_err_to_name(err));
+}
+
+bool ota_mesh_busy(void) {
+  return s_ota.role == ROLE_CH ||
+         (s_ota.role == ROLE_MEMBER &&
+          (s_ota.status == OTA_STATUS_RECEIVING ||
+           s_ota.status == OTA_STATUS_APPLYING));
+}
+
+void ota_mesh_log_report(void) {
+  ESP_LOGI(TAG, "Running %s, image %.16s...",
+           s_running ? s_running->label : "?", s_running_hex);
+  if (s_ota.role == ROLE_MEMBER) {
+    ESP_LOGI(TAG, "Member of update %08" PRIx32 ": %u/%u fragments, status %d",
+             s_ota.session, s_ota.have_count, s_ota.frag_count,
+             (int)s_ota.status);
+    return;
+  }
+  if (s_ota.frags_sent == 0) {
+    return;
+  }
+  int done = 0, rejected = 0, failed = 0, pending = 0;
+  for (int i = 0; i < MAX_NEIGHBORS; i++) {
+    const member_t *m = &s_ota.members[i];
+    if (!m->used) {
+      continue;
+    }
+    done += m->status == OTA_STATUS_DONE;
+    rejected += m->status == OTA_STATUS_REJECTED;
+    failed += m->status == OTA_STATUS_FAILED;
+    pending += m->status == OTA_STATUS_RECEIVING ||
+               m->status == OTA_STATUS_APPLYING;
+  }
+  ESP_LOGI(TAG,
+           "Update %08" PRIx32 ": package %" PRIu32 " B, %u rounds, %" PRIu32
+           " fragments / %" PRIu32 " B on air (%" PRIu32 " ms at 1 Mbps, "
+           "%" PRIu32 "%% repair) | members done=%d pending=%d rejected=%d "
+           "failed=%d",
+           s_ota.session, s_ota.pkg_len, s_ota.rounds + 1, s_ota.frags_sent,
+           s_ota.bytes_sent, s_ota.airtime_us / 1000,
+           s_ota.frags_sent > s_ota.frag_count
+               ? (s_ota.frags_sent - s_ota.frag_count) * 100 / s_ota.frag_count
+               : 0,
+           done, pending, rejected, failed);
+}
@@ -0,0 +1,146 @@
+#ifndef OTA_MESH_H
+#define OTA_MESH_H
+
+#include "config.h"
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Cluster-wide firmware update over ESP-NOW
+ *
+ * The CH receives an 'MSOT' delta package once (from the UAV, see
+ * uav_client_fetch_update) and broadcasts it to its members in fragments.
+ * Members answer each round's offer with bitmaps of the fragments they
+ * are missing (one status frame per OTA_STATUS_WINDOW with holes), and
+ * only those are sent again. Every node then rebuilds the
+ * new image into the idle OTA slot from its running image plus the
+ * package's changed blocks, verifies it and reboots into it.
+ *
+ * Package (little-endian, built by tools/ota_delta.py):
+ *   ota_pkg_hdr_t | block_count x u32 source | MSPB container
+ * A source is the byte offset of an identical block in the running image,
+ * or OTA_SRC_LITERAL for the next block of the MSPB container (one zlib
+ * stream per changed block, see compression.h). The header's ECDSA P-256
+ * signature covers the header and the source table; the container needs
+ * none, since the rebuilt image must match the signed new_sha. Nodes hold
+ * only the public key (ota_sign_key.h).
+ *
+ * Offers are tagged with the cluster key too, and a member takes them only
+ * from its current CH. The new image boots pending verification and is
+ * marked valid once the node is back in a cluster (the bootloader rolls
+ * back otherwise).
+ */
+
+#define OTA_PKG_MAGIC 0x544F534DU // 'MSOT'
+#define OTA_PKG_VERSION 2
+#define OTA_SRC_LITERAL 0xFFFFFFFFU
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t block_size;
+  uint32_t base_len;
+  uint8_t base_sha[32]; // Image digest of the image the delta applies to
+  uint32_t new_len;
+  uint8_t new_sha[32]; // Image digest of the result
+  uint32_t block_count;
+  uint32_t reserved;
+  uint8_t sig[64]; // r || s over SHA-256(this header, sig zeroed | table)
+} ota_pkg_hdr_t;
+
+// ESP-NOW frames, told apart by their first word
+#define OTA_MSG_OFFER 0x4F4F534DU  // 'MSOO' CH -> broadcast
+#define OTA_MSG_DATA 0x444F534DU   // 'MSOD' CH -> broadcast
+#define OTA_MSG_STATUS 0x534F534DU // 'MSOS' member -> CH
+
+typedef enum {
+  OTA_STATUS_RECEIVING, // Bitmap lists what is still missing
+  OTA_STATUS_APPLYING,  // Package complete, image being written
+  OTA_STATUS_DONE,      // Rebooting into the new image (or already on it)
+  OTA_STATUS_REJECTED,  // Not running the package's base image
+  OTA_STATUS_FAILED,    // Out of memory, or the image did not verify
+} ota_status_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t session;
+  uint32_t pkg_len;
+  uint16_t frag_count;
+  uint8_t round;
+  uint8_t reserved;
+  uint8_t base_sha[8];
+  uint8_t new_sha[8];
+  uint32_t ch_id;
+  uint8_t hmac[OTA_MESH_HMAC_BYTES]; // Over the frame, tag zeroed
+} ota_offer_msg_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t session;
+  uint16_t index;
+  uint8_t len;
+  uint8_t reserved;
+  uint8_t data[OTA_MESH_FRAG_BYTES];
+} ota_data_msg_t;
+
+#define OTA_STATUS_WINDOW 512 // Fragments covered by one status bitmap
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t session;
+  uint8_t status; // ota_status_t
+  uint8_t reserved;
+  uint16_t first; // Fragment index of bitmap bit 0
+  uint16_t missing;
+  uint8_t bitmap[OTA_STATUS_WINDOW / 8]; // 1 = missing
+} ota_status_msg_t;
+
+/**
+ * @brief Digest the running image and start the OTA task
+ */
+esp_err_t ota_mesh_init(void);
+
+/**
+ * @brief Handle an ESP-NOW frame if it belongs to the OTA protocol
+ * @return true if consumed (called from the Wi-Fi task)
+ */
+bool ota_mesh_handle_frame(const uint8_t *src, const uint8_t *data, int len);
+
+/**
+ * @brief Append a piece of a downloaded package (uav_client callback)
+ * @param total Full package length; the first call allocates for it
+ */
+esp_err_t ota_mesh_stage_chunk(const uint8_t *data, size_t len, size_t total,
+                               void *ctx);
+
+/**
+ * @brief Check the staged package and, if it applies to this image, start
+ * distributing it to the cluster (then update this node too)
+ */
+esp_err_t ota_mesh_stage_commit(void);
+
+/**
+ * @brief Hex digest of the running image (64 chars + NUL)
+ */
+const char *ota_mesh_running_sha_hex(void);
+
+/**
+ * @brief true while a package is being received, distributed or applied;
+ * members keep their radio awake meanwhile
+ */
+bool ota_mesh_busy(void);
+
+/**
+ * @brief The node is back in a cluster (MEMBER of a verified CH, or CH
+ * hearing a member): an image booted from an update is marked valid
+ */
+void ota_mesh_on_cluster_joined(void);
+
+/**
+ * @brief Log session progress and per-round airtime
+ */
+void ota_mesh_log_report(void);
+
+#endif // OTA_MESH_H
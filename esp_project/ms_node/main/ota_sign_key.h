@@ -0,0 +1,23 @@
+#ifndef OTA_SIGN_KEY_H
+#define OTA_SIGN_KEY_H
+
+#include <stdint.h>
+
+/**
+ * @brief Public half of the firmware signing key (P-256, uncompressed point)
+ *
+ * ota_mesh only boots packages signed with the matching private key, which
+ * stays on the build machine. The key below is a placeholder whose private
+ * half was not kept, so no package verifies until it is replaced with the
+ * fleet's own: `python tools/ota_delta.py --gen-key ota_sign.pem` prints the
+ * array. A node accepts only packages signed for the key it runs with.
+ */
+static const uint8_t k_ota_sign_pub[65] = {
+  0x04, 0x8d, 0x6e, 0x86, 0x7f, 0x57, 0x50, 0xfe, 0x01, 0x17, 0xd2, 0xf8,
+  0x0c, 0x6e, 0xd2, 0x9d, 0x74, 0x0b, 0x87, 0x46, 0x9d, 0x94, 0xd8, 0x88,
+  0x00, 0xbd, 0xd9, 0x3d, 0x8d, 0x0a, 0xf2, 0xcb, 0xeb, 0xdd, 0x6e, 0x46,
+  0xf4, 0xf2, 0x74, 0x6a, 0x17, 0xb5, 0x87, 0xbe, 0x62, 0xdb, 0x73, 0xea,
+  0xfd, 0xce, 0xcd, 0x60, 0xb6, 0x14, 0x51, 0xe8, 0x6e, 0xc1, 0xd9, 0x29,
+  0xc4, 0x83, 0x5a, 0xd1, 0xfc};
+
+#endif // OTA_SIGN_KEY_H
@@ -1,41 +1,232 @@
 #include "persistence.h"
 #include "config.h"
 #include "esp_log.h"
-#include "esp_spiffs.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "neighbor_manager.h"
+#include "storage_layout.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 static const char *TAG = "PERSISTENCE";
 static bool persistence_initialized = false;
 
+#define REPUTATION_PATH STORAGE_STATE_PATH "/reputation.bin"
+#define REPUTATION_MAGIC 0x5052534DU // 'MSRP'
+#define REPUTATION_VERSION 1
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t count;
+    uint16_t reserved;
+    uint32_t cluster_head; // Our CH when written (our own id as CH)
+    uint32_t crc;          // Over the records
+} reputation_hdr_t;        // followed by count x neighbor_reputation_t
+
+// What the file holds now, so unchanged tables are never rewritten
+static neighbor_reputation_t s_written[MAX_NEIGHBORS];
+static size_t s_written_count = 0;
+static uint32_t s_written_ch = 0;
+static uint64_t s_last_write_ms = 0;
+static uint32_t s_write_count = 0;
+
+static uint32_t s_current_ch = 0;
+static uint32_t s_previous_ch = 0;
+static SemaphoreHandle_t s_rep_mutex = NULL;
+
+// Open for the node's lifetime with a fixed buffer: saves run on the state
+// machine task after mem_plan_seal(), where fopen would allocate
+static FILE *s_rep_file = NULL;
+static char s_rep_buf[128];
+
 void persistence_init(void) {
     if (persistence_initialized) {
         return;
     }
     
-    esp_vfs_spiffs_conf_t conf = {
-        .base_path = SPIFFS_BASE_PATH,
-        .partition_label = NULL,
-        .max_files = 5,
-        .format_if_mount_failed = true
-    };
-    
-    esp_err_t ret = esp_vfs_spiffs_register(&conf);
+    // Durable state has its own small partition: quick to mount and never
+    // waits on log GC
+    esp_err_t ret = storage_layout_mount(STORAGE_CLASS_STATE);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize SPIFFS (%s)", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "Failed to mount state storage (%s)", esp_err_to_name(ret));
         return;
     }
-    
+
+    s_rep_file = fopen(REPUTATION_PATH, "r+b");
+    if (s_rep_file == NULL) {
+        s_rep_file = fopen(REPUTATION_PATH, "w+b");
+    }
+    if (s_rep_file == NULL) {
+        ESP_LOGE(TAG, "Cannot open %s", REPUTATION_PATH);
+        return;
+    }
+    setvbuf(s_rep_file, s_rep_buf, _IOFBF, sizeof(s_rep_buf));
+
+    s_rep_mutex = xSemaphoreCreateMutex();
     persistence_initialized = true;
     ESP_LOGI(TAG, "Persistence system initialized");
 }
 
+// Largest trust/PDR move of any neighbor since the last write; a neighbor
+// appearing or disappearing counts as a full move.
+static float reputation_drift(const neighbor_reputation_t *recs,
+                              size_t count) {
+    float drift = (count != s_written_count) ? 1.0f : 0.0f;
+    for (size_t i = 0; i < count && drift < 1.0f; i++) {
+        const neighbor_reputation_t *old = NULL;
+        for (size_t j = 0; j < s_written_count; j++) {
+            if (s_written[j].node_id == recs[i].node_id) {
+                old = &s_written[j];
+                break;
+            }
+        }
+        if (old == NULL) {
+            return 1.0f;
+        }
+        const int dt = abs((int)recs[i].trust - (int)old->trust);
+        const int dp = abs((int)recs[i].pdr - (int)old->pdr);
+        const float d = (dt > dp ? dt : dp) / 65535.0f;
+        if (d > drift) {
+            drift = d;
+        }
+    }
+    return drift;
+}
+
+static void reputation_write(const neighbor_reputation_t *recs, size_t count) {
+    reputation_hdr_t hdr = {
+        .magic = REPUTATION_MAGIC,
+        .version = REPUTATION_VERSION,
+        .count = (uint8_t)count,
+        .cluster_head = s_current_ch,
+        .crc = esp_rom_crc32_le(0, (const uint8_t *)recs,
+                                count * sizeof(neighbor_reputation_t)),
+    };
+
+    // One small file rewritten from the start: a torn write fails the CRC
+    // on load and costs only the warm start. A shorter table leaves stale
+    // bytes past its end, which hdr.count excludes.
+    const int64_t t0 = esp_timer_get_time();
+    FILE *f = s_rep_file;
+    const bool ok = fseek(f, 0, SEEK_SET) == 0 &&
+                    fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+                    fwrite(recs, sizeof(*recs), count, f) == count &&
+                    fflush(f) == 0;
+    storage_layout_note_write(STORAGE_CLASS_STATE, t0);
+    if (!ok) {
+        ESP_LOGW(TAG, "Short write to %s", REPUTATION_PATH);
+        return;
+    }
+
+    memcpy(s_written, recs, count * sizeof(*recs));
+    s_written_count = count;
+    s_written_ch = s_current_ch;
+    s_write_count++;
+    ESP_LOGI(TAG, "Saved %u reputation(s), CH %lu (write #%lu)",
+             (unsigned)count, (unsigned long)s_current_ch,
+             (unsigned long)s_write_count);
+}
+
+static void reputation_save(bool force) {
+    if (!persistence_initialized ||
+        xSemaphoreTake(s_rep_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+        return;
+    }
+
+    neighbor_reputation_t recs[MAX_NEIGHBORS];
+    const size_t count =
+        neighbor_manager_export_reputations(recs, MAX_NEIGHBORS);
+    const float drift = reputation_drift(recs, count);
+    const uint64_t since = esp_timer_get_time() / 1000 - s_last_write_ms;
+
+    bool write;
+    if (force) {
+        write = drift > 0.0f || s_current_ch != s_written_ch;
+    } else {
+        // A CH change is what a rebooted node needs most, so it waits least
+        write = (s_current_ch != s_written_ch &&
+                 since >= REPUTATION_ROLE_SAVE_MS) ||
+                (drift >= REPUTATION_SAVE_DELTA &&
+                 since >= REPUTATION_SAVE_PERIOD_MS);
+    }
+    if (write) {
+        reputation_write(recs, count);
+        s_last_write_ms = esp_timer_get_time() / 1000;
+    }
+    xSemaphoreGive(s_rep_mutex);
+}
+
 void persistence_save_reputations(void) {
-    // TODO: Implement reputation table persistence
-    // This would save neighbor reputation data to SPIFFS
+    reputation_save(false);
+}
+
+void persistence_flush_reputations(void) {
+    reputation_save(true);
 }
 
 void persistence_load_reputations(void) {
-    // TODO: Implement reputation table loading
-    // This would load neighbor reputation data from SPIFFS
+    if (!persistence_initialized) {
+        return;
+    }
+
+    FILE *f = s_rep_file;
+    reputation_hdr_t hdr;
+    neighbor_reputation_t recs[MAX_NEIGHBORS];
+    if (fseek(f, 0, SEEK_SET) != 0 || fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        hdr.magic == 0) {
+        ESP_LOGI(TAG, "No saved reputations (first boot)");
+        return;
+    }
+    bool ok = hdr.magic == REPUTATION_MAGIC &&
+              hdr.version == REPUTATION_VERSION && hdr.count <= MAX_NEIGHBORS &&
+              fread(recs, sizeof(*recs), hdr.count, f) == hdr.count;
+    if (ok) {
+        ok = esp_rom_crc32_le(0, (const uint8_t *)recs,
+                              hdr.count * sizeof(*recs)) == hdr.crc;
+    }
+    if (!ok) {
+        ESP_LOGW(TAG, "Discarding corrupt %s", REPUTATION_PATH);
+        // A zero magic reads as "nothing saved" until the next write
+        const reputation_hdr_t empty = {0};
+        if (fseek(f, 0, SEEK_SET) == 0) {
+            fwrite(&empty, sizeof(empty), 1, f);
+            fflush(f);
+        }
+        return;
+    }
+
+    // The table as written is what the next save compares against
+    memcpy(s_written, recs, hdr.count * sizeof(*recs));
+    s_written_count = hdr.count;
+    s_written_ch = hdr.cluster_head;
+    s_previous_ch = hdr.cluster_head;
+
+    // time() survives deep sleep and soft resets but not a power cut; a
+    // clock behind the records means it was reset, so age is unknown
+    const time_t now_s = time(NULL);
+    size_t kept = 0;
+    for (size_t i = 0; i < hdr.count; i++) {
+        if ((time_t)recs[i].last_seen_s <= now_s &&
+            now_s - (time_t)recs[i].last_seen_s > REPUTATION_MAX_AGE_S) {
+            continue;
+        }
+        recs[kept++] = recs[i];
+    }
+    neighbor_manager_restore(recs, kept);
+    ESP_LOGI(TAG, "Loaded %u/%u reputation(s), previous CH %lu",
+             (unsigned)kept, (unsigned)hdr.count,
+             (unsigned long)s_previous_ch);
 }
 
+void persistence_note_cluster_head(uint32_t ch_id) {
+    s_current_ch = ch_id;
+}
+
+uint32_t persistence_previous_cluster_head(void) {
+    return s_previous_ch;
+}
@@ -11,13 +11,33 @@ void persistence_init(void);
 
 /**
  * @brief Save reputation table to SPIFFS
+ *
+ * Cheap enough to call every state machine pass: the file is only rewritten
+ * when our CH changed (at most every REPUTATION_ROLE_SAVE_MS) or some
+ * neighbor's trust/PDR moved by REPUTATION_SAVE_DELTA (at most every
+ * REPUTATION_SAVE_PERIOD_MS).
  */
 void persistence_save_reputations(void);
 
 /**
- * @brief Load reputation table from SPIFFS
+ * @brief Write any change at all now (before deep sleep or a restart)
+ */
+void persistence_flush_reputations(void);
+
+/**
+ * @brief Load reputation table from SPIFFS and seed the neighbor table
+ *        (after neighbor_manager_init)
  */
 void persistence_load_reputations(void);
 
-#endif // PERSISTENCE_H
+/**
+ * @brief Record our current CH (our own id while CH, 0 while electing)
+ */
+void persistence_note_cluster_head(uint32_t ch_id);
 
+/**
+ * @brief CH we belonged to before the last reboot, 0 if unknown
+ */
+uint32_t persistence_previous_cluster_head(void);
+
+#endif // PERSISTENCE_H
@@ -1,14 +1,22 @@
 #include "state_machine.h"
 #include "ble_manager.h"
+#include "channel_plan.h"
+#include "cluster_aggregator.h"
 #include "config.h"
+#include "config_sync.h"
 #include "election.h"
+#include "gossip.h"
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_now_manager.h"
 #include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "led_manager.h"
 #include "metrics.h"
 #include "neighbor_manager.h"
+#include "ota_mesh.h"
+#include "persistence.h"
 #include "rf_receiver.h"
 #include "storage_manager.h"
 #include "uav_client.h"
@@ -71,6 +79,19 @@ uint32_t state_machine_get_sleep_time_ms(void) {
 
 static const char *TAG = "STATE";
 
+// A neighbor we knew before the reboot has been heard again
+static bool restored_neighbor_heard(void) {
+  neighbor_entry_t neighbors[MAX_NEIGHBORS];
+  size_t count = neighbor_manager_get_all(neighbors, MAX_NEIGHBORS);
+  for (size_t i = 0; i < count; i++) {
+    if (neighbors[i].restored && neighbors[i].verified &&
+        neighbor_manager_is_in_cluster(&neighbors[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
 node_state_t g_current_state = STATE_INIT;
 bool g_is_ch = false;
 uint32_t g_node_id = 0;
@@ -80,6 +101,9 @@ uint64_t g_mac_addr = 0;
 extern uint8_t g_cluster_key[CLUSTER_KEY_SIZE];
 
 static uint64_t state_entry_time = 0;
+static TaskHandle_t s_sm_task = NULL;
+static volatile bool s_force_uav = false;
+static bool s_hold_awake = false; // MEMBER radio held for OTA/config sync
 
 const char *state_machine_get_state_name(void) {
   switch (g_current_state) {
@@ -125,6 +149,17 @@ static void transition_to_state(node_state_t new_state) {
 
   g_current_state = new_state;
   led_manager_set_state(new_state);
+  if (new_state == STATE_CH) {
+    // A new cluster: free to take whichever channel is quietest
+    esp_now_manager_set_channel(channel_plan_select(true));
+  } else if (new_state == STATE_CANDIDATE) {
+    // Candidates gossip on the common channel, whichever cluster they left
+    esp_now_manager_set_channel(ESP_NOW_CHANNEL);
+  }
+  // Only an idle MEMBER lets the radio duty-cycle; everything else has to
+  // hear its neighbours.
+  esp_now_manager_set_radio_awake(new_state != STATE_MEMBER);
+  s_hold_awake = false;
   state_entry_time = esp_timer_get_time() / 1000;
 }
 
@@ -147,12 +182,43 @@ void state_machine_init(void) {
 
 void state_machine_force_uav_test(void) {
   ESP_LOGI(TAG, "Forcing UAV Test Mode (Manual Trigger)");
-  transition_to_state(STATE_UAV_ONBOARDING);
+  // Applied by the state machine task so transitions stay on one task
+  s_force_uav = true;
+  state_machine_notify();
+}
+
+void state_machine_notify(void) {
+  if (s_sm_task) {
+    xTaskNotifyGive(s_sm_task);
+  }
+}
+
+void state_machine_wait_next(void) {
+  if (!s_sm_task) {
+    s_sm_task = xTaskGetCurrentTaskHandle();
+  }
+
+  uint32_t wait_ms = SM_POLL_FAST_MS;
+  if (g_current_state == STATE_CH) {
+    wait_ms = SM_POLL_IDLE_MS;
+  } else if (g_current_state == STATE_MEMBER) {
+    // Wake in time for our slot (100 ms while inside it)
+    wait_ms = state_machine_get_sleep_time_ms();
+    if (wait_ms > SM_POLL_IDLE_MS) {
+      wait_ms = SM_POLL_IDLE_MS;
+    }
+  }
+  (void)ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
 }
 
 void state_machine_run(void) {
   uint64_t now_ms = esp_timer_get_time() / 1000;
 
+  if (s_force_uav) {
+    s_force_uav = false;
+    transition_to_state(STATE_UAV_ONBOARDING);
+  }
+
   switch (g_current_state) {
   case STATE_INIT:
     // Boot & self-init
@@ -183,9 +249,11 @@ void state_machine_run(void) {
         last_update = now_ms;
 
         // Check if there's already an existing CH (check continuously, not just
-        // at end)
+        // at end). Our CH from before a reboot is rejoined as soon as heard.
         uint32_t existing_ch = neighbor_manager_get_current_ch();
-        if (existing_ch != 0 && (now_ms - state_entry_time) >= 2000) {
+        const uint32_t previous_ch = persistence_previous_cluster_head();
+        if (existing_ch != 0 && ((now_ms - state_entry_time) >= 2000 ||
+                                 existing_ch == previous_ch)) {
           // Found CH after at least 2 seconds of discovery (give time to find
           // neighbors)
           ESP_LOGI(TAG,
@@ -200,6 +268,17 @@ void state_machine_run(void) {
           transition_to_state(STATE_MEMBER);
           break; // Exit DISCOVER immediately
         }
+
+        // We were CH before rebooting and our members are still around with
+        // nobody else claiming the cluster: take it back without an election
+        // (members keep their CH for CH_BEACON_TIMEOUT_MS, so they stay put)
+        if (existing_ch == 0 && previous_ch == g_node_id &&
+            (now_ms - state_entry_time) >= 2000 && restored_neighbor_heard()) {
+          ESP_LOGI(TAG, "DISCOVER: Resuming as CH of our pre-reboot cluster");
+          g_is_ch = true;
+          transition_to_state(STATE_CH);
+          break;
+        }
       }
     } else {
       // Discovery complete (5 seconds elapsed) - check if there's already a CH
@@ -241,6 +320,17 @@ void state_machine_run(void) {
       // Cleanup stale neighbors
       neighbor_manager_cleanup_stale();
 
+      // Our pre-reboot CH came back: follow it rather than elect a rival
+      const uint32_t previous_ch = persistence_previous_cluster_head();
+      if (previous_ch != 0 && previous_ch != g_node_id &&
+          neighbor_manager_get_current_ch() == previous_ch) {
+        ESP_LOGI(TAG, "CANDIDATE: Previous CH node_%lu is back, rejoining",
+                 previous_ch);
+        g_is_ch = false;
+        transition_to_state(STATE_MEMBER);
+        break;
+      }
+
       // Check if election window has expired
       uint64_t window_start = election_get_window_start();
       if (window_start == 0) {
@@ -248,7 +338,11 @@ void state_machine_run(void) {
         window_start = election_get_window_start();
       }
 
-      if (now_ms - window_start >= ELECTION_WINDOW_MS) {
+      // Digests out, neighbors' merged; done as soon as every candidate
+      // sees what we see rather than at the end of the window
+      gossip_tick(now_ms);
+      if (now_ms - window_start >= ELECTION_WINDOW_MS ||
+          gossip_converged(now_ms)) {
         // Run election
         uint32_t winner = election_run();
 
@@ -299,6 +393,30 @@ void state_machine_run(void) {
       // CH duties: maintain member list, etc.
       neighbor_manager_cleanup_stale();
 
+      // Move the cluster if neighboring CHs have crowded our channel
+      static uint64_t last_channel_plan = 0;
+      if (now_ms - last_channel_plan >= ESPNOW_CHANNEL_REPLAN_MS) {
+        if (last_channel_plan != 0) {
+          esp_now_manager_set_channel(channel_plan_select(false));
+        }
+        last_channel_plan = now_ms;
+      }
+
+      // Close the aggregation window and store its summary when due
+      cluster_aggregator_tick(now_ms);
+
+      // One broadcast diff answers every member that asked since last pass
+      config_sync_tick(now_ms);
+
+      // Batched: rewritten only on real change, rarely
+      persistence_note_cluster_head(g_node_id);
+      persistence_save_reputations();
+
+      // A CH with members again is running a working image
+      if (neighbor_manager_get_member_count() > 0) {
+        ota_mesh_on_cluster_joined();
+      }
+
       // Check cluster size
       neighbor_entry_t neighbors[MAX_NEIGHBORS];
       size_t count = neighbor_manager_get_all(neighbors, MAX_NEIGHBORS);
@@ -320,7 +438,14 @@ void state_machine_run(void) {
       // Cycle: 5s buffer + (N * 1s slots). Min 10s.
       if (now_ms - last_schedule_broadcast >= 10000) {
         neighbor_entry_t neighbors[MAX_NEIGHBORS];
-        size_t count = neighbor_manager_get_all(neighbors, MAX_NEIGHBORS);
+        size_t all = neighbor_manager_get_all(neighbors, MAX_NEIGHBORS);
+        size_t count = 0;
+        for (size_t i = 0; i < all; i++) {
+          // Restored entries not yet heard have no peer to send to
+          if (neighbors[i].verified) {
+            neighbors[count++] = neighbors[i];
+          }
+        }
 
         if (count > 0) {
           // Sort by Priority (Githmi-style: P = Link + (100-Bat))
@@ -331,12 +456,14 @@ void state_machine_run(void) {
           for (size_t i = 0; i < count; i++) {
             schedule_msg_t sched;
             sched.epoch_us = epoch_us;
+            sched.sent_us = esp_timer_get_time();
             sched.slot_index = i;
             sched.slot_duration_sec = 1; // 1 second per node
             sched.magic = ESP_NOW_MAGIC_SCHEDULE;
 
             // Broadcast to each (using Unicast for reliability)
-            esp_now_manager_send_data(neighbors[i].mac_addr, (uint8_t *)&sched,
+            esp_now_manager_send_data(ESP_NOW_CLASS_CONTROL,
+                                      neighbors[i].mac_addr, (uint8_t *)&sched,
                                       sizeof(sched));
             ESP_LOGI(TAG, "SCHED: Assigned Slot %d to Node %lu (Score %.2f)",
                      (int)i, neighbors[i].node_id, neighbors[i].score);
@@ -366,8 +493,13 @@ void state_machine_run(void) {
         }
       }
 
-      // Check if CH is still valid
+      // Check if CH is still valid. Right after an election the winner has
+      // not announced itself yet: give it a few beacons before giving up.
       uint32_t current_ch = neighbor_manager_get_current_ch();
+      if (current_ch == 0 &&
+          now_ms - state_entry_time < MEMBER_JOIN_GRACE_MS) {
+        break;
+      }
       if (current_ch == 0) {
         ESP_LOGW(
             TAG,
@@ -378,6 +510,27 @@ void state_machine_run(void) {
         break;
       }
 
+      // Firmware updates and config diffs are broadcast once; duty-cycling
+      // would miss most of them and cost the cluster extra rounds
+      config_sync_tick(now_ms);
+      persistence_note_cluster_head(current_ch);
+      persistence_save_reputations();
+      ota_mesh_on_cluster_joined();
+      const bool hold = ota_mesh_busy() || config_sync_pending();
+      if (hold != s_hold_awake) {
+        s_hold_awake = !s_hold_awake;
+        esp_now_manager_set_radio_awake(s_hold_awake);
+      }
+
+      // Exchange data on the channel our CH announces
+      neighbor_entry_t *ch = neighbor_manager_get(current_ch);
+      if (ch && ch->channel != 0 &&
+          ch->channel != esp_now_manager_get_channel()) {
+        ESP_LOGI(TAG, "Following CH %lu to channel %u", current_ch,
+                 ch->channel);
+        esp_now_manager_set_channel(ch->channel);
+      }
+
       // Update advertisement (as member) - throttled to avoid crashes
       static uint64_t last_adv_update = 0;
       uint64_t now_ms = esp_timer_get_time() / 1000;
@@ -438,12 +591,25 @@ void state_machine_run(void) {
           sensor_payload_t payload;
           metrics_get_sensor_data(&payload);
 
+          // Routine readings only go out as a periodic keep-alive; anomalous
+          // ones go out in the first slot after they were sampled.
+          static uint32_t last_sent_seq = UINT32_MAX;
+          static uint64_t last_routine_send = 0;
+          bool fresh_anomaly = (payload.flags & SENSOR_PAYLOAD_FLAG_ANOMALY) &&
+                               payload.seq_num != last_sent_seq;
+          bool routine_due =
+              (now_ms - last_routine_send) >= MEMBER_ROUTINE_SEND_MS;
+
           // Only send if we have valid data (timestamp != 0)
-          if (payload.timestamp_ms != 0) {
+          if (payload.timestamp_ms != 0 && (fresh_anomaly || routine_due)) {
             esp_err_t ret = esp_now_manager_send_data(
-                ch_mac, (uint8_t *)&payload, sizeof(payload));
+                ESP_NOW_CLASS_REALTIME, ch_mac, (uint8_t *)&payload,
+                sizeof(payload));
             if (ret == ESP_OK) {
               last_data_send = now_ms;
+              last_sent_seq = payload.seq_num;
+              if (!fresh_anomaly)
+                last_routine_send = now_ms;
               ESP_LOGI(TAG, "Sent sensor data to CH (Node %lu)",
                        payload.node_id);
             } else {
@@ -459,8 +625,8 @@ void state_machine_run(void) {
       // -------------------------------------------------------------
       // Time-Bounded Burst (Novelty: "Sprint" during slot)
       // -------------------------------------------------------------
-      int64_t now_us = esp_timer_get_time();
-      schedule_msg_t sched = esp_now_get_current_schedule();
+      now_us = esp_timer_get_time();
+      sched = esp_now_get_current_schedule();
       bool in_slot = false;
       int64_t slot_end_us = 0;
 
@@ -481,29 +647,45 @@ void state_machine_run(void) {
       if (in_slot && current_ch != 0) {
         uint8_t ch_mac[6];
         if (neighbor_manager_get_ch_mac(ch_mac)) {
-          char history_line[256];
+          // Anomalous records drain before routine summaries.
+          char history_line[STORAGE_LINE_MAX];
           int packets_sent = 0;
+          if (!s_hold_awake) {
+            esp_now_manager_set_radio_awake(true);
+          }
 
           // Keep sending as long as we have >1s remaining in slot
           while ((esp_timer_get_time() < (slot_end_us - 1000000LL))) {
+            // The bulk queue paces the burst: only pop a line once it has
+            // room, so nothing popped is lost to a full queue
+            if (esp_now_manager_queue_free(ESP_NOW_CLASS_BULK) == 0) {
+              vTaskDelay(pdMS_TO_TICKS(10));
+              continue;
+            }
             if (storage_manager_pop_line(history_line, sizeof(history_line)) ==
                 ESP_OK) {
               esp_err_t ret = esp_now_manager_send_data(
-                  ch_mac, (uint8_t *)history_line, strlen(history_line));
+                  ESP_NOW_CLASS_BULK, ch_mac, (uint8_t *)history_line,
+                  strlen(history_line));
               if (ret == ESP_OK) {
                 packets_sent++;
-                // Small delay to prevent radio buffer overflow
-                // We use a busy-wait delay or very short vTaskDelay?
-                // Since we are in task context, short vTaskDelay is safer.
-                vTaskDelay(pdMS_TO_TICKS(50));
               } else {
                 ESP_LOGW(TAG, "Burst send failed: %s", esp_err_to_name(ret));
-                break; // Radio busy? Stop bursting.
+                break; // Queue rejected it; stop bursting.
               }
             } else {
               break; // No more data
             }
           }
+          // Let the queued tail go out before the radio duty-cycles again
+          while (esp_now_manager_queue_free(ESP_NOW_CLASS_BULK) <
+                     ESPNOW_QOS_BULK_DEPTH &&
+                 esp_timer_get_time() < slot_end_us) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+          }
+          if (!s_hold_awake) {
+            esp_now_manager_set_radio_awake(false);
+          }
           if (packets_sent > 0) {
             ESP_LOGI(TAG, "BURST: Sent %d stored packets during Slot %d",
                      packets_sent, sched.slot_index);
@@ -532,8 +714,18 @@ void state_machine_run(void) {
       // Execute onboarding (Blocking for now)
       esp_err_t ret = uav_client_run_onboarding();
 
+      bool update_staged = false;
       if (ret == ESP_OK) {
         ESP_LOGI(TAG, "UAV Onboarding SUCCESS");
+        // While connected, pick up any firmware delta for our image; the
+        // cluster gets it over ESP-NOW once we are back on its channel
+        ret = uav_client_fetch_update(ota_mesh_running_sha_hex(),
+                                      ota_mesh_stage_chunk, NULL);
+        update_staged = (ret == ESP_OK);
+        if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND) {
+          ESP_LOGW(TAG, "Firmware update download failed: %s",
+                   esp_err_to_name(ret));
+        }
       } else {
         ESP_LOGE(TAG, "UAV Onboarding FAILED: %s", esp_err_to_name(ret));
       }
@@ -544,6 +736,13 @@ void state_machine_run(void) {
 
       // Re-enable BLE advertising
       ble_manager_start_advertising();
+
+      // Commit even a failed download: it releases the staging buffer
+      if (ota_mesh_stage_commit() == ESP_OK) {
+        ESP_LOGI(TAG, "Distributing firmware update to the cluster");
+      } else if (update_staged) {
+        ESP_LOGW(TAG, "Firmware update not applicable to this image");
+      }
     }
     break;
 
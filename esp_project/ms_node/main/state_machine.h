@@ -49,4 +49,17 @@ const char *state_machine_get_state_name(void);
  */
 uint32_t state_machine_get_sleep_time_ms(void);
 
+/**
+ * @brief Block the state machine task until its next run is due
+ * Tickless-idle friendly: SM_POLL_FAST_MS while electing, SM_POLL_IDLE_MS
+ * as CH/MEMBER (bounded by the MEMBER's next slot), or earlier on
+ * state_machine_notify().
+ */
+void state_machine_wait_next(void);
+
+/**
+ * @brief Wake the state machine task for an immediate run
+ */
+void state_machine_notify(void);
+
 #endif // STATE_MACHINE_H
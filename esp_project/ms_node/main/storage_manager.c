@@ -0,0 +1,225 @@
+#include "storage_manager.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "storage_layout.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "STORAGE";
+
+// The read cursor is persisted every N pops, so a reboot re-sends at most
+// N-1 lines instead of rewriting the cursor on every pop. Queues churn and
+// live on the logs partition; cursors are durable state.
+#define CURSOR_SYNC_EVERY 8
+
+// Queue and cursor files stay open with fixed stdio buffers: fopen (and a
+// stdio-chosen buffer) allocates, and lines are pushed from the main loop
+// after mem_plan_seal()
+typedef struct {
+  const char *path;
+  const char *cursor_path;
+  size_t max_bytes; // Unsent bytes allowed before pushes are refused
+  long read_off;
+  long size;
+  uint32_t pops_since_sync;
+  FILE *f;
+  FILE *cur;
+  char buf[STORAGE_LINE_MAX + 16];
+  char cur_buf[16];
+} fwd_queue_t;
+
+static fwd_queue_t s_queues[STORAGE_PRIO_COUNT] = {
+    [STORAGE_PRIO_HIGH] = {.path = STORAGE_LOGS_PATH "/fwd_hi.q",
+                           .cursor_path = STORAGE_STATE_PATH "/fwd_hi.cur",
+                           .max_bytes = 128 * 1024},
+    [STORAGE_PRIO_LOW] = {.path = STORAGE_LOGS_PATH "/fwd_lo.q",
+                          .cursor_path = STORAGE_STATE_PATH "/fwd_lo.cur",
+                          .max_bytes = 64 * 1024},
+};
+
+static SemaphoreHandle_t s_mutex = NULL;
+
+// Open for update, creating the file if needed
+static FILE *file_open(const char *path, char *buf, size_t len) {
+  FILE *f = fopen(path, "r+b");
+  if (!f)
+    f = fopen(path, "w+b");
+  if (f)
+    setvbuf(f, buf, _IOFBF, len);
+  return f;
+}
+
+// Truncate in place. freopen keeps the FILE but drops its buffer, so the
+// fixed one is set again before the next read or write.
+static FILE *file_truncate(FILE *f, const char *path, char *buf, size_t len) {
+  if (!f)
+    return NULL;
+  f = freopen(path, "w+b", f);
+  if (f)
+    setvbuf(f, buf, _IOFBF, len);
+  return f;
+}
+
+static void cursor_save(fwd_queue_t *q) {
+  const int64_t t0 = esp_timer_get_time();
+  if (q->cur && fseek(q->cur, 0, SEEK_SET) == 0) {
+    fwrite(&q->read_off, 1, sizeof(q->read_off), q->cur);
+    fflush(q->cur);
+    storage_layout_note_write(STORAGE_CLASS_STATE, t0);
+  }
+  q->pops_since_sync = 0;
+}
+
+// Fully drained: truncate the files so SPIFFS gets the space back.
+static void queue_reset(fwd_queue_t *q) {
+  q->f = file_truncate(q->f, q->path, q->buf, sizeof(q->buf));
+  q->cur = file_truncate(q->cur, q->cursor_path, q->cur_buf,
+                         sizeof(q->cur_buf));
+  q->read_off = 0;
+  q->size = 0;
+  q->pops_since_sync = 0;
+}
+
+static void queue_open(fwd_queue_t *q) {
+  q->f = file_open(q->path, q->buf, sizeof(q->buf));
+  q->cur = file_open(q->cursor_path, q->cur_buf, sizeof(q->cur_buf));
+  q->size = 0;
+  q->read_off = 0;
+  q->pops_since_sync = 0;
+  if (!q->f || !q->cur) {
+    ESP_LOGE(TAG, "%s: cannot open", q->path);
+    return;
+  }
+
+  if (fseek(q->f, 0, SEEK_END) == 0)
+    q->size = ftell(q->f);
+  if (q->size < 0)
+    q->size = 0;
+  if (fread(&q->read_off, 1, sizeof(q->read_off), q->cur) !=
+      sizeof(q->read_off)) {
+    q->read_off = 0;
+  }
+  if (q->read_off < 0 || q->read_off > q->size)
+    q->read_off = 0;
+  if (q->size > 0 && q->read_off >= q->size)
+    queue_reset(q);
+}
+
+esp_err_t storage_manager_init(void) {
+  if (!s_mutex) {
+    s_mutex = xSemaphoreCreateMutex();
+    if (!s_mutex)
+      return ESP_ERR_NO_MEM;
+  }
+
+  esp_err_t ret = storage_layout_mount(STORAGE_CLASS_LOGS);
+  if (ret == ESP_OK)
+    ret = storage_layout_mount(STORAGE_CLASS_STATE);
+  if (ret != ESP_OK)
+    return ret;
+
+  for (int p = 0; p < STORAGE_PRIO_COUNT; p++) {
+    queue_open(&s_queues[p]);
+  }
+  ESP_LOGI(TAG, "Forward queues: high=%ld bytes, low=%ld bytes pending",
+           s_queues[STORAGE_PRIO_HIGH].size -
+               s_queues[STORAGE_PRIO_HIGH].read_off,
+           s_queues[STORAGE_PRIO_LOW].size - s_queues[STORAGE_PRIO_LOW].read_off);
+  return ESP_OK;
+}
+
+esp_err_t storage_manager_push_line(const char *line, storage_prio_t prio) {
+  if (!line || prio >= STORAGE_PRIO_COUNT)
+    return ESP_ERR_INVALID_ARG;
+  if (!s_mutex)
+    return ESP_ERR_INVALID_STATE;
+
+  const size_t len = strlen(line);
+  if (len == 0 || len >= STORAGE_LINE_MAX)
+    return ESP_ERR_INVALID_ARG;
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+  fwd_queue_t *q = &s_queues[prio];
+  esp_err_t ret = ESP_OK;
+
+  if ((size_t)(q->size - q->read_off) + len + 1 > q->max_bytes) {
+    ESP_LOGW(TAG, "%s full, dropping line", q->path);
+    ret = ESP_ERR_NO_MEM;
+  } else {
+    const int64_t t0 = esp_timer_get_time();
+    FILE *f = q->f;
+    if (!f || fseek(f, q->size, SEEK_SET) != 0) {
+      ret = ESP_FAIL;
+    } else {
+      if (fwrite(line, 1, len, f) != len || fputc('\n', f) == EOF ||
+          fflush(f) != 0)
+        ret = ESP_FAIL;
+      storage_layout_note_write(STORAGE_CLASS_LOGS, t0);
+      if (ret == ESP_OK)
+        q->size += (long)len + 1;
+    }
+  }
+
+  xSemaphoreGive(s_mutex);
+  return ret;
+}
+
+esp_err_t storage_manager_pop_line(char *buf, size_t buf_len) {
+  if (!buf || buf_len == 0)
+    return ESP_ERR_INVALID_ARG;
+  if (!s_mutex)
+    return ESP_ERR_INVALID_STATE;
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+  esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+  for (int p = 0; p < STORAGE_PRIO_COUNT && ret == ESP_ERR_NOT_FOUND; p++) {
+    fwd_queue_t *q = &s_queues[p];
+    if (q->read_off >= q->size)
+      continue;
+
+    char line[STORAGE_LINE_MAX + 2];
+    FILE *f = q->f;
+    if (!f || fseek(f, q->read_off, SEEK_SET) != 0 ||
+        !fgets(line, sizeof(line), f)) {
+      // Unreadable tail (e.g. file lost): start the queue over.
+      queue_reset(q);
+      continue;
+    }
+
+    size_t n = strlen(line);
+    const long consumed = (long)n;
+    if (n > 0 && line[n - 1] == '\n')
+      line[--n] = '\0';
+
+    if (n >= buf_len) {
+      ret = ESP_ERR_INVALID_SIZE;
+      break;
+    }
+    memcpy(buf, line, n + 1);
+    ret = ESP_OK;
+
+    q->read_off += consumed;
+    if (q->read_off >= q->size) {
+      queue_reset(q);
+    } else if (++q->pops_since_sync >= CURSOR_SYNC_EVERY) {
+      cursor_save(q);
+    }
+  }
+
+  xSemaphoreGive(s_mutex);
+  return ret;
+}
+
+size_t storage_manager_pending_bytes(storage_prio_t prio) {
+  if (prio >= STORAGE_PRIO_COUNT || !s_mutex)
+    return 0;
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+  size_t n = (size_t)(s_queues[prio].size - s_queues[prio].read_off);
+  xSemaphoreGive(s_mutex);
+  return n;
+}
@@ -0,0 +1,43 @@
+#ifndef STORAGE_MANAGER_H
+#define STORAGE_MANAGER_H
+
+#include "esp_err.h"
+#include <stddef.h>
+
+// Longest line that still fits in one ESP-NOW frame
+#define STORAGE_LINE_MAX 240
+
+typedef enum {
+  STORAGE_PRIO_HIGH = 0, // Anomalous records, drained first
+  STORAGE_PRIO_LOW,      // Periodic routine summaries
+  STORAGE_PRIO_COUNT
+} storage_prio_t;
+
+/**
+ * @brief Open the store-and-forward queues (mounts the logs and state
+ * partitions if needed)
+ */
+esp_err_t storage_manager_init(void);
+
+/**
+ * @brief Queue one line for forwarding to the CH
+ * @param line NUL-terminated line without '\n', shorter than STORAGE_LINE_MAX
+ * @param prio Queue to append to
+ * @return ESP_ERR_NO_MEM if that queue is at its byte budget
+ */
+esp_err_t storage_manager_push_line(const char *line, storage_prio_t prio);
+
+/**
+ * @brief Pop the oldest line, high-priority queue first
+ * @param buf Output buffer (line is NUL-terminated, '\n' stripped)
+ * @param buf_len Buffer size
+ * @return ESP_ERR_NOT_FOUND when both queues are empty
+ */
+esp_err_t storage_manager_pop_line(char *buf, size_t buf_len);
+
+/**
+ * @brief Bytes still queued (not yet popped) in one queue
+ */
+size_t storage_manager_pending_bytes(storage_prio_t prio);
+
+#endif // STORAGE_MANAGER_H
@@ -0,0 +1,255 @@
+#include "tx_power.h"
+#include "config.h"
+#include "esp_bt.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "esp_now_rate.h"
+#include "esp_wifi.h"
+#include "neighbor_manager.h"
+#include "sdkconfig.h"
+#include "state_machine.h"
+#include <inttypes.h>
+#include <string.h>
+
+static const char *TAG = "TX_POWER";
+
+#define TXP_PEERS MAX_NEIGHBORS
+
+// esp_wifi_set_max_tx_power() range, in 0.25 dBm
+#define WIFI_QDBM_MIN 8
+#define WIFI_QDBM_MAX (CONFIG_ESP_PHY_MAX_WIFI_TX_POWER * 4)
+
+// BLE controller levels run from -24 dBm in 3 dB steps
+#define BLE_LVL_MIN_DBM (-24)
+#define BLE_LVL_STEP_DB 3
+#define BLE_LVL_MAX ((int)ESP_PWR_LVL_P21 - (int)ESP_PWR_LVL_N24)
+
+typedef struct {
+  bool used;
+  uint8_t mac[ESP_NOW_ETH_ALEN];
+  int8_t offset_db;  // Closed-loop correction on top of the link budget
+  uint8_t good_run;  // Delivered frames since the last change
+  int8_t last_qdbm;  // Power of the last frame
+  int16_t path_loss; // Last estimate, 0 if unknown
+  uint32_t last_use;
+  uint32_t frames, delivered, raised, lowered;
+  uint64_t energy_nj;     // All attempts at the chosen power
+  uint64_t energy_max_nj; // The same attempts at full power
+} peer_power_t;
+
+typedef struct {
+  uint32_t frames, delivered;
+  uint64_t energy_nj, energy_max_nj;
+} power_totals_t;
+
+static peer_power_t s_peers[TXP_PEERS];
+static power_totals_t s_bcast;
+static uint32_t s_clock = 0;
+static int8_t s_applied_qdbm = 0; // 0 until the first frame
+static int8_t s_ble_dbm = TXP_BLE_REF_DBM;
+
+void tx_power_init(void) {
+  memset(s_peers, 0, sizeof(s_peers));
+  memset(&s_bcast, 0, sizeof(s_bcast));
+  s_clock = 0;
+  s_applied_qdbm = 0;
+  s_ble_dbm = TXP_BLE_REF_DBM;
+}
+
+static peer_power_t *find_peer(const uint8_t *mac) {
+  for (int i = 0; i < TXP_PEERS; i++) {
+    if (s_peers[i].used &&
+        memcmp(s_peers[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+      return &s_peers[i];
+    }
+  }
+  return NULL;
+}
+
+// Same LRU reuse as esp_now_rate
+static peer_power_t *claim_peer(const uint8_t *mac) {
+  peer_power_t *victim = &s_peers[0];
+  for (int i = 0; i < TXP_PEERS; i++) {
+    if (!s_peers[i].used) {
+      victim = &s_peers[i];
+      break;
+    }
+    if (s_peers[i].last_use < victim->last_use) {
+      victim = &s_peers[i];
+    }
+  }
+  memset(victim, 0, sizeof(*victim));
+  victim->used = true;
+  memcpy(victim->mac, mac, ESP_NOW_ETH_ALEN);
+  return victim;
+}
+
+// Path loss from a neighbor's normalised beacon RSSI; 0 if it has not been
+// heard (yet)
+static int path_loss_db(float rssi_ewma) {
+  if (rssi_ewma == 0.0f) {
+    return 0;
+  }
+  return (int)((float)TXP_BLE_REF_DBM - rssi_ewma + 0.5f);
+}
+
+static int clamp_int(int v, int lo, int hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+int8_t tx_power_select(const uint8_t *mac, int rate_idx) {
+  int qdbm = WIFI_QDBM_MAX;
+  if (mac) {
+    peer_power_t *p = find_peer(mac);
+    if (!p) {
+      p = claim_peer(mac);
+    }
+    p->last_use = ++s_clock;
+    const neighbor_entry_t *n = neighbor_manager_get_by_mac(mac);
+    p->path_loss = (int16_t)(n ? path_loss_db(n->rssi_ewma) : 0);
+    if (p->path_loss > 0) {
+      const int dbm = p->path_loss + esp_now_rate_sensitivity_dbm(rate_idx) +
+                      TXP_WIFI_MARGIN_DB + p->offset_db;
+      qdbm = clamp_int(dbm * 4, WIFI_QDBM_MIN, WIFI_QDBM_MAX);
+    }
+    p->last_qdbm = (int8_t)qdbm;
+  }
+
+  if (qdbm != s_applied_qdbm) {
+    esp_err_t err = esp_wifi_set_max_tx_power((int8_t)qdbm);
+    if (err != ESP_OK) {
+      ESP_LOGD(TAG, "TX power %d not set: %s", qdbm, esp_err_to_name(err));
+      // Whatever the driver holds now, resend it next time
+      s_applied_qdbm = 0;
+      return (int8_t)WIFI_QDBM_MAX;
+    }
+    s_applied_qdbm = (int8_t)qdbm;
+  }
+  return (int8_t)qdbm;
+}
+
+// Supply energy of one attempt: airtime x PA current at that power
+static uint64_t frame_energy_nj(int qdbm, int rate_idx, size_t len) {
+  const int ma = TXP_I_BASE_MA + TXP_I_MA_PER_DB * qdbm / 4;
+  const uint32_t us = esp_now_rate_frame_airtime_us(rate_idx, len);
+  return (uint64_t)TXP_SUPPLY_MV * (uint64_t)ma * us / 1000; // mV*mA*us = pJ
+}
+
+void tx_power_report(const uint8_t *mac, int8_t power, int rate_idx,
+                     size_t len, bool ok, bool probed) {
+  const uint64_t e = frame_energy_nj(power, rate_idx, len);
+  const uint64_t e_max = frame_energy_nj(WIFI_QDBM_MAX, rate_idx, len);
+
+  if (!mac) {
+    s_bcast.frames++;
+    s_bcast.delivered += ok ? 1 : 0;
+    s_bcast.energy_nj += e;
+    s_bcast.energy_max_nj += e_max;
+    return;
+  }
+  peer_power_t *p = find_peer(mac);
+  if (!p) {
+    return;
+  }
+  p->frames++;
+  p->energy_nj += e;
+  p->energy_max_nj += e_max;
+  if (ok) {
+    p->delivered++;
+  }
+  if (probed || p->path_loss == 0) {
+    return; // Rate control's business, or not running on a link budget
+  }
+
+  // Back off quickly after a loss, creep down while frames keep arriving
+  if (!ok) {
+    p->offset_db = (int8_t)clamp_int(p->offset_db + TXP_STEP_UP_DB,
+                                     -TXP_WIFI_MARGIN_DB, TXP_MAX_OFFSET_DB);
+    p->good_run = 0;
+    p->raised++;
+  } else if (++p->good_run >= TXP_STEP_DOWN_FRAMES) {
+    p->good_run = 0;
+    if (p->offset_db > -TXP_WIFI_MARGIN_DB &&
+        p->last_qdbm > WIFI_QDBM_MIN) {
+      p->offset_db--;
+      p->lowered++;
+    }
+  }
+}
+
+int8_t tx_power_ble_update(void) {
+  static neighbor_entry_t s_nbrs[MAX_NEIGHBORS];
+
+  // Full power while the cluster is forming, so every candidate is heard
+  int dbm = TXP_BLE_REF_DBM;
+  if (g_current_state == STATE_CH || g_current_state == STATE_MEMBER) {
+    const size_t count = neighbor_manager_get_all(s_nbrs, MAX_NEIGHBORS);
+    int need = TXP_BLE_MIN_DBM;
+    bool any = false;
+    for (size_t i = 0; i < count; i++) {
+      const int pl = path_loss_db(s_nbrs[i].rssi_ewma);
+      if (pl == 0 || !neighbor_manager_is_in_cluster(&s_nbrs[i])) {
+        continue;
+      }
+      const int d = pl + TXP_BLE_SENS_DBM + TXP_BLE_MARGIN_DB;
+      if (d > need) {
+        need = d;
+      }
+      any = true;
+    }
+    if (any && need < dbm) {
+      dbm = need;
+    }
+  }
+
+  // Round up to a controller level
+  const int lvl = clamp_int((dbm - BLE_LVL_MIN_DBM + BLE_LVL_STEP_DB - 1) /
+                                BLE_LVL_STEP_DB,
+                            0, BLE_LVL_MAX);
+  const int lvl_dbm = BLE_LVL_MIN_DBM + lvl * BLE_LVL_STEP_DB;
+  if (lvl_dbm != s_ble_dbm) {
+    esp_err_t err = esp_ble_tx_power_set(
+        ESP_BLE_PWR_TYPE_ADV, (esp_power_level_t)(ESP_PWR_LVL_N24 + lvl));
+    if (err != ESP_OK) {
+      ESP_LOGW(TAG, "BLE power not set: %s", esp_err_to_name(err));
+      return s_ble_dbm;
+    }
+    ESP_LOGI(TAG, "BLE advertising power %d -> %d dBm", s_ble_dbm, lvl_dbm);
+    s_ble_dbm = (int8_t)lvl_dbm;
+  }
+  return s_ble_dbm;
+}
+
+static void log_energy(const char *who, uint32_t frames, uint32_t delivered,
+                       uint64_t e_nj, uint64_t e_max_nj) {
+  ESP_LOGI(TAG,
+           "%s frames=%" PRIu32 " delivered=%" PRIu32
+           " | energy/delivered=%" PRIu32 " uJ (full power %" PRIu32
+           " uJ, saved %d%%)",
+           who, frames, delivered,
+           delivered ? (uint32_t)(e_nj / delivered / 1000) : 0,
+           delivered ? (uint32_t)(e_max_nj / delivered / 1000) : 0,
+           e_max_nj ? (int)(100 - e_nj * 100 / e_max_nj) : 0);
+}
+
+void tx_power_log_report(void) {
+  ESP_LOGI(TAG, "BLE advertising at %d dBm", s_ble_dbm);
+  for (int i = 0; i < TXP_PEERS; i++) {
+    const peer_power_t *p = &s_peers[i];
+    if (!p->used) {
+      continue;
+    }
+    char who[96];
+    snprintf(who, sizeof(who),
+             MACSTR " txp=%d.%02d dBm loss=%d dB offset=%+d dB (+%" PRIu32
+                    "/-%" PRIu32 ")",
+             MAC2STR(p->mac), p->last_qdbm / 4, (p->last_qdbm % 4) * 25,
+             p->path_loss, p->offset_db, p->raised, p->lowered);
+    log_energy(who, p->frames, p->delivered, p->energy_nj, p->energy_max_nj);
+  }
+  if (s_bcast.frames) {
+    log_energy("broadcast", s_bcast.frames, s_bcast.delivered,
+               s_bcast.energy_nj, s_bcast.energy_max_nj);
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef TX_POWER_H
+#define TX_POWER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Link-aware transmit power control for ESP-NOW and BLE
+ *
+ * Path loss to a neighbor comes from its BLE rssi_ewma (beacons are
+ * normalised to TXP_BLE_REF_DBM, see ble_manager). Each unicast ESP-NOW
+ * frame then goes out at that path loss plus the receiver sensitivity of
+ * its PHY rate plus TXP_WIFI_MARGIN_DB, corrected per peer by delivery
+ * feedback. BLE advertising covers the weakest in-cluster neighbor once
+ * the node is a CH or member. Powers are in 0.25 dBm units, as taken by
+ * esp_wifi_set_max_tx_power().
+ */
+
+/**
+ * @brief Clear peer state; call after esp_wifi_start()
+ */
+void tx_power_init(void);
+
+/**
+ * @brief Pick and apply the Wi-Fi TX power for the next frame
+ * @param mac Peer MAC address, NULL for a broadcast (full power)
+ * @param rate_idx Value from esp_now_rate_select() (< 0 for the default)
+ * @return Power applied, to pass back to tx_power_report()
+ */
+int8_t tx_power_select(const uint8_t *mac, int rate_idx);
+
+/**
+ * @brief Feed back the outcome of a frame sent at tx_power_select() power
+ * @param mac Peer MAC address, NULL for a broadcast
+ * @param power Value returned by tx_power_select()
+ * @param rate_idx Rate the frame went out at
+ * @param len ESP-NOW payload length
+ * @param ok true if the frame was acknowledged
+ * @param probed true for a rate probe (its loss says nothing about power)
+ */
+void tx_power_report(const uint8_t *mac, int8_t power, int rate_idx,
+                     size_t len, bool ok, bool probed);
+
+/**
+ * @brief Re-evaluate and apply the BLE advertising power
+ * @return Advertising power in dBm, for the beacon's tx_dbm field
+ */
+int8_t tx_power_ble_update(void);
+
+/**
+ * @brief Log per-peer power, margin and energy per delivered frame
+ */
+void tx_power_log_report(void);
+
+#endif // TX_POWER_H
@@ -0,0 +1,440 @@
+#!/usr/bin/env python3
+"""
+Host-side simulator for MS Node cluster behaviour.
+
+Usage:
+  python cluster_sim.py beacons
+  python cluster_sim.py beacons --nodes 10 25 50 100 --seconds 120
+  python cluster_sim.py election
+  python cluster_sim.py election --nodes 3 5 8 --spread 0.5 1.5 --loss 0.2
+
+beacons: BLE beacon reception ratio for N nodes all in range of each other,
+comparing advertising schedules:
+  fast     NimBLE fast interval (30 ms), what ble_manager used to do
+  fixed    beacon_interval_ms for everyone, no offset or jitter
+  planned  ble_manager now: interval stretched by the number of nodes heard,
+           a MAC-hash offset, and jitter re-drawn on every 30 s restart
+
+Nodes start advertising within a few tens of ms of each other, as they do
+when an election window closes. Each adv event sends one packet on 37, 38
+and 39; the controller's random advDelay (0-10 ms) is always applied.
+Scanners use ble_manager's 50 ms window every 100 ms, rotating channels. A
+copy is lost if another overlaps it on the same channel (no capture
+effect). The reception ratio counts only copies a scanner was listening
+for, so it measures collisions rather than scan duty. Half-duplex loss
+while the scanner itself advertises is ignored.
+
+election: time from the last node booting until every node is CH or MEMBER
+of a CH it hears and nothing changes any more, comparing
+  window   the candidate phase always lasts ELECTION_WINDOW_MS
+  gossip   gossip.c: digests every GOSSIP_INTERVAL_MS and the phase ends
+           once the view is quiet and agreed (window as the cap), unless
+           a node that counts us was missing from our candidates
+Nodes are dropped in a square --spread radio ranges wide and boot within
+--boot-spread seconds. The state machine is followed per 100 ms pass: INIT,
+DISCOVER (joining a heard CH), CANDIDATE, MEMBER (back to CANDIDATE when
+no CH is heard after MEMBER_JOIN_GRACE_MS) and CH (yielding to a better CH
+in range). Beacons (1 s) and digests are each lost with probability
+--loss. Each node has one true score; like the firmware, a node's own view
+of itself differs from what others use by its locally computed centrality
+(assumed within +-0.1), unless the scores came from gossip. Percentiles
+are over the runs that settled within --seconds; "phases" is candidate
+phases per node.
+
+Standard library only.
+"""
+
+from __future__ import annotations
+
+import argparse
+import random
+import sys
+
+# Firmware constants (main/config.h, sensor_config.c)
+BEACON_INTERVAL_MS = 1000.0
+BLE_BEACON_OFFSET_SPAN_MS = 100
+BLE_BEACON_JITTER_MS = 50
+BLE_BEACON_RESCHEDULE_MS = 30000.0
+BLE_BEACON_DENSITY_WINDOW_MS = 20000.0
+BLE_BEACON_DENSITY_REF = 15
+BLE_BEACON_MAX_SCALE = 4
+BLE_SCAN_INTERVAL_MS = 100.0
+BLE_SCAN_WINDOW_MS = 50.0
+NIMBLE_FAST_INTERVAL_MS = 30.0
+ELECTION_WINDOW_MS = 10000
+GOSSIP_INTERVAL_MS = 500
+GOSSIP_QUIET_MS = 1500
+GOSSIP_MIN_WINDOW_MS = 2000
+CH_BEACON_TIMEOUT_MS = 10000
+NEIGHBOR_TIMEOUT_MS = 20000
+INIT_MS = 2000         # state_machine.c STATE_INIT
+DISCOVER_MS = 5000     # ... STATE_DISCOVER, joining a CH from 2 s on
+DISCOVER_JOIN_MS = 2000
+SM_TICK_MS = 100
+SM_IDLE_MS = 1000      # CH/MEMBER checks run once per SM_POLL_IDLE_MS
+MEMBER_JOIN_GRACE_MS = 3000
+CENTRALITY_BIAS = 0.1  # Own-view score error without gossip
+
+# Air interface
+PACKET_MS = 0.32      # 40 bytes at 1 Mbps (24-byte AdvData)
+CHANNEL_GAP_MS = 0.5  # Start-to-start spacing of the three copies
+ADV_DELAY_MS = 10.0   # Random advDelay per event (Core spec)
+START_SPREAD_MS = 50.0
+ADV_CHANNELS = (37, 38, 39)
+
+
+def mac_offset_ms(node: int) -> int:
+    """FNV-1a over a synthetic MAC, as adv_interval_ms() does."""
+    mac = bytes([0x10, 0x20, 0xBA]) + node.to_bytes(3, "big")
+    h = 2166136261
+    for b in mac:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h % BLE_BEACON_OFFSET_SPAN_MS
+
+
+def planned_interval(node: int, density: int, rng: random.Random) -> float:
+    scale = 1.0
+    if density > BLE_BEACON_DENSITY_REF:
+        scale = min(density / BLE_BEACON_DENSITY_REF, BLE_BEACON_MAX_SCALE)
+    return (BEACON_INTERVAL_MS * scale + mac_offset_ms(node) +
+            rng.randint(0, BLE_BEACON_JITTER_MS))
+
+
+def adv_events(strategy: str, node: int, n: int, seconds: float,
+               rng: random.Random) -> list[float]:
+    """Start times (ms) of one node's advertising events."""
+    end = seconds * 1000.0
+    t = rng.uniform(0.0, START_SPREAD_MS)
+    events = []
+    if strategy == "fast":
+        while t < end:
+            events.append(t)
+            t += NIMBLE_FAST_INTERVAL_MS + rng.uniform(0.0, ADV_DELAY_MS)
+        return events
+    if strategy == "fixed":
+        while t < end:
+            events.append(t)
+            t += BEACON_INTERVAL_MS + rng.uniform(0.0, ADV_DELAY_MS)
+        return events
+
+    # planned: restart (new phase, new jitter) every reschedule period; the
+    # density estimate exists once the first counting window has closed
+    restart = t
+    while restart < end:
+        density = n - 1 if restart >= BLE_BEACON_DENSITY_WINDOW_MS else 0
+        interval = planned_interval(node, density, rng)
+        stop = min(restart + BLE_BEACON_RESCHEDULE_MS, end)
+        t = restart
+        while t < stop:
+            events.append(t)
+            t += interval + rng.uniform(0.0, ADV_DELAY_MS)
+        restart = stop
+    return events
+
+
+def collided_copies(events: list[list[float]]) -> set[tuple[int, int, int]]:
+    """(node, event index, channel index) of every copy that overlapped."""
+    lost = set()
+    for c in range(len(ADV_CHANNELS)):
+        copies = sorted(
+            (t + c * CHANNEL_GAP_MS, node, k)
+            for node, times in enumerate(events)
+            for k, t in enumerate(times))
+        for i in range(1, len(copies)):
+            if copies[i][0] - copies[i - 1][0] < PACKET_MS:
+                lost.add((copies[i][1], copies[i][2], c))
+                lost.add((copies[i - 1][1], copies[i - 1][2], c))
+    return lost
+
+
+def listening(phase: float, t: float, c: int) -> bool:
+    """Scanner hears channel index c for the whole copy starting at t."""
+    since = t - phase
+    if since < 0:
+        return False
+    k = int(since // BLE_SCAN_INTERVAL_MS)
+    into = since - k * BLE_SCAN_INTERVAL_MS
+    return k % 3 == c and into + PACKET_MS <= BLE_SCAN_WINDOW_MS
+
+
+def simulate_beacons(strategy: str, n: int, seconds: float, scanners: int,
+                     seed: int) -> tuple[float, float, float]:
+    rng = random.Random(f"{seed}-{strategy}-{n}")
+    events = [adv_events(strategy, i, n, seconds, rng) for i in range(n)]
+    lost = collided_copies(events)
+    chosen = rng.sample(range(n), min(scanners, n))
+    phases = {s: rng.uniform(0.0, BLE_SCAN_INTERVAL_MS) for s in chosen}
+
+    eligible = received = 0
+    for s in chosen:
+        for node, times in enumerate(events):
+            if node == s:
+                continue
+            for k, t in enumerate(times):
+                heard = False
+                listened = False
+                for c in range(len(ADV_CHANNELS)):
+                    tc = t + c * CHANNEL_GAP_MS
+                    if listening(phases[s], tc, c):
+                        listened = True
+                        if (node, k, c) not in lost:
+                            heard = True
+                            break
+                if listened:
+                    eligible += 1
+                    received += 1 if heard else 0
+
+    ratio = received / eligible if eligible else 0.0
+    per_min = received / len(chosen) / (n - 1) / (seconds / 60.0)
+    sent_per_s = sum(len(t) for t in events) / n / seconds
+    return ratio, per_min, sent_per_s
+
+
+def cmd_beacons(args: argparse.Namespace) -> int:
+    strategies = ["fast", "fixed", "planned"]
+    print(f"{'nodes':>5}  {'schedule':<8} {'reception':>9} "
+          f"{'rx/nbr/min':>10} {'adv/s':>6}")
+    for n in args.nodes:
+        for strategy in strategies:
+            ratio, per_min, sent = simulate_beacons(
+                strategy, n, args.seconds, args.scanners, args.seed)
+            print(f"{n:>5}  {strategy:<8} {ratio * 100:>8.1f}% "
+                  f"{per_min:>10.1f} {sent:>6.2f}")
+        print()
+    return 0
+
+
+class Node:
+    def __init__(self, idx: int, boot_ms: float, score: float, bias: float,
+                 rng: random.Random) -> None:
+        self.idx = idx
+        self.boot = boot_ms
+        self.score = score  # What everyone else sees (beacon, gossip)
+        self.bias = bias    # Our own view of ourselves is score + bias
+        self.beacon_phase = rng.uniform(0.0, BEACON_INTERVAL_MS)
+        self.state = "OFF"
+        self.entered = 0.0
+        self.heard: dict[int, float] = {}     # BLE: node -> last beacon
+        self.ch_heard: dict[int, float] = {}  # ... with is_ch set
+        self.last_change = 0.0
+        self.phases = 0
+        # Gossip, per candidate phase
+        self.known: set[int] = set()   # Nodes whose current vector we hold
+        self.peers: dict[int, tuple[frozenset, bool, float]] = {}
+        self.view: frozenset = frozenset()
+        self.view_since = 0.0
+        self.next_tx = 0.0
+        self.lopsided = False  # Counted by a node we do not count
+
+
+def election_view(nodes: list[Node], me: Node, now: float) -> frozenset:
+    """(candidate, vector known) for ourselves and every neighbor heard."""
+    cands = [me.idx] + [j for j, t in me.heard.items()
+                        if now - t < NEIGHBOR_TIMEOUT_MS]
+    return frozenset((j, j in me.known) for j in cands)
+
+
+def elect(nodes: list[Node], me: Node, now: float, mode: str) -> int:
+    best, best_score = me.idx, -1.0
+    for j, known in sorted(election_view(nodes, me, now)):
+        if mode == "gossip" and known:
+            s = nodes[j].score + nodes[j].bias  # Its own frozen inputs
+        elif j == me.idx:
+            s = me.score + me.bias
+        else:
+            s = nodes[j].score
+        if s > best_score:
+            best, best_score = j, s
+    return best
+
+
+def current_ch(nodes: list[Node], me: Node, now: float) -> int | None:
+    heard = [j for j, t in me.ch_heard.items()
+             if now - t < CH_BEACON_TIMEOUT_MS]
+    return max(heard, key=lambda j: nodes[j].score, default=None)
+
+
+def gossip_converged(me: Node, now: float) -> bool:
+    cands = {j for j, _ in me.view} - {me.idx}
+    for j, (_, counts_us, t) in me.peers.items():
+        if counts_us and t >= me.entered and j not in cands:
+            me.lopsided = True
+    if (me.lopsided or now - me.entered < GOSSIP_MIN_WINDOW_MS or
+            now - me.view_since < GOSSIP_QUIET_MS):
+        return False
+    for j in cands:
+        peer = me.peers.get(j)
+        if peer is None or peer[0] != me.view or peer[2] < me.view_since:
+            return False
+    return True
+
+
+def simulate_election(mode: str, n: int, spread: float, boot_spread: float,
+                      loss: float, seconds: float,
+                      rng: random.Random) -> tuple[float | None, int, int]:
+    """(ms to stable, candidate phases, CHs at the end)"""
+    pos = [(rng.uniform(0, spread), rng.uniform(0, spread)) for _ in range(n)]
+    in_range = [[i != j and (pos[i][0] - pos[j][0]) ** 2 +
+                 (pos[i][1] - pos[j][1]) ** 2 <= 1.0 for j in range(n)]
+                for i in range(n)]
+    nodes = [Node(i, rng.uniform(0.0, boot_spread * 1000.0), rng.random(),
+                  rng.uniform(-CENTRALITY_BIAS, CENTRALITY_BIAS), rng)
+             for i in range(n)]
+
+    def enter(me: Node, state: str, now: float) -> None:
+        me.state, me.entered, me.last_change = state, now, now
+        if state == "CANDIDATE":
+            me.phases += 1
+            me.known = {me.idx}
+            me.view, me.view_since, me.next_tx = frozenset(), now, now
+            me.lopsided = False
+
+    end = seconds * 1000.0
+    t = 0.0
+    while t < end:
+        for me in nodes:
+            if me.state == "OFF" and t >= me.boot:
+                enter(me, "INIT", t)
+
+        # Beacons sent during this pass
+        for src in nodes:
+            if src.state in ("OFF", "INIT"):
+                continue
+            k = (t - src.beacon_phase) // BEACON_INTERVAL_MS
+            sent = src.beacon_phase + k * BEACON_INTERVAL_MS
+            if not t - SM_TICK_MS < sent <= t:
+                continue
+            for dst in nodes:
+                if in_range[src.idx][dst.idx] and rng.random() >= loss:
+                    dst.heard[src.idx] = t
+                    if src.state == "CH":
+                        dst.ch_heard[src.idx] = t
+
+        # Digests from candidates
+        if mode == "gossip":
+            for src in nodes:
+                if src.state != "CANDIDATE":
+                    continue
+                view = election_view(nodes, src, t)
+                if view != src.view:
+                    src.view, src.view_since, src.next_tx = view, t, t
+                if t < src.next_tx:
+                    continue
+                src.next_tx = t + GOSSIP_INTERVAL_MS * rng.uniform(0.75, 1.25)
+                entries = {j for j, known in view if known}
+                for dst in nodes:
+                    if (dst.state == "CANDIDATE" and
+                            in_range[src.idx][dst.idx] and
+                            rng.random() >= loss):
+                        dst.known |= entries - {dst.idx}
+                        dst.known.add(src.idx)
+                        dst.peers[src.idx] = (view, dst.idx in entries, t)
+
+        for me in nodes:
+            since = t - me.entered
+            if me.state == "INIT" and since >= INIT_MS:
+                enter(me, "DISCOVER", t)
+            elif me.state == "DISCOVER":
+                ch = current_ch(nodes, me, t)
+                if ch is not None and since >= DISCOVER_JOIN_MS:
+                    enter(me, "MEMBER", t)
+                elif since >= DISCOVER_MS:
+                    enter(me, "CANDIDATE", t)
+            elif me.state == "CANDIDATE":
+                done = since >= ELECTION_WINDOW_MS or (
+                    mode == "gossip" and gossip_converged(me, t))
+                if done:
+                    winner = elect(nodes, me, t, mode)
+                    enter(me, "CH" if winner == me.idx else "MEMBER", t)
+            elif me.state in ("CH", "MEMBER") and t % SM_IDLE_MS < SM_TICK_MS:
+                ch = current_ch(nodes, me, t)
+                if (me.state == "MEMBER" and ch is None and
+                        since >= MEMBER_JOIN_GRACE_MS):
+                    enter(me, "CANDIDATE", t)
+                elif me.state == "CH":
+                    better = [j for j in me.ch_heard
+                              if t - me.ch_heard[j] < CH_BEACON_TIMEOUT_MS and
+                              nodes[j].state == "CH" and
+                              (nodes[j].score, -j) > (me.score, -me.idx)]
+                    if better:
+                        enter(me, "MEMBER", t)
+        t += SM_TICK_MS
+
+    last_boot = max(me.boot for me in nodes)
+    settled = all(me.state == "CH" or
+                  (me.state == "MEMBER" and
+                   current_ch(nodes, me, end) is not None)
+                  for me in nodes)
+    chs = sum(1 for me in nodes if me.state == "CH")
+    phases = sum(me.phases for me in nodes)
+    if not settled:
+        return None, phases, chs
+    return max(me.last_change for me in nodes) - last_boot, phases, chs
+
+
+def cmd_election(args: argparse.Namespace) -> int:
+    print(f"{'nodes':>5} {'spread':>6}  {'mode':<7} {'p50 s':>6} {'p90 s':>6} "
+          f"{'max s':>6} {'phases':>6} {'CHs':>5} {'unsettled':>9}")
+    for n in args.nodes:
+        for spread in args.spread:
+            for mode in ("window", "gossip"):
+                times, phases, chs, unsettled = [], 0, 0, 0
+                for run in range(args.runs):
+                    # Seeded per run, so both modes get the same layouts and
+                    # boot times however differently earlier runs went
+                    rng = random.Random(f"{args.seed}-{n}-{spread}-{run}")
+                    ms, ph, ch = simulate_election(
+                        mode, n, spread, args.boot_spread, args.loss,
+                        args.seconds, rng)
+                    phases += ph
+                    chs += ch
+                    if ms is None:
+                        unsettled += 1
+                    else:
+                        times.append(ms / 1000.0)
+                times.sort()
+
+                def pct(q: float) -> str:
+                    if not times:
+                        return "-"
+                    i = min(len(times) - 1, int(q * len(times)))
+                    return f"{times[i]:.1f}"
+
+                print(f"{n:>5} {spread:>6.1f}  {mode:<7} {pct(0.5):>6} "
+                      f"{pct(0.9):>6} {pct(1.0):>6} "
+                      f"{phases / args.runs / n:>6.2f} "
+                      f"{chs / args.runs:>5.2f} {unsettled:>9}")
+        print()
+    return 0
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("beacons", help="BLE beacon reception ratio")
+    p.add_argument("--nodes", type=int, nargs="+", default=[10, 25, 50, 100])
+    p.add_argument("--seconds", type=float, default=120.0)
+    p.add_argument("--scanners", type=int, default=8,
+                   help="scanners sampled per run")
+    p.add_argument("--seed", type=int, default=1)
+    p.set_defaults(func=cmd_beacons)
+
+    p = sub.add_parser("election", help="time to a stable CH set")
+    p.add_argument("--nodes", type=int, nargs="+", default=[3, 5, 8])
+    p.add_argument("--spread", type=float, nargs="+", default=[0.5, 1.5],
+                   help="square side in radio ranges (<0.7: all in range)")
+    p.add_argument("--boot-spread", type=float, default=3.0,
+                   help="seconds over which the nodes power up")
+    p.add_argument("--loss", type=float, default=0.1)
+    p.add_argument("--seconds", type=float, default=120.0)
+    p.add_argument("--runs", type=int, default=100)
+    p.add_argument("--seed", type=int, default=1)
+    p.set_defaults(func=cmd_election)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
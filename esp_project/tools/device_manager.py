@@ -114,7 +114,10 @@ def cmd_flash(args):
         print("Specify --port or --name", file=sys.stderr)
         sys.exit(1)
     print(f"Flashing {port}...")
-    r = run_idf(MS_NODE_ROOT, "-p", port, "app-flash" if getattr(args, "app_only", False) else "flash")
+    # erase-otadata: a node updated over the mesh may be booting ota_1, and
+    # app-flash writes ota_0
+    targets = ["erase-otadata", "app-flash"] if getattr(args, "app_only", False) else ["flash"]
+    r = run_idf(MS_NODE_ROOT, "-p", port, *targets)
     sys.exit(r.returncode)
 
 
@@ -129,7 +132,7 @@ def cmd_flash_all(_):
             print(f"Skipping {name}: no port", file=sys.stderr)
             continue
         print(f"Flashing {name} ({port})...")
-        r = run_idf(MS_NODE_ROOT, "-p", port, "app-flash")
+        r = run_idf(MS_NODE_ROOT, "-p", port, "erase-otadata", "app-flash")
         if r.returncode != 0:
             print(f"Flash failed for {name}", file=sys.stderr)
             sys.exit(1)
@@ -212,7 +215,9 @@ def cmd_optimize(args):
     ser = serial.Serial(port, 115200, timeout=0.5)
     time.sleep(0.5)
     for kv in pairs:
-        line = f"CONFIG {kv}\n"
+        # Leading newline: the node may be in light sleep and drops the
+        # bytes that wake its UART.
+        line = f"\nCONFIG {kv}\n"
         ser.write(line.encode())
         time.sleep(0.3)
         out = ser.read(256).decode("utf-8", errors="ignore")
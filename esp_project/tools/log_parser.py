@@ -18,6 +18,25 @@ HEADER_SIZE = struct.calcsize(HEADER_FMT)
 LOG_MAGIC = 0x4D534C47  # 'MSLG'
 LOG_VERSION = 2
 
+# Rollup tier file format (matches rollup.c)
+# header: uint32 magic, uint16 version, uint16 record_size, uint32 capacity, uint32 head, uint32 count
+# record: uint32 window_start, uint8 channel, uint8 tier, uint16 count, float min, float max, float mean
+ROLLUP_HDR_FMT = '<IHHIII'
+ROLLUP_HDR_SIZE = struct.calcsize(ROLLUP_HDR_FMT)
+ROLLUP_REC_FMT = '<IBBHfff'
+ROLLUP_REC_SIZE = struct.calcsize(ROLLUP_REC_FMT)
+ROLLUP_MAGIC = 0x4D535255  # 'MSRU'
+ROLLUP_CHANNELS = ['temp', 'hum', 'press', 'aqi', 'tvoc', 'eco2',
+                   'mag_x', 'mag_y', 'mag_z', 'bus_v', 'current', 'audio_rms']
+ROLLUP_TIERS = ['5m', '1h']
+
+# Raw log partition format (matches rawlog.c)
+# 64 KB segments, each: uint32 magic, uint16 version, uint16 hdr_len, uint32 seq, uint32 ~seq, then MSLG chunks
+RAWLOG_SEG_FMT = '<IHHII'
+RAWLOG_SEG_HDR_SIZE = struct.calcsize(RAWLOG_SEG_FMT)
+RAWLOG_SEG_MAGIC = 0x4D535253  # 'MSRS'
+RAWLOG_SEGMENT_SIZE = 64 * 1024
+
 class LogChunk:
     def __init__(self, magic, version, algo, level, raw_len, data_len, crc32, node_id, timestamp, reserved):
         self.magic = magic
@@ -195,6 +214,57 @@ def scan_raw_partition(data, verify_crc=True, verbose=False, force=False, spiffs
             
     return chunks
 
+def parse_rawlog_partition(data, verify_crc=True, verbose=False, force=False):
+    """Walk a rawlog partition dump segment by segment, oldest first"""
+    segments = []
+    for base in range(0, len(data) - RAWLOG_SEG_HDR_SIZE + 1, RAWLOG_SEGMENT_SIZE):
+        magic, version, hdr_len, seq, seq_inv = struct.unpack_from(RAWLOG_SEG_FMT, data, base)
+        if magic != RAWLOG_SEG_MAGIC or seq_inv != (~seq & 0xFFFFFFFF):
+            continue
+        segments.append((seq, base, hdr_len))
+    segments.sort()
+    if verbose:
+        print(f"Found {len(segments)} rawlog segments", file=sys.stderr)
+
+    chunks = []
+    for seq, base, hdr_len in segments:
+        end = min(base + RAWLOG_SEGMENT_SIZE, len(data))
+        pos = base + hdr_len
+        while pos + HEADER_SIZE <= end:
+            chunk = LogChunk(*struct.unpack_from(HEADER_FMT, data, pos))
+            if chunk.magic != LOG_MAGIC or pos + HEADER_SIZE + chunk.data_len > end:
+                break  # Erased tail or torn write
+            chunk_data = data[pos + HEADER_SIZE:pos + HEADER_SIZE + chunk.data_len]
+            crc_valid = calc_crc32(chunk_data) == chunk.crc32
+            if verify_crc and not crc_valid and not force:
+                if verbose:
+                    print(f"  CRC FAIL in segment seq={seq} at 0x{pos:08X}", file=sys.stderr)
+                pos += HEADER_SIZE + chunk.data_len
+                continue
+            if chunk.algo == 1:
+                try:
+                    raw_data = zlib.decompress(chunk_data, wbits=-15)
+                except zlib.error:
+                    raw_data = b''
+            else:
+                raw_data = chunk_data
+            chunks.append({
+                'chunk_num': len(chunks) + 1,
+                'offset': pos,
+                'node_id': format_node_id(chunk.node_id),
+                'timestamp': chunk.timestamp,
+                'timestamp_iso': datetime.fromtimestamp(chunk.timestamp).isoformat() if chunk.timestamp > 0 else 'N/A',
+                'algo': 'miniz' if chunk.algo == 1 else 'raw',
+                'level': chunk.level,
+                'raw_len': chunk.raw_len,
+                'compressed_len': chunk.data_len if chunk.algo == 1 else None,
+                'crc32': f'0x{chunk.crc32:08X}',
+                'crc_valid': crc_valid,
+                'raw_data': raw_data
+            })
+            pos += HEADER_SIZE + chunk.data_len
+    return chunks
+
 def parse_log_file(filepath, verify_crc=True, verbose=False):
     """Parse binary log file and yield chunks with metadata"""
     
@@ -271,6 +341,34 @@ def parse_log_file(filepath, verify_crc=True, verbose=False):
                 'raw_data': raw_data
             }
 
+def parse_rollup_file(filepath):
+    """Parse a rollup tier ring file, yielding records oldest first"""
+    with open(filepath, 'rb') as f:
+        data = f.read()
+    if len(data) < ROLLUP_HDR_SIZE:
+        print("ERROR: Rollup file too short", file=sys.stderr)
+        return
+    magic, version, rec_size, capacity, head, count = struct.unpack_from(ROLLUP_HDR_FMT, data, 0)
+    if magic != ROLLUP_MAGIC or rec_size != ROLLUP_REC_SIZE:
+        print(f"ERROR: Invalid rollup header (magic 0x{magic:08X}, record size {rec_size})", file=sys.stderr)
+        return
+    first = (head + capacity - count) % capacity
+    for i in range(count):
+        off = ROLLUP_HDR_SIZE + ((first + i) % capacity) * ROLLUP_REC_SIZE
+        if off + ROLLUP_REC_SIZE > len(data):
+            print(f"WARNING: Rollup record {i} beyond end of file", file=sys.stderr)
+            break
+        ts, ch, tier, n, vmin, vmax, vmean = struct.unpack_from(ROLLUP_REC_FMT, data, off)
+        yield {
+            'window_start': ts,
+            'tier': ROLLUP_TIERS[tier] if tier < len(ROLLUP_TIERS) else tier,
+            'channel': ROLLUP_CHANNELS[ch] if ch < len(ROLLUP_CHANNELS) else ch,
+            'count': n,
+            'min': round(vmin, 4),
+            'max': round(vmax, 4),
+            'mean': round(vmean, 4),
+        }
+
 def parse_json_sensor_data(raw_data):
     """Attempt to parse sensor data as JSON"""
     try:
@@ -290,9 +388,11 @@ def main():
     parser.add_argument('--json', action='store_true', help='Output sensor data as JSON')
     parser.add_argument('--hex', action='store_true', help='Output raw data as hex dump')
     parser.add_argument('--raw-partition', action='store_true', help='Scan raw SPIFFS partition dump for log chunks')
+    parser.add_argument('--rawlog', action='store_true', help='Parse a dump of the "rawlog" partition (no SPIFFS page headers)')
     parser.add_argument('--spiffs', action='store_true', help='Attempt to strip SPIFFS page headers (assumes 256b pages, 12b headers)')
     parser.add_argument('--force', action='store_true', help='Output chunks even if CRC verification fails')
     parser.add_argument('--extract-lines', action='store_true', help='Extract valid JSON lines from corrupted/raw chunks (implies --force)')
+    parser.add_argument('--rollup', action='store_true', help='Parse a rollup tier file (rollup_5m.bin / rollup_1h.bin) as JSON lines')
     args = parser.parse_args()
     
     if args.extract_lines:
@@ -305,8 +405,17 @@ def main():
     verify = not args.no_verify
     verbose = not args.quiet
     
+    if args.rollup:
+        for rec in parse_rollup_file(args.logfile):
+            print(json.dumps(rec))
+        return
+    
     # Parse based on mode
-    if args.raw_partition:
+    if args.rawlog:
+        with open(args.logfile, 'rb') as f:
+            partition_data = f.read()
+        chunks = parse_rawlog_partition(partition_data, verify_crc=verify, verbose=verbose, force=args.force)
+    elif args.raw_partition:
         # Scan raw SPIFFS partition dump
         with open(args.logfile, 'rb') as f:
             partition_data = f.read()
@@ -0,0 +1,294 @@
+#!/usr/bin/env python3
+"""
+Build an 'MSOT' firmware delta package for ota_mesh.
+
+Usage:
+  python ota_delta.py build/ms_node.bin new/ms_node.bin -o update.msot
+  python ota_delta.py base.bin new.bin -o update.msot --block-size 4096
+  python ota_delta.py base.bin new.bin -o update.msot --check
+  python ota_delta.py --gen-key ota_sign.pem
+
+Every package is signed: --sign-key (or the OTA_SIGN_KEY environment
+variable) names the P-256 private key in PEM form.
+
+The new image is cut into fixed-size blocks. A block found anywhere in the
+base image (the one running on the nodes) is sent as its offset there; the
+rest are zlib-compressed into an MSPB container. A node rebuilds the image
+block by block from its running partition plus the container, so the
+package only carries what changed. See DATA_FORMAT.md for the layout.
+
+Both images must be ESP-IDF app binaries with the SHA-256 appended (the
+default). The UAV serves the package at /ota?base=<hex digest of the base>,
+which is the digest this tool prints.
+
+The header carries an ECDSA P-256 signature (r || s) over the SHA-256 of
+itself (signature zeroed) and the source table. Nodes hold only the public
+key (main/ota_sign_key.h) and drop packages that fail it, so the private key
+never has to leave the build machine. --gen-key writes a new private key and
+prints the public key as the C array for ota_sign_key.h.
+
+--check verifies the signature, rebuilds the new image from base + package
+and compares it.
+
+Standard library only; signing runs the openssl command line tool.
+"""
+
+from __future__ import annotations
+
+import argparse
+import hashlib
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+from pathlib import Path
+
+PKG_MAGIC = 0x544F534D  # 'MSOT'
+PKG_VERSION = 2
+SRC_LITERAL = 0xFFFFFFFF
+PKG_HDR = struct.Struct("<IHHI32sI32sII64s")
+NO_SIG = bytes(64)
+
+PAR_MAGIC = 0x4250534D  # 'MSPB'
+PAR_VERSION = 1
+PAR_HDR = struct.Struct("<IBBHIII")
+
+# Firmware constants (main/config.h)
+OTA_MESH_FRAG_BYTES = 200
+OTA_MESH_MAX_PKG_BYTES = 1024 * 1024
+ESPNOW_FRAME_OVERHEAD = 12  # ota_data_msg_t header
+
+MOD = 1 << 16
+
+
+def image_digest(image: bytes, name: str) -> bytes:
+    """The digest esp_partition_get_sha256() reports for an app image."""
+    if len(image) < 64 or hashlib.sha256(image[:-32]).digest() != image[-32:]:
+        raise SystemExit(f"{name}: no appended SHA-256 (not an app image?)")
+    return image[-32:]
+
+
+def checksum(data: bytes) -> tuple[int, int]:
+    a = sum(data) % MOD
+    b = sum((len(data) - i) * x for i, x in enumerate(data)) % MOD
+    return a, b
+
+
+def find_blocks(base: bytes, new: bytes, block: int) -> list[int]:
+    """Source offset in base for each block of new, or SRC_LITERAL."""
+    count = (len(new) + block - 1) // block
+    sources = [SRC_LITERAL] * count
+    wanted: dict[int, list[int]] = {}
+    for j in range(count):
+        chunk = new[j * block:(j + 1) * block]
+        if base[j * block:j * block + len(chunk)] == chunk:
+            sources[j] = j * block  # Unchanged in place, the common case
+        elif len(chunk) == block:
+            a, b = checksum(chunk)
+            wanted.setdefault(a | (b << 16), []).append(j)
+    if not wanted or len(base) < block:
+        return sources
+
+    # rsync-style weak rolling sum over every base offset, confirmed bytewise
+    a, b = checksum(base[:block])
+    off = 0
+    while True:
+        for j in wanted.get(a | (b << 16), ()):
+            if (sources[j] == SRC_LITERAL and
+                    base[off:off + block] == new[j * block:(j + 1) * block]):
+                sources[j] = off
+        if off + block >= len(base):
+            break
+        out, inc = base[off], base[off + block]
+        a = (a - out + inc) % MOD
+        b = (b - block * out + a) % MOD
+        off += 1
+    return sources
+
+
+def pack_container(blocks: list[bytes], block: int, level: int) -> bytes:
+    """MSPB container, as lz_compress_parallel() writes it."""
+    streams = [zlib.compress(b, level) for b in blocks]
+    hdr = PAR_HDR.pack(PAR_MAGIC, PAR_VERSION, level, 0, block,
+                       sum(len(b) for b in blocks), len(blocks))
+    table = b"".join(struct.pack("<I", len(s)) for s in streams)
+    return hdr + table + b"".join(streams)
+
+
+def openssl(*args: str, data: bytes = b"") -> bytes:
+    try:
+        run = subprocess.run(["openssl", *args], input=data,
+                             capture_output=True, check=True)
+    except FileNotFoundError:
+        raise SystemExit("openssl not found on PATH")
+    except subprocess.CalledProcessError as e:
+        raise SystemExit(f"openssl {args[0]}: {e.stderr.decode().strip()}")
+    return run.stdout
+
+
+def der_to_raw(der: bytes) -> bytes:
+    """ECDSA-Sig-Value (SEQUENCE of two INTEGERs) to 32-byte r || s."""
+    assert der[0] == 0x30 and der[2] == 0x02
+    out, pos = b"", 2
+    for _ in range(2):
+        n = der[pos + 1]
+        out += der[pos + 2:pos + 2 + n].lstrip(b"\0").rjust(32, b"\0")
+        pos += 2 + n
+    return out
+
+
+def raw_to_der(raw: bytes) -> bytes:
+    ints = b""
+    for half in (raw[:32], raw[32:]):
+        v = half.lstrip(b"\0") or b"\0"
+        if v[0] & 0x80:
+            v = b"\0" + v
+        ints += bytes([0x02, len(v)]) + v
+    return bytes([0x30, len(ints)]) + ints
+
+
+def signed_bytes(fields: tuple, table: bytes) -> bytes:
+    """The header with its signature zeroed, then the source table."""
+    return PKG_HDR.pack(*fields, NO_SIG) + table
+
+
+def sign(key: Path, msg: bytes) -> bytes:
+    return der_to_raw(openssl("dgst", "-sha256", "-sign", str(key),
+                              data=msg))
+
+
+def verify(key: Path, msg: bytes, sig: bytes) -> bool:
+    """Against the public half of key, as a node would."""
+    pub = openssl("ec", "-in", str(key), "-pubout")
+    with tempfile.TemporaryDirectory() as tmp:
+        pub_path = os.path.join(tmp, "pub.pem")
+        sig_path = os.path.join(tmp, "sig.der")
+        Path(pub_path).write_bytes(pub)
+        Path(sig_path).write_bytes(raw_to_der(sig))
+        run = subprocess.run(["openssl", "dgst", "-sha256", "-verify",
+                              pub_path, "-signature", sig_path],
+                             input=msg, capture_output=True)
+    return run.returncode == 0
+
+
+def gen_key(path: Path) -> None:
+    openssl("ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out",
+            str(path))
+    point = openssl("ec", "-in", str(path), "-pubout", "-outform", "DER")[-65:]
+    rows = [", ".join(f"0x{b:02x}" for b in point[i:i + 12])
+            for i in range(0, len(point), 12)]
+    print(f"Private key written to {path}; keep it off the nodes.")
+    print("Public key for main/ota_sign_key.h:")
+    print("static const uint8_t k_ota_sign_pub[65] = {")
+    print(",\n".join("  " + r for r in rows) + "};")
+
+
+def build(base: bytes, new: bytes, block: int, level: int,
+          key: Path) -> tuple[bytes, list[int]]:
+    sources = find_blocks(base, new, block)
+    literals = [new[j * block:(j + 1) * block]
+                for j, src in enumerate(sources) if src == SRC_LITERAL]
+    fields = (PKG_MAGIC, PKG_VERSION, block, len(base),
+              image_digest(base, "base"), len(new), image_digest(new, "new"),
+              len(sources), 0)
+    table = b"".join(struct.pack("<I", s) for s in sources)
+    hdr = PKG_HDR.pack(*fields, sign(key, signed_bytes(fields, table)))
+    return hdr + table + pack_container(literals, block, level), sources
+
+
+def apply(base: bytes, pkg: bytes, key: Path) -> bytes:
+    """What ota_mesh's apply_package() does, for --check."""
+    *fields, sig = PKG_HDR.unpack_from(pkg)
+    (magic, version, block, base_len, base_sha, new_len, new_sha, count,
+     _) = fields
+    assert magic == PKG_MAGIC and version == PKG_VERSION
+    assert base_len == len(base) and base_sha == image_digest(base, "base")
+    off = PKG_HDR.size
+    table = pkg[off:off + 4 * count]
+    assert verify(key, signed_bytes(tuple(fields), table), sig)
+    sources = struct.unpack_from(f"<{count}I", pkg, off)
+    off += 4 * count
+    _, _, _, _, _, _, lit_count = PAR_HDR.unpack_from(pkg, off)
+    lengths = struct.unpack_from(f"<{lit_count}I", pkg, off + PAR_HDR.size)
+    pos = off + PAR_HDR.size + 4 * lit_count
+    literals = []
+    for n in lengths:
+        literals.append(zlib.decompress(pkg[pos:pos + n]))
+        pos += n
+
+    out = bytearray()
+    lit = iter(literals)
+    for j, src in enumerate(sources):
+        n = min(block, new_len - j * block)
+        out += next(lit) if src == SRC_LITERAL else base[src:src + n]
+    assert hashlib.sha256(out[:-32]).digest() == new_sha == out[-32:]
+    return bytes(out)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("base", type=Path, nargs="?",
+                        help="image running on the nodes")
+    parser.add_argument("new", type=Path, nargs="?", help="image to update to")
+    parser.add_argument("-o", "--output", type=Path)
+    parser.add_argument("--block-size", type=int, default=4096)
+    parser.add_argument("--level", type=int, default=9)
+    parser.add_argument("--sign-key", type=Path,
+                        default=os.environ.get("OTA_SIGN_KEY"),
+                        help="P-256 private key (PEM) to sign with")
+    parser.add_argument("--gen-key", type=Path, metavar="PEM",
+                        help="write a new signing key and print its public "
+                             "half")
+    parser.add_argument("--check", action="store_true",
+                        help="rebuild the new image from the package")
+    args = parser.parse_args()
+
+    if args.gen_key:
+        if args.gen_key.exists():
+            raise SystemExit(f"{args.gen_key} exists, not overwriting it")
+        gen_key(args.gen_key)
+        return 0
+    if not (args.base and args.new and args.output):
+        parser.error("base, new and -o are required")
+    if not args.sign_key:
+        parser.error("--sign-key (or OTA_SIGN_KEY) is required")
+
+    base = args.base.read_bytes()
+    new = args.new.read_bytes()
+    if not 0 < args.block_size <= 0xFFFF:
+        raise SystemExit("--block-size must fit in 16 bits")
+    pkg, sources = build(base, new, args.block_size, args.level,
+                         args.sign_key)
+    args.output.write_bytes(pkg)
+
+    moved = sum(1 for j, s in enumerate(sources)
+                if s not in (SRC_LITERAL, j * args.block_size))
+    literal = sources.count(SRC_LITERAL)
+    frags = (len(pkg) + OTA_MESH_FRAG_BYTES - 1) // OTA_MESH_FRAG_BYTES
+    on_air = len(pkg) + frags * ESPNOW_FRAME_OVERHEAD
+    print(f"base     {args.base.name}: {len(base)} B, "
+          f"sha256 {image_digest(base, 'base').hex()}")
+    print(f"new      {args.new.name}: {len(new)} B, "
+          f"sha256 {image_digest(new, 'new').hex()}")
+    print(f"blocks   {len(sources)} x {args.block_size} B: "
+          f"{len(sources) - literal - moved} in place, {moved} moved, "
+          f"{literal} changed")
+    print(f"package  {len(pkg)} B ({len(pkg) * 100 / len(new):.1f}% of the "
+          f"image), {frags} ESP-NOW fragments, {on_air} B on air per round")
+    print(f"         full image would be "
+          f"{len(zlib.compress(new, args.level))} B compressed")
+    if len(pkg) > OTA_MESH_MAX_PKG_BYTES:
+        print("warning: larger than OTA_MESH_MAX_PKG_BYTES, nodes will "
+              "refuse it", file=sys.stderr)
+    if args.check:
+        if apply(base, pkg, args.sign_key) != new:
+            print("check FAILED: rebuilt image differs", file=sys.stderr)
+            return 1
+        print("check    rebuilt image matches")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())